@@ -13,6 +13,7 @@ bool kRunning = true;
 
 // Set __uDEBUG_SYSTEM__ == 1 in compiler invocation to enable system debugging
 // -- msvc: /D__UE_debug__ == 1#1
+#include "batch_render_tools.h"
 #include "data_structures.h"
 #include "debug_tools.h"
 #include "event_tools.h"
@@ -24,6 +25,9 @@ bool kRunning = true;
 // Set __uTESTS_ENABLED__ == 0 in tests.h to disable tests on startup
 #include "tests/tests.h"
 
+// Set __UE_benchmarks__ == 1 in compiler invocation to run benchmarks on startup
+#include "tests/benchmarks.h"
+
 //
 // [ begin ] Global members
 size_t kTotalFrameCount = 0;
@@ -225,11 +229,23 @@ uDestroyEngine()
 int
 main(int argc, char** argv)
 {
+    // Render farm workers only trace tiles, see: farm_tools.h
+    const char* farm_name = GetFarmWorkerArgument(argc, argv);
+    if (farm_name)
+    {
+        return RunFarmWorker(farm_name) ? 0 : 1;
+    }
+
 // See tests/tests.h to disable
 #if __uTESTS_ENABLED__
     runAllTests();
 #endif
 
+// See tests/benchmarks.h to enable
+#if __uBENCHMARKS_ENABLED__
+    runAllBenchmarks();
+#endif // __uBENCHMARKS_ENABLED__
+
 #if __UE_debug__ == 1
 #ifdef _WIN32
     // Enable _CRT Allocation Analysis
@@ -243,8 +259,20 @@ main(int argc, char** argv)
 #endif // _WIN32
 #endif // __UE_debug__ == 1
 
-    if (argc && argv)
+    // Headless batch rendering never starts Vulkan, see: batch_render_tools.h
+    BatchRenderSettings batch_settings = { 0 };
+    if (ParseBatchRenderArguments(argc, argv, &batch_settings))
     {
+        if (!batch_settings.frame_count)
+        {
+            PrintBatchRenderArgumentError(&batch_settings);
+            return 1;
+        }
+
+        BatchRenderReport batch_report = { 0 };
+        const bool        success      = RunBatchRender(&batch_settings, &batch_report);
+        PrintBatchRenderReport(&batch_settings, &batch_report);
+        return success ? 0 : 1;
     }
 
 #if __UE_debug__ == 1
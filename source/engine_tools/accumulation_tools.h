@@ -0,0 +1,335 @@
+#ifndef __UE_ACCUMULATION_TOOLS_H___
+#define __UE_ACCUMULATION_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <color_tools.h>
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <sampler_tools.h>
+#include <thread_tools.h>
+#include <type_tools.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Progressive rendering
+//
+// Samples are summed into a floating point accumulation buffer across
+// passes. Per-pixel luminance variance is tracked with Welford's method so
+// that converged pixels, and tiles made up entirely of converged pixels, stop
+// receiving samples. Any change to the scene or view must be followed by a
+// call to ResetAccumulationBuffer().
+//
+// A pass is one parallel task per tile; a task only writes its own tile's
+// pixels, so passes are identical for any thread count.
+//
+
+typedef struct
+{
+    u32 min_samples;
+    u32 max_samples;
+    r32 convergence_threshold;
+} ProgressiveSettings;
+
+typedef struct
+{
+    v3*   color_sum;      // Per-pixel sum of samples, channels in [ 0, 1 ]
+    r32*  luminance_mean; // Per-pixel running luminance mean
+    r32*  luminance_m2;   // Per-pixel sum of squared luminance deviations
+    u32*  sample_count;   // Per-pixel number of accumulated samples
+    bool* tile_converged; // Per-tile; true when every pixel has converged
+    u32*  tile_samples;   // Per-tile; samples taken by the last pass
+
+    size_t image_width;
+    size_t image_height;
+    size_t tile_size;
+    size_t tiles_x;
+    size_t tiles_y;
+    size_t converged_tile_count;
+    u32    pass_count;
+} AccumulationBuffer;
+
+__UE_inline__ static void
+GetDefaultProgressiveSettings(_mut_ ProgressiveSettings* restrict const settings)
+{
+    __UE_ASSERT__(settings);
+
+    settings->min_samples           = __UE_PR__min_samples;
+    settings->max_samples           = __UE_PR__max_samples;
+    settings->convergence_threshold = ( r32 )__UE_PR__convergence_threshold;
+}
+
+__UE_inline__ static r32
+GetLuminance(const v3* restrict const linear_color)
+{
+    __UE_ASSERT__(linear_color);
+    return (0.2126f * linear_color->x) + (0.7152f * linear_color->y) + (0.0722f * linear_color->z);
+}
+
+static AccumulationBuffer*
+CreateAccumulationBuffer(const size_t image_width, const size_t image_height, const size_t tile_size)
+{
+    __UE_ASSERT__(image_width && image_height && tile_size);
+
+    AccumulationBuffer* buffer = ( AccumulationBuffer* )calloc(1, sizeof(AccumulationBuffer));
+    __UE_ASSERT__(buffer);
+
+    const size_t pixel_count = image_width * image_height;
+
+    buffer->image_width  = image_width;
+    buffer->image_height = image_height;
+    buffer->tile_size    = tile_size;
+    buffer->tiles_x      = (image_width + tile_size - 1) / tile_size;
+    buffer->tiles_y      = (image_height + tile_size - 1) / tile_size;
+
+    buffer->color_sum      = ( v3* )calloc(pixel_count, sizeof(v3));
+    buffer->luminance_mean = ( r32* )calloc(pixel_count, sizeof(r32));
+    buffer->luminance_m2   = ( r32* )calloc(pixel_count, sizeof(r32));
+    buffer->sample_count   = ( u32* )calloc(pixel_count, sizeof(u32));
+    buffer->tile_converged = ( bool* )calloc(buffer->tiles_x * buffer->tiles_y, sizeof(bool));
+    buffer->tile_samples   = ( u32* )calloc(buffer->tiles_x * buffer->tiles_y, sizeof(u32));
+
+    __UE_ASSERT__(buffer->color_sum && buffer->luminance_mean && buffer->luminance_m2);
+    __UE_ASSERT__(buffer->sample_count && buffer->tile_converged && buffer->tile_samples);
+
+    return buffer;
+}
+
+static void
+DestroyAccumulationBuffer(_mut_ AccumulationBuffer* restrict const buffer)
+{
+    if (!buffer)
+    {
+        return;
+    }
+
+    free(buffer->color_sum);
+    free(buffer->luminance_mean);
+    free(buffer->luminance_m2);
+    free(buffer->sample_count);
+    free(buffer->tile_converged);
+    free(buffer->tile_samples);
+    free(buffer);
+}
+
+static void
+ResetAccumulationBuffer(_mut_ AccumulationBuffer* restrict const buffer)
+{
+    __UE_ASSERT__(buffer);
+
+    const size_t pixel_count = buffer->image_width * buffer->image_height;
+
+    memset(buffer->color_sum, 0, pixel_count * sizeof(v3));
+    memset(buffer->luminance_mean, 0, pixel_count * sizeof(r32));
+    memset(buffer->luminance_m2, 0, pixel_count * sizeof(r32));
+    memset(buffer->sample_count, 0, pixel_count * sizeof(u32));
+    memset(buffer->tile_converged, 0, buffer->tiles_x * buffer->tiles_y * sizeof(bool));
+    memset(buffer->tile_samples, 0, buffer->tiles_x * buffer->tiles_y * sizeof(u32));
+
+    buffer->converged_tile_count = 0;
+    buffer->pass_count           = 0;
+}
+
+__UE_inline__ static void
+AccumulateSample(_mut_ AccumulationBuffer* restrict const buffer, const size_t pixel_index, const Color32_RGB* restrict const sample_color)
+{
+    __UE_ASSERT__(buffer);
+    __UE_ASSERT__(sample_color);
+    __UE_ASSERT__(pixel_index < (buffer->image_width * buffer->image_height));
+
+    v3 linear_color = { 0 };
+    v3Set(&linear_color, sample_color->channel.R / 255.0f, sample_color->channel.G / 255.0f, sample_color->channel.B / 255.0f);
+    v3* color_sum = &buffer->color_sum[pixel_index];
+    color_sum->x += linear_color.x;
+    color_sum->y += linear_color.y;
+    color_sum->z += linear_color.z;
+
+    // Welford
+    const u32 sample_count = ++buffer->sample_count[pixel_index];
+    const r32 luminance    = GetLuminance(&linear_color);
+    const r32 delta        = luminance - buffer->luminance_mean[pixel_index];
+    buffer->luminance_mean[pixel_index] += delta / ( r32 )sample_count;
+    buffer->luminance_m2[pixel_index] += delta * (luminance - buffer->luminance_mean[pixel_index]);
+}
+
+__UE_inline__ static bool
+IsPixelConverged(const AccumulationBuffer* restrict const buffer, const ProgressiveSettings* restrict const settings, const size_t pixel_index)
+{
+    __UE_ASSERT__(buffer && settings);
+
+    const u32 sample_count = buffer->sample_count[pixel_index];
+    if (sample_count < settings->min_samples)
+    {
+        return false;
+    }
+
+    if (sample_count >= settings->max_samples)
+    {
+        return true;
+    }
+
+    // Variance needs two samples, whatever min_samples says
+    if (sample_count < 2)
+    {
+        return false;
+    }
+
+    // Relative standard error of the luminance mean; dark pixels are measured
+    // against an absolute floor so that black backgrounds converge.
+    const r32 variance       = buffer->luminance_m2[pixel_index] / ( r32 )(sample_count - 1);
+    const r32 standard_error = ( r32 )sqrt(variance / ( r32 )sample_count);
+    const r32 mean           = buffer->luminance_mean[pixel_index];
+    const r32 reference      = mean > 0.1f ? mean : 0.1f;
+
+    return (standard_error / reference) < settings->convergence_threshold;
+}
+
+// Adds one sample to every unconverged pixel of a tile.
+// Returns the number of samples taken.
+static size_t
+RenderProgressiveTile(_mut_ AccumulationBuffer* restrict const buffer,
+                      const ProgressiveSettings* restrict const settings,
+                      const size_t                              tile_x,
+                      const size_t                              tile_y,
+                      const Entity* restrict const              entity_arr,
+                      const size_t                              num_entitys)
+{
+    __UE_ASSERT__(buffer && settings && entity_arr);
+    __UE_ASSERT__(tile_x < buffer->tiles_x && tile_y < buffer->tiles_y);
+
+    const size_t tile_index = (tile_y * buffer->tiles_x) + tile_x;
+    if (buffer->tile_converged[tile_index])
+    {
+        return 0;
+    }
+
+    const size_t x_min = tile_x * buffer->tile_size;
+    const size_t y_min = tile_y * buffer->tile_size;
+    const size_t x_max = (x_min + buffer->tile_size) < buffer->image_width ? (x_min + buffer->tile_size) : buffer->image_width;
+    const size_t y_max = (y_min + buffer->tile_size) < buffer->image_height ? (y_min + buffer->tile_size) : buffer->image_height;
+
+    size_t samples_taken  = 0;
+    bool   tile_converged = true;
+    for (size_t pix_y = y_min; pix_y < y_max; pix_y++)
+    {
+        for (size_t pix_x = x_min; pix_x < x_max; pix_x++)
+        {
+            const size_t pixel_index = (pix_y * buffer->image_width) + pix_x;
+            if (IsPixelConverged(buffer, settings, pixel_index))
+            {
+                continue;
+            }
+
+            // Sample n of a pixel is a pure function of (pixel, n); a pass
+            // never depends on the order or thread that earlier passes used.
+            BeginPixelSample(( u32 )pixel_index, buffer->sample_count[pixel_index]);
+            const r32 sample_x = ( r32 )pix_x + NextSample1D();
+            const r32 sample_y = ( r32 )pix_y + NextSample1D();
+
+            RayIntersection intersection = { 0 };
+            Color32_RGB     sample_color = { 0 };
+            TracePrimarySample(sample_x, sample_y, buffer->image_width, buffer->image_height, &intersection, &sample_color, entity_arr, num_entitys);
+
+            AccumulateSample(buffer, pixel_index, &sample_color);
+            samples_taken++;
+
+            tile_converged &= IsPixelConverged(buffer, settings, pixel_index);
+        }
+    }
+
+    if (tile_converged)
+    {
+        buffer->tile_converged[tile_index] = true;
+    }
+
+    return samples_taken;
+}
+
+typedef struct
+{
+    AccumulationBuffer*        buffer;
+    const ProgressiveSettings* settings;
+    const Entity*              entity_arr;
+    size_t                     num_entitys;
+} ProgressivePass;
+
+// One tile of a pass. A ParallelTaskFunction over a ProgressivePass.
+static void
+RenderProgressiveTileTask(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const ProgressivePass* pass   = ( const ProgressivePass* )context;
+    AccumulationBuffer*    buffer = pass->buffer;
+    const size_t           tile_x = task_index % buffer->tiles_x;
+    const size_t           tile_y = task_index / buffer->tiles_x;
+
+    buffer->tile_samples[task_index] = ( u32 )RenderProgressiveTile(buffer, pass->settings, tile_x, tile_y, pass->entity_arr, pass->num_entitys);
+}
+
+// Adds one sample to every unconverged pixel of the image, one parallel task
+// per tile.
+// Returns the number of samples taken; zero once the image has converged.
+static size_t
+RenderProgressivePass(_mut_ AccumulationBuffer* restrict const buffer,
+                      const ProgressiveSettings* restrict const settings,
+                      const Entity* restrict const              entity_arr,
+                      const size_t                              num_entitys,
+                      ThreadPool* const                         pool)
+{
+    __UE_ASSERT__(buffer && settings && entity_arr);
+
+    ProgressivePass pass = { 0 };
+    pass.buffer          = buffer;
+    pass.settings        = settings;
+    pass.entity_arr      = entity_arr;
+    pass.num_entitys     = num_entitys;
+
+    const size_t tile_count = buffer->tiles_x * buffer->tiles_y;
+    ParallelFor(pool, tile_count, RenderProgressiveTileTask, &pass);
+
+    size_t samples_taken        = 0;
+    size_t converged_tile_count = 0;
+    for (size_t tile_index = 0; tile_index < tile_count; tile_index++)
+    {
+        samples_taken += buffer->tile_samples[tile_index];
+        converged_tile_count += buffer->tile_converged[tile_index];
+    }
+
+    buffer->converged_tile_count = converged_tile_count;
+    buffer->pass_count++;
+
+    return samples_taken;
+}
+
+// Write the per-pixel sample mean to a linear, row-major pixel array.
+static void
+ResolveAccumulationBuffer(const AccumulationBuffer* restrict const buffer, _mut_ Color32_RGB* restrict const pixel_array)
+{
+    __UE_ASSERT__(buffer && pixel_array);
+
+    const size_t pixel_count = buffer->image_width * buffer->image_height;
+    for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+    {
+        const u32 sample_count = buffer->sample_count[pixel_index];
+        if (!sample_count)
+        {
+            pixel_array[pixel_index].value = 0;
+            continue;
+        }
+
+        const r32    scale     = 255.0f / ( r32 )sample_count;
+        const v3*    color_sum = &buffer->color_sum[pixel_index];
+        Color32_RGB* pixel     = &pixel_array[pixel_index];
+
+        pixel->channel.R = ( u8 )fmin(255.0f, round(color_sum->x * scale));
+        pixel->channel.G = ( u8 )fmin(255.0f, round(color_sum->y * scale));
+        pixel->channel.B = ( u8 )fmin(255.0f, round(color_sum->z * scale));
+        pixel->channel.A = 0xFF;
+    }
+}
+
+#endif // __UE_ACCUMULATION_TOOLS_H___
@@ -0,0 +1,332 @@
+#ifndef __UE_ANTIALIASING_TOOLS_H___
+#define __UE_ANTIALIASING_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <accumulation_tools.h>
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <sampler_tools.h>
+#include <thread_tools.h>
+#include <type_tools.h>
+
+#include <algorithm>
+#include <stdlib.h>
+
+//
+// Adaptive anti-aliasing
+//
+// A base pass traces one ray through the center of every pixel. Pixels whose
+// luminance differs from a 4-neighbour by more than the contrast threshold, or
+// whose hit entity differs from a 4-neighbour, are then re-sampled with an
+// N x N stratified grid. Flat regions keep their single sample.
+//
+// Note: refinement decisions read base pass data only, so the result does not
+//       depend on the order in which pixels are refined, nor on the thread
+//       count.
+//
+
+typedef struct
+{
+    r32 contrast_threshold;     // Luminance delta in [ 0, 1 ] that triggers refinement
+    u32 subsamples_per_axis;    // Refined pixels receive subsamples_per_axis^2 samples
+    u32 max_refinement_samples; // Per-frame refinement sample budget; 0 is unbounded
+} AdaptiveAASettings;
+
+typedef struct
+{
+    size_t primary_samples;
+    size_t refinement_samples;
+    size_t refined_pixels;
+    size_t candidate_pixels; // Pixels over the threshold, including those cut by the budget
+} AdaptiveAAStats;
+
+typedef struct
+{
+    Color32_RGB* base_color;       // Base pass color
+    r32*         base_luminance;   // Base pass luminance
+    u32*         base_entity;      // Base pass hit entity, ENTITY_INDEX_NONE on miss
+    r32*         priority;         // Refinement priority, see GetPixelRefinementPriority()
+    u32*         refinement_queue; // Pixel indices awaiting refinement
+
+    size_t image_width;
+    size_t image_height;
+} AdaptiveAAState;
+
+typedef struct
+{
+    AdaptiveAAState*          state;
+    const AdaptiveAASettings* settings;
+    Color32_RGB*              pixel_array;
+    const Entity*             entity_arr;
+    size_t                    num_entitys;
+} AdaptiveAAPass;
+
+__UE_inline__ static void
+GetDefaultAdaptiveAASettings(_mut_ AdaptiveAASettings* restrict const settings)
+{
+    __UE_ASSERT__(settings);
+
+    settings->contrast_threshold     = ( r32 )__UE_AA__contrast_threshold;
+    settings->subsamples_per_axis    = __UE_AA__subsamples_per_axis;
+    settings->max_refinement_samples = __UE_AA__max_refinement_samples;
+}
+
+static AdaptiveAAState*
+CreateAdaptiveAAState(const size_t image_width, const size_t image_height)
+{
+    __UE_ASSERT__(image_width && image_height);
+
+    AdaptiveAAState* state = ( AdaptiveAAState* )calloc(1, sizeof(AdaptiveAAState));
+    __UE_ASSERT__(state);
+
+    const size_t pixel_count = image_width * image_height;
+
+    state->image_width      = image_width;
+    state->image_height     = image_height;
+    state->base_color       = ( Color32_RGB* )calloc(pixel_count, sizeof(Color32_RGB));
+    state->base_luminance   = ( r32* )calloc(pixel_count, sizeof(r32));
+    state->base_entity      = ( u32* )calloc(pixel_count, sizeof(u32));
+    state->priority         = ( r32* )calloc(pixel_count, sizeof(r32));
+    state->refinement_queue = ( u32* )calloc(pixel_count, sizeof(u32));
+
+    __UE_ASSERT__(state->base_color && state->base_luminance && state->base_entity);
+    __UE_ASSERT__(state->priority && state->refinement_queue);
+
+    return state;
+}
+
+static void
+DestroyAdaptiveAAState(_mut_ AdaptiveAAState* restrict const state)
+{
+    if (!state)
+    {
+        return;
+    }
+
+    free(state->base_color);
+    free(state->base_luminance);
+    free(state->base_entity);
+    free(state->priority);
+    free(state->refinement_queue);
+    free(state);
+}
+
+__UE_inline__ static r32
+GetColorLuminance(const Color32_RGB* restrict const color)
+{
+    __UE_ASSERT__(color);
+
+    v3 linear_color = { 0 };
+    v3Set(&linear_color, color->channel.R / 255.0f, color->channel.G / 255.0f, color->channel.B / 255.0f);
+    return GetLuminance(&linear_color);
+}
+
+// Returns 0 for flat pixels, the largest 4-neighbour luminance delta for
+// pixels on a shading edge, and 1 + that delta for pixels on a geometric
+// edge (differing hit entity) so that geometric edges are refined first.
+__UE_inline__ static r32
+GetPixelRefinementPriority(const AdaptiveAAState* restrict const state, const size_t pix_x, const size_t pix_y)
+{
+    __UE_ASSERT__(state);
+    __UE_ASSERT__(pix_x < state->image_width && pix_y < state->image_height);
+
+    const size_t pixel_index = (pix_y * state->image_width) + pix_x;
+    const r32    luminance   = state->base_luminance[pixel_index];
+    const u32    entity      = state->base_entity[pixel_index];
+
+    size_t neighbours[4]   = { 0 };
+    size_t neighbour_count = 0;
+    if (pix_x > 0)
+    {
+        neighbours[neighbour_count++] = pixel_index - 1;
+    }
+    if ((pix_x + 1) < state->image_width)
+    {
+        neighbours[neighbour_count++] = pixel_index + 1;
+    }
+    if (pix_y > 0)
+    {
+        neighbours[neighbour_count++] = pixel_index - state->image_width;
+    }
+    if ((pix_y + 1) < state->image_height)
+    {
+        neighbours[neighbour_count++] = pixel_index + state->image_width;
+    }
+
+    r32  contrast          = 0.0f;
+    bool is_geometric_edge = false;
+    for (size_t neighbour_index = 0; neighbour_index < neighbour_count; neighbour_index++)
+    {
+        const r32 delta = ( r32 )fabs(luminance - state->base_luminance[neighbours[neighbour_index]]);
+        contrast          = delta > contrast ? delta : contrast;
+        is_geometric_edge |= (entity != state->base_entity[neighbours[neighbour_index]]);
+    }
+
+    return is_geometric_edge ? (1.0f + contrast) : contrast;
+}
+
+// One base pass row: a centered sample per pixel, and its luminance and hit
+// entity. A ParallelTaskFunction over an AdaptiveAAPass.
+static void
+TraceAdaptiveAABaseRow(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const AdaptiveAAPass* pass  = ( const AdaptiveAAPass* )context;
+    AdaptiveAAState*      state = pass->state;
+    const size_t          pix_y = task_index;
+
+    for (size_t pix_x = 0; pix_x < state->image_width; pix_x++)
+    {
+        const size_t pixel_index = (pix_y * state->image_width) + pix_x;
+
+        BeginPixelSample(( u32 )pixel_index, 0);
+
+        RayIntersection intersection = { 0 };
+        Color32_RGB     sample_color = { 0 };
+        TracePrimarySample(( r32 )pix_x + 0.5f, ( r32 )pix_y + 0.5f, state->image_width, state->image_height, &intersection, &sample_color, pass->entity_arr, pass->num_entitys);
+
+        state->base_color[pixel_index]     = sample_color;
+        state->base_luminance[pixel_index] = GetColorLuminance(&sample_color);
+        state->base_entity[pixel_index]    = intersection.entity_index;
+        pass->pixel_array[pixel_index]     = sample_color;
+    }
+}
+
+// Refinement priority of every pixel in one row; reads base pass data only.
+static void
+PrioritizeAdaptiveAARow(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const AdaptiveAAPass* pass  = ( const AdaptiveAAPass* )context;
+    AdaptiveAAState*      state = pass->state;
+    const size_t          pix_y = task_index;
+
+    for (size_t pix_x = 0; pix_x < state->image_width; pix_x++)
+    {
+        state->priority[(pix_y * state->image_width) + pix_x] = GetPixelRefinementPriority(state, pix_x, pix_y);
+    }
+}
+
+// Replace a pixel with the mean of N x N scrambled Sobol samples. For
+// power-of-two N the samples are stratified: exactly one falls in each cell
+// of the N x N grid.
+// Returns the number of samples taken.
+static size_t
+RefinePixelStratified(const AdaptiveAAState* restrict const state,
+                      _mut_ Color32_RGB* restrict const     pixel_array,
+                      const size_t                          pixel_index,
+                      const u32                             subsamples_per_axis,
+                      const Entity* restrict const          entity_arr,
+                      const size_t                          num_entitys)
+{
+    __UE_ASSERT__(state && pixel_array && entity_arr);
+    __UE_ASSERT__(subsamples_per_axis);
+
+    const size_t pix_x = pixel_index % state->image_width;
+    const size_t pix_y = pixel_index / state->image_width;
+
+    v3 color_sum = { 0 };
+    for (u32 sample_index = 0; sample_index < (subsamples_per_axis * subsamples_per_axis); sample_index++)
+    {
+        BeginPixelSample(( u32 )pixel_index, sample_index);
+        const r32 sample_x = ( r32 )pix_x + NextSample1D();
+        const r32 sample_y = ( r32 )pix_y + NextSample1D();
+
+        RayIntersection intersection = { 0 };
+        Color32_RGB     sample_color = { 0 };
+        TracePrimarySample(sample_x, sample_y, state->image_width, state->image_height, &intersection, &sample_color, entity_arr, num_entitys);
+
+        color_sum.x += sample_color.channel.R;
+        color_sum.y += sample_color.channel.G;
+        color_sum.z += sample_color.channel.B;
+    }
+
+    const u32    sample_count = subsamples_per_axis * subsamples_per_axis;
+    Color32_RGB* pixel        = &pixel_array[pixel_index];
+
+    pixel->channel.R = ( u8 )round(color_sum.x / ( r32 )sample_count);
+    pixel->channel.G = ( u8 )round(color_sum.y / ( r32 )sample_count);
+    pixel->channel.B = ( u8 )round(color_sum.z / ( r32 )sample_count);
+
+    return sample_count;
+}
+
+// One refinement queue entry.
+static void
+RefineAdaptiveAAPixel(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const AdaptiveAAPass* pass = ( const AdaptiveAAPass* )context;
+    RefinePixelStratified(pass->state, pass->pixel_array, pass->state->refinement_queue[task_index], pass->settings->subsamples_per_axis, pass->entity_arr, pass->num_entitys);
+}
+
+// Orders the refinement queue by descending priority; equal priorities keep
+// pixel order so the budget cut is reproducible.
+static void
+SortRefinementQueue(_mut_ u32* restrict const queue, const size_t queue_length, const r32* restrict const priority)
+{
+    __UE_ASSERT__(queue && priority);
+
+    std::sort(queue, queue + queue_length, [priority](const u32 a, const u32 b) {
+        return (priority[a] > priority[b]) || (priority[a] == priority[b] && a < b);
+    });
+}
+
+// Trace the base pass and refine its edge pixels, one parallel task per row
+// and then per refined pixel.
+static AdaptiveAAStats
+RenderAdaptiveAA(_mut_ AdaptiveAAState* restrict const    state,
+                 const AdaptiveAASettings* restrict const settings,
+                 _mut_ Color32_RGB* restrict const        pixel_array,
+                 const Entity* restrict const             entity_arr,
+                 const size_t                             num_entitys,
+                 ThreadPool* const                        pool)
+{
+    __UE_ASSERT__(state && settings && pixel_array && entity_arr);
+    __UE_ASSERT__(settings->subsamples_per_axis);
+
+    AdaptiveAAStats stats = { 0 };
+    AdaptiveAAPass  pass  = { 0 };
+    pass.state            = state;
+    pass.settings         = settings;
+    pass.pixel_array      = pixel_array;
+    pass.entity_arr       = entity_arr;
+    pass.num_entitys      = num_entitys;
+
+    ParallelFor(pool, state->image_height, TraceAdaptiveAABaseRow, &pass);
+    ParallelFor(pool, state->image_height, PrioritizeAdaptiveAARow, &pass);
+    stats.primary_samples = state->image_width * state->image_height;
+
+    // Gather edge pixels in pixel order
+    size_t queue_length = 0;
+    for (size_t pixel_index = 0; pixel_index < stats.primary_samples; pixel_index++)
+    {
+        if (state->priority[pixel_index] > settings->contrast_threshold)
+        {
+            state->refinement_queue[queue_length++] = ( u32 )pixel_index;
+        }
+    }
+    stats.candidate_pixels = queue_length;
+
+    // Over budget: spend it on the highest priority pixels
+    const size_t samples_per_pixel = settings->subsamples_per_axis * settings->subsamples_per_axis;
+    if (settings->max_refinement_samples && (queue_length * samples_per_pixel) > settings->max_refinement_samples)
+    {
+        SortRefinementQueue(state->refinement_queue, queue_length, state->priority);
+
+        queue_length = settings->max_refinement_samples / samples_per_pixel;
+    }
+
+    ParallelFor(pool, queue_length, RefineAdaptiveAAPixel, &pass);
+    stats.refinement_samples = queue_length * samples_per_pixel;
+    stats.refined_pixels     = queue_length;
+
+    return stats;
+}
+
+#endif // __UE_ANTIALIASING_TOOLS_H___
@@ -0,0 +1,645 @@
+#ifndef __UE_BATCH_RENDER_TOOLS_H___
+#define __UE_BATCH_RENDER_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <accumulation_tools.h>
+#include <antialiasing_tools.h>
+#include <clock_tools.h>
+#include <entity_tools.h>
+#include <farm_tools.h>
+#include <image_tools.h>
+#include <irradiance_tools.h>
+#include <kernel_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <scene_tools.h>
+#include <shading_rate_tools.h>
+#include <stats_tools.h>
+#include <thread_tools.h>
+#include <type_tools.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif // _WIN32
+
+//
+// Headless batch rendering
+//
+// Started with --headless on the command line; Vulkan and the window are
+// never created. A scene of random entities is built from a fixed seed and N
+// frames are traced on the CPU and optionally written as bitmaps, then a
+// performance report is printed:
+//
+//   Understone --headless --width 1920 --height 1080 --frames 16 --seed 7
+//              --threads 8 --output frames/out
+//
+// With --farm <workers> each frame is traced by that many local worker
+// processes instead of the thread pool (see: farm_tools.h).
+//
+// With --irradiance 1 the first diffuse bounce is interpolated from an
+// irradiance cache that is kept across frames and topped up before each one
+// (see: PopulateIrradianceCache()). It needs --bounces and is not available
+// on the farm, whose workers trace every bounce.
+//
+// Output is deterministic: entities come from XorShift32 seeded with --seed,
+// samples are indexed by (pixel, frame) (see: BeginPixelSample()), so the
+// images do not depend on the thread count.
+//
+// With --renderer adaptive-aa each frame is traced by RenderAdaptiveAA()
+// instead of the kernel: one centered sample per pixel, then a stratified grid
+// over the pixels on an edge (see: antialiasing_tools.h). It shades like
+// TraceEntityArray(), so --aa and --bounces do not apply.
+//
+// With --sampler blue-noise the --aa jitter is drawn from a blue noise mask
+// seeded with --seed instead of the Sobol sequence: at one sample per pixel
+// the error is spread evenly rather than clumped (see: sampler_tools.h).
+//
+// With --renderer progressive each frame is accumulated from an empty buffer
+// by RenderProgressivePass() until every pixel has converged, then resolved
+// (see: accumulation_tools.h). It shades like adaptive-aa.
+//
+// With --renderer shading-rate each frame is traced by RenderShadingRateFrame()
+// at a per tile rate: full rate near the image center, coarser towards the
+// edges, and back to full rate wherever the previous frame shows contrast
+// (see: shading_rate_tools.h). The first frame has no previous frame and is
+// traced at full rate. It shades like adaptive-aa.
+//
+// With --stats <prefix> a statistics build (-D__UE_STATS__enabled=1) counts
+// every pixel's rays, bounces, box and primitive tests over all frames,
+// prints the totals and writes one heatmap per counter as
+// <prefix>_<counter>.bmp (see: stats_tools.h). Farm workers do not count.
+//
+// Note: Mrays/s counts primary rays only; bounces are in the --stats totals.
+// Note: only the kernel renderer runs on the farm, fills the irradiance cache,
+//       counts statistics or samples blue noise; farm workers do not.
+//
+
+typedef enum
+{
+    BR_KERNEL,      // RenderTraceKernel(), see: kernel_tools.h
+    BR_ADAPTIVE_AA, // RenderAdaptiveAA(), see: antialiasing_tools.h
+    BR_PROGRESSIVE, // RenderProgressivePass(), see: accumulation_tools.h
+    BR_SHADING_RATE // RenderShadingRateFrame(), see: shading_rate_tools.h
+} BatchRenderer;
+
+typedef struct
+{
+    u32           image_width;
+    u32           image_height;
+    u32           frame_count;
+    u32           thread_count; // 0 uses every hardware thread
+    u32           entity_count;
+    u32           seed;
+    u32           farm_workers; // Worker processes; 0 renders in-process
+    bool          irradiance_cache;
+    bool          blue_noise; // Blue noise --aa jitter, see: TraceKernelFrame
+    BatchRenderer renderer;
+    const char*   output_prefix;  // Frames are written as <prefix>_<frame>.bmp; NULL writes nothing
+    const char*   stats_prefix;   // Heatmaps are written as <prefix>_<counter>.bmp; NULL counts nothing
+    const char*   invalid_option; // First malformed option, see: ParseBatchRenderArguments()
+    const char*   invalid_value;
+
+    TraceKernelSettings kernel;
+} BatchRenderSettings;
+
+typedef struct
+{
+    r64    total_seconds;
+    r64    min_frame_seconds;
+    r64    max_frame_seconds;
+    size_t primary_rays;
+    size_t peak_memory_bytes;
+    u32    farm_tiles_recovered;
+    u32    farm_failed_workers;
+    u32    farm_timed_out_workers;
+    r64    farm_launch_seconds;
+    size_t irradiance_records;
+    u64    stats_total[RS_BOUNCES + 1]; // Indexed by RayStatsCounter
+    size_t refined_pixels;
+    size_t progressive_samples;
+    size_t progressive_passes;
+    size_t shading_rate_traced;                    // Pixels traced; the others are interpolated
+    size_t shading_rate_tiles[SHADING_RATE_COUNT]; // Indexed by ShadingRate, over all frames
+} BatchRenderReport;
+
+__UE_inline__ static void
+GetDefaultBatchRenderSettings(_mut_ BatchRenderSettings* restrict const settings)
+{
+    __UE_ASSERT__(settings);
+
+    settings->image_width      = IMAGE_WIDTH;
+    settings->image_height     = IMAGE_HEIGHT;
+    settings->frame_count      = 1;
+    settings->thread_count     = 0;
+    settings->entity_count     = 64;
+    settings->seed             = 1;
+    settings->farm_workers     = 0;
+    settings->irradiance_cache = false;
+    settings->blue_noise       = false;
+    settings->renderer         = BR_KERNEL;
+    settings->output_prefix    = NULL;
+    settings->stats_prefix     = NULL;
+    settings->invalid_option   = NULL;
+    settings->invalid_value    = NULL;
+    GetDefaultTraceKernelSettings(&settings->kernel);
+}
+
+static void
+PrintBatchRenderUsage()
+{
+    printf("usage: Understone --headless [ options ]\n"
+           "  --width <pixels>     image width (default: %d)\n"
+           "  --height <pixels>    image height (default: %d)\n"
+           "  --frames <count>     frames to render (default: 1)\n"
+           "  --threads <count>    render threads, 0 for all (default: 0)\n"
+           "  --entities <count>   random entities in the scene (default: 64)\n"
+           "  --seed <value>       scene seed (default: 1)\n"
+           "  --aa <0|1>           jittered primary samples\n"
+           "  --bounces <count>    reflection depth, 0 disables (max: %d)\n"
+           "  --farm <workers>     render on local worker processes (max: %d)\n"
+           "  --irradiance <0|1>   cache the first diffuse bounce across frames\n"
+           "  --sampler <name>     aa jitter, sobol or blue-noise (default: sobol)\n"
+           "  --renderer <name>    kernel, adaptive-aa, progressive or shading-rate (default: kernel)\n"
+           "  --output <prefix>    write <prefix>_<frame>.bmp\n"
+           "  --stats <prefix>     write <prefix>_<counter>.bmp (statistics build)\n",
+           IMAGE_WIDTH,
+           IMAGE_HEIGHT,
+           KERNEL_MAX_BOUNCES,
+           FARM_MAX_WORKERS);
+}
+
+static void
+PrintBatchRenderArgumentError(const BatchRenderSettings* restrict const settings)
+{
+    __UE_ASSERT__(settings && settings->invalid_option);
+
+    printf("[ batch ] Invalid argument: %s %s\n", settings->invalid_option, settings->invalid_value ? settings->invalid_value : "");
+    PrintBatchRenderUsage();
+}
+
+static bool
+ParseBatchRenderU32(const char* const text, _mut_ u32* restrict const value)
+{
+    char*               end    = NULL;
+    const unsigned long parsed = strtoul(text, &end, 10);
+    if (!text[0] || *end || parsed > 0xFFFFFFFFul)
+    {
+        return false;
+    }
+
+    *value = ( u32 )parsed;
+    return true;
+}
+
+// Returns true if argv asks for a headless render. On a malformed command
+// line 'settings->frame_count' is set to zero and the offending option is
+// kept for PrintBatchRenderArgumentError().
+static bool
+ParseBatchRenderArguments(const int argc, char** const argv, _mut_ BatchRenderSettings* restrict const settings)
+{
+    __UE_ASSERT__(settings);
+    GetDefaultBatchRenderSettings(settings);
+
+    bool is_headless = false;
+    for (int arg_index = 1; arg_index < argc; arg_index++)
+    {
+        if (!strcmp(argv[arg_index], "--headless"))
+        {
+            is_headless = true;
+        }
+    }
+
+    if (!is_headless)
+    {
+        return false;
+    }
+
+    for (int arg_index = 1; arg_index < argc; arg_index++)
+    {
+        const char* option = argv[arg_index];
+        if (!strcmp(option, "--headless"))
+        {
+            continue;
+        }
+
+        const char* value = (arg_index + 1) < argc ? argv[++arg_index] : NULL;
+        u32         aa         = 0;
+        u32         depth      = 0;
+        u32         irradiance = 0;
+        bool        valid      = (value != NULL);
+        if (valid && !strcmp(option, "--width"))
+        {
+            valid = ParseBatchRenderU32(value, &settings->image_width) && settings->image_width;
+        }
+        else if (valid && !strcmp(option, "--height"))
+        {
+            valid = ParseBatchRenderU32(value, &settings->image_height) && settings->image_height;
+        }
+        else if (valid && !strcmp(option, "--frames"))
+        {
+            valid = ParseBatchRenderU32(value, &settings->frame_count) && settings->frame_count;
+        }
+        else if (valid && !strcmp(option, "--threads"))
+        {
+            valid = ParseBatchRenderU32(value, &settings->thread_count);
+        }
+        else if (valid && !strcmp(option, "--entities"))
+        {
+            // Note: TraceEntityArray() requires at least two entities
+            valid = ParseBatchRenderU32(value, &settings->entity_count) && settings->entity_count >= 2;
+        }
+        else if (valid && !strcmp(option, "--seed"))
+        {
+            // Note: XorShift32 never leaves a zero state
+            valid = ParseBatchRenderU32(value, &settings->seed) && settings->seed;
+        }
+        else if (valid && !strcmp(option, "--aa"))
+        {
+            valid                          = ParseBatchRenderU32(value, &aa) && aa <= 1;
+            settings->kernel.anti_aliasing = (aa == 1);
+        }
+        else if (valid && !strcmp(option, "--bounces"))
+        {
+            valid                        = ParseBatchRenderU32(value, &depth) && depth <= KERNEL_MAX_BOUNCES;
+            settings->kernel.reflections = (depth > 0);
+            settings->kernel.max_bounces = depth;
+        }
+        else if (valid && !strcmp(option, "--farm"))
+        {
+            valid = ParseBatchRenderU32(value, &settings->farm_workers) && settings->farm_workers <= FARM_MAX_WORKERS
+                    && !(settings->farm_workers && (settings->irradiance_cache || settings->stats_prefix || settings->blue_noise || settings->renderer != BR_KERNEL));
+        }
+        else if (valid && !strcmp(option, "--irradiance"))
+        {
+            // Note: farm workers do not share the coordinator's cache
+            valid                      = ParseBatchRenderU32(value, &irradiance) && irradiance <= 1 && !(irradiance && (settings->farm_workers || settings->renderer != BR_KERNEL));
+            settings->irradiance_cache = (irradiance == 1);
+        }
+        else if (valid && !strcmp(option, "--output"))
+        {
+            settings->output_prefix = value;
+        }
+        else if (valid && !strcmp(option, "--stats"))
+        {
+            // Note: only a statistics build counts, and farm workers never do
+            valid                  = (__UE_STATS__enabled == 1) && !settings->farm_workers && settings->renderer == BR_KERNEL;
+            settings->stats_prefix = value;
+        }
+        else if (valid && !strcmp(option, "--renderer"))
+        {
+            if (!strcmp(value, "kernel"))
+            {
+                settings->renderer = BR_KERNEL;
+            }
+            else if (!strcmp(value, "adaptive-aa") || !strcmp(value, "progressive") || !strcmp(value, "shading-rate"))
+            {
+                settings->renderer = !strcmp(value, "adaptive-aa") ? BR_ADAPTIVE_AA : (!strcmp(value, "progressive") ? BR_PROGRESSIVE : BR_SHADING_RATE);
+                valid              = !settings->farm_workers && !settings->irradiance_cache && !settings->stats_prefix && !settings->blue_noise;
+            }
+            else
+            {
+                valid = false;
+            }
+        }
+        else if (valid && !strcmp(option, "--sampler"))
+        {
+            if (!strcmp(value, "sobol"))
+            {
+                settings->blue_noise = false;
+            }
+            else if (!strcmp(value, "blue-noise"))
+            {
+                settings->blue_noise = true;
+                valid                = !settings->farm_workers && settings->renderer == BR_KERNEL;
+            }
+            else
+            {
+                valid = false;
+            }
+        }
+        else
+        {
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            settings->frame_count    = 0;
+            settings->invalid_option = option;
+            settings->invalid_value  = value;
+            return true;
+        }
+    }
+
+    return true;
+}
+
+// Peak resident set of the process so far, or zero if unavailable.
+static size_t
+GetPeakMemoryBytes()
+{
+#if _WIN32
+    PROCESS_MEMORY_COUNTERS counters = { 0 };
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return ( size_t )counters.PeakWorkingSetSize;
+    }
+
+    return 0;
+#else
+    struct rusage usage = { 0 };
+    if (!getrusage(RUSAGE_SELF, &usage))
+    {
+        // Note: kilobytes on Linux
+        return ( size_t )usage.ru_maxrss * 1024;
+    }
+
+    return 0;
+#endif // _WIN32
+}
+
+// Render settings->frame_count frames and fill 'report'. Returns false if a
+// frame could not be written or the farm could not be created.
+static bool
+RunBatchRender(const BatchRenderSettings* restrict const settings, _mut_ BatchRenderReport* restrict const report)
+{
+    __UE_ASSERT__(settings && report);
+    __UE_ASSERT__(settings->image_width && settings->image_height);
+    __UE_ASSERT__(settings->entity_count >= 2);
+    __UE_ASSERT__(!(settings->farm_workers && (settings->irradiance_cache || settings->stats_prefix)));
+    __UE_ASSERT__(settings->renderer == BR_KERNEL || !(settings->farm_workers || settings->irradiance_cache || settings->stats_prefix || settings->blue_noise));
+    __UE_ASSERT__(!(settings->farm_workers && settings->blue_noise));
+
+    memset(report, 0, sizeof(BatchRenderReport));
+    report->min_frame_seconds = 1e30;
+
+    XorShift32State    = settings->seed;
+    Entity* entity_arr = CreateRandomEntities(settings->entity_count);
+
+    // The calling thread renders too
+    ThreadPool* pool = NULL;
+    Farm*       farm = NULL;
+    if (settings->farm_workers)
+    {
+        FarmSettings farm_settings = { 0 };
+        GetDefaultFarmSettings(&farm_settings);
+        farm_settings.worker_count = settings->farm_workers;
+
+        farm = CreateFarm(&farm_settings, entity_arr, settings->entity_count, settings->image_width, settings->image_height);
+        if (!farm)
+        {
+            printf("[ batch ] Unable to create the render farm.\n");
+            free(entity_arr);
+            return false;
+        }
+    }
+    else if (settings->thread_count != 1)
+    {
+        pool = CreateThreadPool(settings->thread_count ? (settings->thread_count - 1) : 0);
+    }
+
+    const size_t pixel_count = ( size_t )settings->image_width * settings->image_height;
+    Scene*       scene       = CreateScene(entity_arr, settings->entity_count);
+
+    TraceKernelFrame frame = { 0 };
+    frame.pixel_arr        = ( Color32_RGB* )calloc(pixel_count, sizeof(Color32_RGB));
+    frame.image_width      = settings->image_width;
+    frame.image_height     = settings->image_height;
+    frame.scene            = scene;
+    __UE_ASSERT__(frame.pixel_arr);
+
+    IrradianceCache* irradiance_cache = NULL;
+    if (settings->irradiance_cache)
+    {
+        IrradianceCacheSettings cache_settings = { 0 };
+        GetDefaultIrradianceCacheSettings(&cache_settings);
+        irradiance_cache       = CreateIrradianceCache(&cache_settings);
+        frame.irradiance_cache = irradiance_cache;
+    }
+
+    BlueNoiseMask* blue_noise = settings->blue_noise ? CreateBlueNoiseMask(settings->seed) : NULL;
+    frame.blue_noise          = blue_noise;
+
+    RenderStats* stats = settings->stats_prefix ? CreateRenderStats(settings->image_width, settings->image_height, 16) : NULL;
+    frame.stats        = stats;
+
+    AdaptiveAASettings aa_settings = { 0 };
+    AdaptiveAAState*   aa_state    = NULL;
+    if (settings->renderer == BR_ADAPTIVE_AA)
+    {
+        GetDefaultAdaptiveAASettings(&aa_settings);
+        aa_state = CreateAdaptiveAAState(settings->image_width, settings->image_height);
+    }
+
+    ProgressiveSettings progressive_settings = { 0 };
+    AccumulationBuffer* accumulation         = NULL;
+    if (settings->renderer == BR_PROGRESSIVE)
+    {
+        GetDefaultProgressiveSettings(&progressive_settings);
+        accumulation = CreateAccumulationBuffer(settings->image_width, settings->image_height, __UE_PR__tile_size);
+    }
+
+    ShadingRateSettings rate_settings = { 0 };
+    ShadingRateMap*     rate_map      = NULL;
+    if (settings->renderer == BR_SHADING_RATE)
+    {
+        GetDefaultShadingRateSettings(&rate_settings);
+        rate_map = CreateShadingRateMap(settings->image_width, settings->image_height, rate_settings.tile_size);
+    }
+
+    bool success = true;
+    for (u32 frame_index = 0; frame_index < settings->frame_count; frame_index++)
+    {
+        frame.sample_index = frame_index;
+
+        const r64 frame_begin = GetClockSeconds();
+        if (farm)
+        {
+            FarmFrameReport farm_report = { 0 };
+            RenderFarmFrame(farm, &settings->kernel, frame_index, frame.pixel_arr, &farm_report);
+            report->farm_tiles_recovered += farm_report.tiles_recovered;
+            report->farm_failed_workers += farm_report.failed_workers;
+            report->farm_timed_out_workers += farm_report.timed_out_workers;
+            report->farm_launch_seconds += farm_report.launch_seconds;
+        }
+        else if (aa_state)
+        {
+            const AdaptiveAAStats aa_stats = RenderAdaptiveAA(aa_state, &aa_settings, frame.pixel_arr, entity_arr, settings->entity_count, pool);
+            report->refined_pixels += aa_stats.refined_pixels;
+        }
+        else if (accumulation)
+        {
+            ResetAccumulationBuffer(accumulation);
+
+            size_t samples_taken = 0;
+            while ((samples_taken = RenderProgressivePass(accumulation, &progressive_settings, entity_arr, settings->entity_count, pool)))
+            {
+                report->progressive_samples += samples_taken;
+            }
+            report->progressive_passes += accumulation->pass_count;
+
+            ResolveAccumulationBuffer(accumulation, frame.pixel_arr);
+        }
+        else if (rate_map)
+        {
+            // frame.pixel_arr still holds the previous frame
+            if (frame_index)
+            {
+                SetShadingRateByFocus(rate_map, &rate_settings, 0.5f * ( r32 )settings->image_width, 0.5f * ( r32 )settings->image_height);
+                RefineShadingRateByContrast(rate_map, &rate_settings, frame.pixel_arr);
+            }
+            else
+            {
+                MarkShadingRateRegion(rate_map, 0, 0, settings->image_width, settings->image_height, SHADING_RATE_1X1);
+            }
+
+            const ShadingRateStats rate_stats = RenderShadingRateFrame(rate_map, frame.pixel_arr, entity_arr, settings->entity_count, frame_index, pool);
+            report->shading_rate_traced += rate_stats.pixels_traced;
+            for (u32 rate = 0; rate < SHADING_RATE_COUNT; rate++)
+            {
+                report->shading_rate_tiles[rate] += rate_stats.tiles_at_rate[rate];
+            }
+        }
+        else
+        {
+            if (irradiance_cache)
+            {
+                report->irradiance_records += PopulateIrradianceCache(&settings->kernel, &frame, irradiance_cache, pool);
+            }
+
+            RenderTraceKernel(&settings->kernel, &frame, pool);
+        }
+        const r64 frame_seconds = GetClockSeconds() - frame_begin;
+
+        report->total_seconds += frame_seconds;
+        report->primary_rays += pixel_count;
+        report->min_frame_seconds = frame_seconds < report->min_frame_seconds ? frame_seconds : report->min_frame_seconds;
+        report->max_frame_seconds = frame_seconds > report->max_frame_seconds ? frame_seconds : report->max_frame_seconds;
+
+        printf("[ batch ] frame %u: %.2f ms\n", frame_index, frame_seconds * 1e3);
+
+        if (settings->output_prefix)
+        {
+            char image_name[1024];
+            if (snprintf(image_name, sizeof(image_name), "%s_%04u.bmp", settings->output_prefix, frame_index) >= ( int )sizeof(image_name))
+            {
+                printf("[ batch ] Output prefix is too long.\n");
+                success = false;
+                break;
+            }
+
+            if (!WriteBitmap32(frame.pixel_arr, settings->image_width, settings->image_height, image_name))
+            {
+                printf("[ batch ] Unable to write: %s\n", image_name);
+                success = false;
+                break;
+            }
+        }
+    }
+
+    report->peak_memory_bytes = GetPeakMemoryBytes();
+
+    if (stats)
+    {
+        AggregateRenderStats(stats, pool);
+
+        const char* const counter_names[] = { "rays", "box_tests", "primitive_tests", "bounces" };
+        for (u32 counter = RS_RAYS; counter <= RS_BOUNCES; counter++)
+        {
+            for (size_t tile_index = 0; tile_index < stats->tile_count; tile_index++)
+            {
+                report->stats_total[counter] += GetRayStatsCounter(&stats->tile_arr[tile_index], ( RayStatsCounter )counter);
+            }
+
+            char image_name[1024];
+            if (success && (snprintf(image_name, sizeof(image_name), "%s_%s.bmp", settings->stats_prefix, counter_names[counter]) >= ( int )sizeof(image_name)
+                            || !WriteRenderStatsHeatmap(stats, ( RayStatsCounter )counter, false, image_name)))
+            {
+                printf("[ batch ] Unable to write the %s heatmap.\n", counter_names[counter]);
+                success = false;
+            }
+        }
+    }
+
+    free(frame.pixel_arr);
+    DestroyScene(scene);
+    DestroyRenderStats(stats);
+    DestroyBlueNoiseMask(blue_noise);
+    DestroyAdaptiveAAState(aa_state);
+    DestroyAccumulationBuffer(accumulation);
+    DestroyShadingRateMap(rate_map);
+    DestroyIrradianceCache(irradiance_cache);
+    DestroyFarm(farm);
+    DestroyThreadPool(pool);
+    free(entity_arr);
+
+    return success;
+}
+
+static void
+PrintBatchRenderReport(const BatchRenderSettings* restrict const settings, const BatchRenderReport* restrict const report)
+{
+    __UE_ASSERT__(settings && report);
+
+    const u32 frame_count = settings->frame_count ? settings->frame_count : 1;
+    const u32 threads     = settings->thread_count ? settings->thread_count : ( u32 )GetHardwareThreadCount();
+
+    printf("[ batch ] %u x %u, %u frame(s), %u thread(s), %u entities, seed %u\n",
+           settings->image_width,
+           settings->image_height,
+           settings->frame_count,
+           threads,
+           settings->entity_count,
+           settings->seed);
+    printf("[ batch ] frame time: %.2f ms avg, %.2f ms min, %.2f ms max\n",
+           (report->total_seconds / frame_count) * 1e3,
+           report->min_frame_seconds * 1e3,
+           report->max_frame_seconds * 1e3);
+    printf("[ batch ] throughput: %.2f Mrays/s (primary)\n", report->total_seconds > 0.0 ? (( r64 )report->primary_rays / report->total_seconds) * 1e-6 : 0.0);
+    printf("[ batch ] peak memory: %.1f MB\n", ( r64 )report->peak_memory_bytes / (1024.0 * 1024.0));
+    if (settings->farm_workers)
+    {
+        printf("[ batch ] farm: %u worker(s), %u failed (%u timed out), %u tile(s) recovered\n", settings->farm_workers, report->farm_failed_workers, report->farm_timed_out_workers, report->farm_tiles_recovered);
+        printf("[ batch ] farm: %.2f ms/frame launching workers\n", (report->farm_launch_seconds / frame_count) * 1e3);
+    }
+    if (settings->irradiance_cache)
+    {
+        printf("[ batch ] irradiance cache: %zu record(s)\n", report->irradiance_records);
+    }
+    if (settings->renderer == BR_ADAPTIVE_AA)
+    {
+        printf("[ batch ] adaptive aa: %.1f%% of pixels refined\n", 100.0 * ( r64 )report->refined_pixels / ( r64 )report->primary_rays);
+    }
+    if (settings->renderer == BR_PROGRESSIVE)
+    {
+        printf("[ batch ] progressive: %.2f samples/pixel, %.1f passes/frame\n",
+               ( r64 )report->progressive_samples / ( r64 )report->primary_rays,
+               ( r64 )report->progressive_passes / frame_count);
+    }
+    if (settings->renderer == BR_SHADING_RATE)
+    {
+        printf("[ batch ] shading rate: %.1f%% of pixels traced, %zu / %zu / %zu tiles at 1x1 / 2x2 / 4x4\n",
+               100.0 * ( r64 )report->shading_rate_traced / ( r64 )report->primary_rays,
+               report->shading_rate_tiles[SHADING_RATE_1X1],
+               report->shading_rate_tiles[SHADING_RATE_2X2],
+               report->shading_rate_tiles[SHADING_RATE_4X4]);
+    }
+    if (settings->stats_prefix)
+    {
+        printf("[ batch ] stats: %llu rays, %llu bounces, %llu box tests, %llu primitive tests\n",
+               ( unsigned long long )report->stats_total[RS_RAYS],
+               ( unsigned long long )report->stats_total[RS_BOUNCES],
+               ( unsigned long long )report->stats_total[RS_BOX_TESTS],
+               ( unsigned long long )report->stats_total[RS_PRIMITIVE_TESTS]);
+    }
+}
+
+#endif // __UE_BATCH_RENDER_TOOLS_H___
@@ -0,0 +1,921 @@
+#ifndef __UE_BVH_TOOLS_H___
+#define __UE_BVH_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <thread_tools.h>
+#include <type_tools.h>
+
+#include <float.h>
+#include <stdlib.h>
+
+//
+// Bounding volume hierarchy
+//
+// A binary BVH over any primitive type that can report an AABB through a
+// GetPrimitiveBoundsFunction. Built with binned SAH.
+//
+// Node layout: a node covering k primitives owns the 2k - 1 node slots that
+// follow it, inclusive. Its left child is the next slot and its right child
+// sits 2 * left_count slots after it. Every subtree can therefore be rebuilt
+// in place, in parallel with its siblings, without reallocating.
+//
+// Dynamic scenes: the tree is split at a fixed depth into independent
+// subtrees, one parallel task each. UpdateBVH() refits every subtree bottom
+// up; a subtree whose SAH cost has degraded past the rebuild threshold,
+// relative to its cost when it was last built, is rebuilt in place. If the
+// levels above the subtrees degrade, the whole tree is rebuilt.
+//
+// Depth: nodes deeper than BVH_MEDIAN_SPLIT_DEPTH are split at the object
+// median instead of by SAH. With fewer than 2^31 primitives no leaf is deeper
+// than BVH_STACK_SIZE - 1, whatever the input, so a traversal stack of
+// BVH_STACK_SIZE entries cannot overflow.
+//
+
+#define BVH_STACK_SIZE         64
+#define BVH_MEDIAN_SPLIT_DEPTH (BVH_STACK_SIZE - 32)
+
+typedef struct
+{
+    v3 min;
+    v3 max;
+} AABB;
+
+typedef void (*GetPrimitiveBoundsFunction)(const void* primitives, const u32 primitive_index, _mut_ AABB* const bounds);
+
+typedef struct
+{
+    v3  min;
+    u32 first_index; // First entry of BVH::indices covered by this node
+    v3  max;
+    u32 index_count; // Number of primitives covered by this node
+    u32 left_count;  // Number of primitives in the left child; 0 for leaves
+} BVHNode;
+
+typedef struct
+{
+    BVHNode* nodes;            // 2 * primitive_count - 1 slots
+    u32*     indices;          // Primitive indices; leaf ranges are contiguous
+    AABB*    primitive_bounds; // Bounds of primitive indices[i], as of the last build or refit
+    size_t   primitive_count;
+    size_t   node_capacity;
+    u32      max_leaf_size;
+
+    // Parallel update bookkeeping
+    u32*   subtree_roots;
+    r32*   subtree_build_cost; // Normalized SAH cost of each subtree when it was built
+    u8*    subtree_rebuilt;
+    size_t subtree_count;
+    u32    subtree_depth;
+    r32    build_cost; // Normalized SAH cost of the whole tree when it was built
+} BVH;
+
+typedef struct
+{
+    size_t rebuilt_subtrees;
+    bool   full_rebuild;
+    r32    sah_cost;
+} BVHUpdateStats;
+
+//
+// AABB
+//
+__UE_inline__ static void
+AABBSetEmpty(_mut_ AABB* restrict const box)
+{
+    __UE_ASSERT__(box);
+    v3Set(&box->min, FLT_MAX, FLT_MAX, FLT_MAX);
+    v3Set(&box->max, -FLT_MAX, -FLT_MAX, -FLT_MAX);
+}
+
+__UE_inline__ static void
+AABBGrow(_mut_ AABB* restrict const box, const AABB* restrict const other)
+{
+    __UE_ASSERT__(box && other);
+    for (u8 axis = 0; axis < 3; axis++)
+    {
+        box->min.arr[axis] = other->min.arr[axis] < box->min.arr[axis] ? other->min.arr[axis] : box->min.arr[axis];
+        box->max.arr[axis] = other->max.arr[axis] > box->max.arr[axis] ? other->max.arr[axis] : box->max.arr[axis];
+    }
+}
+
+__UE_inline__ static void
+AABBGrowPoint(_mut_ AABB* restrict const box, const v3* restrict const point)
+{
+    __UE_ASSERT__(box && point);
+    for (u8 axis = 0; axis < 3; axis++)
+    {
+        box->min.arr[axis] = point->arr[axis] < box->min.arr[axis] ? point->arr[axis] : box->min.arr[axis];
+        box->max.arr[axis] = point->arr[axis] > box->max.arr[axis] ? point->arr[axis] : box->max.arr[axis];
+    }
+}
+
+__UE_inline__ static r32
+AABBSurfaceArea(const AABB* restrict const box)
+{
+    __UE_ASSERT__(box);
+
+    const r32 dx = box->max.x - box->min.x;
+    const r32 dy = box->max.y - box->min.y;
+    const r32 dz = box->max.z - box->min.z;
+    if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+    {
+        return 0.0f;
+    }
+
+    return 2.0f * ((dx * dy) + (dy * dz) + (dz * dx));
+}
+
+__UE_inline__ static r32
+AABBCentroid(const AABB* restrict const box, const u8 axis)
+{
+    __UE_ASSERT__(box && axis < 3);
+    return 0.5f * (box->min.arr[axis] + box->max.arr[axis]);
+}
+
+// Returns the entry magnitude of the ray into the box, or FLT_MAX if the ray
+// misses the box within [ 0, max_magnitude ].
+__UE_inline__ static r32
+IntersectAABB(const v3* restrict const origin, const v3* restrict const inverse_direction, const v3* restrict const box_min, const v3* restrict const box_max, const r32 max_magnitude)
+{
+    __UE_STAT__(box_tests, 1);
+
+    r32 t_near = 0.0f;
+    r32 t_far  = max_magnitude;
+    for (u8 axis = 0; axis < 3; axis++)
+    {
+        r32 t0 = (box_min->arr[axis] - origin->arr[axis]) * inverse_direction->arr[axis];
+        r32 t1 = (box_max->arr[axis] - origin->arr[axis]) * inverse_direction->arr[axis];
+        if (t0 > t1)
+        {
+            const r32 swap = t0;
+            t0             = t1;
+            t1             = swap;
+        }
+
+        t_near = t0 > t_near ? t0 : t_near;
+        t_far  = t1 < t_far ? t1 : t_far;
+    }
+
+    return t_near <= t_far ? t_near : FLT_MAX;
+}
+
+__UE_inline__ static void
+GetInverseDirection(const v3* restrict const direction, _mut_ v3* restrict const inverse_direction)
+{
+    __UE_ASSERT__(direction && inverse_direction);
+    for (u8 axis = 0; axis < 3; axis++)
+    {
+        const r32 component           = direction->arr[axis];
+        inverse_direction->arr[axis] = 1.0f / (fabs(component) > 1e-12f ? component : (component < 0.0f ? -1e-12f : 1e-12f));
+    }
+}
+
+//
+// Build
+//
+__UE_inline__ static void
+SetBVHNodeBounds(_mut_ BVHNode* restrict const node, const AABB* restrict const bounds)
+{
+    node->min = bounds->min;
+    node->max = bounds->max;
+}
+
+__UE_inline__ static void
+GetBVHNodeBounds(const BVHNode* restrict const node, _mut_ AABB* restrict const bounds)
+{
+    bounds->min = node->min;
+    bounds->max = node->max;
+}
+
+// Bounds are stored per slot of BVH::indices and move with their index
+__UE_inline__ static void
+SwapBVHSlots(_mut_ BVH* restrict const bvh, const u32 slot_a, const u32 slot_b)
+{
+    const u32  swap_index         = bvh->indices[slot_a];
+    const AABB swap_bounds        = bvh->primitive_bounds[slot_a];
+    bvh->indices[slot_a]          = bvh->indices[slot_b];
+    bvh->primitive_bounds[slot_a] = bvh->primitive_bounds[slot_b];
+    bvh->indices[slot_b]          = swap_index;
+    bvh->primitive_bounds[slot_b] = swap_bounds;
+}
+
+// Partition [ first_index, first_index + index_count ) with binned SAH.
+// Returns the number of primitives placed in the left half.
+static u32
+PartitionBVHNodeSAH(_mut_ BVH* restrict const bvh, const u32 first_index, const u32 index_count)
+{
+    AABB centroid_bounds = { 0 };
+    AABBSetEmpty(&centroid_bounds);
+    for (u32 index = first_index; index < (first_index + index_count); index++)
+    {
+        const AABB* primitive_bounds = &bvh->primitive_bounds[index];
+
+        v3 centroid = { 0 };
+        v3Set(&centroid, AABBCentroid(primitive_bounds, 0), AABBCentroid(primitive_bounds, 1), AABBCentroid(primitive_bounds, 2));
+        AABBGrowPoint(&centroid_bounds, &centroid);
+    }
+
+    r32 best_cost  = FLT_MAX;
+    u8  best_axis  = 0;
+    u32 best_split = 0;
+    for (u8 axis = 0; axis < 3; axis++)
+    {
+        const r32 extent = centroid_bounds.max.arr[axis] - centroid_bounds.min.arr[axis];
+        if (extent <= 0.0f)
+        {
+            continue;
+        }
+
+        AABB bin_bounds[__UE_BVH__bin_count];
+        u32  bin_counts[__UE_BVH__bin_count] = { 0 };
+        for (u32 bin = 0; bin < __UE_BVH__bin_count; bin++)
+        {
+            AABBSetEmpty(&bin_bounds[bin]);
+        }
+
+        const r32 bin_scale = ( r32 )__UE_BVH__bin_count / extent;
+        for (u32 index = first_index; index < (first_index + index_count); index++)
+        {
+            const AABB* primitive_bounds = &bvh->primitive_bounds[index];
+            u32         bin              = ( u32 )((AABBCentroid(primitive_bounds, axis) - centroid_bounds.min.arr[axis]) * bin_scale);
+            bin                          = bin < __UE_BVH__bin_count ? bin : __UE_BVH__bin_count - 1;
+
+            AABBGrow(&bin_bounds[bin], primitive_bounds);
+            bin_counts[bin]++;
+        }
+
+        // Sweep from the right, then evaluate every split from the left
+        r32  right_cost[__UE_BVH__bin_count] = { 0 };
+        AABB running_bounds                  = { 0 };
+        u32  running_count                   = 0;
+        AABBSetEmpty(&running_bounds);
+        for (u32 bin = __UE_BVH__bin_count - 1; bin > 0; bin--)
+        {
+            AABBGrow(&running_bounds, &bin_bounds[bin]);
+            running_count += bin_counts[bin];
+            right_cost[bin] = AABBSurfaceArea(&running_bounds) * ( r32 )running_count;
+        }
+
+        AABBSetEmpty(&running_bounds);
+        running_count = 0;
+        for (u32 split = 1; split < __UE_BVH__bin_count; split++)
+        {
+            AABBGrow(&running_bounds, &bin_bounds[split - 1]);
+            running_count += bin_counts[split - 1];
+
+            const r32 cost = (AABBSurfaceArea(&running_bounds) * ( r32 )running_count) + right_cost[split];
+            if (running_count && running_count < index_count && cost < best_cost)
+            {
+                best_cost  = cost;
+                best_axis  = axis;
+                best_split = split;
+            }
+        }
+    }
+
+    // Coincident centroids; any split is as good as another
+    if (best_cost == FLT_MAX)
+    {
+        return index_count / 2;
+    }
+
+    const r32 extent    = centroid_bounds.max.arr[best_axis] - centroid_bounds.min.arr[best_axis];
+    const r32 bin_scale = ( r32 )__UE_BVH__bin_count / extent;
+
+    u32 left  = first_index;
+    u32 right = first_index + index_count;
+    while (left < right)
+    {
+        const AABB* primitive_bounds = &bvh->primitive_bounds[left];
+        u32         bin              = ( u32 )((AABBCentroid(primitive_bounds, best_axis) - centroid_bounds.min.arr[best_axis]) * bin_scale);
+        bin                          = bin < __UE_BVH__bin_count ? bin : __UE_BVH__bin_count - 1;
+
+        if (bin < best_split)
+        {
+            left++;
+        }
+        else
+        {
+            SwapBVHSlots(bvh, left, --right);
+        }
+    }
+
+    return left - first_index;
+}
+
+// Partition [ first_index, first_index + index_count ) at the object median
+// along the widest centroid axis. Returns the number of primitives placed in
+// the left half.
+static u32
+PartitionBVHNodeMedian(_mut_ BVH* restrict const bvh, const u32 first_index, const u32 index_count)
+{
+    AABB centroid_bounds = { 0 };
+    AABBSetEmpty(&centroid_bounds);
+    for (u32 index = first_index; index < (first_index + index_count); index++)
+    {
+        const AABB* primitive_bounds = &bvh->primitive_bounds[index];
+
+        v3 centroid = { 0 };
+        v3Set(&centroid, AABBCentroid(primitive_bounds, 0), AABBCentroid(primitive_bounds, 1), AABBCentroid(primitive_bounds, 2));
+        AABBGrowPoint(&centroid_bounds, &centroid);
+    }
+
+    u8 axis = 0;
+    for (u8 candidate = 1; candidate < 3; candidate++)
+    {
+        const r32 extent = centroid_bounds.max.arr[candidate] - centroid_bounds.min.arr[candidate];
+        axis             = extent > (centroid_bounds.max.arr[axis] - centroid_bounds.min.arr[axis]) ? candidate : axis;
+    }
+
+    // Quickselect with a three-way partition, so that runs of coincident
+    // centroids do not degrade it
+    const u32 median = first_index + (index_count / 2);
+    u32       lo     = first_index;
+    u32       hi     = first_index + index_count;
+    while ((hi - lo) > 1)
+    {
+        const r32 pivot   = AABBCentroid(&bvh->primitive_bounds[lo + ((hi - lo) / 2)], axis);
+        u32       less    = lo;
+        u32       slot    = lo;
+        u32       greater = hi;
+        while (slot < greater)
+        {
+            const r32 centroid = AABBCentroid(&bvh->primitive_bounds[slot], axis);
+            if (centroid < pivot)
+            {
+                SwapBVHSlots(bvh, slot++, less++);
+            }
+            else if (centroid > pivot)
+            {
+                SwapBVHSlots(bvh, slot, --greater);
+            }
+            else
+            {
+                slot++;
+            }
+        }
+
+        if (median < less)
+        {
+            hi = less;
+        }
+        else if (median >= greater)
+        {
+            lo = greater;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    return index_count / 2;
+}
+
+// Build the subtree rooted at node_index, at the given depth, over the given
+// index range. Returns the subtree's SAH cost, in units of surface area.
+static r32
+BuildBVHSubtree(_mut_ BVH* restrict const bvh, const u32 node_index, const u32 first_index, const u32 index_count, const u32 depth)
+{
+    __UE_ASSERT__(bvh);
+    __UE_ASSERT__(index_count);
+    __UE_ASSERT__((node_index + (2 * index_count) - 1) <= bvh->node_capacity);
+
+    BVHNode* node    = &bvh->nodes[node_index];
+    node->first_index = first_index;
+    node->index_count = index_count;
+    node->left_count  = 0;
+
+    AABB bounds = { 0 };
+    AABBSetEmpty(&bounds);
+    for (u32 index = first_index; index < (first_index + index_count); index++)
+    {
+        AABBGrow(&bounds, &bvh->primitive_bounds[index]);
+    }
+    SetBVHNodeBounds(node, &bounds);
+
+    const r32 area = AABBSurfaceArea(&bounds);
+    if (index_count <= bvh->max_leaf_size)
+    {
+        return area * ( r32 )index_count;
+    }
+
+    const u32 left_count = (depth < BVH_MEDIAN_SPLIT_DEPTH) ? PartitionBVHNodeSAH(bvh, first_index, index_count) : PartitionBVHNodeMedian(bvh, first_index, index_count);
+    node->left_count     = left_count;
+
+    const r32 left_cost  = BuildBVHSubtree(bvh, node_index + 1, first_index, left_count, depth + 1);
+    const r32 right_cost = BuildBVHSubtree(bvh, node_index + (2 * left_count), first_index + left_count, index_count - left_count, depth + 1);
+
+    return (area * ( r32 )__UE_BVH__traversal_cost) + left_cost + right_cost;
+}
+
+// Refit the subtree rooted at node_index from the primitive bounds cache.
+// Returns the subtree's SAH cost, in units of surface area.
+static r32
+RefitBVHSubtree(_mut_ BVH* restrict const bvh, const u32 node_index)
+{
+    BVHNode* node   = &bvh->nodes[node_index];
+    AABB     bounds = { 0 };
+
+    if (!node->left_count)
+    {
+        AABBSetEmpty(&bounds);
+        for (u32 index = node->first_index; index < (node->first_index + node->index_count); index++)
+        {
+            AABBGrow(&bounds, &bvh->primitive_bounds[index]);
+        }
+        SetBVHNodeBounds(node, &bounds);
+
+        return AABBSurfaceArea(&bounds) * ( r32 )node->index_count;
+    }
+
+    const u32 left_index  = node_index + 1;
+    const u32 right_index = node_index + (2 * node->left_count);
+    const r32 child_cost  = RefitBVHSubtree(bvh, left_index) + RefitBVHSubtree(bvh, right_index);
+
+    AABB right_bounds = { 0 };
+    GetBVHNodeBounds(&bvh->nodes[left_index], &bounds);
+    GetBVHNodeBounds(&bvh->nodes[right_index], &right_bounds);
+    AABBGrow(&bounds, &right_bounds);
+    SetBVHNodeBounds(node, &bounds);
+
+    return (AABBSurfaceArea(&bounds) * ( r32 )__UE_BVH__traversal_cost) + child_cost;
+}
+
+__UE_inline__ static r32
+NormalizeBVHCost(const BVH* restrict const bvh, const u32 node_index, const r32 cost)
+{
+    AABB bounds = { 0 };
+    GetBVHNodeBounds(&bvh->nodes[node_index], &bounds);
+
+    const r32 area = AABBSurfaceArea(&bounds);
+    return area > 0.0f ? (cost / area) : 0.0f;
+}
+
+// Build (is_refit == false) or refit the levels above the parallel subtrees.
+// Subtree roots are recorded during a build; their costs are read from
+// subtree_cost. Returns the SAH cost of the whole tree, in units of surface
+// area.
+static r32
+UpdateBVHTopLevels(_mut_ BVH* restrict const bvh, const u32 node_index, const u32 first_index, const u32 index_count, const u32 depth, const bool is_refit)
+{
+    BVHNode* node = &bvh->nodes[node_index];
+
+    const bool is_subtree_root = (depth == bvh->subtree_depth) || (index_count <= bvh->max_leaf_size);
+    if (is_subtree_root)
+    {
+        size_t subtree_index = 0;
+        if (is_refit)
+        {
+            while (bvh->subtree_roots[subtree_index] != node_index)
+            {
+                subtree_index++;
+            }
+        }
+        else
+        {
+            subtree_index                     = bvh->subtree_count++;
+            bvh->subtree_roots[subtree_index] = node_index;
+            node->first_index                 = first_index;
+            node->index_count                 = index_count;
+        }
+
+        AABB bounds = { 0 };
+        GetBVHNodeBounds(node, &bounds);
+        return bvh->subtree_build_cost[subtree_index] * AABBSurfaceArea(&bounds);
+    }
+
+    AABB bounds = { 0 };
+    if (!is_refit)
+    {
+        node->first_index = first_index;
+        node->index_count = index_count;
+        node->left_count  = PartitionBVHNodeSAH(bvh, first_index, index_count);
+
+        AABBSetEmpty(&bounds);
+        for (u32 index = first_index; index < (first_index + index_count); index++)
+        {
+            AABBGrow(&bounds, &bvh->primitive_bounds[index]);
+        }
+        SetBVHNodeBounds(node, &bounds);
+    }
+
+    const u32 left_count = node->left_count;
+    const r32 left_cost  = UpdateBVHTopLevels(bvh, node_index + 1, first_index, left_count, depth + 1, is_refit);
+    const r32 right_cost = UpdateBVHTopLevels(bvh, node_index + (2 * left_count), first_index + left_count, index_count - left_count, depth + 1, is_refit);
+
+    if (is_refit)
+    {
+        AABB right_bounds = { 0 };
+        GetBVHNodeBounds(&bvh->nodes[node_index + 1], &bounds);
+        GetBVHNodeBounds(&bvh->nodes[node_index + (2 * left_count)], &right_bounds);
+        AABBGrow(&bounds, &right_bounds);
+        SetBVHNodeBounds(node, &bounds);
+    }
+
+    return (AABBSurfaceArea(&bounds) * ( r32 )__UE_BVH__traversal_cost) + left_cost + right_cost;
+}
+
+typedef struct
+{
+    BVH*                       bvh;
+    GetPrimitiveBoundsFunction get_bounds;
+    const void*                primitives;
+    bool                       is_refit;
+} BVHTaskContext;
+
+static void
+RunBVHSubtreeTask(void* context, size_t task_index, size_t thread_index)
+{
+    ( void )thread_index;
+
+    const BVHTaskContext* task = ( const BVHTaskContext* )context;
+    BVH*                  bvh  = task->bvh;
+    const u32             root = bvh->subtree_roots[task_index];
+    const BVHNode*        node = &bvh->nodes[root];
+
+    // Refresh this subtree's primitive bounds; subtrees cover disjoint slot
+    // ranges, so no two tasks write the same entry.
+    for (u32 index = node->first_index; index < (node->first_index + node->index_count); index++)
+    {
+        task->get_bounds(task->primitives, bvh->indices[index], &bvh->primitive_bounds[index]);
+    }
+
+    bvh->subtree_rebuilt[task_index] = false;
+    if (task->is_refit)
+    {
+        const r32 cost = NormalizeBVHCost(bvh, root, RefitBVHSubtree(bvh, root));
+        if (cost <= (bvh->subtree_build_cost[task_index] * ( r32 )__UE_BVH__sah_rebuild_threshold))
+        {
+            return;
+        }
+
+        bvh->subtree_rebuilt[task_index] = true;
+    }
+
+    // Subtree roots sit at subtree_depth or above; assuming the deepest keeps
+    // the depth bound
+    const r32 cost                      = BuildBVHSubtree(bvh, root, node->first_index, node->index_count, bvh->subtree_depth);
+    bvh->subtree_build_cost[task_index] = NormalizeBVHCost(bvh, root, cost);
+}
+
+// Note: BuildBVH() calls this with identity indices, so slot and primitive
+//       indices coincide.
+static void
+GetPrimitiveBoundsSerial(_mut_ BVH* restrict const bvh, const GetPrimitiveBoundsFunction get_bounds, const void* primitives)
+{
+    for (u32 primitive_index = 0; primitive_index < bvh->primitive_count; primitive_index++)
+    {
+        get_bounds(primitives, primitive_index, &bvh->primitive_bounds[primitive_index]);
+    }
+}
+
+static BVH*
+CreateBVH(const size_t primitive_count, const u32 max_leaf_size)
+{
+    __UE_ASSERT__(primitive_count && primitive_count < (( size_t )1 << 31));
+    __UE_ASSERT__(max_leaf_size);
+
+    BVH* bvh = ( BVH* )calloc(1, sizeof(BVH));
+    __UE_ASSERT__(bvh);
+
+    bvh->primitive_count  = primitive_count;
+    bvh->node_capacity    = (2 * primitive_count) - 1;
+    bvh->max_leaf_size    = max_leaf_size;
+    bvh->nodes            = ( BVHNode* )calloc(bvh->node_capacity, sizeof(BVHNode));
+    bvh->indices          = ( u32* )calloc(primitive_count, sizeof(u32));
+    bvh->primitive_bounds = ( AABB* )calloc(primitive_count, sizeof(AABB));
+    __UE_ASSERT__(bvh->nodes && bvh->indices && bvh->primitive_bounds);
+
+    return bvh;
+}
+
+static void
+DestroyBVH(_mut_ BVH* restrict const bvh)
+{
+    if (!bvh)
+    {
+        return;
+    }
+
+    free(bvh->nodes);
+    free(bvh->indices);
+    free(bvh->primitive_bounds);
+    free(bvh->subtree_roots);
+    free(bvh->subtree_build_cost);
+    free(bvh->subtree_rebuilt);
+    free(bvh);
+}
+
+// Full build. The top levels are built serially; the subtrees below them are
+// built in parallel on the pool.
+static void
+BuildBVH(_mut_ BVH* restrict const bvh, const GetPrimitiveBoundsFunction get_bounds, const void* primitives, ThreadPool* const pool)
+{
+    __UE_ASSERT__(bvh && get_bounds && primitives);
+
+    // Aim for several subtrees per thread so that uneven subtrees balance out
+    u32 subtree_depth = 0;
+    while ((( size_t )1 << subtree_depth) < (4 * GetThreadPoolWidth(pool)))
+    {
+        subtree_depth++;
+    }
+
+    const size_t max_subtree_count = ( size_t )1 << subtree_depth;
+    if (!bvh->subtree_roots || bvh->subtree_depth != subtree_depth)
+    {
+        free(bvh->subtree_roots);
+        free(bvh->subtree_build_cost);
+        free(bvh->subtree_rebuilt);
+
+        bvh->subtree_roots      = ( u32* )calloc(max_subtree_count, sizeof(u32));
+        bvh->subtree_build_cost = ( r32* )calloc(max_subtree_count, sizeof(r32));
+        bvh->subtree_rebuilt    = ( u8* )calloc(max_subtree_count, sizeof(u8));
+        __UE_ASSERT__(bvh->subtree_roots && bvh->subtree_build_cost && bvh->subtree_rebuilt);
+    }
+    __UE_ASSERT__(subtree_depth < BVH_MEDIAN_SPLIT_DEPTH);
+    bvh->subtree_depth = subtree_depth;
+    bvh->subtree_count = 0;
+
+    for (u32 primitive_index = 0; primitive_index < bvh->primitive_count; primitive_index++)
+    {
+        bvh->indices[primitive_index] = primitive_index;
+    }
+
+    GetPrimitiveBoundsSerial(bvh, get_bounds, primitives);
+    UpdateBVHTopLevels(bvh, 0, 0, ( u32 )bvh->primitive_count, 0, false);
+
+    BVHTaskContext context = { bvh, get_bounds, primitives, false };
+    ParallelFor(pool, bvh->subtree_count, RunBVHSubtreeTask, &context);
+
+    // Top level bounds now that every subtree has bounds
+    bvh->build_cost = NormalizeBVHCost(bvh, 0, UpdateBVHTopLevels(bvh, 0, 0, ( u32 )bvh->primitive_count, 0, true));
+}
+
+// Per-frame update for moving primitives. Primitive count must not change.
+static BVHUpdateStats
+UpdateBVH(_mut_ BVH* restrict const bvh, const GetPrimitiveBoundsFunction get_bounds, const void* primitives, ThreadPool* const pool)
+{
+    __UE_ASSERT__(bvh && get_bounds && primitives);
+    __UE_ASSERT__(bvh->subtree_count);
+
+    BVHUpdateStats stats = { 0 };
+
+    BVHTaskContext context = { bvh, get_bounds, primitives, true };
+    ParallelFor(pool, bvh->subtree_count, RunBVHSubtreeTask, &context);
+
+    for (size_t subtree_index = 0; subtree_index < bvh->subtree_count; subtree_index++)
+    {
+        stats.rebuilt_subtrees += bvh->subtree_rebuilt[subtree_index];
+    }
+
+    stats.sah_cost = NormalizeBVHCost(bvh, 0, UpdateBVHTopLevels(bvh, 0, 0, ( u32 )bvh->primitive_count, 0, true));
+    if (stats.sah_cost > (bvh->build_cost * ( r32 )__UE_BVH__sah_rebuild_threshold))
+    {
+        BuildBVH(bvh, get_bounds, primitives, pool);
+
+        stats.full_rebuild = true;
+        stats.sah_cost     = bvh->build_cost;
+    }
+
+    return stats;
+}
+
+// Note: slots of the reserved layout that are not reachable from the root
+//       hold stale data; walk the tree rather than scanning the node array.
+static size_t
+CountBVHLeaves(const BVH* restrict const bvh)
+{
+    __UE_ASSERT__(bvh);
+
+    size_t leaf_count = 0;
+    u32    stack[BVH_STACK_SIZE];
+    u32    stack_size   = 0;
+    stack[stack_size++] = 0;
+    while (stack_size)
+    {
+        const u32      node_index = stack[--stack_size];
+        const BVHNode* node       = &bvh->nodes[node_index];
+        if (!node->left_count)
+        {
+            leaf_count++;
+            continue;
+        }
+
+        __UE_ASSERT__((stack_size + 2) <= (sizeof(stack) / sizeof(stack[0])));
+        stack[stack_size++] = node_index + (2 * node->left_count);
+        stack[stack_size++] = node_index + 1;
+    }
+
+    return leaf_count;
+}
+
+//
+// Entities
+//
+static void
+GetEntityBounds(const void* primitives, const u32 primitive_index, _mut_ AABB* const bounds)
+{
+    const Entity* entity = &(( const Entity* )primitives)[primitive_index];
+    __UE_ASSERT__(entity->type != ET_TRIANGLE_MESH);
+
+    const r32 extent = (entity->type == ET_CUBE) ? (0.5f * entity->length) : entity->radius;
+    v3Set(&bounds->min, entity->position.x - extent, entity->position.y - extent, entity->position.z - extent);
+    v3Set(&bounds->max, entity->position.x + extent, entity->position.y + extent, entity->position.z + extent);
+}
+
+static BVH*
+CreateEntityBVH(const Entity* restrict const entity_arr, const size_t num_entitys, ThreadPool* const pool)
+{
+    __UE_ASSERT__(entity_arr);
+
+    BVH* bvh = CreateBVH(num_entitys, __UE_BVH__max_leaf_size);
+    BuildBVH(bvh, GetEntityBounds, entity_arr, pool);
+    return bvh;
+}
+
+__UE_inline__ static BVHUpdateStats
+UpdateEntityBVH(_mut_ BVH* restrict const bvh, const Entity* restrict const entity_arr, ThreadPool* const pool)
+{
+    return UpdateBVH(bvh, GetEntityBounds, entity_arr, pool);
+}
+
+// Closest hit among the entities of a BVH within [ 0, max_magnitude ).
+// Returns false, leaving 'closest_intersection' and 'closest_entity_index'
+// untouched, if nothing is hit.
+static bool
+IntersectEntityBVH(const Ray* restrict const ray,
+                   const BVH* restrict const              bvh,
+                   const Entity* restrict const           entity_arr,
+                   const r32                              max_magnitude,
+                   _mut_ RayIntersection* restrict const  closest_intersection,
+                   _mut_ u32* restrict const              closest_entity_index)
+{
+    __UE_ASSERT__(ray && bvh && entity_arr);
+    __UE_ASSERT__(closest_intersection && closest_entity_index);
+    __UE_STAT__(rays, 1);
+
+    v3 inverse_direction = { 0 };
+    GetInverseDirection(&ray->direction, &inverse_direction);
+
+    r32  closest_magnitude = max_magnitude;
+    bool does_intersect    = false;
+
+    // Nodes are pushed with their entry magnitude so that subtrees beyond a
+    // closer hit found in the meantime can be skipped on pop
+    u32 stack[BVH_STACK_SIZE];
+    r32 stack_near[BVH_STACK_SIZE];
+    u32 stack_size = 0;
+
+    const r32 root_near = IntersectAABB(&ray->origin, &inverse_direction, &bvh->nodes[0].min, &bvh->nodes[0].max, closest_magnitude);
+    if (root_near != FLT_MAX)
+    {
+        stack[stack_size]      = 0;
+        stack_near[stack_size] = root_near;
+        stack_size++;
+    }
+
+    while (stack_size)
+    {
+        stack_size--;
+        if (stack_near[stack_size] >= closest_magnitude)
+        {
+            continue;
+        }
+
+        const u32      node_index = stack[stack_size];
+        const BVHNode* node       = &bvh->nodes[node_index];
+        if (!node->left_count)
+        {
+            for (u32 index = node->first_index; index < (node->first_index + node->index_count); index++)
+            {
+                const u32 entity_index = bvh->indices[index];
+
+                RayIntersection candidate = { 0 };
+                IntersectEntity(ray, &entity_arr[entity_index], &candidate);
+                if (candidate.does_intersect && candidate.magnitude >= 0.0f && candidate.magnitude < closest_magnitude)
+                {
+                    *closest_intersection = candidate;
+                    *closest_entity_index = entity_index;
+                    closest_magnitude     = candidate.magnitude;
+                    does_intersect        = true;
+                }
+            }
+
+            continue;
+        }
+
+        // Push the farther child first so that the nearer child is visited first
+        u32 near_index = node_index + 1;
+        u32 far_index  = node_index + (2 * node->left_count);
+        r32 near_entry = IntersectAABB(&ray->origin, &inverse_direction, &bvh->nodes[near_index].min, &bvh->nodes[near_index].max, closest_magnitude);
+        r32 far_entry  = IntersectAABB(&ray->origin, &inverse_direction, &bvh->nodes[far_index].min, &bvh->nodes[far_index].max, closest_magnitude);
+        if (far_entry < near_entry)
+        {
+            const u32 swap_index = near_index;
+            const r32 swap_entry = near_entry;
+            near_index           = far_index;
+            near_entry           = far_entry;
+            far_index            = swap_index;
+            far_entry            = swap_entry;
+        }
+
+        __UE_ASSERT__((stack_size + 2) <= (sizeof(stack) / sizeof(stack[0])));
+        if (far_entry != FLT_MAX)
+        {
+            stack[stack_size]      = far_index;
+            stack_near[stack_size] = far_entry;
+            stack_size++;
+        }
+        if (near_entry != FLT_MAX)
+        {
+            stack[stack_size]      = near_index;
+            stack_near[stack_size] = near_entry;
+            stack_size++;
+        }
+    }
+
+    return does_intersect;
+}
+
+// Closest-hit query; the BVH counterpart of TraceEntityArray(). Hits behind
+// the ray origin are ignored.
+// Note: secondary rays are not spawned (see: ReflectRays()).
+__UE_inline__ static void
+TraceEntityBVH(const Ray* restrict const ray,
+               _mut_ RayIntersection* restrict const intersection,
+               _mut_ r32* restrict const global_magnitude_threshold,
+               _mut_ Color32_RGB* restrict const return_color,
+               const BVH* restrict const         bvh,
+               const Entity* restrict const      entity_arr)
+{
+    __UE_ASSERT__(ray);
+    __UE_ASSERT__(intersection);
+    __UE_ASSERT__(global_magnitude_threshold);
+    __UE_ASSERT__(return_color);
+    __UE_ASSERT__(bvh && entity_arr);
+
+    const r32 max_magnitude = ( r32 )fmin(MAX_RAY_MAG, fabs(*global_magnitude_threshold));
+
+    RayIntersection closest_intersection = { 0 };
+    u32             closest_entity_index = ENTITY_INDEX_NONE;
+    const bool      does_intersect       = IntersectEntityBVH(ray, bvh, entity_arr, max_magnitude, &closest_intersection, &closest_entity_index);
+
+    *intersection                = closest_intersection;
+    intersection->does_intersect = does_intersect;
+    intersection->entity_index   = closest_entity_index;
+    if (does_intersect)
+    {
+        return_color->value = entity_arr[closest_entity_index].material.color.value;
+    }
+}
+
+// Any-hit counterpart of TraceEntityBVH(); children are visited in storage
+// order and the first occluder ends the traversal.
+static bool
+OccludedEntityBVH(const Ray* restrict const ray, const r32 max_magnitude, const BVH* restrict const bvh, const Entity* restrict const entity_arr)
+{
+    __UE_ASSERT__(ray && bvh && entity_arr);
+    __UE_STAT__(rays, 1);
+
+    v3 inverse_direction = { 0 };
+    GetInverseDirection(&ray->direction, &inverse_direction);
+
+    u32 stack[BVH_STACK_SIZE];
+    u32 stack_size      = 0;
+    stack[stack_size++] = 0;
+    while (stack_size)
+    {
+        const u32      node_index = stack[--stack_size];
+        const BVHNode* node       = &bvh->nodes[node_index];
+        if (IntersectAABB(&ray->origin, &inverse_direction, &node->min, &node->max, max_magnitude) == FLT_MAX)
+        {
+            continue;
+        }
+
+        if (!node->left_count)
+        {
+            for (u32 index = node->first_index; index < (node->first_index + node->index_count); index++)
+            {
+                if (IsRayOccludedByEntity(ray, &entity_arr[bvh->indices[index]], max_magnitude))
+                {
+                    return true;
+                }
+            }
+
+            continue;
+        }
+
+        __UE_ASSERT__((stack_size + 2) <= (sizeof(stack) / sizeof(stack[0])));
+        stack[stack_size++] = node_index + (2 * node->left_count);
+        stack[stack_size++] = node_index + 1;
+    }
+
+    return false;
+}
+
+#endif // __UE_BVH_TOOLS_H___
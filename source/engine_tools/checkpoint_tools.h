@@ -0,0 +1,512 @@
+#ifndef __UE_CHECKPOINT_TOOLS_H___
+#define __UE_CHECKPOINT_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <accumulation_tools.h>
+#include <clock_tools.h>
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <type_tools.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#if _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+//
+// Progressive render checkpoints
+//
+// The state of an AccumulationBuffer is snapshotted into a memory-mapped
+// file so that a long render can resume after the process dies:
+//
+//   [ CheckpointHeader ][ slot 0 ][ slot 1 ]
+//
+// A slot holds the summed samples, the Welford luminance terms, the per-pixel
+// sample counts and the converged tiles of one pass boundary. The sampler is
+// a pure function of (pixel, sample index) (see: BeginPixelSample()), so the
+// sample counts are also the position of every pixel's sample stream and a
+// resumed render continues bit-identically.
+//
+// RequestCheckpoint() is called between passes. Once per interval it copies
+// the buffer into a staging area, which costs a memcpy, and hands it to a
+// writer thread; if the previous snapshot is still being written the request
+// is skipped rather than waited on. The writer fills the older slot, flushes
+// it, and only then publishes it in the header with a sequence number and a
+// checksum. A crash at any point leaves at least one complete slot.
+//
+// The header records the image, the progressive settings and a hash of the
+// scene; a file written for anything else is ignored by
+// ResumeFromCheckpoint() and overwritten.
+//
+
+#define CHECKPOINT_MAGIC   0x54504B43 // "CKPT"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_SLOTS   2
+#define CHECKPOINT_ALIGN   4096
+
+typedef struct
+{
+    u64 sequence; // 0 marks an empty slot
+    u64 checksum; // Of the slot's payload
+    u64 pass_count;
+    u64 converged_tile_count;
+} CheckpointSlot;
+
+typedef struct
+{
+    u32 magic;
+    u32 version;
+    u64 file_size;
+    u64 image_width;
+    u64 image_height;
+    u64 tile_size;
+    u64 scene_hash; // See: GetCheckpointSceneHash()
+    u32 min_samples;
+    u32 max_samples;
+    r32 convergence_threshold;
+    u32 reserved;
+    u64 slot_offset; // Slot n starts at slot_offset + (n * slot_size)
+    u64 slot_size;
+
+    CheckpointSlot slot_arr[CHECKPOINT_SLOTS];
+} CheckpointHeader;
+
+typedef struct
+{
+    u8*               base;
+    CheckpointHeader* header;
+    size_t            file_size;
+    size_t            payload_size;
+#if _WIN32
+    HANDLE file_handle;
+    HANDLE mapping_handle;
+#else
+    int file_descriptor;
+#endif // _WIN32
+
+    // Snapshot handed to the writer
+    u8* staging;
+    u64 staged_pass_count;
+    u64 staged_converged_tile_count;
+    r64 last_snapshot_seconds;
+    r64 interval_seconds;
+
+    std::thread             writer;
+    std::mutex              mutex;
+    std::condition_variable wake_writer;
+    std::condition_variable write_complete;
+
+    u64  sequence;          // Guarded by mutex; newest slot published
+    u32  snapshots_written; // Guarded by mutex
+    bool pending;           // Guarded by mutex
+    bool shutdown;          // Guarded by mutex
+} Checkpoint;
+
+// 64-bit multiply-xorshift over 8-byte words; not cryptographic.
+static u64
+HashCheckpointBytes(const void* restrict const data, const size_t size, u64 hash)
+{
+    __UE_ASSERT__(data || !size);
+
+    const u8* bytes      = ( const u8* )data;
+    size_t    byte_index = 0;
+    for (; (byte_index + sizeof(u64)) <= size; byte_index += sizeof(u64))
+    {
+        u64 word = 0;
+        memcpy(&word, bytes + byte_index, sizeof(u64));
+        hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+        hash ^= hash >> 29;
+    }
+
+    for (; byte_index < size; byte_index++)
+    {
+        hash = (hash ^ bytes[byte_index]) * 0x100000001B3ull;
+    }
+
+    return hash ^ (hash >> 32);
+}
+
+// Note: hashes the entities byte for byte; entities should come from
+//       zeroed memory so that padding does not change the hash.
+__UE_inline__ static u64
+GetCheckpointSceneHash(const Entity* restrict const entity_arr, const size_t num_entitys)
+{
+    __UE_ASSERT__(entity_arr);
+    return HashCheckpointBytes(entity_arr, num_entitys * sizeof(Entity), 0xCBF29CE484222325ull ^ num_entitys);
+}
+
+//
+// Slot layout
+//
+__UE_inline__ static size_t
+AlignCheckpointOffset(const size_t offset, const size_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+typedef struct
+{
+    size_t color_sum;
+    size_t luminance_mean;
+    size_t luminance_m2;
+    size_t sample_count;
+    size_t tile_converged;
+    size_t size;
+} CheckpointPayloadLayout;
+
+static CheckpointPayloadLayout
+GetCheckpointPayloadLayout(const AccumulationBuffer* restrict const buffer)
+{
+    __UE_ASSERT__(buffer);
+
+    const size_t pixel_count = buffer->image_width * buffer->image_height;
+
+    CheckpointPayloadLayout layout = { 0 };
+    layout.color_sum               = 0;
+    layout.luminance_mean          = AlignCheckpointOffset(layout.color_sum + (pixel_count * sizeof(v3)), 8);
+    layout.luminance_m2            = AlignCheckpointOffset(layout.luminance_mean + (pixel_count * sizeof(r32)), 8);
+    layout.sample_count            = AlignCheckpointOffset(layout.luminance_m2 + (pixel_count * sizeof(r32)), 8);
+    layout.tile_converged          = AlignCheckpointOffset(layout.sample_count + (pixel_count * sizeof(u32)), 8);
+    layout.size                    = AlignCheckpointOffset(layout.tile_converged + (buffer->tiles_x * buffer->tiles_y * sizeof(bool)), 8);
+
+    return layout;
+}
+
+static void
+CopyAccumulationToPayload(const AccumulationBuffer* restrict const buffer, _mut_ u8* restrict const payload)
+{
+    __UE_ASSERT__(buffer && payload);
+
+    const CheckpointPayloadLayout layout      = GetCheckpointPayloadLayout(buffer);
+    const size_t                  pixel_count = buffer->image_width * buffer->image_height;
+
+    memset(payload, 0, layout.size);
+    memcpy(payload + layout.color_sum, buffer->color_sum, pixel_count * sizeof(v3));
+    memcpy(payload + layout.luminance_mean, buffer->luminance_mean, pixel_count * sizeof(r32));
+    memcpy(payload + layout.luminance_m2, buffer->luminance_m2, pixel_count * sizeof(r32));
+    memcpy(payload + layout.sample_count, buffer->sample_count, pixel_count * sizeof(u32));
+    memcpy(payload + layout.tile_converged, buffer->tile_converged, buffer->tiles_x * buffer->tiles_y * sizeof(bool));
+}
+
+static void
+CopyPayloadToAccumulation(const u8* restrict const payload, _mut_ AccumulationBuffer* restrict const buffer)
+{
+    __UE_ASSERT__(payload && buffer);
+
+    const CheckpointPayloadLayout layout      = GetCheckpointPayloadLayout(buffer);
+    const size_t                  pixel_count = buffer->image_width * buffer->image_height;
+
+    memcpy(buffer->color_sum, payload + layout.color_sum, pixel_count * sizeof(v3));
+    memcpy(buffer->luminance_mean, payload + layout.luminance_mean, pixel_count * sizeof(r32));
+    memcpy(buffer->luminance_m2, payload + layout.luminance_m2, pixel_count * sizeof(r32));
+    memcpy(buffer->sample_count, payload + layout.sample_count, pixel_count * sizeof(u32));
+    memcpy(buffer->tile_converged, payload + layout.tile_converged, buffer->tiles_x * buffer->tiles_y * sizeof(bool));
+}
+
+//
+// File
+//
+
+// Write a mapped range through to the file.
+static void
+FlushCheckpointRange(const Checkpoint* restrict const checkpoint, const size_t offset, const size_t size)
+{
+    __UE_ASSERT__(checkpoint);
+    __UE_ASSERT__((offset + size) <= checkpoint->file_size);
+
+#if _WIN32
+    FlushViewOfFile(checkpoint->base + offset, size);
+    FlushFileBuffers(checkpoint->file_handle);
+#else
+    const size_t page_size   = ( size_t )sysconf(_SC_PAGESIZE);
+    const size_t page_offset = offset & ~(page_size - 1);
+    msync(checkpoint->base + page_offset, size + (offset - page_offset), MS_SYNC);
+#endif // _WIN32
+}
+
+static void
+CheckpointWriter(Checkpoint* const checkpoint)
+{
+    while (true)
+    {
+        u64 sequence = 0;
+        {
+            std::unique_lock< std::mutex > lock(checkpoint->mutex);
+            while (!checkpoint->shutdown && !checkpoint->pending)
+            {
+                checkpoint->wake_writer.wait(lock);
+            }
+
+            if (!checkpoint->pending)
+            {
+                return;
+            }
+
+            sequence = checkpoint->sequence + 1;
+        }
+
+        // The older slot; the newest one stays intact until this is published
+        CheckpointHeader* header     = checkpoint->header;
+        const u32         slot_index = ( u32 )(sequence % CHECKPOINT_SLOTS);
+        const size_t      slot_start = ( size_t )(header->slot_offset + (slot_index * header->slot_size));
+
+        memcpy(checkpoint->base + slot_start, checkpoint->staging, checkpoint->payload_size);
+        FlushCheckpointRange(checkpoint, slot_start, checkpoint->payload_size);
+
+        CheckpointSlot slot       = { 0 };
+        slot.sequence             = sequence;
+        slot.checksum             = HashCheckpointBytes(checkpoint->staging, checkpoint->payload_size, sequence);
+        slot.pass_count           = checkpoint->staged_pass_count;
+        slot.converged_tile_count = checkpoint->staged_converged_tile_count;
+        header->slot_arr[slot_index] = slot;
+        FlushCheckpointRange(checkpoint, 0, sizeof(CheckpointHeader));
+
+        {
+            std::unique_lock< std::mutex > lock(checkpoint->mutex);
+            checkpoint->sequence = sequence;
+            checkpoint->snapshots_written++;
+            checkpoint->pending = false;
+        }
+        checkpoint->write_complete.notify_all();
+    }
+}
+
+static void
+DestroyCheckpoint(_mut_ Checkpoint* restrict const checkpoint)
+{
+    if (!checkpoint)
+    {
+        return;
+    }
+
+    // A pending snapshot is written before the writer exits
+    if (checkpoint->writer.joinable())
+    {
+        {
+            std::unique_lock< std::mutex > lock(checkpoint->mutex);
+            checkpoint->shutdown = true;
+        }
+        checkpoint->wake_writer.notify_all();
+        checkpoint->writer.join();
+    }
+
+#if _WIN32
+    if (checkpoint->base)
+    {
+        UnmapViewOfFile(checkpoint->base);
+    }
+    if (checkpoint->mapping_handle)
+    {
+        CloseHandle(checkpoint->mapping_handle);
+    }
+    if (checkpoint->file_handle && checkpoint->file_handle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(checkpoint->file_handle);
+    }
+#else
+    if (checkpoint->base)
+    {
+        munmap(checkpoint->base, checkpoint->file_size);
+    }
+    if (checkpoint->file_descriptor >= 0)
+    {
+        close(checkpoint->file_descriptor);
+    }
+#endif // _WIN32
+
+    free(checkpoint->staging);
+    delete checkpoint;
+}
+
+// Open or create the checkpoint file for 'buffer' rendered with 'settings'
+// over the scene with hash 'scene_hash'. An existing file for a different
+// render is reset. Returns NULL if the file cannot be created or mapped.
+static Checkpoint*
+CreateCheckpoint(const char* const                         path,
+                 const AccumulationBuffer* restrict const  buffer,
+                 const ProgressiveSettings* restrict const settings,
+                 const u64                                 scene_hash)
+{
+    __UE_ASSERT__(path && buffer && settings);
+
+    Checkpoint* checkpoint            = new Checkpoint();
+    checkpoint->interval_seconds      = ( r64 )__UE_CK__interval_seconds;
+    checkpoint->last_snapshot_seconds = GetClockSeconds();
+
+    const CheckpointPayloadLayout layout      = GetCheckpointPayloadLayout(buffer);
+    const size_t                  slot_offset = AlignCheckpointOffset(sizeof(CheckpointHeader), CHECKPOINT_ALIGN);
+    const size_t                  slot_size   = AlignCheckpointOffset(layout.size, CHECKPOINT_ALIGN);
+    checkpoint->payload_size                  = layout.size;
+    checkpoint->file_size                     = slot_offset + (CHECKPOINT_SLOTS * slot_size);
+
+#if _WIN32
+    checkpoint->file_handle = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER file_size = { 0 };
+    file_size.QuadPart      = ( LONGLONG )checkpoint->file_size;
+    if (checkpoint->file_handle == INVALID_HANDLE_VALUE || !SetFilePointerEx(checkpoint->file_handle, file_size, NULL, FILE_BEGIN) || !SetEndOfFile(checkpoint->file_handle))
+    {
+        DestroyCheckpoint(checkpoint);
+        return NULL;
+    }
+
+    checkpoint->mapping_handle = CreateFileMappingA(checkpoint->file_handle, NULL, PAGE_READWRITE, 0, 0, NULL);
+    checkpoint->base           = checkpoint->mapping_handle ? ( u8* )MapViewOfFile(checkpoint->mapping_handle, FILE_MAP_ALL_ACCESS, 0, 0, 0) : NULL;
+    if (!checkpoint->base)
+    {
+        DestroyCheckpoint(checkpoint);
+        return NULL;
+    }
+#else
+    checkpoint->file_descriptor = open(path, O_RDWR | O_CREAT, 0644);
+    if (checkpoint->file_descriptor < 0 || ftruncate(checkpoint->file_descriptor, ( off_t )checkpoint->file_size) != 0)
+    {
+        DestroyCheckpoint(checkpoint);
+        return NULL;
+    }
+
+    void* base = mmap(NULL, checkpoint->file_size, PROT_READ | PROT_WRITE, MAP_SHARED, checkpoint->file_descriptor, 0);
+    if (base == MAP_FAILED)
+    {
+        DestroyCheckpoint(checkpoint);
+        return NULL;
+    }
+
+    checkpoint->base = ( u8* )base;
+#endif // _WIN32
+
+    checkpoint->staging = ( u8* )calloc(1, layout.size);
+    checkpoint->header  = ( CheckpointHeader* )checkpoint->base;
+    __UE_ASSERT__(checkpoint->staging);
+
+    CheckpointHeader expected_header      = { 0 };
+    expected_header.magic                 = CHECKPOINT_MAGIC;
+    expected_header.version               = CHECKPOINT_VERSION;
+    expected_header.file_size             = checkpoint->file_size;
+    expected_header.image_width           = buffer->image_width;
+    expected_header.image_height          = buffer->image_height;
+    expected_header.tile_size             = buffer->tile_size;
+    expected_header.scene_hash            = scene_hash;
+    expected_header.min_samples           = settings->min_samples;
+    expected_header.max_samples           = settings->max_samples;
+    expected_header.convergence_threshold = settings->convergence_threshold;
+    expected_header.slot_offset           = slot_offset;
+    expected_header.slot_size             = slot_size;
+
+    // Everything but the slots must match for the file to be resumed
+    if (memcmp(checkpoint->header, &expected_header, offsetof(CheckpointHeader, slot_arr)) != 0)
+    {
+        *checkpoint->header = expected_header;
+        FlushCheckpointRange(checkpoint, 0, sizeof(CheckpointHeader));
+    }
+
+    for (u32 slot_index = 0; slot_index < CHECKPOINT_SLOTS; slot_index++)
+    {
+        checkpoint->sequence = checkpoint->header->slot_arr[slot_index].sequence > checkpoint->sequence ? checkpoint->header->slot_arr[slot_index].sequence : checkpoint->sequence;
+    }
+
+    checkpoint->writer = std::thread(CheckpointWriter, checkpoint);
+    return checkpoint;
+}
+
+// Restore the newest complete snapshot into 'buffer'. Returns false, leaving
+// 'buffer' untouched, if the file holds none.
+static bool
+ResumeFromCheckpoint(const Checkpoint* restrict const checkpoint, _mut_ AccumulationBuffer* restrict const buffer)
+{
+    __UE_ASSERT__(checkpoint && buffer);
+    __UE_ASSERT__(buffer->image_width == checkpoint->header->image_width && buffer->image_height == checkpoint->header->image_height);
+    __UE_ASSERT__(buffer->tile_size == checkpoint->header->tile_size);
+
+    const CheckpointHeader* header      = checkpoint->header;
+    const CheckpointSlot*   newest_slot = NULL;
+    const u8*               payload     = NULL;
+    for (u32 slot_index = 0; slot_index < CHECKPOINT_SLOTS; slot_index++)
+    {
+        const CheckpointSlot* slot         = &header->slot_arr[slot_index];
+        const u8*             slot_payload = checkpoint->base + header->slot_offset + (slot_index * header->slot_size);
+        if (!slot->sequence || (newest_slot && slot->sequence < newest_slot->sequence))
+        {
+            continue;
+        }
+
+        if (HashCheckpointBytes(slot_payload, checkpoint->payload_size, slot->sequence) == slot->checksum)
+        {
+            newest_slot = slot;
+            payload     = slot_payload;
+        }
+    }
+
+    if (!newest_slot)
+    {
+        return false;
+    }
+
+    CopyPayloadToAccumulation(payload, buffer);
+    buffer->pass_count           = ( u32 )newest_slot->pass_count;
+    buffer->converged_tile_count = ( size_t )newest_slot->converged_tile_count;
+
+    return true;
+}
+
+// Call between passes. Stages a snapshot of 'buffer' for the writer once the
+// interval has elapsed, or always with 'force'. Returns false, without
+// waiting, if no snapshot was taken.
+static bool
+RequestCheckpoint(_mut_ Checkpoint* restrict const checkpoint, const AccumulationBuffer* restrict const buffer, const bool force)
+{
+    __UE_ASSERT__(checkpoint && buffer);
+
+    const r64 now_seconds = GetClockSeconds();
+    if (!force && (now_seconds - checkpoint->last_snapshot_seconds) < checkpoint->interval_seconds)
+    {
+        return false;
+    }
+
+    {
+        std::unique_lock< std::mutex > lock(checkpoint->mutex);
+        if (checkpoint->pending)
+        {
+            return false;
+        }
+    }
+
+    // The writer only reads the staging area while a snapshot is pending
+    CopyAccumulationToPayload(buffer, checkpoint->staging);
+    checkpoint->staged_pass_count           = buffer->pass_count;
+    checkpoint->staged_converged_tile_count = buffer->converged_tile_count;
+    checkpoint->last_snapshot_seconds       = now_seconds;
+
+    {
+        std::unique_lock< std::mutex > lock(checkpoint->mutex);
+        checkpoint->pending = true;
+    }
+    checkpoint->wake_writer.notify_one();
+
+    return true;
+}
+
+// Block until the staged snapshot, if any, is on disk.
+static void
+WaitForCheckpoint(_mut_ Checkpoint* restrict const checkpoint)
+{
+    __UE_ASSERT__(checkpoint);
+
+    std::unique_lock< std::mutex > lock(checkpoint->mutex);
+    while (checkpoint->pending)
+    {
+        checkpoint->write_complete.wait(lock);
+    }
+}
+
+#endif // __UE_CHECKPOINT_TOOLS_H___
@@ -0,0 +1,25 @@
+#ifndef __UE_CLOCK_TOOLS_H___
+#define __UE_CLOCK_TOOLS_H___
+
+#include "debug_tools.h"
+#include "macro_tools.h"
+#include "type_tools.h"
+
+#include <time.h>
+
+//
+// Wall clock
+//
+// Frame budgets, checkpoint intervals, farm launches, batch reports and the
+// benchmarks all time themselves with this clock.
+//
+
+__UE_inline__ static r64
+GetClockSeconds()
+{
+    struct timespec now = { 0 };
+    timespec_get(&now, TIME_UTC);
+    return ( r64 )now.tv_sec + (( r64 )now.tv_nsec * 1e-9);
+}
+
+#endif // __UE_CLOCK_TOOLS_H___
@@ -196,4 +196,23 @@ HSV32ToRGB32(const Color32_HSV* restrict const hsv_source, _mut_ Color32_RGB* re
     rgb_result->channel.B = ( u8 )round(NormalizeToRange(0.0f, 1.0f, 0.0f, 255.0f, rgb_b));
 }
 
+// Approximate a color's photon energy by mapping its hue onto the visible
+// spectrum: 0 (red, 700nm) through 270 (violet, 400nm).
+__UE_inline__ static void
+GetEnergyByColorRGB_eV(const Color32_RGB* restrict const color, _mut_ r64* restrict const energy_eV)
+{
+    __UE_ASSERT__(color);
+    __UE_ASSERT__(energy_eV);
+
+    const r64 joules_per_eV = 1.602176634e-19;
+
+    Color32_HSV hsv = { 0 };
+    RGB32ToHSV32(color, &hsv);
+
+    const r64 hue           = hsv.H < 270.0f ? hsv.H : 270.0f;
+    const r64 wavelength_nm = 700.0 - ((hue / 270.0) * 300.0);
+
+    *energy_eV = (_PLANK_CONST_ * _C_VACCUME_) / (wavelength_nm * 1e-9) / joules_per_eV;
+}
+
 #endif // __UE_COLOR_TOOLS_H__
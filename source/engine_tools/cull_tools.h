@@ -0,0 +1,333 @@
+#ifndef __UE_CULL_TOOLS_H___
+#define __UE_CULL_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <thread_tools.h>
+#include <type_tools.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Frustum culling
+//
+// Primary rays leave the camera origin through the image plane of
+// SetRayDirectionByPixelSample(). The rays through a rectangle of the image
+// form a pyramid bounded by four planes through the origin, a Frustum.
+//
+// An EntityCullGrid is rebuilt once per frame:
+//    1. The image frustum culls the entity array into a visible list.
+//    2. Each tile's sub-frustum culls the visible list into the tile's list,
+//       one parallel task per tile.
+// Tile lists are compact copies of the entities in their original order, so
+// a tile's primary rays are traced by TraceEntityArray() unchanged and find
+// the same closest hit as against the whole array.
+//
+// Culling is conservative: spheres and ET_NONE entities are tested by their
+// radius, cubes by their bounding sphere, and meshes are never culled.
+// TraceEntityArray() also accepts roots behind the ray origin. An entity is
+// therefore only culled when it lies outside both the pyramid and its mirror
+// image behind the camera.
+//
+// Note: intersection.entity_index of a culled trace indexes the tile's list;
+//       see: GetEntityCullSourceIndex().
+// Note: tile lists only apply to primary rays. Secondary rays must be traced
+//       against the whole entity array.
+// Note: a list may hold a single entity, which TraceEntityArray() does not
+//       take; trace the whole array for such a tile.
+//
+
+#define FRUSTUM_PLANE_COUNT 4
+
+typedef struct
+{
+    v3 normal_arr[FRUSTUM_PLANE_COUNT]; // Unit normals of planes through the camera origin, pointing inwards
+} Frustum;
+
+typedef struct
+{
+    Entity* visible_arr;          // Entities inside the image frustum
+    u32*    visible_source_arr;   // visible_arr index -> caller's index
+    Entity* tile_entity_arr;      // Each tile's list, tile by tile
+    u32*    tile_source_arr;      // tile_entity_arr index -> caller's index
+    u32*    tile_begin_arr;       // tile_count + 1 offsets into tile_entity_arr
+    size_t  visible_capacity;
+    size_t  tile_entity_capacity;
+    size_t  visible_count;
+
+    size_t image_width;
+    size_t image_height;
+    size_t tile_size;
+    size_t tiles_x;
+    size_t tiles_y;
+    size_t tile_count;
+} EntityCullGrid;
+
+// Frustum of the primary rays through the image rectangle [ x_min, x_max ) x
+// [ y_min, y_max ), in continuous image coordinates (see:
+// SetRayDirectionByPixelSample()).
+static void
+GetImageFrustum(const r32                    x_min,
+                const r32                    y_min,
+                const r32                    x_max,
+                const r32                    y_max,
+                const size_t                 image_width,
+                const size_t                 image_height,
+                _mut_ Frustum* restrict const frustum)
+{
+    __UE_ASSERT__(frustum);
+    __UE_ASSERT__(image_width && image_height);
+    __UE_ASSERT__(x_min < x_max && y_min < y_max);
+
+    // Corners in winding order, and the center ray
+    Ray corner_arr[FRUSTUM_PLANE_COUNT] = { 0 };
+    Ray center                          = { 0 };
+    SetRayDirectionByPixelSample(&corner_arr[0], x_min, y_min, image_width, image_height);
+    SetRayDirectionByPixelSample(&corner_arr[1], x_max, y_min, image_width, image_height);
+    SetRayDirectionByPixelSample(&corner_arr[2], x_max, y_max, image_width, image_height);
+    SetRayDirectionByPixelSample(&corner_arr[3], x_min, y_max, image_width, image_height);
+    SetRayDirectionByPixelSample(&center, 0.5f * (x_min + x_max), 0.5f * (y_min + y_max), image_width, image_height);
+
+    for (u32 plane_index = 0; plane_index < FRUSTUM_PLANE_COUNT; plane_index++)
+    {
+        v3* normal = &frustum->normal_arr[plane_index];
+        v3Cross(&corner_arr[plane_index].direction, &corner_arr[(plane_index + 1) % FRUSTUM_PLANE_COUNT].direction, normal);
+        v3Norm(normal);
+
+        if (v3Dot(normal, &center.direction) < 0.0f)
+        {
+            v3Set(normal, -normal->x, -normal->y, -normal->z);
+        }
+    }
+}
+
+// True if no ray of the frustum, forwards or backwards, can reach the sphere.
+__UE_inline__ static bool
+IsSphereCulled(const Frustum* restrict const frustum, const v3* restrict const center, const r32 radius)
+{
+    __UE_ASSERT__(frustum && center);
+
+    // Absorbs the rounding of the rays themselves
+    const r32 margin = radius + (1e-4f * v3Mag(center)) + ( r32 )TOLERANCE;
+
+    bool outside_front = false;
+    bool outside_back  = false;
+    for (u32 plane_index = 0; plane_index < FRUSTUM_PLANE_COUNT; plane_index++)
+    {
+        const r32 distance = v3Dot(&frustum->normal_arr[plane_index], center);
+        outside_front |= (distance < -margin);
+        outside_back |= (distance > margin);
+    }
+
+    return outside_front && outside_back;
+}
+
+__UE_inline__ static bool
+IsEntityCulled(const Frustum* restrict const frustum, const Entity* restrict const entity)
+{
+    __UE_ASSERT__(frustum && entity);
+
+    switch (entity->type)
+    {
+        case ET_NONE:
+        case ET_SPHERE:
+            return IsSphereCulled(frustum, &entity->position, ( r32 )fabs(entity->radius));
+        case ET_CUBE:
+            // sqrt(3) / 2
+            return IsSphereCulled(frustum, &entity->position, 0.8660254f * ( r32 )fabs(entity->length));
+        case ET_TRIANGLE_MESH:
+            return false;
+    }
+
+    return false;
+}
+
+// Copy the entities not culled by 'frustum' to 'culled_arr', keeping their
+// order, and their indices in 'source_index_arr' (which may be NULL).
+// Returns the number copied.
+static size_t
+CullEntities(const Frustum* restrict const frustum,
+             const Entity* restrict const  entity_arr,
+             const size_t                  num_entitys,
+             const u32* restrict const     source_arr,
+             _mut_ Entity* restrict const  culled_arr,
+             _mut_ u32* restrict const     source_index_arr)
+{
+    __UE_ASSERT__(frustum && culled_arr);
+    __UE_ASSERT__(entity_arr || !num_entitys);
+
+    size_t culled_count = 0;
+    for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
+    {
+        if (IsEntityCulled(frustum, &entity_arr[entity_index]))
+        {
+            continue;
+        }
+
+        culled_arr[culled_count] = entity_arr[entity_index];
+        if (source_index_arr)
+        {
+            source_index_arr[culled_count] = source_arr ? source_arr[entity_index] : ( u32 )entity_index;
+        }
+
+        culled_count++;
+    }
+
+    return culled_count;
+}
+
+//
+// Tile lists
+//
+static EntityCullGrid*
+CreateEntityCullGrid(const size_t image_width, const size_t image_height, const size_t tile_size)
+{
+    __UE_ASSERT__(image_width && image_height && tile_size);
+
+    EntityCullGrid* grid = ( EntityCullGrid* )calloc(1, sizeof(EntityCullGrid));
+    __UE_ASSERT__(grid);
+
+    grid->image_width    = image_width;
+    grid->image_height   = image_height;
+    grid->tile_size      = tile_size;
+    grid->tiles_x        = (image_width + tile_size - 1) / tile_size;
+    grid->tiles_y        = (image_height + tile_size - 1) / tile_size;
+    grid->tile_count     = grid->tiles_x * grid->tiles_y;
+    grid->tile_begin_arr = ( u32* )calloc(grid->tile_count + 1, sizeof(u32));
+    __UE_ASSERT__(grid->tile_begin_arr);
+
+    return grid;
+}
+
+static void
+DestroyEntityCullGrid(_mut_ EntityCullGrid* restrict const grid)
+{
+    if (!grid)
+    {
+        return;
+    }
+
+    free(grid->visible_arr);
+    free(grid->visible_source_arr);
+    free(grid->tile_entity_arr);
+    free(grid->tile_source_arr);
+    free(grid->tile_begin_arr);
+    free(grid);
+}
+
+__UE_inline__ static void
+GetEntityCullTileFrustum(const EntityCullGrid* restrict const grid, const size_t tile_index, _mut_ Frustum* restrict const frustum)
+{
+    __UE_ASSERT__(grid && frustum);
+    __UE_ASSERT__(tile_index < grid->tile_count);
+
+    const size_t x_min = (tile_index % grid->tiles_x) * grid->tile_size;
+    const size_t y_min = (tile_index / grid->tiles_x) * grid->tile_size;
+    const size_t x_max = (x_min + grid->tile_size) < grid->image_width ? (x_min + grid->tile_size) : grid->image_width;
+    const size_t y_max = (y_min + grid->tile_size) < grid->image_height ? (y_min + grid->tile_size) : grid->image_height;
+
+    GetImageFrustum(( r32 )x_min, ( r32 )y_min, ( r32 )x_max, ( r32 )y_max, grid->image_width, grid->image_height, frustum);
+}
+
+// Pass 1 stores each tile's count in tile_begin_arr[ tile + 1 ]; pass 2 fills
+// the lists once the counts have been summed into offsets.
+static void
+CountEntityCullTile(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    EntityCullGrid* grid    = ( EntityCullGrid* )context;
+    Frustum         frustum = { 0 };
+    GetEntityCullTileFrustum(grid, task_index, &frustum);
+
+    u32 tile_entity_count = 0;
+    for (size_t visible_index = 0; visible_index < grid->visible_count; visible_index++)
+    {
+        tile_entity_count += !IsEntityCulled(&frustum, &grid->visible_arr[visible_index]);
+    }
+
+    grid->tile_begin_arr[task_index + 1] = tile_entity_count;
+}
+
+static void
+FillEntityCullTile(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    EntityCullGrid* grid    = ( EntityCullGrid* )context;
+    Frustum         frustum = { 0 };
+    GetEntityCullTileFrustum(grid, task_index, &frustum);
+
+    const u32 tile_begin = grid->tile_begin_arr[task_index];
+    CullEntities(&frustum, grid->visible_arr, grid->visible_count, grid->visible_source_arr, &grid->tile_entity_arr[tile_begin], &grid->tile_source_arr[tile_begin]);
+}
+
+// Rebuild the visible list and every tile's list for this frame's entities.
+static void
+BuildEntityCullGrid(_mut_ EntityCullGrid* restrict const grid, const Entity* restrict const entity_arr, const size_t num_entitys, ThreadPool* const pool)
+{
+    __UE_ASSERT__(grid && entity_arr);
+
+    if (num_entitys >= grid->visible_capacity)
+    {
+        free(grid->visible_arr);
+        free(grid->visible_source_arr);
+        grid->visible_capacity   = num_entitys + 1;
+        grid->visible_arr        = ( Entity* )malloc(grid->visible_capacity * sizeof(Entity));
+        grid->visible_source_arr = ( u32* )malloc(grid->visible_capacity * sizeof(u32));
+        __UE_ASSERT__(grid->visible_arr && grid->visible_source_arr);
+    }
+
+    Frustum image_frustum = { 0 };
+    GetImageFrustum(0.0f, 0.0f, ( r32 )grid->image_width, ( r32 )grid->image_height, grid->image_width, grid->image_height, &image_frustum);
+    grid->visible_count = CullEntities(&image_frustum, entity_arr, num_entitys, NULL, grid->visible_arr, grid->visible_source_arr);
+
+    grid->tile_begin_arr[0] = 0;
+    ParallelFor(pool, grid->tile_count, CountEntityCullTile, grid);
+    for (size_t tile_index = 0; tile_index < grid->tile_count; tile_index++)
+    {
+        grid->tile_begin_arr[tile_index + 1] += grid->tile_begin_arr[tile_index];
+    }
+
+    const size_t tile_entity_count = grid->tile_begin_arr[grid->tile_count];
+    if (tile_entity_count >= grid->tile_entity_capacity)
+    {
+        free(grid->tile_entity_arr);
+        free(grid->tile_source_arr);
+        grid->tile_entity_capacity = tile_entity_count + (tile_entity_count / 2) + 1;
+        grid->tile_entity_arr      = ( Entity* )malloc(grid->tile_entity_capacity * sizeof(Entity));
+        grid->tile_source_arr      = ( u32* )malloc(grid->tile_entity_capacity * sizeof(u32));
+        __UE_ASSERT__(grid->tile_entity_arr && grid->tile_source_arr);
+    }
+
+    ParallelFor(pool, grid->tile_count, FillEntityCullTile, grid);
+}
+
+// The tile's entities, in their original order.
+__UE_inline__ static const Entity*
+GetEntityCullTile(const EntityCullGrid* restrict const grid, const size_t tile_index, _mut_ size_t* restrict const num_entitys)
+{
+    __UE_ASSERT__(grid && num_entitys);
+    __UE_ASSERT__(tile_index < grid->tile_count);
+
+    *num_entitys = grid->tile_begin_arr[tile_index + 1] - grid->tile_begin_arr[tile_index];
+    return &grid->tile_entity_arr[grid->tile_begin_arr[tile_index]];
+}
+
+// The caller's index of entity 'entity_index' of a tile's list.
+__UE_inline__ static u32
+GetEntityCullSourceIndex(const EntityCullGrid* restrict const grid, const size_t tile_index, const u32 entity_index)
+{
+    __UE_ASSERT__(grid);
+    __UE_ASSERT__(tile_index < grid->tile_count);
+    __UE_ASSERT__((grid->tile_begin_arr[tile_index] + entity_index) < grid->tile_begin_arr[tile_index + 1]);
+
+    return grid->tile_source_arr[grid->tile_begin_arr[tile_index] + entity_index];
+}
+
+#endif // __UE_CULL_TOOLS_H___
@@ -156,10 +156,10 @@ char _message_buffer[MAX_ERROR_LEN];
     }
 
 // uAssert()
-#define uAssert(cond)           \
-    if (!(( long long )(cond))) \
-    {                           \
-        exit(666);              \
+#define uAssert(cond) \
+    if (!(cond))      \
+    {                 \
+        exit(666);    \
     }
 
 #define uDebugStatement(statement) statement
@@ -0,0 +1,511 @@
+#ifndef __UE_DENOISE_TOOLS_H___
+#define __UE_DENOISE_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <sampler_tools.h>
+#include <thread_tools.h>
+#include <type_tools.h>
+
+#include <math.h>
+#include <stdlib.h>
+
+#if __UE_SIMD__sse
+#include <emmintrin.h>
+#endif // __UE_SIMD__sse
+
+//
+// Edge-aware a-trous denoising
+//
+// The tracer writes color together with three noise-free guides per pixel:
+// the hit normal, the hit distance and the albedo (material color) of the
+// hit entity. Color is divided by albedo before filtering so that texture
+// and material edges are not blurred, then multiplied back.
+//
+// Each iteration applies a 5 x 5 B3-spline kernel whose taps are 2^i pixels
+// apart, so five iterations cover a 125 x 125 footprint at 25 taps per pixel.
+// A tap q of pixel p is weighted by:
+//
+//   h(q) * exp(-( sigma_normal * (1 - dot(n_p, n_q))
+//               + |z_p - z_q| / (sigma_depth * z_p * 2^i)
+//               + |l_p - l_q| / (sigma_luminance * 2^-i) ))
+//
+// where l is the luminance of the (demodulated) color being filtered. The
+// luminance sigma halves every iteration, as the color grows smoother.
+//
+// Rows are filtered in parallel; with __UE_SIMD__sse, four neighbouring
+// pixels are filtered at once wherever their taps are all inside the image.
+//
+// Note: buffers are planar (one array per channel) so that 4-wide loads read
+//       four neighbouring pixels of one channel.
+//
+
+typedef struct
+{
+    u32 iterations;
+    r32 sigma_normal;
+    r32 sigma_depth;
+    r32 sigma_luminance;
+} DenoiseSettings;
+
+typedef struct
+{
+    r32* color[3];  // Linear, channels in [ 0, 1 ]; replaced by the filtered result
+    r32* albedo[3]; // Channels in [ 0, 1 ]; 1 on miss so that misses are filtered as is
+    r32* normal[3]; // Unit hit normal; zero on miss
+    r32* depth;     // Hit distance; MAX_RAY_MAG on miss
+
+    // Demodulated color, ping-ponged between iterations
+    r32* irradiance[3];
+    r32* scratch[3];
+
+    size_t image_width;
+    size_t image_height;
+} DenoiseBuffers;
+
+__UE_inline__ static void
+GetDefaultDenoiseSettings(_mut_ DenoiseSettings* restrict const settings)
+{
+    __UE_ASSERT__(settings);
+
+    settings->iterations      = __UE_DN__iterations;
+    settings->sigma_normal    = ( r32 )__UE_DN__sigma_normal;
+    settings->sigma_depth     = ( r32 )__UE_DN__sigma_depth;
+    settings->sigma_luminance = ( r32 )__UE_DN__sigma_luminance;
+}
+
+static DenoiseBuffers*
+CreateDenoiseBuffers(const size_t image_width, const size_t image_height)
+{
+    __UE_ASSERT__(image_width && image_height);
+
+    DenoiseBuffers* buffers = ( DenoiseBuffers* )calloc(1, sizeof(DenoiseBuffers));
+    __UE_ASSERT__(buffers);
+
+    const size_t pixel_count = image_width * image_height;
+    buffers->image_width     = image_width;
+    buffers->image_height    = image_height;
+    buffers->depth           = ( r32* )calloc(pixel_count, sizeof(r32));
+    __UE_ASSERT__(buffers->depth);
+
+    for (u8 channel_index = 0; channel_index < 3; channel_index++)
+    {
+        buffers->color[channel_index]      = ( r32* )calloc(pixel_count, sizeof(r32));
+        buffers->albedo[channel_index]     = ( r32* )calloc(pixel_count, sizeof(r32));
+        buffers->normal[channel_index]     = ( r32* )calloc(pixel_count, sizeof(r32));
+        buffers->irradiance[channel_index] = ( r32* )calloc(pixel_count, sizeof(r32));
+        buffers->scratch[channel_index]    = ( r32* )calloc(pixel_count, sizeof(r32));
+        __UE_ASSERT__(buffers->color[channel_index] && buffers->albedo[channel_index] && buffers->normal[channel_index]);
+        __UE_ASSERT__(buffers->irradiance[channel_index] && buffers->scratch[channel_index]);
+    }
+
+    return buffers;
+}
+
+static void
+DestroyDenoiseBuffers(_mut_ DenoiseBuffers* restrict const buffers)
+{
+    if (!buffers)
+    {
+        return;
+    }
+
+    for (u8 channel_index = 0; channel_index < 3; channel_index++)
+    {
+        free(buffers->color[channel_index]);
+        free(buffers->albedo[channel_index]);
+        free(buffers->normal[channel_index]);
+        free(buffers->irradiance[channel_index]);
+        free(buffers->scratch[channel_index]);
+    }
+
+    free(buffers->depth);
+    free(buffers);
+}
+
+//
+// Guide and color input
+//
+typedef struct
+{
+    DenoiseBuffers* buffers;
+    const Entity*   entity_arr;
+    size_t          num_entitys;
+    u32             samples_per_pixel;
+} DenoiseInputContext;
+
+static void
+RenderDenoiseInputRow(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const DenoiseInputContext* input   = ( const DenoiseInputContext* )context;
+    DenoiseBuffers*            buffers = input->buffers;
+    const size_t               pix_y   = task_index;
+    const r32                  scale   = 1.0f / ( r32 )input->samples_per_pixel;
+
+    for (size_t pix_x = 0; pix_x < buffers->image_width; pix_x++)
+    {
+        const size_t pixel_index = (pix_y * buffers->image_width) + pix_x;
+
+        v3  color  = { 0 };
+        v3  albedo = { 0 };
+        v3  normal = { 0 };
+        r32 depth  = 0;
+        for (u32 sample_index = 0; sample_index < input->samples_per_pixel; sample_index++)
+        {
+            BeginPixelSample(( u32 )pixel_index, sample_index);
+            const r32 sample_x = ( r32 )pix_x + NextSample1D();
+            const r32 sample_y = ( r32 )pix_y + NextSample1D();
+
+            RayIntersection intersection = { 0 };
+            Color32_RGB     sample_color = { 0 };
+            TracePrimarySample(sample_x, sample_y, buffers->image_width, buffers->image_height, &intersection, &sample_color, input->entity_arr, input->num_entitys);
+
+            v3Set(&color, color.x + (sample_color.channel.R / 255.0f), color.y + (sample_color.channel.G / 255.0f), color.z + (sample_color.channel.B / 255.0f));
+            if (!intersection.does_intersect)
+            {
+                v3Set(&albedo, albedo.x + 1.0f, albedo.y + 1.0f, albedo.z + 1.0f);
+                depth += ( r32 )MAX_RAY_MAG;
+                continue;
+            }
+
+            const Color32_RGB* material_color = &input->entity_arr[intersection.entity_index].material.color;
+            v3Set(&albedo, albedo.x + (material_color->channel.R / 255.0f), albedo.y + (material_color->channel.G / 255.0f), albedo.z + (material_color->channel.B / 255.0f));
+            v3Set(&normal, normal.x + intersection.normal_vector.x, normal.y + intersection.normal_vector.y, normal.z + intersection.normal_vector.z);
+            depth += intersection.magnitude;
+        }
+
+        // Pixels straddling an edge get the mean of their samples' guides;
+        // the normal is renormalized unless no sample hit.
+        const r32 normal_magnitude = v3Mag(&normal);
+        const r32 normal_scale     = normal_magnitude > 0.0f ? (1.0f / normal_magnitude) : 0.0f;
+        for (u8 channel_index = 0; channel_index < 3; channel_index++)
+        {
+            buffers->color[channel_index][pixel_index]  = color.arr[channel_index] * scale;
+            buffers->albedo[channel_index][pixel_index] = albedo.arr[channel_index] * scale;
+            buffers->normal[channel_index][pixel_index] = normal.arr[channel_index] * normal_scale;
+        }
+        buffers->depth[pixel_index] = depth * scale;
+    }
+}
+
+// Trace samples_per_pixel jittered primary samples per pixel into the color
+// and guide buffers.
+static void
+RenderDenoiseInput(_mut_ DenoiseBuffers* restrict const buffers,
+                   const u32                          samples_per_pixel,
+                   const Entity* restrict const       entity_arr,
+                   const size_t                       num_entitys,
+                   ThreadPool* const                  pool)
+{
+    __UE_ASSERT__(buffers && entity_arr);
+    __UE_ASSERT__(samples_per_pixel);
+
+    DenoiseInputContext input = { 0 };
+    input.buffers             = buffers;
+    input.entity_arr          = entity_arr;
+    input.num_entitys         = num_entitys;
+    input.samples_per_pixel   = samples_per_pixel;
+
+    ParallelFor(pool, buffers->image_height, RenderDenoiseInputRow, &input);
+}
+
+//
+// Filter
+//
+static const r32 kDenoiseKernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+#define DENOISE_LOG2_E    1.44269504f
+#define DENOISE_MIN_DEPTH 1e-4f
+
+// 2^x for x <= 0; a degree-5 polynomial on the fractional part, relative
+// error below 2e-5. Arguments under -126 return 0.
+__UE_inline__ static r32
+DenoiseExp2(const r32 x)
+{
+    if (x < -126.0f)
+    {
+        return 0.0f;
+    }
+
+    const r32 whole    = floorf(x);
+    const r32 fraction = x - whole;
+    const r32 p        = 1.0f + (fraction * (0.6931472f + (fraction * (0.2402265f + (fraction * (0.0555041f + (fraction * (0.0096181f + (fraction * 0.0013334f)))))))));
+
+    return ldexpf(p, ( s32 )whole);
+}
+
+__UE_inline__ static r32
+GetPlanarLuminance(r32* const* const planes, const size_t pixel_index)
+{
+    return (0.2126f * planes[0][pixel_index]) + (0.7152f * planes[1][pixel_index]) + (0.0722f * planes[2][pixel_index]);
+}
+
+typedef struct
+{
+    const DenoiseBuffers* buffers;
+    r32* const*           source;
+    r32* const*           destination;
+    size_t                step;
+    r32                   sigma_normal;
+    r32                   inverse_sigma_depth;     // 1 / (sigma_depth * step)
+    r32                   inverse_sigma_luminance; // 1 / (sigma_luminance / step)
+} DenoisePassContext;
+
+static void
+FilterDenoisePixel(const DenoisePassContext* restrict const pass, const size_t pix_x, const size_t pix_y)
+{
+    const DenoiseBuffers* buffers     = pass->buffers;
+    const size_t          width       = buffers->image_width;
+    const size_t          height      = buffers->image_height;
+    const size_t          pixel_index = (pix_y * width) + pix_x;
+    const s64             step        = ( s64 )pass->step;
+
+    const r32 luminance   = GetPlanarLuminance(pass->source, pixel_index);
+    const r32 depth       = buffers->depth[pixel_index];
+    const r32 depth_scale = pass->inverse_sigma_depth / (depth > DENOISE_MIN_DEPTH ? depth : DENOISE_MIN_DEPTH);
+
+    r32 weight_sum = 0;
+    v3  color_sum  = { 0 };
+    for (s64 tap_y = -2; tap_y <= 2; tap_y++)
+    {
+        const s64 y = ( s64 )pix_y + (tap_y * step);
+        if (y < 0 || y >= ( s64 )height)
+        {
+            continue;
+        }
+
+        for (s64 tap_x = -2; tap_x <= 2; tap_x++)
+        {
+            const s64 x = ( s64 )pix_x + (tap_x * step);
+            if (x < 0 || x >= ( s64 )width)
+            {
+                continue;
+            }
+
+            const size_t tap_index = (( size_t )y * width) + ( size_t )x;
+            const r32    normal_dot
+                = (buffers->normal[0][pixel_index] * buffers->normal[0][tap_index]) + (buffers->normal[1][pixel_index] * buffers->normal[1][tap_index]) + (buffers->normal[2][pixel_index] * buffers->normal[2][tap_index]);
+
+            const r32 exponent = (pass->sigma_normal * (1.0f - normal_dot)) + (( r32 )fabs(depth - buffers->depth[tap_index]) * depth_scale)
+                                 + (( r32 )fabs(luminance - GetPlanarLuminance(pass->source, tap_index)) * pass->inverse_sigma_luminance);
+            const r32 kernel = kDenoiseKernel[tap_x + 2] * kDenoiseKernel[tap_y + 2];
+            const r32 weight = (tap_index == pixel_index) ? kernel : kernel * DenoiseExp2(-exponent * DENOISE_LOG2_E);
+
+            weight_sum += weight;
+            v3Set(&color_sum,
+                  color_sum.x + (weight * pass->source[0][tap_index]),
+                  color_sum.y + (weight * pass->source[1][tap_index]),
+                  color_sum.z + (weight * pass->source[2][tap_index]));
+        }
+    }
+
+    // The center tap is never edge-stopped (a miss has no normal), weight_sum > 0
+    for (u8 channel_index = 0; channel_index < 3; channel_index++)
+    {
+        pass->destination[channel_index][pixel_index] = color_sum.arr[channel_index] / weight_sum;
+    }
+}
+
+#if __UE_SIMD__sse
+// 4-wide DenoiseExp2()
+__UE_inline__ static __m128
+DenoiseExp2SSE(const __m128 x)
+{
+    const __m128  clamped   = _mm_max_ps(x, _mm_set1_ps(-126.0f));
+    __m128i       whole     = _mm_cvttps_epi32(clamped);
+    const __m128  truncated = _mm_cvtepi32_ps(whole);
+    whole                   = _mm_add_epi32(whole, _mm_castps_si128(_mm_cmpgt_ps(truncated, clamped))); // floor for x < 0
+    const __m128 fraction   = _mm_sub_ps(clamped, _mm_cvtepi32_ps(whole));
+
+    __m128 p = _mm_set1_ps(0.0013334f);
+    p        = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(0.0096181f));
+    p        = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(0.0555041f));
+    p        = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(0.2402265f));
+    p        = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(0.6931472f));
+    p        = _mm_add_ps(_mm_mul_ps(p, fraction), _mm_set1_ps(1.0f));
+
+    const __m128 scale  = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(whole, _mm_set1_epi32(127)), 23));
+    const __m128 result = _mm_mul_ps(p, scale);
+    return _mm_and_ps(result, _mm_cmpge_ps(x, _mm_set1_ps(-126.0f)));
+}
+
+// Pixels [ pix_x, pix_x + 4 ) of row pix_y; every tap column must be inside
+// the image.
+static void
+FilterDenoisePixelsSSE(const DenoisePassContext* restrict const pass, const size_t pix_x, const size_t pix_y)
+{
+    const DenoiseBuffers* buffers     = pass->buffers;
+    const size_t          width       = buffers->image_width;
+    const size_t          height      = buffers->image_height;
+    const size_t          pixel_index = (pix_y * width) + pix_x;
+    const s64             step        = ( s64 )pass->step;
+
+    const __m128 luminance_r = _mm_set1_ps(0.2126f);
+    const __m128 luminance_g = _mm_set1_ps(0.7152f);
+    const __m128 luminance_b = _mm_set1_ps(0.0722f);
+    const __m128 one         = _mm_set1_ps(1.0f);
+    const __m128 sign_mask   = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+    const __m128 color_r   = _mm_loadu_ps(&pass->source[0][pixel_index]);
+    const __m128 color_g   = _mm_loadu_ps(&pass->source[1][pixel_index]);
+    const __m128 color_b   = _mm_loadu_ps(&pass->source[2][pixel_index]);
+    const __m128 luminance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(color_r, luminance_r), _mm_mul_ps(color_g, luminance_g)), _mm_mul_ps(color_b, luminance_b));
+    const __m128 normal_x  = _mm_loadu_ps(&buffers->normal[0][pixel_index]);
+    const __m128 normal_y  = _mm_loadu_ps(&buffers->normal[1][pixel_index]);
+    const __m128 normal_z  = _mm_loadu_ps(&buffers->normal[2][pixel_index]);
+    const __m128 depth     = _mm_loadu_ps(&buffers->depth[pixel_index]);
+
+    const __m128 depth_scale     = _mm_div_ps(_mm_set1_ps(pass->inverse_sigma_depth), _mm_max_ps(depth, _mm_set1_ps(DENOISE_MIN_DEPTH)));
+    const __m128 luminance_scale = _mm_set1_ps(pass->inverse_sigma_luminance);
+    const __m128 sigma_normal    = _mm_set1_ps(pass->sigma_normal);
+    const __m128 negative_log2_e = _mm_set1_ps(-DENOISE_LOG2_E);
+
+    __m128 weight_sum = _mm_setzero_ps();
+    __m128 sum_r      = _mm_setzero_ps();
+    __m128 sum_g      = _mm_setzero_ps();
+    __m128 sum_b      = _mm_setzero_ps();
+    for (s64 tap_y = -2; tap_y <= 2; tap_y++)
+    {
+        const s64 y = ( s64 )pix_y + (tap_y * step);
+        if (y < 0 || y >= ( s64 )height)
+        {
+            continue;
+        }
+
+        for (s64 tap_x = -2; tap_x <= 2; tap_x++)
+        {
+            const size_t tap_index = ( size_t )((y * ( s64 )width) + ( s64 )pix_x + (tap_x * step));
+
+            const __m128 tap_r     = _mm_loadu_ps(&pass->source[0][tap_index]);
+            const __m128 tap_g     = _mm_loadu_ps(&pass->source[1][tap_index]);
+            const __m128 tap_b     = _mm_loadu_ps(&pass->source[2][tap_index]);
+            const __m128 tap_luma  = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tap_r, luminance_r), _mm_mul_ps(tap_g, luminance_g)), _mm_mul_ps(tap_b, luminance_b));
+            const __m128 tap_depth = _mm_loadu_ps(&buffers->depth[tap_index]);
+
+            __m128 normal_dot = _mm_mul_ps(normal_x, _mm_loadu_ps(&buffers->normal[0][tap_index]));
+            normal_dot        = _mm_add_ps(normal_dot, _mm_mul_ps(normal_y, _mm_loadu_ps(&buffers->normal[1][tap_index])));
+            normal_dot        = _mm_add_ps(normal_dot, _mm_mul_ps(normal_z, _mm_loadu_ps(&buffers->normal[2][tap_index])));
+
+            __m128 exponent = _mm_mul_ps(sigma_normal, _mm_sub_ps(one, normal_dot));
+            exponent        = _mm_add_ps(exponent, _mm_mul_ps(_mm_and_ps(_mm_sub_ps(depth, tap_depth), sign_mask), depth_scale));
+            exponent        = _mm_add_ps(exponent, _mm_mul_ps(_mm_and_ps(_mm_sub_ps(luminance, tap_luma), sign_mask), luminance_scale));
+
+            const __m128 kernel = _mm_set1_ps(kDenoiseKernel[tap_x + 2] * kDenoiseKernel[tap_y + 2]);
+            const __m128 weight = (tap_x == 0 && tap_y == 0) ? kernel : _mm_mul_ps(kernel, DenoiseExp2SSE(_mm_mul_ps(exponent, negative_log2_e)));
+
+            weight_sum = _mm_add_ps(weight_sum, weight);
+            sum_r      = _mm_add_ps(sum_r, _mm_mul_ps(weight, tap_r));
+            sum_g      = _mm_add_ps(sum_g, _mm_mul_ps(weight, tap_g));
+            sum_b      = _mm_add_ps(sum_b, _mm_mul_ps(weight, tap_b));
+        }
+    }
+
+    const __m128 inverse_weight = _mm_div_ps(one, weight_sum);
+    _mm_storeu_ps(&pass->destination[0][pixel_index], _mm_mul_ps(sum_r, inverse_weight));
+    _mm_storeu_ps(&pass->destination[1][pixel_index], _mm_mul_ps(sum_g, inverse_weight));
+    _mm_storeu_ps(&pass->destination[2][pixel_index], _mm_mul_ps(sum_b, inverse_weight));
+}
+#endif // __UE_SIMD__sse
+
+static void
+FilterDenoiseRow(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const DenoisePassContext* pass  = ( const DenoisePassContext* )context;
+    const size_t              width = pass->buffers->image_width;
+
+    size_t pix_x = 0;
+#if __UE_SIMD__sse
+    const size_t reach = 2 * pass->step;
+
+    // Left border, then 4-wide blocks whose taps stay inside the row
+    for (; pix_x < width && pix_x < reach; pix_x++)
+    {
+        FilterDenoisePixel(pass, pix_x, task_index);
+    }
+    for (; (pix_x + 4 + reach) <= width; pix_x += 4)
+    {
+        FilterDenoisePixelsSSE(pass, pix_x, task_index);
+    }
+#endif // __UE_SIMD__sse
+    for (; pix_x < width; pix_x++)
+    {
+        FilterDenoisePixel(pass, pix_x, task_index);
+    }
+}
+
+// Filters buffers->color in place, guided by the albedo, normal and depth
+// buffers. Rows are spread over the pool's threads.
+static void
+Denoise(_mut_ DenoiseBuffers* restrict const buffers, const DenoiseSettings* restrict const settings, ThreadPool* const pool)
+{
+    __UE_ASSERT__(buffers && settings);
+    __UE_ASSERT__(settings->sigma_depth > 0.0f && settings->sigma_luminance > 0.0f);
+
+    const size_t pixel_count = buffers->image_width * buffers->image_height;
+
+    // Demodulate
+    for (u8 channel_index = 0; channel_index < 3; channel_index++)
+    {
+        for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+        {
+            const r32 albedo                                = buffers->albedo[channel_index][pixel_index];
+            buffers->irradiance[channel_index][pixel_index] = (albedo > ( r32 )TOLERANCE) ? (buffers->color[channel_index][pixel_index] / albedo) : buffers->color[channel_index][pixel_index];
+        }
+    }
+
+    r32** source      = buffers->irradiance;
+    r32** destination = buffers->scratch;
+    for (u32 iteration = 0; iteration < settings->iterations; iteration++)
+    {
+        DenoisePassContext pass      = { 0 };
+        pass.buffers                 = buffers;
+        pass.source                  = source;
+        pass.destination             = destination;
+        pass.step                    = ( size_t )1 << iteration;
+        pass.sigma_normal            = settings->sigma_normal;
+        pass.inverse_sigma_depth     = 1.0f / (settings->sigma_depth * ( r32 )pass.step);
+        pass.inverse_sigma_luminance = ( r32 )pass.step / settings->sigma_luminance;
+
+        ParallelFor(pool, buffers->image_height, FilterDenoiseRow, &pass);
+
+        r32** swap  = source;
+        source      = destination;
+        destination = swap;
+    }
+
+    // Remodulate
+    for (u8 channel_index = 0; channel_index < 3; channel_index++)
+    {
+        for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+        {
+            const r32 albedo                           = buffers->albedo[channel_index][pixel_index];
+            buffers->color[channel_index][pixel_index] = (albedo > ( r32 )TOLERANCE) ? (source[channel_index][pixel_index] * albedo) : source[channel_index][pixel_index];
+        }
+    }
+}
+
+// Write buffers->color to a linear, row-major pixel array.
+static void
+ResolveDenoiseBuffers(const DenoiseBuffers* restrict const buffers, _mut_ Color32_RGB* restrict const pixel_array)
+{
+    __UE_ASSERT__(buffers && pixel_array);
+
+    const size_t pixel_count = buffers->image_width * buffers->image_height;
+    for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+    {
+        Color32_RGB* pixel = &pixel_array[pixel_index];
+        pixel->channel.R   = ( u8 )fmin(255.0f, round(buffers->color[0][pixel_index] * 255.0f));
+        pixel->channel.G   = ( u8 )fmin(255.0f, round(buffers->color[1][pixel_index] * 255.0f));
+        pixel->channel.B   = ( u8 )fmin(255.0f, round(buffers->color[2][pixel_index] * 255.0f));
+        pixel->channel.A   = 0xFF;
+    }
+}
+
+#endif // __UE_DENOISE_TOOLS_H___
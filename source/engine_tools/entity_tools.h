@@ -1,28 +1,26 @@
 #ifndef __UE_ENTITY_TOOLS_H___
 #define __UE_ENTITY_TOOLS_H___
 
-//#include <rt_settings.h> [ cfarvin::REVISIT ]
+#include <rt_settings.h>
+
 #include <color_tools.h>
 #include <macro_tools.h>
+#include <material_tools.h>
 #include <maths_tools.h>
+#include <sampler_tools.h>
+#include <stats_tools.h>
 #include <type_tools.h>
 
+#include <float.h>
+
 typedef enum
 {
     ET_NONE,
-    ET_SPHERE
+    ET_SPHERE,
+    ET_CUBE,
+    ET_TRIANGLE_MESH
 } EntityType;
 
-typedef struct
-{
-    r32 radius;
-} Sphere;
-
-typedef struct
-{
-    r32 length;
-} Cube;
-
 #ifdef _WIN32
 #pragma warning(push)
 #pragma warning(disable : 4201)
@@ -33,29 +31,49 @@ typedef struct
     Material material;
 
     EntityType type;
-    typedef union
+    union
     {
-        Sphere;
-        Cube;
+        // ET_SPHERE
+        struct
+        {
+            r32 radius;
+        };
+
+        // ET_CUBE; axis aligned and centered on position
+        struct
+        {
+            r32 length;
+        };
+
+        // ET_TRIANGLE_MESH; index into the caller's TriangleMesh array, the
+        // mesh is translated by position (see: mesh_tools.h)
+        struct
+        {
+            u32 mesh_index;
+        };
     };
 } Entity;
 #ifdef _WIN32
 #pragma warning(pop)
 #endif // WIN32
 
+#define ENTITY_INDEX_NONE (~( u32 )0)
+
 typedef struct
 {
     v3 origin;
     v3 direction;
 } Ray;
 
+// Note: the hit material is not copied; it is entity_arr[entity_index].material
+//       (see: shading_tools.h).
 typedef struct
 {
-    v3       position;
-    v3       normal_vector;
-    r32      magnitude;
-    bool     does_intersect;
-    Material intersection_material;
+    v3   position;
+    v3   normal_vector;
+    r32  magnitude;
+    bool does_intersect;
+    u32  entity_index; // ENTITY_INDEX_NONE when does_intersect is false
 } RayIntersection;
 
 typedef struct
@@ -105,6 +123,7 @@ ReflectRays(/* const Ray*             restrict const ray, */
         return;
     }
 
+    const Material* incident_material   = &entity_arr[intersected_entity_index].material;
     u16             bounces             = 0;
     r64             photon_energy       = 0;
     RayIntersection bounce_intersection = { 0 };
@@ -112,24 +131,25 @@ ReflectRays(/* const Ray*             restrict const ray, */
     Color32_RGB     bounce_color        = { 0 };
 
     GetEnergyByColorRGB_eV(return_color, &photon_energy);
-    photon_energy /= incident_intersection->intersection_material.absorbtion_coefficient;
+    photon_energy /= incident_material->absorbtion_coefficient;
 
     while (photon_energy > 0)
     {
-        if (bounces > incident_intersection->intersection_material.max_generated_rays)
+        if (bounces > incident_material->max_generated_rays)
         {
             break;
         }
 
         v3Set(&bounce_ray.origin, incident_intersection->normal_vector.x, incident_intersection->normal_vector.y, incident_intersection->normal_vector.z);
 
-        r32 xrand = ( r32 )XorShift32() + TOLERANCE;
-        r32 yrand = ( r32 )XorShift32() + TOLERANCE;
-        r32 zrand = ( r32 )XorShift32() + TOLERANCE;
+        // Note: draws from this thread's sample cursor, see: BeginPixelSample()
+        r32 xrand = NextSample1D();
+        r32 yrand = NextSample1D();
+        r32 zrand = NextSample1D();
         v3SetAndNorm(&bounce_ray.direction,
-                     bounce_ray.origin.x + NormalizeToRange(( r32 )TOLERANCE, (r32)(~( u32 )0), ( r32 )TOLERANCE, ( r32 )__UE_AA__reflection_noise, xrand),
-                     bounce_ray.origin.y + NormalizeToRange(( r32 )TOLERANCE, (r32)(~( u32 )0), ( r32 )TOLERANCE, ( r32 )__UE_AA__reflection_noise, yrand),
-                     bounce_ray.origin.z + NormalizeToRange(( r32 )TOLERANCE, (r32)(~( u32 )0), ( r32 )TOLERANCE, ( r32 )__UE_AA__reflection_noise, zrand));
+                     bounce_ray.origin.x + (xrand * ( r32 )__UE_AA__reflection_noise),
+                     bounce_ray.origin.y + (yrand * ( r32 )__UE_AA__reflection_noise),
+                     bounce_ray.origin.z + (zrand * ( r32 )__UE_AA__reflection_noise));
 
 // Ensure that the reflected ray does not intersect
 // the originating entity at a point other than its
@@ -143,6 +163,7 @@ ReflectRays(/* const Ray*             restrict const ray, */
         }
 #endif // __UE_debug__ == 1
 
+        __UE_STAT__(bounces, 1);
         TraceEntityArray(&bounce_ray, &bounce_intersection, &incident_intersection->magnitude, &bounce_color, entity_arr, num_entitys);
 
         if (bounce_intersection.does_intersect && bounce_intersection.normal_vector.z > incident_intersection->normal_vector.z)
@@ -159,15 +180,15 @@ ReflectRays(/* const Ray*             restrict const ray, */
 #endif // __UE_AA__reflections
 //
 
+// Note: draws from this thread's sample cursor, see: BeginPixelSample()
 __UE_inline__ static void
 SetRayDirectionByPixelCoordAA(_mut_ Ray* restrict const ray, const size_t pix_x, const size_t pix_y)
 {
-    const r32 xOr_contribution_x = NormalizeToRange(( r32 )TOLERANCE, (r32)(~( u32 )0), ( r32 )TOLERANCE, ( r32 )__UE_AA__noise, ( r32 )XorShift32() + ( r32 )TOLERANCE);
-
-    const r32 xOr_contribution_y = NormalizeToRange(( r32 )TOLERANCE, (r32)(~( u32 )0), ( r32 )TOLERANCE, ( r32 )__UE_AA__noise, ( r32 )XorShift32() + ( r32 )TOLERANCE);
+    const r32 jitter_x = NextSample1D() * ( r32 )__UE_AA__noise;
+    const r32 jitter_y = NextSample1D() * ( r32 )__UE_AA__noise;
 
-    const r32 x_numerator = ( r32 )pix_x + xOr_contribution_x;
-    const r32 y_numerator = ( r32 )pix_y + xOr_contribution_y;
+    const r32 x_numerator = ( r32 )pix_x + jitter_x;
+    const r32 y_numerator = ( r32 )pix_y + jitter_y;
 
     ray->direction.x = ((x_numerator / ( r32 )IMAGE_WIDTH) - 0.5f) * ASPECT_RATIO;
     ray->direction.y = (y_numerator / ( r32 )IMAGE_HEIGHT) - 0.5f;
@@ -182,17 +203,155 @@ SetRayDirectionByPixelCoord(_mut_ Ray* restrict const ray, const size_t pix_x, c
     ray->direction.z = -1;
 }
 
+// Note: sample_x and sample_y are continuous image coordinates, ie: pixel
+//       (x, y) covers [x, x + 1) * [y, y + 1).
+__UE_inline__ static void
+SetRayDirectionByPixelSample(_mut_ Ray* restrict const ray, const r32 sample_x, const r32 sample_y, const size_t image_width, const size_t image_height)
+{
+    __UE_ASSERT__(ray);
+    __UE_ASSERT__(image_width && image_height);
+
+    const r32 aspect_ratio = ( r32 )image_width / ( r32 )image_height;
+
+    ray->direction.x = ((sample_x / ( r32 )image_width) - 0.5f) * aspect_ratio;
+    ray->direction.y = (sample_y / ( r32 )image_height) - 0.5f;
+    ray->direction.z = -1;
+}
+
+// Orthonormal camera basis. World up is +y; camera->direction must not be
+// parallel to it. The default camera (origin at zero, direction -z) yields
+// the same rays as SetRayDirectionByPixelSample().
+__UE_inline__ static void
+GetCameraBasis(const Camera* restrict const camera, _mut_ v3* restrict const right, _mut_ v3* restrict const up, _mut_ v3* restrict const forward)
+{
+    __UE_ASSERT__(camera && right && up && forward);
+
+    v3 world_up = { 0 };
+    v3Set(&world_up, 0.0f, 1.0f, 0.0f);
+
+    *forward = camera->direction;
+    v3Norm(forward);
+    v3Cross(forward, &world_up, right);
+    v3Norm(right);
+    v3Cross(right, forward, up);
+}
+
+// Camera space counterpart of SetRayDirectionByPixelSample(); the direction
+// is normalized.
+__UE_inline__ static void
+SetRayByCameraSample(_mut_ Ray* restrict const ray,
+                     const Camera* restrict const camera,
+                     const r32                    sample_x,
+                     const r32                    sample_y,
+                     const size_t                 image_width,
+                     const size_t                 image_height)
+{
+    __UE_ASSERT__(ray && camera);
+    __UE_ASSERT__(image_width && image_height);
+
+    v3 right   = { 0 };
+    v3 up      = { 0 };
+    v3 forward = { 0 };
+    GetCameraBasis(camera, &right, &up, &forward);
+
+    const r32 aspect_ratio = ( r32 )image_width / ( r32 )image_height;
+    const r32 offset_x     = ((sample_x / ( r32 )image_width) - 0.5f) * aspect_ratio;
+    const r32 offset_y     = (sample_y / ( r32 )image_height) - 0.5f;
+
+    ray->origin = camera->origin;
+    v3SetAndNorm(&ray->direction,
+                 forward.x + (offset_x * right.x) + (offset_y * up.x),
+                 forward.y + (offset_x * right.y) + (offset_y * up.y),
+                 forward.z + (offset_x * right.z) + (offset_y * up.z));
+}
+
 static Entity*
 CreateEntities(const size_t entity_count)
 {
     return ( Entity* )calloc(entity_count, sizeof(Entity));
 }
 
+// Slab test against an axis aligned cube. The reported face is the entry
+// face, or the exit face for rays that start inside. Like the sphere normal,
+// the face normal points away from the ray origin.
 __UE_inline__ static void
-IntersectEntity(const Ray* restrict const ray, const Entity* restrict const entity, _mut_ RayIntersection* restrict const intersection)
+IntersectCube(const Ray* restrict const ray, const Entity* restrict const entity, _mut_ RayIntersection* restrict const intersection)
 {
     __UE_ASSERT__(ray && entity && intersection);
-    __UE_ASSERT__(v3IsNorm(&ray->direction));
+    __UE_ASSERT__(entity->type == ET_CUBE);
+    __UE_STAT__(primitive_tests, 1);
+
+    const r32 half_length = 0.5f * entity->length;
+
+    r32 t_near    = -FLT_MAX;
+    r32 t_far     = FLT_MAX;
+    u8  near_axis = 0;
+    u8  far_axis  = 0;
+    for (u8 axis = 0; axis < 3; axis++)
+    {
+        const r32 slab_min = entity->position.arr[axis] - half_length;
+        const r32 slab_max = entity->position.arr[axis] + half_length;
+        if (ray->direction.arr[axis] == 0.0f)
+        {
+            if (ray->origin.arr[axis] < slab_min || ray->origin.arr[axis] > slab_max)
+            {
+                intersection->does_intersect = false;
+                return;
+            }
+
+            continue;
+        }
+
+        const r32 inverse_direction = 1.0f / ray->direction.arr[axis];
+        r32       t0                = (slab_min - ray->origin.arr[axis]) * inverse_direction;
+        r32       t1                = (slab_max - ray->origin.arr[axis]) * inverse_direction;
+        if (t0 > t1)
+        {
+            const r32 swap = t0;
+            t0             = t1;
+            t1             = swap;
+        }
+
+        if (t0 > t_near)
+        {
+            t_near    = t0;
+            near_axis = axis;
+        }
+        if (t1 < t_far)
+        {
+            t_far    = t1;
+            far_axis = axis;
+        }
+    }
+
+    intersection->does_intersect = (t_near <= t_far) && (t_far >= 0.0f);
+    if (!intersection->does_intersect)
+    {
+        return;
+    }
+
+    const bool is_inside = (t_near < 0.0f);
+    const r32  magnitude = is_inside ? t_far : t_near;
+    const u8   face_axis = is_inside ? far_axis : near_axis;
+
+    intersection->magnitude = magnitude;
+    v3Set(&intersection->position,
+          ray->origin.x + (magnitude * ray->direction.x),
+          ray->origin.y + (magnitude * ray->direction.y),
+          ray->origin.z + (magnitude * ray->direction.z));
+
+    v3Set(&intersection->normal_vector, 0.0f, 0.0f, 0.0f);
+    intersection->normal_vector.arr[face_axis] = (ray->direction.arr[face_axis] < 0.0f) ? -1.0f : 1.0f;
+}
+
+// Nearest root of the ray/sphere quadratic. ET_NONE entities are traced as
+// spheres (see: IntersectEntity()).
+__UE_inline__ static void
+IntersectSphere(const Ray* restrict const ray, const Entity* restrict const entity, _mut_ RayIntersection* restrict const intersection)
+{
+    __UE_ASSERT__(ray && entity && intersection);
+    __UE_ASSERT__(entity->type == ET_SPHERE || entity->type == ET_NONE);
+    __UE_STAT__(primitive_tests, 1);
 
     // Quadratic
     r32 entity_radius_sq = entity->radius * entity->radius;
@@ -243,14 +402,30 @@ IntersectEntity(const Ray* restrict const ray, const Entity* restrict const enti
         v3Sub(&entity->position, &intersection->position, &intersection->normal_vector);
 
         v3Norm(&intersection->normal_vector);
+    }
+}
+
+__UE_inline__ static void
+IntersectEntity(const Ray* restrict const ray, const Entity* restrict const entity, _mut_ RayIntersection* restrict const intersection)
+{
+    __UE_ASSERT__(ray && entity && intersection);
+    __UE_ASSERT__(v3IsNorm(&ray->direction));
 
-        // [ cfarvin::REVSIT ] intersection materials
-        // Set intersection material
-        intersection->intersection_material.max_generated_rays     = entity->material.max_generated_rays;
-        intersection->intersection_material.material_class         = entity->material.material_class;
-        intersection->intersection_material.absorbtion_coefficient = entity->material.absorbtion_coefficient;
-        intersection->intersection_material.color                  = entity->material.color;
+    // Meshes are traced by TraceMeshEntityArray(), see: mesh_tools.h
+    // Note: per-entity dispatch; scene_tools.h traces each type as a batch.
+    if (entity->type == ET_TRIANGLE_MESH)
+    {
+        intersection->does_intersect = false;
+        return;
     }
+
+    if (entity->type == ET_CUBE)
+    {
+        IntersectCube(ray, entity, intersection);
+        return;
+    }
+
+    IntersectSphere(ray, entity, intersection);
 }
 
 __UE_inline__ static void
@@ -288,40 +463,28 @@ TraceEntityArray(const Ray* restrict const ray,
     __UE_ASSERT__(entity_arr);
     __UE_ASSERT__(global_magnitude_threshold);
     __UE_ASSERT__(num_entitys >= 2); // See: TraceEntity( ... );
+    __UE_STAT__(rays, 1);
 
     RayIntersection closestIntersection = { 0 };
     closestIntersection.magnitude       = MAX_RAY_MAG;
-//
-#if __UE_AA__reflections
-    //
+
     size_t intersected_entity_index = 0;
-//
-#endif // __UE_AA__reflections \
-    //
     for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
     {
         IntersectEntity(ray, &entity_arr[entity_index], intersection);
         if (intersection->does_intersect && (intersection->magnitude < closestIntersection.magnitude))
         {
-            closestIntersection.does_intersect = true;
-            closestIntersection.magnitude      = intersection->magnitude;
-            v3Set(&closestIntersection.normal_vector, intersection->normal_vector.x, intersection->normal_vector.y, intersection->normal_vector.z);
+            closestIntersection = *intersection;
 
-            return_color->value = (entity_arr[entity_index]).material.color.value;
-//
-#if __UE_AA__reflections
-            //
+            return_color->value      = (entity_arr[entity_index]).material.color.value;
             intersected_entity_index = entity_index;
-//
-#endif // __UE_AA__reflections \
-    //
         }
     }
 
-    if (closestIntersection.does_intersect && fabs(closestIntersection.magnitude) < fabs(*global_magnitude_threshold))
-    {
-        intersection->does_intersect = true;
-    }
+    // Report the closest intersection rather than the last entity tested.
+    *intersection                = closestIntersection;
+    intersection->does_intersect = closestIntersection.does_intersect && fabs(closestIntersection.magnitude) < fabs(*global_magnitude_threshold);
+    intersection->entity_index   = intersection->does_intersect ? ( u32 )intersected_entity_index : ENTITY_INDEX_NONE;
 
 //
 #if __UE_AA__reflections
@@ -332,6 +495,127 @@ TraceEntityArray(const Ray* restrict const ray,
        //
 }
 
+//
+// Occlusion
+//
+// Any-hit queries for shadow and visibility rays. An entity occludes a ray if
+// its surface crosses the ray within [ 0, max_magnitude ). No intersection
+// record is built and the first occluder found ends the query.
+//
+// Note: callers tracing from a surface should offset the ray origin, ie: by
+//       TOLERANCE along the normal, so the surface does not occlude itself.
+//
+__UE_inline__ static bool
+IsRayOccludedByEntity(const Ray* restrict const ray, const Entity* restrict const entity, const r32 max_magnitude)
+{
+    __UE_ASSERT__(ray && entity);
+    __UE_ASSERT__(v3IsNorm(&ray->direction));
+
+    // Meshes are handled by OccludedMeshEntityArray(), see: mesh_tools.h
+    if (entity->type == ET_TRIANGLE_MESH)
+    {
+        return false;
+    }
+
+    r32 t_near = 0.0f;
+    r32 t_far  = 0.0f;
+    if (entity->type == ET_CUBE)
+    {
+        const r32 half_length = 0.5f * entity->length;
+
+        t_near = -FLT_MAX;
+        t_far  = FLT_MAX;
+        for (u8 axis = 0; axis < 3; axis++)
+        {
+            const r32 slab_min = entity->position.arr[axis] - half_length;
+            const r32 slab_max = entity->position.arr[axis] + half_length;
+            if (ray->direction.arr[axis] == 0.0f)
+            {
+                if (ray->origin.arr[axis] < slab_min || ray->origin.arr[axis] > slab_max)
+                {
+                    return false;
+                }
+
+                continue;
+            }
+
+            const r32 inverse_direction = 1.0f / ray->direction.arr[axis];
+            const r32 t0                = (slab_min - ray->origin.arr[axis]) * inverse_direction;
+            const r32 t1                = (slab_max - ray->origin.arr[axis]) * inverse_direction;
+            const r32 slab_near         = t0 < t1 ? t0 : t1;
+            const r32 slab_far          = t0 < t1 ? t1 : t0;
+            t_near                      = slab_near > t_near ? slab_near : t_near;
+            t_far                       = slab_far < t_far ? slab_far : t_far;
+        }
+
+        if (t_near > t_far)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        v3 ray_to_entity = { 0 };
+        v3Sub(&ray->origin, &entity->position, &ray_to_entity);
+
+        // Normalized direction
+        const r32 b            = v3Dot(&ray->direction, &ray_to_entity);
+        const r32 c            = v3Dot(&ray_to_entity, &ray_to_entity) - (entity->radius * entity->radius);
+        const r32 discriminant = (b * b) - c;
+        if (discriminant < 0.0f)
+        {
+            return false;
+        }
+
+        const r32 root = ( r32 )sqrt(discriminant);
+        t_near         = -b - root;
+        t_far          = -b + root;
+    }
+
+    return (t_near >= 0.0f && t_near < max_magnitude) || (t_far >= 0.0f && t_far < max_magnitude);
+}
+
+// Any-hit counterpart of TraceEntityArray().
+__UE_inline__ static bool
+OccludedEntityArray(const Ray* restrict const ray, const r32 max_magnitude, const Entity* restrict const entity_arr, const size_t num_entitys)
+{
+    __UE_ASSERT__(ray && entity_arr);
+
+    for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
+    {
+        if (IsRayOccludedByEntity(ray, &entity_arr[entity_index], max_magnitude))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Trace a single camera ray through the continuous image coordinate
+// (sample_x, sample_y).
+__UE_inline__ static void
+TracePrimarySample(const r32                         sample_x,
+                   const r32                         sample_y,
+                   const size_t                      image_width,
+                   const size_t                      image_height,
+                   _mut_ RayIntersection* restrict const intersection,
+                   _mut_ Color32_RGB* restrict const return_color,
+                   const Entity* restrict const      entity_arr,
+                   const size_t                      num_entitys)
+{
+    __UE_ASSERT__(intersection);
+    __UE_ASSERT__(return_color);
+    __UE_ASSERT__(entity_arr);
+
+    Ray ray = { 0 };
+    SetRayDirectionByPixelSample(&ray, sample_x, sample_y, image_width, image_height);
+    v3Norm(&ray.direction);
+
+    r32 magnitude_threshold = ( r32 )MAX_RAY_MAG;
+    TraceEntityArray(&ray, intersection, &magnitude_threshold, return_color, entity_arr, num_entitys);
+}
+
 static Entity*
 CreateRandomEntities(size_t num_entitys)
 {
@@ -346,12 +630,16 @@ CreateRandomEntities(size_t num_entitys)
         entity_arr[entity_index].position.z = NormalizeToRange(( r32 )TOLERANCE, (r32)(~( u32 )0), -2.0f, -1.0f, ( r32 )XorShift32());
 
         // Radius
+        entity_arr[entity_index].type   = ET_SPHERE;
         entity_arr[entity_index].radius = NormalizeToRange(( r32 )TOLERANCE, (r32)(~( u32 )0), 0.15f, 0.30f, ( r32 )XorShift32());
 
         // Materials
         entity_arr[entity_index].material.color.channel.R = BindValueTo8BitColorChannel(( r32 )TOLERANCE, (r32)(~( u32 )0), ( r32 )XorShift32());
         entity_arr[entity_index].material.color.channel.G = BindValueTo8BitColorChannel(( r32 )TOLERANCE, (r32)(~( u32 )0), ( r32 )XorShift32());
         entity_arr[entity_index].material.color.channel.B = BindValueTo8BitColorChannel(( r32 )TOLERANCE, (r32)(~( u32 )0), ( r32 )XorShift32());
+
+        entity_arr[entity_index].material.material_class = (entity_index & 1) ? MATERIAL_CLASS_METAL : MATERIAL_CLASS_DIFFUSE;
+        GetDefaultMaterialByClass(&entity_arr[entity_index].material, entity_arr[entity_index].material.material_class);
 //
 #if __UE_debug__ == 1
         //
@@ -373,6 +661,3 @@ CreateRandomEntities(size_t num_entitys)
 }
 
 #endif // __UE_ENTITY_TOOLS_H___
-
-// [ cfarvin::TODO ] The following are sphere-only: uCreateEntities(),
-// IntersectEntity(), TraceEntity(), TraceEntityArray(), CreateRandomEntities()
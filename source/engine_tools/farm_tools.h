@@ -0,0 +1,736 @@
+#ifndef __UE_FARM_TOOLS_H___
+#define __UE_FARM_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <clock_tools.h>
+#include <entity_tools.h>
+#include <kernel_tools.h>
+#include <macro_tools.h>
+#include <scene_tools.h>
+#include <type_tools.h>
+
+#include <atomic>
+#include <errno.h>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif // _WIN32
+
+//
+// Multi-process render farm
+//
+// A coordinator publishes the scene once in a shared-memory segment and runs
+// each frame on a set of local worker processes:
+//
+//   <name>_scene  [ FarmSceneHeader ][ Entity ] entity_count
+//                 mapped read-only by the workers
+//   <name>_work   [ FarmWorkHeader ][ tile state ] tile_count [ pixels ]
+//                 the work queue and the shared framebuffer
+//
+// A tile is a band of rows_per_tile image rows. The queue is a single atomic
+// counter: a worker claims the next tile with a fetch_add, traces it with the
+// frame's specialized kernel (see: kernel_tools.h) straight into the shared
+// framebuffer and then marks the tile done. Workers never coordinate with
+// each other and nothing but the counter is contended.
+//
+// Workers are this executable, re-launched with --farm-worker <name>; each
+// maps the scene where it lies, so N workers on N sockets share one copy of
+// it. A worker that crashes loses at most the tiles it had claimed: once all
+// workers have exited the coordinator traces any tile not marked done itself.
+// A worker still running worker_timeout_seconds after the launch is killed
+// and its tiles are recovered the same way.
+//
+// Workers live for one frame: every frame pays a process launch per worker
+// (FarmFrameReport::launch_seconds) and each worker maps both segments
+// again. On small images this can dominate the frame; the batch report
+// prints the launch time.
+//
+// Note: the segments store Entity verbatim; coordinator and workers must be
+//       the same build (see: FarmSceneHeader).
+//
+
+#define FARM_MAGIC        0x4D524146 // "FARM"
+#define FARM_VERSION      1
+#define FARM_MAX_NAME     64
+#define FARM_MAX_SEGMENT  (FARM_MAX_NAME + 16) // A farm name with its platform prefix and segment suffix
+#define FARM_MAX_WORKERS  256
+#define FARM_WORKER_FLAG  "--farm-worker"
+
+static_assert(std::atomic<u32>::is_always_lock_free, "farm queues are shared between processes");
+
+typedef struct
+{
+    u32 magic;
+    u32 version;
+    u32 entity_size; // sizeof(Entity) of the coordinator
+    u32 reserved;
+    u64 entity_count;
+    u64 entity_offset;
+    u64 segment_size;
+} FarmSceneHeader;
+
+typedef struct
+{
+    u32                 magic;
+    u32                 version;
+    u32                 image_width;
+    u32                 image_height;
+    u32                 rows_per_tile;
+    u32                 tile_count;
+    u32                 sample_index;
+    u32                 reserved;
+    TraceKernelSettings kernel;
+
+    std::atomic<u32> next_tile;  // Next unclaimed tile
+    std::atomic<u32> tiles_done; // Tiles completed by workers this frame
+
+    u64 tile_state_offset; // std::atomic<u32>[ tile_count ], 1 once a tile's pixels are written
+    u64 pixel_offset;      // Color32_RGB[ image_width * image_height ], row-major
+    u64 segment_size;
+} FarmWorkHeader;
+
+typedef struct
+{
+    u8*    base;
+    size_t size;
+    bool   is_owner; // The owner removes the segment on close
+    char   name[FARM_MAX_SEGMENT];
+#if _WIN32
+    HANDLE mapping_handle;
+#else
+    int descriptor;
+#endif // _WIN32
+} FarmSegment;
+
+typedef struct
+{
+    u32         worker_count;
+    u32         rows_per_tile;
+    r64         worker_timeout_seconds; // From the launch; workers still running then are killed
+    const char* worker_executable;      // NULL re-launches the running executable
+} FarmSettings;
+
+typedef struct
+{
+    FarmSettings settings;
+    char         name[FARM_MAX_NAME];
+    FarmSegment  scene_segment;
+    FarmSegment  work_segment;
+    Scene*       entity_scene; // Over the scene segment, for tile recovery
+} Farm;
+
+typedef struct
+{
+    u32 tiles_by_workers;
+    u32 tiles_recovered;   // Traced by the coordinator after a worker failed
+    u32 failed_workers;    // Workers that could not start or did not exit cleanly
+    u32 timed_out_workers; // Killed at the deadline; also counted as failed
+    r64 launch_seconds;    // Spent starting the workers
+} FarmFrameReport;
+
+__UE_inline__ static void
+GetDefaultFarmSettings(_mut_ FarmSettings* restrict const settings)
+{
+    __UE_ASSERT__(settings);
+
+    settings->worker_count           = 4;
+    settings->rows_per_tile          = 8;
+    settings->worker_timeout_seconds = 300.0;
+    settings->worker_executable      = NULL;
+}
+
+//
+// Shared-memory segments
+//
+
+// An unopened segment; CloseFarmSegment() on it is a no-op.
+__UE_inline__ static void
+ResetFarmSegment(_mut_ FarmSegment* restrict const segment)
+{
+    __UE_ASSERT__(segment);
+
+    memset(segment, 0, sizeof(FarmSegment));
+#if !_WIN32
+    segment->descriptor = -1;
+#endif // !_WIN32
+}
+
+// 'segment_name' holds FARM_MAX_SEGMENT characters. Returns false if the
+// name does not fit.
+__UE_inline__ static bool
+GetFarmSegmentName(const char* const farm_name, const char* const suffix, _mut_ char* restrict const segment_name)
+{
+#if _WIN32
+    const int length = snprintf(segment_name, FARM_MAX_SEGMENT, "Local\\%s_%s", farm_name, suffix);
+#else
+    const int length = snprintf(segment_name, FARM_MAX_SEGMENT, "/%s_%s", farm_name, suffix);
+#endif // _WIN32
+    return length > 0 && length < FARM_MAX_SEGMENT;
+}
+
+static void
+CloseFarmSegment(_mut_ FarmSegment* restrict const segment)
+{
+    __UE_ASSERT__(segment);
+
+#if _WIN32
+    if (segment->base)
+    {
+        UnmapViewOfFile(segment->base);
+    }
+    if (segment->mapping_handle)
+    {
+        CloseHandle(segment->mapping_handle);
+    }
+#else
+    if (segment->base)
+    {
+        munmap(segment->base, segment->size);
+    }
+    if (segment->descriptor >= 0)
+    {
+        close(segment->descriptor);
+    }
+    if (segment->is_owner)
+    {
+        shm_unlink(segment->name);
+    }
+#endif // _WIN32
+
+    ResetFarmSegment(segment);
+}
+
+// Creates and maps a zero-filled segment. Returns false if a segment of that
+// name exists or memory is unavailable.
+static bool
+CreateFarmSegment(const char* const segment_name, const size_t size, _mut_ FarmSegment* restrict const segment)
+{
+    __UE_ASSERT__(segment_name && size && segment);
+
+    ResetFarmSegment(segment);
+    strncpy(segment->name, segment_name, FARM_MAX_SEGMENT - 1);
+    segment->size     = size;
+    segment->is_owner = true;
+
+#if _WIN32
+    segment->mapping_handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, ( DWORD )(( u64 )size >> 32), ( DWORD )size, segment_name);
+    if (!segment->mapping_handle || GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        CloseFarmSegment(segment);
+        return false;
+    }
+
+    segment->base = ( u8* )MapViewOfFile(segment->mapping_handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+#else
+    segment->descriptor = shm_open(segment_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (segment->descriptor < 0)
+    {
+        segment->is_owner = false;
+        CloseFarmSegment(segment);
+        return false;
+    }
+
+    void* base = MAP_FAILED;
+    if (ftruncate(segment->descriptor, ( off_t )size) == 0)
+    {
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->descriptor, 0);
+    }
+
+    segment->base = (base == MAP_FAILED) ? NULL : ( u8* )base;
+#endif // _WIN32
+
+    if (!segment->base)
+    {
+        CloseFarmSegment(segment);
+        return false;
+    }
+
+    return true;
+}
+
+// Maps an existing segment; read-only unless 'writable'. The caller checks
+// the segment's own header for its size.
+static bool
+OpenFarmSegment(const char* const segment_name, const bool writable, _mut_ FarmSegment* restrict const segment)
+{
+    __UE_ASSERT__(segment_name && segment);
+
+    ResetFarmSegment(segment);
+    strncpy(segment->name, segment_name, FARM_MAX_SEGMENT - 1);
+
+#if _WIN32
+    segment->mapping_handle = OpenFileMappingA(writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, FALSE, segment_name);
+    segment->base           = segment->mapping_handle ? ( u8* )MapViewOfFile(segment->mapping_handle, writable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, 0) : NULL;
+
+    MEMORY_BASIC_INFORMATION region = { 0 };
+    if (!segment->base || !VirtualQuery(segment->base, &region, sizeof(region)))
+    {
+        CloseFarmSegment(segment);
+        return false;
+    }
+
+    segment->size = ( size_t )region.RegionSize;
+#else
+    segment->descriptor   = shm_open(segment_name, writable ? O_RDWR : O_RDONLY, 0);
+    struct stat segment_stat = { 0 };
+    if (segment->descriptor < 0 || fstat(segment->descriptor, &segment_stat) != 0 || !segment_stat.st_size)
+    {
+        CloseFarmSegment(segment);
+        return false;
+    }
+
+    segment->size = ( size_t )segment_stat.st_size;
+    void* base    = mmap(NULL, segment->size, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, segment->descriptor, 0);
+    if (base == MAP_FAILED)
+    {
+        CloseFarmSegment(segment);
+        return false;
+    }
+
+    segment->base = ( u8* )base;
+#endif // _WIN32
+
+    return true;
+}
+
+__UE_inline__ static std::atomic<u32>*
+GetFarmTileStates(const FarmWorkHeader* restrict const work)
+{
+    return ( std::atomic<u32>* )(( u8* )work + work->tile_state_offset);
+}
+
+__UE_inline__ static Color32_RGB*
+GetFarmPixels(const FarmWorkHeader* restrict const work)
+{
+    return ( Color32_RGB* )(( u8* )work + work->pixel_offset);
+}
+
+// Traces one band of rows into the shared framebuffer.
+static void
+RenderFarmTile(const FarmWorkHeader* restrict const work, const Scene* restrict const entity_scene, const u32 tile_index)
+{
+    __UE_ASSERT__(work && entity_scene);
+    __UE_ASSERT__(tile_index < work->tile_count);
+
+    TraceKernelFrame frame = { 0 };
+    frame.pixel_arr        = GetFarmPixels(work);
+    frame.image_width      = work->image_width;
+    frame.image_height     = work->image_height;
+    frame.scene            = entity_scene;
+    frame.sample_index     = work->sample_index;
+
+    const ParallelTaskFunction kernel    = GetTraceKernel(&work->kernel);
+    const u32                  row_begin = tile_index * work->rows_per_tile;
+    const u32                  row_end   = (row_begin + work->rows_per_tile) < work->image_height ? (row_begin + work->rows_per_tile) : work->image_height;
+    for (u32 row = row_begin; row < row_end; row++)
+    {
+        kernel(&frame, row, 0);
+    }
+}
+
+//
+// Worker
+//
+
+// The farm name if argv launches a worker, else NULL.
+static const char*
+GetFarmWorkerArgument(const int argc, char** const argv)
+{
+    for (int arg_index = 1; (arg_index + 1) < argc; arg_index++)
+    {
+        if (!strcmp(argv[arg_index], FARM_WORKER_FLAG))
+        {
+            return argv[arg_index + 1];
+        }
+    }
+
+    return NULL;
+}
+
+// Whether the tile states and the framebuffer 'work' describes lie within its
+// mapped 'segment_size' bytes. Offsets are checked before sizes so that
+// neither difference can wrap.
+static bool
+IsFarmWorkHeaderValid(const FarmWorkHeader* restrict const work, const size_t segment_size)
+{
+    __UE_ASSERT__(work);
+
+    if (segment_size < sizeof(FarmWorkHeader) || work->magic != FARM_MAGIC || work->version != FARM_VERSION || work->segment_size > segment_size)
+    {
+        return false;
+    }
+
+    if (!work->image_width || !work->image_height || !work->rows_per_tile
+        || work->tile_count != ((( u64 )work->image_height + work->rows_per_tile - 1) / work->rows_per_tile) || ( u32 )work->kernel.primitives >= KERNEL_PRIMITIVE_SET_COUNT)
+    {
+        return false;
+    }
+
+    const u64 tile_state_size = ( u64 )work->tile_count * sizeof(std::atomic<u32>);
+    const u64 pixel_size      = ( u64 )work->image_width * work->image_height * sizeof(Color32_RGB);
+    return work->tile_state_offset >= sizeof(FarmWorkHeader) && (work->tile_state_offset % alignof(std::atomic<u32>)) == 0
+           && work->tile_state_offset <= work->segment_size && tile_state_size <= (work->segment_size - work->tile_state_offset)
+           && work->pixel_offset >= sizeof(FarmWorkHeader) && (work->pixel_offset % alignof(Color32_RGB)) == 0
+           && work->pixel_offset <= work->segment_size && pixel_size <= (work->segment_size - work->pixel_offset);
+}
+
+// Claims and traces tiles until the queue is empty. Returns false if the
+// farm's segments cannot be mapped, do not match this build, or describe
+// arrays past their mapped size.
+static bool
+RunFarmWorker(const char* const farm_name)
+{
+    __UE_ASSERT__(farm_name);
+
+    char        scene_name[FARM_MAX_SEGMENT];
+    char        work_name[FARM_MAX_SEGMENT];
+    FarmSegment scene_segment;
+    FarmSegment work_segment;
+    ResetFarmSegment(&scene_segment);
+    ResetFarmSegment(&work_segment);
+    if (!GetFarmSegmentName(farm_name, "scene", scene_name) || !GetFarmSegmentName(farm_name, "work", work_name))
+    {
+        return false;
+    }
+
+    if (!OpenFarmSegment(scene_name, false, &scene_segment))
+    {
+        return false;
+    }
+
+    if (!OpenFarmSegment(work_name, true, &work_segment))
+    {
+        CloseFarmSegment(&scene_segment);
+        return false;
+    }
+
+    const FarmSceneHeader* scene = ( const FarmSceneHeader* )scene_segment.base;
+    FarmWorkHeader*        work  = ( FarmWorkHeader* )work_segment.base;
+    if (scene_segment.size < sizeof(FarmSceneHeader) || scene->magic != FARM_MAGIC || scene->version != FARM_VERSION || scene->entity_size != sizeof(Entity)
+        || scene->segment_size > scene_segment.size || scene->entity_offset < sizeof(FarmSceneHeader) || scene->entity_offset > scene->segment_size || !scene->entity_count
+        || scene->entity_count > ((scene->segment_size - scene->entity_offset) / sizeof(Entity)) || !IsFarmWorkHeaderValid(work, work_segment.size))
+    {
+        CloseFarmSegment(&work_segment);
+        CloseFarmSegment(&scene_segment);
+        return false;
+    }
+
+    const Entity*      entity_arr   = ( const Entity* )(scene_segment.base + scene->entity_offset);
+    Scene*             entity_scene = CreateScene(entity_arr, ( size_t )scene->entity_count);
+    std::atomic<u32>*  tile_states  = GetFarmTileStates(work);
+    for (;;)
+    {
+        const u32 tile_index = work->next_tile.fetch_add(1, std::memory_order_relaxed);
+        if (tile_index >= work->tile_count)
+        {
+            break;
+        }
+
+        RenderFarmTile(work, entity_scene, tile_index);
+        tile_states[tile_index].store(1, std::memory_order_release);
+        work->tiles_done.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    DestroyScene(entity_scene);
+    CloseFarmSegment(&work_segment);
+    CloseFarmSegment(&scene_segment);
+    return true;
+}
+
+//
+// Coordinator
+//
+static void
+DestroyFarm(_mut_ Farm* restrict const farm)
+{
+    if (!farm)
+    {
+        return;
+    }
+
+    DestroyScene(farm->entity_scene);
+    CloseFarmSegment(&farm->work_segment);
+    CloseFarmSegment(&farm->scene_segment);
+    free(farm);
+}
+
+// Publishes the scene and a framebuffer for image_width x image_height.
+// Returns NULL if the segments cannot be created.
+static Farm*
+CreateFarm(const FarmSettings* restrict const settings, const Entity* restrict const entity_arr, const size_t num_entitys, const u32 image_width, const u32 image_height)
+{
+    __UE_ASSERT__(settings && entity_arr && num_entitys);
+    __UE_ASSERT__(settings->worker_count && settings->worker_count <= FARM_MAX_WORKERS);
+    __UE_ASSERT__(settings->rows_per_tile);
+    __UE_ASSERT__(image_width && image_height);
+
+    Farm* farm = ( Farm* )calloc(1, sizeof(Farm));
+    __UE_ASSERT__(farm);
+
+    ResetFarmSegment(&farm->scene_segment);
+    ResetFarmSegment(&farm->work_segment);
+    farm->settings = *settings;
+#if _WIN32
+    snprintf(farm->name, FARM_MAX_NAME, "ue_farm_%lu", ( unsigned long )GetCurrentProcessId());
+#else
+    snprintf(farm->name, FARM_MAX_NAME, "ue_farm_%ld", ( long )getpid());
+#endif // _WIN32
+
+    char scene_name[FARM_MAX_SEGMENT];
+    char work_name[FARM_MAX_SEGMENT];
+    if (!GetFarmSegmentName(farm->name, "scene", scene_name) || !GetFarmSegmentName(farm->name, "work", work_name))
+    {
+        DestroyFarm(farm);
+        return NULL;
+    }
+
+    // Scene
+    const size_t entity_offset = (sizeof(FarmSceneHeader) + 63) & ~( size_t )63;
+    const size_t scene_size    = entity_offset + (num_entitys * sizeof(Entity));
+    if (!CreateFarmSegment(scene_name, scene_size, &farm->scene_segment))
+    {
+        DestroyFarm(farm);
+        return NULL;
+    }
+
+    FarmSceneHeader* scene = ( FarmSceneHeader* )farm->scene_segment.base;
+    scene->magic           = FARM_MAGIC;
+    scene->version         = FARM_VERSION;
+    scene->entity_size     = sizeof(Entity);
+    scene->entity_count    = num_entitys;
+    scene->entity_offset   = entity_offset;
+    scene->segment_size    = scene_size;
+    memcpy(farm->scene_segment.base + entity_offset, entity_arr, num_entitys * sizeof(Entity));
+    farm->entity_scene = CreateScene(( const Entity* )(farm->scene_segment.base + entity_offset), num_entitys);
+
+    // Work queue and framebuffer
+    const u32    tile_count        = (image_height + settings->rows_per_tile - 1) / settings->rows_per_tile;
+    const size_t tile_state_offset = (sizeof(FarmWorkHeader) + 63) & ~( size_t )63;
+    const size_t pixel_offset      = (tile_state_offset + (tile_count * sizeof(std::atomic<u32>)) + 63) & ~( size_t )63;
+    const size_t work_size         = pixel_offset + (( size_t )image_width * image_height * sizeof(Color32_RGB));
+    if (!CreateFarmSegment(work_name, work_size, &farm->work_segment))
+    {
+        DestroyFarm(farm);
+        return NULL;
+    }
+
+    FarmWorkHeader* work    = new (farm->work_segment.base) FarmWorkHeader();
+    work->magic             = FARM_MAGIC;
+    work->version           = FARM_VERSION;
+    work->image_width       = image_width;
+    work->image_height      = image_height;
+    work->rows_per_tile     = settings->rows_per_tile;
+    work->tile_count        = tile_count;
+    work->tile_state_offset = tile_state_offset;
+    work->pixel_offset      = pixel_offset;
+    work->segment_size      = work_size;
+
+    std::atomic<u32>* tile_states = ( std::atomic<u32>* )(farm->work_segment.base + tile_state_offset);
+    for (u32 tile_index = 0; tile_index < tile_count; tile_index++)
+    {
+        new (&tile_states[tile_index]) std::atomic<u32>(0);
+    }
+
+    return farm;
+}
+
+// Path of the running executable, used to launch workers.
+static bool
+GetFarmWorkerExecutable(_mut_ char* restrict const path, const size_t path_size)
+{
+#if _WIN32
+    const DWORD length = GetModuleFileNameA(NULL, path, ( DWORD )path_size);
+    return length > 0 && length < path_size;
+#else
+    const ssize_t length = readlink("/proc/self/exe", path, path_size - 1);
+    if (length <= 0)
+    {
+        return false;
+    }
+
+    path[length] = '\0';
+    return true;
+#endif // _WIN32
+}
+
+// Waits for a worker until 'deadline' (see: GetClockSeconds()) and kills it if
+// it is still running then; 'timed_out' is set if it was killed. Returns
+// whether it exited cleanly.
+#if _WIN32
+static bool
+WaitForFarmWorker(const HANDLE worker, const r64 deadline, _mut_ bool* restrict const timed_out)
+{
+    __UE_ASSERT__(timed_out);
+
+    const r64   remaining_ms = (deadline - GetClockSeconds()) * 1000.0;
+    const DWORD wait_ms      = remaining_ms <= 0.0 ? 0 : (remaining_ms >= ( r64 )(INFINITE - 1) ? (INFINITE - 1) : ( DWORD )remaining_ms);
+    *timed_out               = (WaitForSingleObject(worker, wait_ms) == WAIT_TIMEOUT);
+    if (*timed_out)
+    {
+        TerminateProcess(worker, 1);
+        WaitForSingleObject(worker, INFINITE);
+    }
+
+    DWORD exit_code = 1;
+    GetExitCodeProcess(worker, &exit_code);
+    CloseHandle(worker);
+    return !*timed_out && exit_code == 0;
+}
+#else
+static bool
+WaitForFarmWorker(const pid_t worker, const r64 deadline, _mut_ bool* restrict const timed_out)
+{
+    __UE_ASSERT__(timed_out);
+
+    // waitpid() has no timeout, so the worker is polled
+    const struct timespec poll_interval = { 0, 1000000 };
+    int                   status        = 0;
+    *timed_out                          = false;
+    for (;;)
+    {
+        const pid_t result = waitpid(worker, &status, WNOHANG);
+        if (result == worker)
+        {
+            return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+        if (result < 0 && errno != EINTR)
+        {
+            return false;
+        }
+
+        if (GetClockSeconds() >= deadline)
+        {
+            kill(worker, SIGKILL);
+            while (waitpid(worker, &status, 0) < 0 && errno == EINTR)
+            {
+            }
+
+            *timed_out = true;
+            return false;
+        }
+
+        nanosleep(&poll_interval, NULL);
+    }
+}
+#endif // _WIN32
+
+// Traces one frame on the farm's workers into 'pixel_arr' (row-major,
+// image_width * image_height). Tiles lost to workers that failed to start,
+// crashed or were killed at the deadline are traced here instead, so every
+// pixel is always written.
+static void
+RenderFarmFrame(_mut_ Farm* restrict const farm,
+                const TraceKernelSettings* restrict const kernel,
+                const u32                                 sample_index,
+                _mut_ Color32_RGB* restrict const         pixel_arr,
+                _mut_ FarmFrameReport* restrict const     report)
+{
+    __UE_ASSERT__(farm && kernel && pixel_arr && report);
+
+    FarmWorkHeader*   work        = ( FarmWorkHeader* )farm->work_segment.base;
+    std::atomic<u32>* tile_states = GetFarmTileStates(work);
+    memset(report, 0, sizeof(FarmFrameReport));
+
+    work->kernel       = *kernel;
+    work->sample_index = sample_index;
+    work->next_tile.store(0, std::memory_order_relaxed);
+    work->tiles_done.store(0, std::memory_order_relaxed);
+    for (u32 tile_index = 0; tile_index < work->tile_count; tile_index++)
+    {
+        tile_states[tile_index].store(0, std::memory_order_relaxed);
+    }
+
+    char executable[1024];
+    if (farm->settings.worker_executable)
+    {
+        strncpy(executable, farm->settings.worker_executable, sizeof(executable) - 1);
+        executable[sizeof(executable) - 1] = '\0';
+    }
+    else if (!GetFarmWorkerExecutable(executable, sizeof(executable)))
+    {
+        executable[0] = '\0';
+    }
+
+    // Launch; the queue is complete before any worker starts
+#if _WIN32
+    HANDLE worker_arr[FARM_MAX_WORKERS];
+    char   command_line[1200];
+    snprintf(command_line, sizeof(command_line), "\"%s\" %s %s", executable, FARM_WORKER_FLAG, farm->name);
+#else
+    pid_t worker_arr[FARM_MAX_WORKERS];
+    char* worker_argv[] = { executable, ( char* )FARM_WORKER_FLAG, farm->name, NULL };
+#endif // _WIN32
+
+    const r64 launch_begin = GetClockSeconds();
+    u32       worker_count = 0;
+    for (u32 worker_index = 0; executable[0] && worker_index < farm->settings.worker_count; worker_index++)
+    {
+#if _WIN32
+        STARTUPINFOA        startup_info = { 0 };
+        PROCESS_INFORMATION process_info = { 0 };
+        startup_info.cb                  = sizeof(startup_info);
+        if (!CreateProcessA(executable, command_line, NULL, NULL, FALSE, 0, NULL, NULL, &startup_info, &process_info))
+        {
+            report->failed_workers++;
+            continue;
+        }
+
+        CloseHandle(process_info.hThread);
+        worker_arr[worker_count++] = process_info.hProcess;
+#else
+        pid_t worker_pid = 0;
+        if (posix_spawn(&worker_pid, executable, NULL, NULL, worker_argv, environ) != 0)
+        {
+            report->failed_workers++;
+            continue;
+        }
+
+        worker_arr[worker_count++] = worker_pid;
+#endif // _WIN32
+    }
+    report->launch_seconds = GetClockSeconds() - launch_begin;
+
+    const r64 deadline = launch_begin + farm->settings.worker_timeout_seconds;
+    for (u32 worker_index = 0; worker_index < worker_count; worker_index++)
+    {
+        bool timed_out = false;
+        if (!WaitForFarmWorker(worker_arr[worker_index], deadline, &timed_out))
+        {
+            report->failed_workers++;
+            report->timed_out_workers += timed_out;
+        }
+    }
+
+    // Recovery
+    for (u32 tile_index = 0; tile_index < work->tile_count; tile_index++)
+    {
+        if (tile_states[tile_index].load(std::memory_order_acquire))
+        {
+            report->tiles_by_workers++;
+            continue;
+        }
+
+        RenderFarmTile(work, farm->entity_scene, tile_index);
+        report->tiles_recovered++;
+    }
+
+    memcpy(pixel_arr, GetFarmPixels(work), ( size_t )work->image_width * work->image_height * sizeof(Color32_RGB));
+}
+
+#endif // __UE_FARM_TOOLS_H___
@@ -0,0 +1,336 @@
+#ifndef __UE_FRAME_SCHEDULE_TOOLS_H___
+#define __UE_FRAME_SCHEDULE_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <clock_tools.h>
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <sampler_tools.h>
+#include <thread_tools.h>
+#include <type_tools.h>
+
+#include <algorithm>
+#include <atomic>
+#include <float.h>
+#include <stdlib.h>
+
+//
+// Deadline-aware frame rendering
+//
+// Each frame, tiles are ranked by priority and rendered in that order until
+// the frame budget runs out. A tile is not started unless the time it took
+// when last rendered still fits before the deadline. Tiles that are not
+// reached keep the previous frame's pixels.
+//
+// Tile priority is the sum of:
+//   - closeness to the screen center, in [ 0, 1 ]
+//   - change_weight * the mean per-channel change the tile showed when it was
+//     last rendered, plus change_weight if the caller marked it changed
+//   - age_weight * the number of frames since the tile was last rendered, so
+//     every tile is eventually refreshed
+// Tiles that have never been rendered come first.
+//
+// Note: pixel_array is read as well as written; it must hold the previous
+//       frame's output.
+//
+
+#define FRAME_TILE_AGE_NEVER (~( u32 )0)
+
+typedef struct
+{
+    r32 budget_ms;
+    r32 change_weight;
+    r32 age_weight;
+} FrameScheduleSettings;
+
+typedef struct
+{
+    size_t tiles_rendered;
+    size_t tile_count;
+    size_t pixels_refreshed;
+    r32    refreshed_fraction; // Share of the image's pixels refreshed this frame
+    r32    elapsed_ms;
+    u32    oldest_tile_age;    // Frames since the stalest tile was rendered, FRAME_TILE_AGE_NEVER if one never was
+} FrameScheduleStats;
+
+typedef struct
+{
+    r32*  tile_priority;
+    r32*  tile_change;  // Mean per-channel change in [ 0, 1 ] at the last render
+    r32*  tile_seconds; // Duration of the last render of each tile
+    u32*  tile_age;     // Frames since the last render, FRAME_TILE_AGE_NEVER if never
+    bool* tile_marked;  // Marked changed by the caller since the last render
+    u32*  tile_queue;   // Tile indices in render order
+
+    size_t image_width;
+    size_t image_height;
+    size_t tile_size;
+    size_t tiles_x;
+    size_t tiles_y;
+    u32    frame_index;
+} FrameScheduleState;
+
+__UE_inline__ static void
+GetDefaultFrameScheduleSettings(_mut_ FrameScheduleSettings* restrict const settings)
+{
+    __UE_ASSERT__(settings);
+
+    settings->budget_ms     = ( r32 )__UE_FS__budget_ms;
+    settings->change_weight = ( r32 )__UE_FS__change_weight;
+    settings->age_weight    = ( r32 )__UE_FS__age_weight;
+}
+
+static FrameScheduleState*
+CreateFrameScheduleState(const size_t image_width, const size_t image_height, const size_t tile_size)
+{
+    __UE_ASSERT__(image_width && image_height && tile_size);
+
+    FrameScheduleState* state = ( FrameScheduleState* )calloc(1, sizeof(FrameScheduleState));
+    __UE_ASSERT__(state);
+
+    state->image_width  = image_width;
+    state->image_height = image_height;
+    state->tile_size    = tile_size;
+    state->tiles_x      = (image_width + tile_size - 1) / tile_size;
+    state->tiles_y      = (image_height + tile_size - 1) / tile_size;
+
+    const size_t tile_count = state->tiles_x * state->tiles_y;
+    state->tile_priority    = ( r32* )calloc(tile_count, sizeof(r32));
+    state->tile_change      = ( r32* )calloc(tile_count, sizeof(r32));
+    state->tile_seconds     = ( r32* )calloc(tile_count, sizeof(r32));
+    state->tile_age         = ( u32* )calloc(tile_count, sizeof(u32));
+    state->tile_marked      = ( bool* )calloc(tile_count, sizeof(bool));
+    state->tile_queue       = ( u32* )calloc(tile_count, sizeof(u32));
+    __UE_ASSERT__(state->tile_priority && state->tile_change && state->tile_seconds);
+    __UE_ASSERT__(state->tile_age && state->tile_marked && state->tile_queue);
+
+    for (size_t tile_index = 0; tile_index < tile_count; tile_index++)
+    {
+        state->tile_age[tile_index] = FRAME_TILE_AGE_NEVER;
+    }
+
+    return state;
+}
+
+static void
+DestroyFrameScheduleState(_mut_ FrameScheduleState* restrict const state)
+{
+    if (!state)
+    {
+        return;
+    }
+
+    free(state->tile_priority);
+    free(state->tile_change);
+    free(state->tile_seconds);
+    free(state->tile_age);
+    free(state->tile_marked);
+    free(state->tile_queue);
+    free(state);
+}
+
+// Raise the priority of every tile overlapping the pixel rectangle
+// [ x_min, x_max ) x [ y_min, y_max ), ie: the screen footprint of a moved
+// entity.
+static void
+MarkFrameRegionChanged(_mut_ FrameScheduleState* restrict const state, const size_t x_min, const size_t y_min, const size_t x_max, const size_t y_max)
+{
+    __UE_ASSERT__(state);
+
+    if (x_min >= x_max || y_min >= y_max || x_min >= state->image_width || y_min >= state->image_height)
+    {
+        return;
+    }
+
+    const size_t tile_x_max = ((x_max < state->image_width ? x_max : state->image_width) - 1) / state->tile_size;
+    const size_t tile_y_max = ((y_max < state->image_height ? y_max : state->image_height) - 1) / state->tile_size;
+    for (size_t tile_y = y_min / state->tile_size; tile_y <= tile_y_max; tile_y++)
+    {
+        for (size_t tile_x = x_min / state->tile_size; tile_x <= tile_x_max; tile_x++)
+        {
+            state->tile_marked[(tile_y * state->tiles_x) + tile_x] = true;
+        }
+    }
+}
+
+static r32
+GetFrameTilePriority(const FrameScheduleState* restrict const state, const FrameScheduleSettings* restrict const settings, const size_t tile_index)
+{
+    if (state->tile_age[tile_index] == FRAME_TILE_AGE_NEVER)
+    {
+        return FLT_MAX;
+    }
+
+    // Distance from the tile center to the screen center, normalized by the
+    // distance to a corner
+    const r32 half_width  = 0.5f * ( r32 )state->image_width;
+    const r32 half_height = 0.5f * ( r32 )state->image_height;
+    const r32 center_x    = ((( r32 )(tile_index % state->tiles_x) + 0.5f) * ( r32 )state->tile_size) - half_width;
+    const r32 center_y    = ((( r32 )(tile_index / state->tiles_x) + 0.5f) * ( r32 )state->tile_size) - half_height;
+    const r32 distance    = ( r32 )sqrt(((center_x * center_x) + (center_y * center_y)) / ((half_width * half_width) + (half_height * half_height)));
+
+    r32 priority = 1.0f - (distance < 1.0f ? distance : 1.0f);
+    priority += settings->change_weight * (state->tile_change[tile_index] + (state->tile_marked[tile_index] ? 1.0f : 0.0f));
+    priority += settings->age_weight * ( r32 )state->tile_age[tile_index];
+
+    return priority;
+}
+
+// Orders the tile queue by descending priority; equal priorities keep tile
+// order so the schedule is reproducible.
+static void
+SortFrameTileQueue(_mut_ u32* restrict const queue, const size_t tile_count, const r32* restrict const priority)
+{
+    __UE_ASSERT__(queue && priority);
+
+    std::sort(queue, queue + tile_count, [priority](const u32 a, const u32 b) {
+        return (priority[a] > priority[b]) || (priority[a] == priority[b] && a < b);
+    });
+}
+
+typedef struct
+{
+    FrameScheduleState* state;
+    Color32_RGB*        pixel_array;
+    const Entity*       entity_arr;
+    size_t              num_entitys;
+    r64                 deadline;
+    r32                 default_tile_seconds; // Estimate for tiles never rendered
+
+    std::atomic< bool >   out_of_time;
+    std::atomic< size_t > tiles_rendered;
+} FrameScheduleContext;
+
+static void
+RenderFrameTileTask(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    FrameScheduleContext* frame = ( FrameScheduleContext* )context;
+    FrameScheduleState*   state = frame->state;
+    if (frame->out_of_time.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    // Stop issuing tiles once the next one is not expected to finish in time
+    const u32 tile_index = state->tile_queue[task_index];
+    const r32 estimate   = (state->tile_age[tile_index] == FRAME_TILE_AGE_NEVER) ? frame->default_tile_seconds : state->tile_seconds[tile_index];
+    const r64 start      = GetClockSeconds();
+    if ((start + estimate) > frame->deadline)
+    {
+        frame->out_of_time.store(true, std::memory_order_relaxed);
+        return;
+    }
+
+    const size_t x_min = (tile_index % state->tiles_x) * state->tile_size;
+    const size_t y_min = (tile_index / state->tiles_x) * state->tile_size;
+    const size_t x_max = (x_min + state->tile_size) < state->image_width ? (x_min + state->tile_size) : state->image_width;
+    const size_t y_max = (y_min + state->tile_size) < state->image_height ? (y_min + state->tile_size) : state->image_height;
+
+    u32 channel_change = 0;
+    for (size_t pix_y = y_min; pix_y < y_max; pix_y++)
+    {
+        for (size_t pix_x = x_min; pix_x < x_max; pix_x++)
+        {
+            const size_t pixel_index = (pix_y * state->image_width) + pix_x;
+
+            BeginPixelSample(( u32 )pixel_index, state->frame_index);
+            RayIntersection intersection = { 0 };
+            Color32_RGB     sample_color = { 0 };
+            TracePrimarySample(( r32 )pix_x + 0.5f, ( r32 )pix_y + 0.5f, state->image_width, state->image_height, &intersection, &sample_color, frame->entity_arr, frame->num_entitys);
+            sample_color.channel.A = 0xFF;
+
+            const Color32_RGB* previous = &frame->pixel_array[pixel_index];
+            channel_change += ( u32 )abs(( s32 )sample_color.channel.R - ( s32 )previous->channel.R);
+            channel_change += ( u32 )abs(( s32 )sample_color.channel.G - ( s32 )previous->channel.G);
+            channel_change += ( u32 )abs(( s32 )sample_color.channel.B - ( s32 )previous->channel.B);
+
+            frame->pixel_array[pixel_index] = sample_color;
+        }
+    }
+
+    // The first render has no previous result to compare against
+    const size_t pixel_count     = (x_max - x_min) * (y_max - y_min);
+    const bool   is_first_render = (state->tile_age[tile_index] == FRAME_TILE_AGE_NEVER);
+
+    state->tile_change[tile_index]  = is_first_render ? 0.0f : (( r32 )channel_change / (3.0f * 255.0f * ( r32 )pixel_count));
+    state->tile_seconds[tile_index] = ( r32 )(GetClockSeconds() - start);
+    state->tile_age[tile_index]     = 0;
+    state->tile_marked[tile_index]  = false;
+    frame->tiles_rendered.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Refresh as much of pixel_array as fits in settings->budget_ms, highest
+// priority tiles first. Tiles are spread over the pool's threads.
+static FrameScheduleStats
+RenderFrameWithDeadline(_mut_ FrameScheduleState* restrict const      state,
+                        const FrameScheduleSettings* restrict const settings,
+                        _mut_ Color32_RGB* restrict const           pixel_array,
+                        const Entity* restrict const                entity_arr,
+                        const size_t                                num_entitys,
+                        ThreadPool* const                           pool)
+{
+    __UE_ASSERT__(state && settings && pixel_array && entity_arr);
+
+    const r64    start      = GetClockSeconds();
+    const size_t tile_count = state->tiles_x * state->tiles_y;
+
+    // Tiles never rendered are estimated at the mean cost of those that were
+    r64    known_seconds = 0;
+    size_t known_count   = 0;
+    for (size_t tile_index = 0; tile_index < tile_count; tile_index++)
+    {
+        if (state->tile_age[tile_index] != FRAME_TILE_AGE_NEVER)
+        {
+            state->tile_age[tile_index]++;
+            known_seconds += state->tile_seconds[tile_index];
+            known_count++;
+        }
+
+        state->tile_priority[tile_index] = GetFrameTilePriority(state, settings, tile_index);
+        state->tile_queue[tile_index]    = ( u32 )tile_index;
+    }
+
+    SortFrameTileQueue(state->tile_queue, tile_count, state->tile_priority);
+
+    FrameScheduleContext frame = {};
+    frame.state                = state;
+    frame.pixel_array          = pixel_array;
+    frame.entity_arr           = entity_arr;
+    frame.num_entitys          = num_entitys;
+    frame.deadline             = start + (( r64 )settings->budget_ms * 1e-3);
+    frame.default_tile_seconds = known_count ? ( r32 )(known_seconds / ( r64 )known_count) : 0.0f;
+    frame.out_of_time.store(false);
+    frame.tiles_rendered.store(0);
+
+    ParallelFor(pool, tile_count, RenderFrameTileTask, &frame);
+
+    FrameScheduleStats stats = { 0 };
+    stats.tile_count         = tile_count;
+    stats.tiles_rendered     = frame.tiles_rendered.load();
+    for (size_t tile_index = 0; tile_index < tile_count; tile_index++)
+    {
+        const u32 age = state->tile_age[tile_index];
+        if (age == 0)
+        {
+            const size_t x_min = (tile_index % state->tiles_x) * state->tile_size;
+            const size_t y_min = (tile_index / state->tiles_x) * state->tile_size;
+            const size_t x_max = (x_min + state->tile_size) < state->image_width ? (x_min + state->tile_size) : state->image_width;
+            const size_t y_max = (y_min + state->tile_size) < state->image_height ? (y_min + state->tile_size) : state->image_height;
+            stats.pixels_refreshed += (x_max - x_min) * (y_max - y_min);
+        }
+
+        stats.oldest_tile_age = (age > stats.oldest_tile_age) ? age : stats.oldest_tile_age;
+    }
+
+    stats.refreshed_fraction = ( r32 )stats.pixels_refreshed / ( r32 )(state->image_width * state->image_height);
+    stats.elapsed_ms         = ( r32 )((GetClockSeconds() - start) * 1e3);
+    state->frame_index++;
+
+    return stats;
+}
+
+#endif // __UE_FRAME_SCHEDULE_TOOLS_H___
@@ -0,0 +1,313 @@
+#ifndef __UE_FRAMEBUFFER_TOOLS_H___
+#define __UE_FRAMEBUFFER_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <cull_tools.h>
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <sampler_tools.h>
+#include <stats_tools.h>
+#include <thread_tools.h>
+#include <type_tools.h>
+
+#include <stdlib.h>
+
+//
+// Tiled framebuffer
+//
+// Pixels are stored tile by tile, tiles in row-major order, and in Morton
+// (Z-curve) order within a tile:
+//
+//   index(x, y) = tile(x, y) * tile_pixels + morton(x % tile_size, y % tile_size)
+//
+// With the default 8 x 8 tiles, a tile is 256 contiguous bytes and every
+// aligned 4 x 4 block shares one 64 byte cache line, so a pixel's vertical
+// neighbours are usually on its own cache line rather than a row away. A
+// tile is the unit of work when rendering in parallel; threads write
+// disjoint, contiguous memory.
+//
+// Images are padded up to whole tiles. ResolveTiledFramebuffer() converts to
+// the linear, row-major layout of WriteBitmap32() at output time.
+//
+
+#define FB_TILE_SIZE   (( size_t )1 << __UE_FB__tile_log2)
+#define FB_TILE_PIXELS (FB_TILE_SIZE * FB_TILE_SIZE)
+
+typedef struct
+{
+    Color32_RGB* pixel_arr; // tile_count * FB_TILE_PIXELS pixels
+
+    size_t image_width;
+    size_t image_height;
+    size_t tiles_x;
+    size_t tiles_y;
+    size_t tile_count;
+} TiledFramebuffer;
+
+// Spreads the low 16 bits of 'value' so that bit n lands on bit 2n.
+__UE_inline__ static u32
+SpreadMorton2DBits(u32 value)
+{
+    value &= 0xFFFF;
+    value = (value | (value << 8)) & 0x00FF00FF;
+    value = (value | (value << 4)) & 0x0F0F0F0F;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+__UE_inline__ static size_t
+GetTiledPixelIndex(const TiledFramebuffer* restrict const framebuffer, const size_t pix_x, const size_t pix_y)
+{
+    __UE_ASSERT__(framebuffer);
+    __UE_ASSERT__(pix_x < (framebuffer->tiles_x * FB_TILE_SIZE) && pix_y < (framebuffer->tiles_y * FB_TILE_SIZE));
+
+    const size_t tile_index = ((pix_y >> __UE_FB__tile_log2) * framebuffer->tiles_x) + (pix_x >> __UE_FB__tile_log2);
+    const u32    inner_x    = SpreadMorton2DBits(( u32 )(pix_x & (FB_TILE_SIZE - 1)));
+    const u32    inner_y    = SpreadMorton2DBits(( u32 )(pix_y & (FB_TILE_SIZE - 1)));
+    return (tile_index * FB_TILE_PIXELS) + (inner_x | (inner_y << 1));
+}
+
+__UE_inline__ static Color32_RGB*
+GetTiledPixel(const TiledFramebuffer* restrict const framebuffer, const size_t pix_x, const size_t pix_y)
+{
+    return &framebuffer->pixel_arr[GetTiledPixelIndex(framebuffer, pix_x, pix_y)];
+}
+
+static TiledFramebuffer*
+CreateTiledFramebuffer(const size_t image_width, const size_t image_height)
+{
+    __UE_ASSERT__(image_width && image_height);
+    __UE_ASSERT__(__UE_FB__tile_log2 <= 8);
+
+    TiledFramebuffer* framebuffer = ( TiledFramebuffer* )calloc(1, sizeof(TiledFramebuffer));
+    __UE_ASSERT__(framebuffer);
+
+    framebuffer->image_width  = image_width;
+    framebuffer->image_height = image_height;
+    framebuffer->tiles_x      = (image_width + FB_TILE_SIZE - 1) >> __UE_FB__tile_log2;
+    framebuffer->tiles_y      = (image_height + FB_TILE_SIZE - 1) >> __UE_FB__tile_log2;
+    framebuffer->tile_count   = framebuffer->tiles_x * framebuffer->tiles_y;
+    framebuffer->pixel_arr    = ( Color32_RGB* )calloc(framebuffer->tile_count * FB_TILE_PIXELS, sizeof(Color32_RGB));
+    __UE_ASSERT__(framebuffer->pixel_arr);
+
+    return framebuffer;
+}
+
+static void
+DestroyTiledFramebuffer(_mut_ TiledFramebuffer* restrict const framebuffer)
+{
+    if (!framebuffer)
+    {
+        return;
+    }
+
+    free(framebuffer->pixel_arr);
+    free(framebuffer);
+}
+
+//
+// Layout conversion
+//
+typedef struct
+{
+    TiledFramebuffer* framebuffer;
+    Color32_RGB*      linear_arr;
+    bool              to_linear;
+} TiledConversionContext;
+
+// One row of tiles; inner rows are copied with the Morton offsets of their
+// columns computed once per tile row.
+static void
+ConvertTiledFramebufferRow(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const TiledConversionContext* conversion  = ( const TiledConversionContext* )context;
+    const TiledFramebuffer*       framebuffer = conversion->framebuffer;
+    const size_t                  tile_y      = task_index;
+    const size_t                  row_begin   = tile_y * FB_TILE_SIZE;
+    const size_t                  row_end     = (row_begin + FB_TILE_SIZE) < framebuffer->image_height ? (row_begin + FB_TILE_SIZE) : framebuffer->image_height;
+
+    u32 column_offset[FB_TILE_SIZE];
+    for (size_t inner_x = 0; inner_x < FB_TILE_SIZE; inner_x++)
+    {
+        column_offset[inner_x] = SpreadMorton2DBits(( u32 )inner_x);
+    }
+
+    for (size_t tile_x = 0; tile_x < framebuffer->tiles_x; tile_x++)
+    {
+        Color32_RGB* tile         = &framebuffer->pixel_arr[((tile_y * framebuffer->tiles_x) + tile_x) * FB_TILE_PIXELS];
+        const size_t column_begin = tile_x * FB_TILE_SIZE;
+        const size_t column_count = (column_begin + FB_TILE_SIZE) < framebuffer->image_width ? FB_TILE_SIZE : (framebuffer->image_width - column_begin);
+        for (size_t pix_y = row_begin; pix_y < row_end; pix_y++)
+        {
+            const u32    row_offset = SpreadMorton2DBits(( u32 )(pix_y - row_begin)) << 1;
+            Color32_RGB* linear_row = &conversion->linear_arr[(pix_y * framebuffer->image_width) + column_begin];
+            if (conversion->to_linear)
+            {
+                for (size_t inner_x = 0; inner_x < column_count; inner_x++)
+                {
+                    linear_row[inner_x] = tile[row_offset | column_offset[inner_x]];
+                }
+            }
+            else
+            {
+                for (size_t inner_x = 0; inner_x < column_count; inner_x++)
+                {
+                    tile[row_offset | column_offset[inner_x]] = linear_row[inner_x];
+                }
+            }
+        }
+    }
+}
+
+// Write the image to a linear, row-major pixel array (see: WriteBitmap32()).
+static void
+ResolveTiledFramebuffer(const TiledFramebuffer* restrict const framebuffer, _mut_ Color32_RGB* restrict const pixel_array, ThreadPool* const pool)
+{
+    __UE_ASSERT__(framebuffer && pixel_array);
+
+    TiledConversionContext conversion = { 0 };
+    conversion.framebuffer            = ( TiledFramebuffer* )framebuffer;
+    conversion.linear_arr             = pixel_array;
+    conversion.to_linear              = true;
+
+    ParallelFor(pool, framebuffer->tiles_y, ConvertTiledFramebufferRow, &conversion);
+}
+
+// Read the image from a linear, row-major pixel array; padding is untouched.
+static void
+LoadTiledFramebuffer(_mut_ TiledFramebuffer* restrict const framebuffer, const Color32_RGB* restrict const pixel_array, ThreadPool* const pool)
+{
+    __UE_ASSERT__(framebuffer && pixel_array);
+
+    TiledConversionContext conversion = { 0 };
+    conversion.framebuffer            = framebuffer;
+    conversion.linear_arr             = ( Color32_RGB* )pixel_array;
+    conversion.to_linear              = false;
+
+    ParallelFor(pool, framebuffer->tiles_y, ConvertTiledFramebufferRow, &conversion);
+}
+
+//
+// Rendering
+//
+typedef struct
+{
+    TiledFramebuffer*     framebuffer;
+    const Entity*         entity_arr;
+    size_t                num_entitys;
+    const EntityCullGrid* cull_grid;
+    RenderStats*          stats;
+} TiledRenderContext;
+
+// Traces one tile; pixels in the padding are skipped.
+static void
+RenderTiledFramebufferTile(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const TiledRenderContext* render      = ( const TiledRenderContext* )context;
+    const TiledFramebuffer*   framebuffer = render->framebuffer;
+    const size_t              tile_x      = task_index % framebuffer->tiles_x;
+    const size_t              tile_y      = task_index / framebuffer->tiles_x;
+    Color32_RGB*              tile        = &framebuffer->pixel_arr[task_index * FB_TILE_PIXELS];
+
+    // Reflections are traced against the tile's list too, so they need the
+    // whole array.
+    const Entity* entity_arr  = render->entity_arr;
+    size_t        num_entitys = render->num_entitys;
+#if !__UE_AA__reflections
+    if (render->cull_grid)
+    {
+        // TraceEntityArray() takes two entities or more, so a tile left with
+        // one traces the whole array
+        size_t        tile_entity_count = 0;
+        const Entity* tile_entity_arr   = GetEntityCullTile(render->cull_grid, task_index, &tile_entity_count);
+        if (tile_entity_count != 1)
+        {
+            entity_arr  = tile_entity_arr;
+            num_entitys = tile_entity_count;
+        }
+    }
+#endif // !__UE_AA__reflections
+
+    for (u32 inner_y = 0; inner_y < FB_TILE_SIZE; inner_y++)
+    {
+        const size_t pix_y = (tile_y * FB_TILE_SIZE) + inner_y;
+        if (pix_y >= framebuffer->image_height)
+        {
+            break;
+        }
+
+        for (u32 inner_x = 0; inner_x < FB_TILE_SIZE; inner_x++)
+        {
+            const size_t pix_x = (tile_x * FB_TILE_SIZE) + inner_x;
+            if (pix_x >= framebuffer->image_width)
+            {
+                break;
+            }
+
+#if __UE_STATS__enabled == 1
+            BeginPixelStats();
+#endif // __UE_STATS__enabled == 1
+
+            BeginPixelSample(( u32 )((pix_y * framebuffer->image_width) + pix_x), 0);
+            RayIntersection intersection = { 0 };
+            Color32_RGB     sample_color = { 0 };
+            if (num_entitys)
+            {
+                TracePrimarySample(( r32 )pix_x + 0.5f, ( r32 )pix_y + 0.5f, framebuffer->image_width, framebuffer->image_height, &intersection, &sample_color, entity_arr, num_entitys);
+            }
+            sample_color.channel.A = 0xFF;
+
+            tile[SpreadMorton2DBits(inner_x) | (SpreadMorton2DBits(inner_y) << 1)] = sample_color;
+
+#if __UE_STATS__enabled == 1
+            if (render->stats)
+            {
+                EndPixelStats(render->stats, pix_x, pix_y);
+            }
+#endif // __UE_STATS__enabled == 1
+        }
+    }
+
+#if __UE_STATS__enabled == 1
+    if (render->stats)
+    {
+        AggregateRenderStatsTile(render->stats, task_index);
+    }
+#endif // __UE_STATS__enabled == 1
+}
+
+// One sample per pixel center, one parallel task per tile. If 'cull_grid' is
+// not NULL, it must have been built from 'entity_arr' this frame and each
+// tile's primary rays are traced against that tile's list only. If 'stats' is
+// not NULL (and statistics are enabled) each pixel's traversal counters are
+// added to it and its tiles are re-aggregated. Both must use FB_TILE_SIZE
+// tiles.
+static void
+RenderTiledFramebuffer(_mut_ TiledFramebuffer* restrict const framebuffer,
+                       const Entity* restrict const           entity_arr,
+                       const size_t                           num_entitys,
+                       ThreadPool* const                      pool,
+                       const EntityCullGrid* const            cull_grid,
+                       _mut_ RenderStats* const               stats)
+{
+    __UE_ASSERT__(framebuffer && entity_arr);
+    __UE_ASSERT__(!cull_grid || (cull_grid->tile_size == FB_TILE_SIZE && cull_grid->image_width == framebuffer->image_width && cull_grid->image_height == framebuffer->image_height));
+    __UE_ASSERT__(!stats || (stats->tile_size == FB_TILE_SIZE && stats->image_width == framebuffer->image_width && stats->image_height == framebuffer->image_height));
+
+    TiledRenderContext render = { 0 };
+    render.framebuffer        = framebuffer;
+    render.entity_arr         = entity_arr;
+    render.num_entitys        = num_entitys;
+    render.cull_grid          = cull_grid;
+    render.stats              = stats;
+
+    ParallelFor(pool, framebuffer->tile_count, RenderTiledFramebufferTile, &render);
+}
+
+#endif // __UE_FRAMEBUFFER_TOOLS_H___
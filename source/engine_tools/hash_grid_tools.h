@@ -0,0 +1,598 @@
+#ifndef __UE_HASH_GRID_TOOLS_H___
+#define __UE_HASH_GRID_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <bvh_tools.h>
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <sampler_tools.h>
+#include <thread_tools.h>
+#include <type_tools.h>
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Spatial hash grid
+//
+// A uniform grid for fully dynamic scenes: there is no hierarchy to refit, so
+// the grid is simply rebuilt every frame in O(n). Cells are hashed into a
+// power-of-two bucket table and each entity is listed in the bucket of every
+// cell its bounds overlap. The build runs over fixed-size chunks of entities,
+// then of entries, in parallel:
+//   1. reduce the scene bounds and the largest entity extent
+//   2. count each chunk's entries, and prefix sum the counts
+//   3. emit (bucket, entity) pairs, each chunk at its own offset
+//   4. sort the pairs by bucket with an LSD radix sort over 8-bit digits;
+//      every pass histograms chunks, prefix sums, then scatters chunks
+//   5. find where each bucket's run of entries starts
+// Every step writes disjoint, sequential ranges; the scatters only ever
+// write to 256 places at a time, so the build stays cache friendly where
+// scattering straight into buckets would miss on nearly every entry. The
+// sort is stable, so the grid does not depend on the thread count.
+//
+// The cell size is at least twice the largest extent, so an entity is listed
+// in at most 8 cells, and is grown until the scene bounds hold about
+// entities_per_cell entities per cell.
+//
+// Rays are marched through the cells with a 3D-DDA (Amanatides & Woo, 1987),
+// clipped to the scene bounds. A hit is final once it lies before the current
+// cell's exit, since every entity overlapping an earlier point of the ray was
+// listed in an earlier cell.
+//
+// Note: cells sharing a bucket share its entries; those are extra tests, not
+//       wrong results.
+//
+
+#define HASH_GRID_DIGIT_BITS  8
+#define HASH_GRID_DIGIT_COUNT (1 << HASH_GRID_DIGIT_BITS)
+
+typedef struct
+{
+    AABB   bounds; // Union of the entity bounds as of the last build
+    r32    cell_size;
+    r32    inverse_cell_size;
+    size_t num_entitys;
+
+    u32*   bucket_start; // bucket_count + 1 offsets into entry_arr
+    size_t bucket_count; // Power of two
+    u32    bucket_bits;
+    size_t bucket_capacity;
+    u32*   entry_arr; // Entity indices, grouped by bucket
+    u32*   key_arr;   // Bucket of each entry
+    size_t entry_count;
+    size_t entry_capacity;
+
+    // Build scratch
+    u32*   scratch_entry_arr;
+    u32*   scratch_key_arr;
+    AABB*  chunk_bounds;
+    r32*   chunk_extent;
+    u32*   chunk_offset;    // First entry of each entity chunk
+    u32*   chunk_histogram; // HASH_GRID_DIGIT_COUNT per entry chunk
+    size_t chunk_capacity;
+    size_t histogram_capacity;
+} EntityHashGrid;
+
+typedef struct
+{
+    s32 x;
+    s32 y;
+    s32 z;
+} HashGridCell;
+
+__UE_inline__ static size_t
+GetHashGridBucket(const EntityHashGrid* restrict const grid, const s32 cell_x, const s32 cell_y, const s32 cell_z)
+{
+    const u32 hash = HashCombine(HashCombine(HashU32(( u32 )cell_x), ( u32 )cell_y), ( u32 )cell_z);
+    return ( size_t )hash & (grid->bucket_count - 1);
+}
+
+__UE_inline__ static void
+GetHashGridCellRange(const EntityHashGrid* restrict const grid, const AABB* restrict const bounds, _mut_ HashGridCell* restrict const cell_min, _mut_ HashGridCell* restrict const cell_max)
+{
+    cell_min->x = ( s32 )floor(bounds->min.x * grid->inverse_cell_size);
+    cell_min->y = ( s32 )floor(bounds->min.y * grid->inverse_cell_size);
+    cell_min->z = ( s32 )floor(bounds->min.z * grid->inverse_cell_size);
+    cell_max->x = ( s32 )floor(bounds->max.x * grid->inverse_cell_size);
+    cell_max->y = ( s32 )floor(bounds->max.y * grid->inverse_cell_size);
+    cell_max->z = ( s32 )floor(bounds->max.z * grid->inverse_cell_size);
+}
+
+static EntityHashGrid*
+CreateEntityHashGrid()
+{
+    EntityHashGrid* grid = ( EntityHashGrid* )calloc(1, sizeof(EntityHashGrid));
+    __UE_ASSERT__(grid);
+
+    return grid;
+}
+
+static void
+DestroyEntityHashGrid(_mut_ EntityHashGrid* restrict const grid)
+{
+    if (!grid)
+    {
+        return;
+    }
+
+    free(grid->bucket_start);
+    free(grid->entry_arr);
+    free(grid->key_arr);
+    free(grid->scratch_entry_arr);
+    free(grid->scratch_key_arr);
+    free(grid->chunk_bounds);
+    free(grid->chunk_extent);
+    free(grid->chunk_offset);
+    free(grid->chunk_histogram);
+    free(grid);
+}
+
+//
+// Build
+//
+typedef struct
+{
+    EntityHashGrid* grid;
+    const Entity*   entity_arr;
+    size_t          num_entitys;
+
+    // Radix pass
+    const u32* source_key_arr;
+    const u32* source_entry_arr;
+    u32*       destination_key_arr;
+    u32*       destination_entry_arr;
+    u32        shift;
+} HashGridBuildContext;
+
+__UE_inline__ static void
+GetHashGridChunk(const size_t item_count, const size_t chunk_index, _mut_ size_t* restrict const first_index, _mut_ size_t* restrict const end_index)
+{
+    *first_index = chunk_index * __UE_GRID__build_chunk_size;
+    *end_index   = (*first_index + __UE_GRID__build_chunk_size) < item_count ? (*first_index + __UE_GRID__build_chunk_size) : item_count;
+}
+
+static void
+ReduceHashGridChunk(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const HashGridBuildContext* build       = ( const HashGridBuildContext* )context;
+    size_t                      first_index = 0;
+    size_t                      end_index   = 0;
+    GetHashGridChunk(build->num_entitys, task_index, &first_index, &end_index);
+
+    AABB chunk_bounds = { 0 };
+    r32  max_extent   = 0.0f;
+    AABBSetEmpty(&chunk_bounds);
+    for (size_t entity_index = first_index; entity_index < end_index; entity_index++)
+    {
+        AABB bounds = { 0 };
+        GetEntityBounds(build->entity_arr, ( u32 )entity_index, &bounds);
+        AABBGrow(&chunk_bounds, &bounds);
+
+        const r32 extent = 0.5f * (bounds.max.x - bounds.min.x);
+        max_extent       = extent > max_extent ? extent : max_extent;
+    }
+
+    build->grid->chunk_bounds[task_index] = chunk_bounds;
+    build->grid->chunk_extent[task_index] = max_extent;
+}
+
+static void
+CountHashGridChunk(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const HashGridBuildContext* build       = ( const HashGridBuildContext* )context;
+    size_t                      first_index = 0;
+    size_t                      end_index   = 0;
+    GetHashGridChunk(build->num_entitys, task_index, &first_index, &end_index);
+
+    u32 entry_count = 0;
+    for (size_t entity_index = first_index; entity_index < end_index; entity_index++)
+    {
+        AABB         bounds   = { 0 };
+        HashGridCell cell_min = { 0 };
+        HashGridCell cell_max = { 0 };
+        GetEntityBounds(build->entity_arr, ( u32 )entity_index, &bounds);
+        GetHashGridCellRange(build->grid, &bounds, &cell_min, &cell_max);
+
+        entry_count += ( u32 )((cell_max.x - cell_min.x + 1) * (cell_max.y - cell_min.y + 1) * (cell_max.z - cell_min.z + 1));
+    }
+
+    build->grid->chunk_offset[task_index] = entry_count;
+}
+
+static void
+EmitHashGridChunk(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const HashGridBuildContext* build       = ( const HashGridBuildContext* )context;
+    EntityHashGrid*             grid        = build->grid;
+    size_t                      first_index = 0;
+    size_t                      end_index   = 0;
+    GetHashGridChunk(build->num_entitys, task_index, &first_index, &end_index);
+
+    u32 entry_index = grid->chunk_offset[task_index];
+    for (size_t entity_index = first_index; entity_index < end_index; entity_index++)
+    {
+        AABB         bounds   = { 0 };
+        HashGridCell cell_min = { 0 };
+        HashGridCell cell_max = { 0 };
+        GetEntityBounds(build->entity_arr, ( u32 )entity_index, &bounds);
+        GetHashGridCellRange(grid, &bounds, &cell_min, &cell_max);
+
+        for (s32 cell_z = cell_min.z; cell_z <= cell_max.z; cell_z++)
+        {
+            for (s32 cell_y = cell_min.y; cell_y <= cell_max.y; cell_y++)
+            {
+                for (s32 cell_x = cell_min.x; cell_x <= cell_max.x; cell_x++)
+                {
+                    grid->key_arr[entry_index]   = ( u32 )GetHashGridBucket(grid, cell_x, cell_y, cell_z);
+                    grid->entry_arr[entry_index] = ( u32 )entity_index;
+                    entry_index++;
+                }
+            }
+        }
+    }
+}
+
+static void
+HistogramHashGridChunk(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const HashGridBuildContext* build       = ( const HashGridBuildContext* )context;
+    u32*                        histogram   = &build->grid->chunk_histogram[task_index * HASH_GRID_DIGIT_COUNT];
+    size_t                      first_index = 0;
+    size_t                      end_index   = 0;
+    GetHashGridChunk(build->grid->entry_count, task_index, &first_index, &end_index);
+
+    memset(histogram, 0, HASH_GRID_DIGIT_COUNT * sizeof(u32));
+    for (size_t entry_index = first_index; entry_index < end_index; entry_index++)
+    {
+        histogram[(build->source_key_arr[entry_index] >> build->shift) & (HASH_GRID_DIGIT_COUNT - 1)]++;
+    }
+}
+
+// Stable; each chunk's histogram has been turned into its write offsets.
+static void
+ScatterHashGridChunk(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const HashGridBuildContext* build       = ( const HashGridBuildContext* )context;
+    u32*                        offset      = &build->grid->chunk_histogram[task_index * HASH_GRID_DIGIT_COUNT];
+    size_t                      first_index = 0;
+    size_t                      end_index   = 0;
+    GetHashGridChunk(build->grid->entry_count, task_index, &first_index, &end_index);
+
+    for (size_t entry_index = first_index; entry_index < end_index; entry_index++)
+    {
+        const u32 key         = build->source_key_arr[entry_index];
+        const u32 destination = offset[(key >> build->shift) & (HASH_GRID_DIGIT_COUNT - 1)]++;
+
+        build->destination_key_arr[destination]   = key;
+        build->destination_entry_arr[destination] = build->source_entry_arr[entry_index];
+    }
+}
+
+// Every bucket from the previous entry's (exclusive) to this entry's
+// (inclusive) starts here.
+static void
+FindHashGridBucketStarts(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const HashGridBuildContext* build       = ( const HashGridBuildContext* )context;
+    EntityHashGrid*             grid        = build->grid;
+    size_t                      first_index = 0;
+    size_t                      end_index   = 0;
+    GetHashGridChunk(grid->entry_count, task_index, &first_index, &end_index);
+
+    for (size_t entry_index = first_index; entry_index < end_index; entry_index++)
+    {
+        const size_t first_bucket = entry_index ? (( size_t )grid->key_arr[entry_index - 1] + 1) : 0;
+        for (size_t bucket = first_bucket; bucket <= grid->key_arr[entry_index]; bucket++)
+        {
+            grid->bucket_start[bucket] = ( u32 )entry_index;
+        }
+    }
+}
+
+// Rebuild the grid from 'entity_arr'; call whenever entities move. Buffers
+// are kept between builds and only grow.
+// Note: meshes are not supported, see: GetEntityBounds().
+static void
+BuildEntityHashGrid(_mut_ EntityHashGrid* restrict const grid, const Entity* restrict const entity_arr, const size_t num_entitys, ThreadPool* const pool)
+{
+    __UE_ASSERT__(grid && entity_arr);
+    __UE_ASSERT__(num_entitys < ( size_t )(~( u32 )0) / 8);
+
+    grid->num_entitys = num_entitys;
+    grid->entry_count = 0;
+    AABBSetEmpty(&grid->bounds);
+    if (!num_entitys)
+    {
+        return;
+    }
+
+    HashGridBuildContext build = { 0 };
+    build.grid                 = grid;
+    build.entity_arr           = entity_arr;
+    build.num_entitys          = num_entitys;
+
+    const size_t chunk_count = (num_entitys + __UE_GRID__build_chunk_size - 1) / __UE_GRID__build_chunk_size;
+    if (chunk_count > grid->chunk_capacity)
+    {
+        grid->chunk_capacity = chunk_count;
+        grid->chunk_bounds   = ( AABB* )realloc(grid->chunk_bounds, chunk_count * sizeof(AABB));
+        grid->chunk_extent   = ( r32* )realloc(grid->chunk_extent, chunk_count * sizeof(r32));
+        grid->chunk_offset   = ( u32* )realloc(grid->chunk_offset, chunk_count * sizeof(u32));
+        __UE_ASSERT__(grid->chunk_bounds && grid->chunk_extent && grid->chunk_offset);
+    }
+
+    // 1. Bounds and cell size
+    ParallelFor(pool, chunk_count, ReduceHashGridChunk, &build);
+
+    r32 max_extent = 0.0f;
+    for (size_t chunk_index = 0; chunk_index < chunk_count; chunk_index++)
+    {
+        AABBGrow(&grid->bounds, &grid->chunk_bounds[chunk_index]);
+        max_extent = grid->chunk_extent[chunk_index] > max_extent ? grid->chunk_extent[chunk_index] : max_extent;
+    }
+
+    const r32 min_cell_size = max_extent > 0.0f ? (2.0f * max_extent) : ( r32 )TOLERANCE;
+    const r32 size_x        = grid->bounds.max.x - grid->bounds.min.x;
+    const r32 size_y        = grid->bounds.max.y - grid->bounds.min.y;
+    const r32 size_z        = grid->bounds.max.z - grid->bounds.min.z;
+    const r32 volume        = (size_x > min_cell_size ? size_x : min_cell_size) * (size_y > min_cell_size ? size_y : min_cell_size) * (size_z > min_cell_size ? size_z : min_cell_size);
+    const r32 fill_size     = ( r32 )cbrt(( r64 )volume * ( r64 )__UE_GRID__entities_per_cell / ( r64 )num_entitys);
+
+    grid->cell_size         = fill_size > min_cell_size ? fill_size : min_cell_size;
+    grid->inverse_cell_size = 1.0f / grid->cell_size;
+
+    grid->bucket_count = 1024;
+    grid->bucket_bits  = 10;
+    while (grid->bucket_count < (2 * num_entitys))
+    {
+        grid->bucket_count *= 2;
+        grid->bucket_bits++;
+    }
+
+    if (grid->bucket_count > grid->bucket_capacity)
+    {
+        grid->bucket_capacity = grid->bucket_count;
+        grid->bucket_start    = ( u32* )realloc(grid->bucket_start, (grid->bucket_count + 1) * sizeof(u32));
+        __UE_ASSERT__(grid->bucket_start);
+    }
+
+    // 2. Entry offsets
+    ParallelFor(pool, chunk_count, CountHashGridChunk, &build);
+
+    u32 entry_count = 0;
+    for (size_t chunk_index = 0; chunk_index < chunk_count; chunk_index++)
+    {
+        const u32 chunk_entry_count     = grid->chunk_offset[chunk_index];
+        grid->chunk_offset[chunk_index] = entry_count;
+        entry_count += chunk_entry_count;
+    }
+
+    grid->entry_count = entry_count;
+    if (grid->entry_count > grid->entry_capacity)
+    {
+        grid->entry_capacity    = grid->entry_count;
+        grid->entry_arr         = ( u32* )realloc(grid->entry_arr, grid->entry_capacity * sizeof(u32));
+        grid->key_arr           = ( u32* )realloc(grid->key_arr, grid->entry_capacity * sizeof(u32));
+        grid->scratch_entry_arr = ( u32* )realloc(grid->scratch_entry_arr, grid->entry_capacity * sizeof(u32));
+        grid->scratch_key_arr   = ( u32* )realloc(grid->scratch_key_arr, grid->entry_capacity * sizeof(u32));
+        __UE_ASSERT__(grid->entry_arr && grid->key_arr && grid->scratch_entry_arr && grid->scratch_key_arr);
+    }
+
+    const size_t entry_chunk_count = (grid->entry_count + __UE_GRID__build_chunk_size - 1) / __UE_GRID__build_chunk_size;
+    if (entry_chunk_count > grid->histogram_capacity)
+    {
+        grid->histogram_capacity = entry_chunk_count;
+        grid->chunk_histogram    = ( u32* )realloc(grid->chunk_histogram, entry_chunk_count * HASH_GRID_DIGIT_COUNT * sizeof(u32));
+        __UE_ASSERT__(grid->chunk_histogram);
+    }
+
+    // 3. Entries, in entity order
+    ParallelFor(pool, chunk_count, EmitHashGridChunk, &build);
+
+    // 4. Sort by bucket
+    for (u32 shift = 0; shift < grid->bucket_bits; shift += HASH_GRID_DIGIT_BITS)
+    {
+        build.source_key_arr        = grid->key_arr;
+        build.source_entry_arr      = grid->entry_arr;
+        build.destination_key_arr   = grid->scratch_key_arr;
+        build.destination_entry_arr = grid->scratch_entry_arr;
+        build.shift                 = shift;
+        ParallelFor(pool, entry_chunk_count, HistogramHashGridChunk, &build);
+
+        // Digit major, chunk minor
+        u32 offset = 0;
+        for (size_t digit = 0; digit < HASH_GRID_DIGIT_COUNT; digit++)
+        {
+            for (size_t chunk_index = 0; chunk_index < entry_chunk_count; chunk_index++)
+            {
+                u32*      chunk_digit = &grid->chunk_histogram[(chunk_index * HASH_GRID_DIGIT_COUNT) + digit];
+                const u32 count       = *chunk_digit;
+                *chunk_digit          = offset;
+                offset += count;
+            }
+        }
+
+        ParallelFor(pool, entry_chunk_count, ScatterHashGridChunk, &build);
+
+        u32* swap               = grid->key_arr;
+        grid->key_arr           = grid->scratch_key_arr;
+        grid->scratch_key_arr   = swap;
+        swap                    = grid->entry_arr;
+        grid->entry_arr         = grid->scratch_entry_arr;
+        grid->scratch_entry_arr = swap;
+    }
+
+    // 5. Bucket starts; buckets past the last key are empty
+    ParallelFor(pool, entry_chunk_count, FindHashGridBucketStarts, &build);
+    for (size_t bucket = ( size_t )grid->key_arr[grid->entry_count - 1] + 1; bucket <= grid->bucket_count; bucket++)
+    {
+        grid->bucket_start[bucket] = ( u32 )grid->entry_count;
+    }
+}
+
+//
+// Traversal
+//
+
+// Closest hit among the entities of a grid within [ 0, max_magnitude ).
+// Returns false, leaving 'closest_intersection' and 'closest_entity_index'
+// untouched, if nothing is hit.
+static bool
+IntersectEntityHashGrid(const Ray* restrict const ray,
+                        const EntityHashGrid* restrict const grid,
+                        const Entity* restrict const         entity_arr,
+                        const r32                            max_magnitude,
+                        _mut_ RayIntersection* restrict const closest_intersection,
+                        _mut_ u32* restrict const             closest_entity_index)
+{
+    __UE_ASSERT__(ray && grid && entity_arr);
+    __UE_ASSERT__(closest_intersection && closest_entity_index);
+    __UE_STAT__(rays, 1);
+
+    if (!grid->num_entitys)
+    {
+        return false;
+    }
+
+    v3 inverse_direction = { 0 };
+    GetInverseDirection(&ray->direction, &inverse_direction);
+
+    // Clip to the scene bounds
+    r32 t_enter = 0.0f;
+    r32 t_end   = max_magnitude;
+    for (u8 axis = 0; axis < 3; axis++)
+    {
+        r32 t0 = (grid->bounds.min.arr[axis] - ray->origin.arr[axis]) * inverse_direction.arr[axis];
+        r32 t1 = (grid->bounds.max.arr[axis] - ray->origin.arr[axis]) * inverse_direction.arr[axis];
+        if (t0 > t1)
+        {
+            const r32 swap = t0;
+            t0             = t1;
+            t1             = swap;
+        }
+
+        t_enter = t0 > t_enter ? t0 : t_enter;
+        t_end   = t1 < t_end ? t1 : t_end;
+    }
+
+    if (t_enter > t_end)
+    {
+        return false;
+    }
+
+    // Starting cell, clamped to the bounds against rounding at the entry face
+    s32 cell[3];
+    s32 step[3];
+    r32 t_next[3];
+    r32 t_delta[3];
+    for (u8 axis = 0; axis < 3; axis++)
+    {
+        const s32 axis_min = ( s32 )floor(grid->bounds.min.arr[axis] * grid->inverse_cell_size);
+        const s32 axis_max = ( s32 )floor(grid->bounds.max.arr[axis] * grid->inverse_cell_size);
+        const r32 entry    = ray->origin.arr[axis] + (ray->direction.arr[axis] * t_enter);
+
+        cell[axis] = ( s32 )floor(entry * grid->inverse_cell_size);
+        cell[axis] = cell[axis] < axis_min ? axis_min : (cell[axis] > axis_max ? axis_max : cell[axis]);
+
+        const bool is_positive = ray->direction.arr[axis] >= 0.0f;
+        const r32  boundary    = ( r32 )(cell[axis] + (is_positive ? 1 : 0)) * grid->cell_size;
+        step[axis]             = is_positive ? 1 : -1;
+        t_next[axis]           = (boundary - ray->origin.arr[axis]) * inverse_direction.arr[axis];
+        t_delta[axis]          = grid->cell_size * ( r32 )fabs(inverse_direction.arr[axis]);
+    }
+
+    r32  closest_magnitude = max_magnitude;
+    u32  closest_index     = ENTITY_INDEX_NONE;
+    bool does_intersect    = false;
+    for (;;)
+    {
+        const size_t bucket = GetHashGridBucket(grid, cell[0], cell[1], cell[2]);
+        for (u32 entry_index = grid->bucket_start[bucket]; entry_index < grid->bucket_start[bucket + 1]; entry_index++)
+        {
+            const u32 entity_index = grid->entry_arr[entry_index];
+
+            RayIntersection candidate = { 0 };
+            IntersectEntity(ray, &entity_arr[entity_index], &candidate);
+            if (!candidate.does_intersect || candidate.magnitude < 0.0f || candidate.magnitude >= max_magnitude)
+            {
+                continue;
+            }
+
+            if (candidate.magnitude < closest_magnitude)
+            {
+                *closest_intersection = candidate;
+                closest_magnitude     = candidate.magnitude;
+                closest_index         = entity_index;
+                does_intersect        = true;
+            }
+        }
+
+        const u8  axis      = (t_next[0] < t_next[1]) ? ((t_next[0] < t_next[2]) ? 0 : 2) : ((t_next[1] < t_next[2]) ? 1 : 2);
+        const r32 cell_exit = t_next[axis];
+        if ((does_intersect && closest_magnitude <= cell_exit) || cell_exit >= t_end)
+        {
+            break;
+        }
+
+        cell[axis] += step[axis];
+        t_next[axis] += t_delta[axis];
+    }
+
+    if (does_intersect)
+    {
+        *closest_entity_index = closest_index;
+    }
+
+    return does_intersect;
+}
+
+// Closest-hit query; the hash grid counterpart of TraceEntityArray(). Hits
+// behind the ray origin are ignored.
+// Note: secondary rays are not spawned (see: ReflectRays()).
+__UE_inline__ static void
+TraceEntityHashGrid(const Ray* restrict const ray,
+                    _mut_ RayIntersection* restrict const intersection,
+                    _mut_ r32* restrict const global_magnitude_threshold,
+                    _mut_ Color32_RGB* restrict const return_color,
+                    const EntityHashGrid* restrict const grid,
+                    const Entity* restrict const         entity_arr)
+{
+    __UE_ASSERT__(ray);
+    __UE_ASSERT__(intersection);
+    __UE_ASSERT__(global_magnitude_threshold);
+    __UE_ASSERT__(return_color);
+    __UE_ASSERT__(grid && entity_arr);
+
+    const r32 max_magnitude = ( r32 )fmin(MAX_RAY_MAG, fabs(*global_magnitude_threshold));
+
+    RayIntersection closest_intersection = { 0 };
+    u32             closest_entity_index = ENTITY_INDEX_NONE;
+    const bool      does_intersect       = IntersectEntityHashGrid(ray, grid, entity_arr, max_magnitude, &closest_intersection, &closest_entity_index);
+
+    *intersection                = closest_intersection;
+    intersection->does_intersect = does_intersect;
+    intersection->entity_index   = closest_entity_index;
+    if (does_intersect)
+    {
+        return_color->value = entity_arr[closest_entity_index].material.color.value;
+    }
+}
+
+#endif // __UE_HASH_GRID_TOOLS_H___
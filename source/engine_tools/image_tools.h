@@ -1,9 +1,14 @@
 #ifndef __UE_IMAGE_TOOLS_H__
 #define __UE_IMAGE_TOOLS_H__
 
-#include <engine_tools/debug_tools.h>
-#include <engine_tools/memory_tools.h>
-#include <engine_tools/type_tools.h>
+#include <rt_settings.h>
+
+#include <color_tools.h>
+#include <debug_tools.h>
+#include <memory_tools.h>
+#include <type_tools.h>
+
+#include <stdio.h>
 #ifdef _linux_
 #include <unistd.h>
 #endif
@@ -25,6 +30,33 @@ uMemoryArena* imageArena;
 #define uBI_CMYKRLE8  0x000C
 #define uBI_CMYKRLE4  0x000D
 
+// Note: "P3\n" + two 10 digit dimensions + "\n255\n", and "255 255 255\n"
+#define MAX_PPM_HEADER_SIZE   32
+#define MAX_PPM_TRIPPLET_SIZE 16
+
+// BITMAPFILEHEADER (14 bytes) followed by BITMAPINFOHEADER (40 bytes)
+#pragma pack(push, 1)
+typedef struct
+{
+    u16 magic_number;
+    u32 file_size;
+    u16 reserved_0;
+    u16 reserved_1;
+    u32 pix_arr_offset;
+    u32 bitmap_header_size;
+    s32 bitmap_width;
+    s32 bitmap_height;
+    u16 num_color_planes;
+    u16 bits_per_pix;
+    u32 compression;
+    u32 pix_arr_size;
+    s32 horizontal_resolution;
+    s32 vertical_resolution;
+    u32 num_colors_in_palette;
+    u32 num_important_colors;
+} BitmapHeader;
+#pragma pack(pop)
+
 typedef struct
 {
     size_t      img_height;
@@ -37,7 +69,7 @@ typedef struct
 } uImage;
 
 __UE_inline__ u8
-uReadNextByte(const restrict uImage* const img)
+uReadNextByte(_mut_ uImage* restrict const img)
 {
     if (img->img_cursor < img->img_end)
     {
@@ -49,220 +81,30 @@ uReadNextByte(const restrict uImage* const img)
 }
 
 __UE_inline__ u16
-uRead16AsLE(const restrict uImage* const img)
+uRead16AsLE(_mut_ uImage* restrict const img)
 {
     u16 tmp = uReadNextByte(img);
     return tmp + (uReadNextByte(img) << 8);
 }
 
 __UE_inline__ u32
-uRead32AsLE(const restrict uImage* const img)
+uRead32AsLE(_mut_ uImage* restrict const img)
 {
     u32 tmp = uRead16AsLE(img);
     return tmp + (uRead16AsLE(img) << 16);
 }
 
 __UE_inline__ bool
-uLoadBitmap(const restrict char* const file_path, const restrict uImage* const img)
+uLoadBitmap(const char* restrict const file_path, _mut_ uImage* restrict const img)
 {
+    (void)file_path;
+    (void)img;
     printf("TODO: uLoadBitmap()"); // [ cfarvin::TODO ]
     return false;
 }
 
-__UE_inline__ static u8
-BindValueTo8BitColorChannel(const r32 value_min, const r32 value_max, const r32 value)
-{
-    __UE_ASSERT__(value_max > value_min);
-    __UE_ASSERT__((value_max >= value) && (value_min <= value));
-
-    return ( u8 )NormalizeToRange(value_min, value_max, 0.0f, 255.0f, value);
-}
-
-__UE_inline__ static void
-RGB32ToHSV32(const Color32_RGB* restrict const rgb_source, _mut_ Color32_HSV* restrict const hsv_result)
-{
-    __UE_ASSERT__(rgb_source);
-    __UE_ASSERT__(hsv_result);
-
-    // Normalize [ TOLERANCE, 1.0f ]
-    r32 rgb_r = NormalizeToRange(0.0f, 255.0f, 0.0f, 1.0f, rgb_source->channel.R);
-
-    r32 rgb_g = NormalizeToRange(0.0f, 255.0f, 0.0f, 1.0f, rgb_source->channel.G);
-
-    r32 rgb_b = NormalizeToRange(0.0f, 255.0f, 0.0f, 1.0f, rgb_source->channel.B);
-
-    r32 rgb_min = rgb_r;
-    r32 rgb_max = rgb_r;
-    r32 chroma  = 0.0f;
-
-    // Determine min rgb component
-    if (rgb_min > rgb_g)
-    {
-        rgb_min = rgb_g;
-    }
-
-    if (rgb_min > rgb_b)
-    {
-        rgb_min = rgb_b;
-    }
-
-    // Determine max rgb component
-    if (rgb_max < rgb_g)
-    {
-        rgb_max = rgb_g;
-    }
-
-    if (rgb_max < rgb_b)
-    {
-        rgb_max = rgb_b;
-    }
-
-    // Assign chroma
-    __UE_ASSERT__(rgb_max >= rgb_min);
-    chroma = rgb_max - rgb_min;
-
-    // Asign value
-    r32 value = rgb_max;
-    __UE_ASSERT__(value >= 0.0f);
-    __UE_ASSERT__(value <= 360.0f);
-
-    // Assign hue
-    r32 hue = 0.0f;
-    if (chroma == 0.0f)
-    {
-        // Intentional nop
-    }
-    else if (value == rgb_r)
-    {
-        hue = 60.0f * ((rgb_g - rgb_b) / chroma);
-    }
-    else if (value == rgb_g)
-    {
-        hue = 60.0f * (2.0f + ((rgb_b - rgb_r) / chroma));
-    }
-    else if (value == rgb_b)
-    {
-        hue = 60.0f * (4.0f + ((rgb_r - rgb_g) / chroma));
-    }
-    else
-    {
-        __UE_ASSERT__(false);
-    }
-
-    if (hue < 0.0f)
-    {
-        hue += 360.0f;
-    }
-
-    __UE_ASSERT__(hue >= 0.0f);
-    __UE_ASSERT__(hue <= 360.0f);
-
-    // Assign saturation
-    r32 saturation = 0.0f;
-    if (value != 0.0f)
-    {
-        saturation = chroma / value;
-    }
-
-    hsv_result->H = hue;
-    hsv_result->S = saturation;
-    hsv_result->V = value;
-}
-
-__UE_inline__ static void
-HSV32ToRGB32(const Color32_HSV* restrict const hsv_source, _mut_ Color32_RGB* restrict const rgb_result)
-{
-    __UE_ASSERT__(rgb_result);
-    __UE_ASSERT__(hsv_source);
-    __UE_ASSERT__(hsv_source->H >= 0.0f);
-    __UE_ASSERT__(hsv_source->H <= 360.0f);
-    __UE_ASSERT__(hsv_source->S >= 0.0f);
-    __UE_ASSERT__(hsv_source->S <= 1.0f);
-    __UE_ASSERT__(hsv_source->V >= 0.0f);
-    __UE_ASSERT__(hsv_source->V <= 1.0f);
-
-    // Assign hue_prime
-    r32 hue_prime = hsv_source->H / 60.0f;
-
-    // Assign chroma
-    r32 chroma = hsv_source->V * hsv_source->S;
-    __UE_ASSERT__(chroma >= 0.0f);
-    __UE_ASSERT__(chroma <= 1.0f);
-
-    // Assign 2nd largest color component
-    r32 secondary_color = chroma * (1.0f - ( r32 )fabs(fmod(hue_prime, 2.0f) - 1.0f));
-    __UE_ASSERT__(secondary_color >= 0.0f);
-    __UE_ASSERT__(secondary_color <= 1.0f);
-
-    // Compute rgb components
-    r32 rgb_r = 0.0f;
-    r32 rgb_g = 0.0f;
-    r32 rgb_b = 0.0f;
-
-    bool build_color_channels = true;
-    r32  lightness_component  = hsv_source->V - chroma;
-    __UE_ASSERT__(lightness_component >= 0.0f);
-    if (hue_prime < 0.0f)
-    {
-        build_color_channels = false;
-    }
-
-    __UE_ASSERT__(hue_prime <= 6.0f);
-    if (build_color_channels)
-    {
-        if (hue_prime >= 0.0f && hue_prime <= 1.0f)
-        {
-            rgb_g = secondary_color;
-            rgb_r = chroma;
-        }
-        if (hue_prime > 1.0f && hue_prime <= 2.0f)
-        {
-            rgb_r = secondary_color;
-            rgb_g = chroma;
-        }
-        if (hue_prime > 2.0f && hue_prime <= 3.0f)
-        {
-            rgb_b = secondary_color;
-            rgb_g = chroma;
-        }
-        if (hue_prime > 3.0f && hue_prime <= 4.0f)
-        {
-            rgb_g = secondary_color;
-            rgb_b = chroma;
-        }
-        if (hue_prime > 4.0f && hue_prime <= 5.0f)
-        {
-            rgb_r = secondary_color;
-            rgb_b = chroma;
-        }
-        if (hue_prime > 5.0f && hue_prime <= 6.0f)
-        {
-            rgb_b = secondary_color;
-            rgb_r = chroma;
-        }
-    }
-
-    rgb_r += lightness_component;
-    rgb_g += lightness_component;
-    rgb_b += lightness_component;
-
-    __UE_ASSERT__(rgb_r >= 0.0f);
-    __UE_ASSERT__(rgb_g >= 0.0f);
-    __UE_ASSERT__(rgb_b >= 0.0f);
-    __UE_ASSERT__(rgb_r <= 1.0f);
-    __UE_ASSERT__(rgb_g <= 1.0f);
-    __UE_ASSERT__(rgb_b <= 1.0f);
-
-    // Assign rgb components
-    rgb_result->channel.R = ( u8 )round(NormalizeToRange(0.0f, 1.0f, 0.0f, 255.0f, rgb_r));
-
-    rgb_result->channel.G = ( u8 )round(NormalizeToRange(0.0f, 1.0f, 0.0f, 255.0f, rgb_g));
-
-    rgb_result->channel.B = ( u8 )round(NormalizeToRange(0.0f, 1.0f, 0.0f, 255.0f, rgb_b));
-}
-
 static void
-WritePPM32(const restrict Color32_RGB* const pixel_array, u32 image_width, u32 image_height, const restrict char* const image_name)
+WritePPM32(const Color32_RGB* restrict const pixel_array, u32 image_width, u32 image_height, const char* restrict const image_name)
 {
     __UE_ASSERT__(pixel_array && image_width && image_height);
 
@@ -270,8 +112,8 @@ WritePPM32(const restrict Color32_RGB* const pixel_array, u32 image_width, u32 i
     __UE_ASSERT__(ppm_file);
 
     char ppm_header[MAX_PPM_HEADER_SIZE];
-    u32  success = snprintf(ppm_header, MAX_PPM_HEADER_SIZE, "P3\n%d %d\n255\n", image_width, image_height);
-    __UE_ASSERT__((success > 0) && (success < MAX_PPM_HEADER_SIZE));
+    s32  success = snprintf(ppm_header, MAX_PPM_HEADER_SIZE, "P3\n%d %d\n255\n", image_width, image_height);
+    __UE_ASSERT__((success > 0) && (( u32 )success < MAX_PPM_HEADER_SIZE));
     fwrite(ppm_header, success, 1, ppm_file);
 
     // [ cfarvin::TODO ] This is as temporary as it is bad.
@@ -289,7 +131,7 @@ WritePPM32(const restrict Color32_RGB* const pixel_array, u32 image_width, u32 i
             success = snprintf(rgb_tripplet, MAX_PPM_TRIPPLET_SIZE, "%d %d %d\n", pixel_array[pix_idx].channel.R, pixel_array[pix_idx].channel.G, pixel_array[pix_idx].channel.B);
 
             __UE_ASSERT__(success > 0);
-            __UE_ASSERT__(success < MAX_PPM_TRIPPLET_SIZE);
+            __UE_ASSERT__(( u32 )success < MAX_PPM_TRIPPLET_SIZE);
 
             fwrite(rgb_tripplet, success, 1, ppm_file);
             pix_idx++;
@@ -300,9 +142,9 @@ WritePPM32(const restrict Color32_RGB* const pixel_array, u32 image_width, u32 i
     fclose(ppm_file);
 }
 
-static void
-WriteBitmap32(const restrict Color32_RGB* const pixel_array, u32 image_width, u32 image_height, const char* const image_name)
-
+// Returns false if the file could not be opened.
+static bool
+WriteBitmap32(const Color32_RGB* restrict const pixel_array, u32 image_width, u32 image_height, const char* const image_name)
 {
     __UE_ASSERT__(pixel_array && image_width && image_height);
     u32 pixel_array_size = sizeof(u32) * image_width * image_height;
@@ -316,15 +158,20 @@ WriteBitmap32(const restrict Color32_RGB* const pixel_array, u32 image_width, u3
     bitmap_header.bitmap_height      = image_height;
     bitmap_header.num_color_planes   = 1;
     bitmap_header.bits_per_pix       = 32;
+    bitmap_header.compression        = uBI_RGB;
     bitmap_header.pix_arr_size       = pixel_array_size;
 
     FILE* bitmap_file = fopen(image_name, "wb");
-    __UE_ASSERT__(bitmap_file);
+    if (!bitmap_file)
+    {
+        return false;
+    }
 
     fwrite(&bitmap_header, sizeof(BitmapHeader), 1, bitmap_file);
     fwrite(pixel_array, pixel_array_size, 1, bitmap_file);
 
     fclose(bitmap_file);
+    return true;
 }
 
 #endif // __UE_IMAGE_TOOLS_H__
@@ -0,0 +1,339 @@
+#ifndef __UE_INSTANCE_TOOLS_H___
+#define __UE_INSTANCE_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <bvh_tools.h>
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <thread_tools.h>
+#include <type_tools.h>
+
+#include <float.h>
+#include <stdlib.h>
+
+//
+// Two-level instancing
+//
+// A BLAS (bottom-level acceleration structure) is an entity array in object
+// space and the BVH over it. An Instance places a BLAS in the world through an
+// affine transform. The TLAS (top-level acceleration structure) is a BVH over
+// instance bounds. Any number of instances may share one BLAS; an instance
+// costs one Instance record and one TLAS primitive.
+//
+// Rays are transformed into instance space when a TLAS leaf is reached.
+// Magnitudes are reported in world space regardless of instance scale.
+//
+// Note: the scene does not own its BLAS or instance arrays.
+//
+
+typedef struct
+{
+    const Entity* entity_arr;
+    size_t        num_entitys;
+    BVH*          bvh;
+} BLAS;
+
+typedef struct
+{
+    m4  object_to_world;
+    m4  world_to_object;
+    u32 blas_index;
+} Instance;
+
+typedef struct
+{
+    const BLAS* blas_arr;
+    size_t      blas_count;
+    Instance*   instance_arr;
+    size_t      instance_count;
+    BVH*        tlas;
+} InstancedScene;
+
+static BLAS*
+CreateBLAS(const Entity* restrict const entity_arr, const size_t num_entitys, ThreadPool* const pool)
+{
+    __UE_ASSERT__(entity_arr && num_entitys);
+
+    BLAS* blas = ( BLAS* )calloc(1, sizeof(BLAS));
+    __UE_ASSERT__(blas);
+
+    blas->entity_arr  = entity_arr;
+    blas->num_entitys = num_entitys;
+    blas->bvh         = CreateEntityBVH(entity_arr, num_entitys, pool);
+
+    return blas;
+}
+
+static void
+DestroyBLAS(_mut_ BLAS* restrict const blas)
+{
+    if (!blas)
+    {
+        return;
+    }
+
+    DestroyBVH(blas->bvh);
+    free(blas);
+}
+
+// Returns false if object_to_world is singular; the instance is unchanged.
+__UE_inline__ static bool
+SetInstanceTransform(_mut_ Instance* restrict const instance, const m4* restrict const object_to_world)
+{
+    __UE_ASSERT__(instance && object_to_world);
+
+    if (!m4AffineInverse(object_to_world, &instance->world_to_object))
+    {
+        return false;
+    }
+
+    instance->object_to_world = *object_to_world;
+    return true;
+}
+
+// World space bounds of an instance: its BLAS root bounds, transformed.
+static void
+GetInstanceBounds(const void* primitives, const u32 primitive_index, _mut_ AABB* const bounds)
+{
+    const InstancedScene* scene    = ( const InstancedScene* )primitives;
+    const Instance*       instance = &scene->instance_arr[primitive_index];
+    const BVHNode*        root     = &scene->blas_arr[instance->blas_index].bvh->nodes[0];
+
+    AABBSetEmpty(bounds);
+    for (u8 corner_index = 0; corner_index < 8; corner_index++)
+    {
+        v3 corner = { 0 };
+        v3Set(&corner, (corner_index & 1) ? root->max.x : root->min.x, (corner_index & 2) ? root->max.y : root->min.y, (corner_index & 4) ? root->max.z : root->min.z);
+
+        v3 world_corner = { 0 };
+        m4TransformPoint(&instance->object_to_world, &corner, &world_corner);
+        AABBGrowPoint(bounds, &world_corner);
+    }
+}
+
+static InstancedScene*
+CreateInstancedScene(const BLAS* restrict const blas_arr,
+                     const size_t               blas_count,
+                     _mut_ Instance* restrict const instance_arr,
+                     const size_t                   instance_count,
+                     ThreadPool* const              pool)
+{
+    __UE_ASSERT__(blas_arr && blas_count);
+    __UE_ASSERT__(instance_arr && instance_count);
+
+    InstancedScene* scene = ( InstancedScene* )calloc(1, sizeof(InstancedScene));
+    __UE_ASSERT__(scene);
+
+    scene->blas_arr       = blas_arr;
+    scene->blas_count     = blas_count;
+    scene->instance_arr   = instance_arr;
+    scene->instance_count = instance_count;
+
+    for (size_t instance_index = 0; instance_index < instance_count; instance_index++)
+    {
+        __UE_ASSERT__(instance_arr[instance_index].blas_index < blas_count);
+    }
+
+    scene->tlas = CreateBVH(instance_count, __UE_BVH__max_leaf_size);
+    BuildBVH(scene->tlas, GetInstanceBounds, scene, pool);
+
+    return scene;
+}
+
+static void
+DestroyInstancedScene(_mut_ InstancedScene* restrict const scene)
+{
+    if (!scene)
+    {
+        return;
+    }
+
+    DestroyBVH(scene->tlas);
+    free(scene);
+}
+
+// Call after moving instances. BLAS geometry changes must first be applied
+// to the BLAS with UpdateEntityBVH().
+__UE_inline__ static BVHUpdateStats
+UpdateInstancedScene(_mut_ InstancedScene* restrict const scene, ThreadPool* const pool)
+{
+    __UE_ASSERT__(scene);
+    return UpdateBVH(scene->tlas, GetInstanceBounds, scene, pool);
+}
+
+// Closest-hit query over every instance. intersection->entity_index is the
+// index into the hit instance's BLAS; the instance is reported through
+// 'instance_index', ENTITY_INDEX_NONE on miss. Position and normal are in
+// world space.
+// Note: secondary rays are not spawned (see: ReflectRays()).
+static void
+TraceInstancedScene(const Ray* restrict const ray,
+                    _mut_ RayIntersection* restrict const intersection,
+                    _mut_ r32* restrict const global_magnitude_threshold,
+                    _mut_ Color32_RGB* restrict const return_color,
+                    _mut_ u32* restrict const         instance_index,
+                    const InstancedScene* restrict const scene)
+{
+    __UE_ASSERT__(ray);
+    __UE_ASSERT__(intersection);
+    __UE_ASSERT__(global_magnitude_threshold);
+    __UE_ASSERT__(return_color);
+    __UE_ASSERT__(instance_index);
+    __UE_ASSERT__(scene);
+
+    const BVH* tlas = scene->tlas;
+
+    v3 inverse_direction = { 0 };
+    GetInverseDirection(&ray->direction, &inverse_direction);
+
+    RayIntersection closest_intersection = { 0 };
+    u32             closest_entity_index = ENTITY_INDEX_NONE;
+    u32             closest_instance     = ENTITY_INDEX_NONE;
+    r32             closest_magnitude    = ( r32 )fmin(MAX_RAY_MAG, fabs(*global_magnitude_threshold));
+
+    u32 stack[BVH_STACK_SIZE];
+    u32 stack_size = 0;
+    if (IntersectAABB(&ray->origin, &inverse_direction, &tlas->nodes[0].min, &tlas->nodes[0].max, closest_magnitude) != FLT_MAX)
+    {
+        stack[stack_size++] = 0;
+    }
+
+    while (stack_size)
+    {
+        const u32      node_index = stack[--stack_size];
+        const BVHNode* node       = &tlas->nodes[node_index];
+        if (node->left_count)
+        {
+            const u32 left_index  = node_index + 1;
+            const u32 right_index = node_index + (2 * node->left_count);
+
+            __UE_ASSERT__((stack_size + 2) <= (sizeof(stack) / sizeof(stack[0])));
+            if (IntersectAABB(&ray->origin, &inverse_direction, &tlas->nodes[right_index].min, &tlas->nodes[right_index].max, closest_magnitude) != FLT_MAX)
+            {
+                stack[stack_size++] = right_index;
+            }
+            if (IntersectAABB(&ray->origin, &inverse_direction, &tlas->nodes[left_index].min, &tlas->nodes[left_index].max, closest_magnitude) != FLT_MAX)
+            {
+                stack[stack_size++] = left_index;
+            }
+
+            continue;
+        }
+
+        for (u32 index = node->first_index; index < (node->first_index + node->index_count); index++)
+        {
+            const u32   primitive_index = tlas->indices[index];
+            const AABB* bounds          = &tlas->primitive_bounds[index];
+            if (IntersectAABB(&ray->origin, &inverse_direction, &bounds->min, &bounds->max, closest_magnitude) == FLT_MAX)
+            {
+                continue;
+            }
+
+            // Object space ray. The direction is renormalized for
+            // IntersectEntity(); 'scale' converts magnitudes between spaces.
+            const Instance* instance         = &scene->instance_arr[primitive_index];
+            Ray             object_ray       = { 0 };
+            v3              object_direction = { 0 };
+            m4TransformPoint(&instance->world_to_object, &ray->origin, &object_ray.origin);
+            m4TransformDirection(&instance->world_to_object, &ray->direction, &object_direction);
+
+            const r32 scale = v3Mag(&object_direction);
+            if (scale <= 0.0f)
+            {
+                continue;
+            }
+            v3ScalarMul(&object_direction, 1.0f / scale, &object_ray.direction);
+
+            const BLAS*     blas         = &scene->blas_arr[instance->blas_index];
+            RayIntersection candidate    = { 0 };
+            u32             entity_index = ENTITY_INDEX_NONE;
+            if (IntersectEntityBVH(&object_ray, blas->bvh, blas->entity_arr, closest_magnitude * scale, &candidate, &entity_index))
+            {
+                closest_intersection = candidate;
+                closest_entity_index = entity_index;
+                closest_instance     = primitive_index;
+                closest_magnitude    = candidate.magnitude / scale;
+            }
+        }
+    }
+
+    *instance_index              = closest_instance;
+    *intersection                = closest_intersection;
+    intersection->does_intersect = (closest_instance != ENTITY_INDEX_NONE);
+    intersection->entity_index   = closest_entity_index;
+    if (!intersection->does_intersect)
+    {
+        return;
+    }
+
+    // Back to world space
+    const Instance* instance = &scene->instance_arr[closest_instance];
+    intersection->magnitude  = closest_magnitude;
+    m4TransformPoint(&instance->object_to_world, &closest_intersection.position, &intersection->position);
+    m4TransformNormal(&instance->world_to_object, &closest_intersection.normal_vector, &intersection->normal_vector);
+    v3Norm(&intersection->normal_vector);
+
+    return_color->value = scene->blas_arr[instance->blas_index].entity_arr[closest_entity_index].material.color.value;
+}
+
+// Any-hit counterpart of TraceInstancedScene(); see: IsRayOccludedByEntity().
+static bool
+OccludedInstancedScene(const Ray* restrict const ray, const r32 max_magnitude, const InstancedScene* restrict const scene)
+{
+    __UE_ASSERT__(ray && scene);
+
+    const BVH* tlas = scene->tlas;
+
+    v3 inverse_direction = { 0 };
+    GetInverseDirection(&ray->direction, &inverse_direction);
+
+    u32 stack[BVH_STACK_SIZE];
+    u32 stack_size      = 0;
+    stack[stack_size++] = 0;
+    while (stack_size)
+    {
+        const u32      node_index = stack[--stack_size];
+        const BVHNode* node       = &tlas->nodes[node_index];
+        if (IntersectAABB(&ray->origin, &inverse_direction, &node->min, &node->max, max_magnitude) == FLT_MAX)
+        {
+            continue;
+        }
+
+        if (node->left_count)
+        {
+            __UE_ASSERT__((stack_size + 2) <= (sizeof(stack) / sizeof(stack[0])));
+            stack[stack_size++] = node_index + (2 * node->left_count);
+            stack[stack_size++] = node_index + 1;
+            continue;
+        }
+
+        for (u32 index = node->first_index; index < (node->first_index + node->index_count); index++)
+        {
+            const u32       primitive_index  = tlas->indices[index];
+            const Instance* instance         = &scene->instance_arr[primitive_index];
+            Ray             object_ray       = { 0 };
+            v3              object_direction = { 0 };
+            m4TransformPoint(&instance->world_to_object, &ray->origin, &object_ray.origin);
+            m4TransformDirection(&instance->world_to_object, &ray->direction, &object_direction);
+
+            const r32 scale = v3Mag(&object_direction);
+            if (scale <= 0.0f)
+            {
+                continue;
+            }
+            v3ScalarMul(&object_direction, 1.0f / scale, &object_ray.direction);
+
+            const BLAS* blas = &scene->blas_arr[instance->blas_index];
+            if (OccludedEntityBVH(&object_ray, max_magnitude * scale, blas->bvh, blas->entity_arr))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+#endif // __UE_INSTANCE_TOOLS_H___
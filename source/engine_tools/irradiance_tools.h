@@ -0,0 +1,488 @@
+#ifndef __UE_IRRADIANCE_TOOLS_H___
+#define __UE_IRRADIANCE_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <color_tools.h>
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <sampler_tools.h>
+#include <scene_tools.h>
+#include <type_tools.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Irradiance cache
+//
+// Light arriving at a diffuse surface varies slowly with position and normal,
+// so it is estimated sparsely and interpolated (Ward et al., 1988). A record
+// holds the mean color of record_rays cosine-weighted bounce rays leaving a
+// hit, and a validity radius: the harmonic mean distance of those rays,
+// clamped to [ min_radius, max_radius ]. A record i contributes at position
+// x with normal n when its error
+//
+//   e_i = |x - x_i| / R_i + sqrt(1 - n . n_i)
+//
+// is below 'accuracy', weighted by 1 / e_i, and if the record is visible from
+// x: a record behind an occluder would leak its light through it. Records on
+// the same (convex) entity as x are visible by construction.
+//
+// Records live in a hash grid. A record can only contribute within
+// accuracy * R_i of its position, so it is linked into every cell that sphere
+// overlaps, and a lookup visits the one cell around x. Cells are
+// 2 * accuracy * max_radius wide, so a record is linked into at most eight.
+// The cache is only modified between passes (see: PopulateIrradianceCache());
+// a pass reads it from any number of threads without synchronization.
+//
+// A caller that moves an entity between frames reports it with
+// InvalidateIrradianceEntity(), which drops the records that may see the
+// change; the next population pass re-fills only the holes. The batch
+// renderer keeps its entities still and never needs to. A record is dropped
+// if:
+//    1. it lies on the changed entity,
+//    2. one of its bounce rays hit the entity (tracked modulo 64), or
+//    3. the entity's bounds are above its surface, within its reach (the
+//       longest distance one of its bounce rays travelled) and cover more
+//       than one bounce ray's share of its hemisphere.
+//
+// Note: only the first bounce of a record is tracked; light that reached it
+//       over several bounces may change without invalidating it.
+// Note: normals follow RayIntersection, pointing away from the ray origin;
+//       bounce rays leave on the opposite side.
+//
+
+#define IRRADIANCE_LINK_NONE   (~( u32 )0)
+#define IRRADIANCE_RAY_OFFSET  1e-3f // Along the surface side, so bounce rays miss their own surface
+
+typedef struct
+{
+    r32 accuracy;
+    r32 min_radius;
+    r32 max_radius;
+    u32 record_rays;
+    u32 population_stride; // Pixels between population samples, in x and y
+} IrradianceCacheSettings;
+
+typedef struct
+{
+    v3          position;
+    v3          normal;
+    r32         radius;
+    r32         reach;
+    Color32_RGB irradiance;
+    u32         entity_index; // Surface the record lies on
+    u64         hit_mask;     // Bit (entity_index % 64) of every entity a bounce ray hit
+    bool        valid;
+} IrradianceRecord;
+
+typedef struct
+{
+    s32 x;
+    s32 y;
+    s32 z;
+} IrradianceCell;
+
+typedef struct
+{
+    IrradianceCell cell;
+    u32            record_index;
+    u32            next; // Next link in the same bucket
+} IrradianceCellLink;
+
+typedef struct
+{
+    IrradianceCacheSettings settings;
+    r32                     cell_size;
+
+    IrradianceRecord*   record_arr;
+    size_t              record_count;
+    size_t              record_capacity;
+    size_t              invalid_count;
+    IrradianceCellLink* link_arr;
+    size_t              link_count;
+    size_t              link_capacity;
+    u32*                bucket_arr;   // Head link of each bucket
+    size_t              bucket_count; // Power of two
+} IrradianceCache;
+
+__UE_inline__ static void
+GetDefaultIrradianceCacheSettings(_mut_ IrradianceCacheSettings* restrict const settings)
+{
+    __UE_ASSERT__(settings);
+
+    settings->accuracy          = ( r32 )__UE_IC__accuracy;
+    settings->min_radius        = ( r32 )__UE_IC__min_radius;
+    settings->max_radius        = ( r32 )__UE_IC__max_radius;
+    settings->record_rays       = __UE_IC__record_rays;
+    settings->population_stride = __UE_IC__population_stride;
+}
+
+//
+// Hash grid
+//
+__UE_inline__ static IrradianceCell
+GetIrradianceCell(const IrradianceCache* restrict const cache, const r32 x, const r32 y, const r32 z)
+{
+    const r32      inverse_size = 1.0f / cache->cell_size;
+    IrradianceCell cell         = { 0 };
+    cell.x                      = ( s32 )floor(x * inverse_size);
+    cell.y                      = ( s32 )floor(y * inverse_size);
+    cell.z                      = ( s32 )floor(z * inverse_size);
+    return cell;
+}
+
+__UE_inline__ static size_t
+GetIrradianceBucket(const IrradianceCache* restrict const cache, const IrradianceCell* restrict const cell)
+{
+    const u32 hash = HashCombine(HashCombine(HashU32(( u32 )cell->x), ( u32 )cell->y), ( u32 )cell->z);
+    return ( size_t )hash & (cache->bucket_count - 1);
+}
+
+// Link a record into every cell its sphere of influence overlaps.
+static void
+LinkIrradianceRecord(_mut_ IrradianceCache* restrict const cache, const u32 record_index)
+{
+    __UE_ASSERT__(cache);
+    __UE_ASSERT__(record_index < cache->record_count);
+
+    const IrradianceRecord* record    = &cache->record_arr[record_index];
+    const r32               influence = cache->settings.accuracy * record->radius;
+    const IrradianceCell    cell_min  = GetIrradianceCell(cache, record->position.x - influence, record->position.y - influence, record->position.z - influence);
+    const IrradianceCell    cell_max  = GetIrradianceCell(cache, record->position.x + influence, record->position.y + influence, record->position.z + influence);
+
+    for (s32 cell_z = cell_min.z; cell_z <= cell_max.z; cell_z++)
+    {
+        for (s32 cell_y = cell_min.y; cell_y <= cell_max.y; cell_y++)
+        {
+            for (s32 cell_x = cell_min.x; cell_x <= cell_max.x; cell_x++)
+            {
+                if (cache->link_count == cache->link_capacity)
+                {
+                    cache->link_capacity = cache->link_capacity ? (cache->link_capacity * 2) : 4096;
+                    cache->link_arr      = ( IrradianceCellLink* )realloc(cache->link_arr, cache->link_capacity * sizeof(IrradianceCellLink));
+                    __UE_ASSERT__(cache->link_arr);
+                }
+
+                IrradianceCellLink* link = &cache->link_arr[cache->link_count];
+                link->cell.x             = cell_x;
+                link->cell.y             = cell_y;
+                link->cell.z             = cell_z;
+                link->record_index       = record_index;
+
+                const size_t bucket       = GetIrradianceBucket(cache, &link->cell);
+                link->next                = cache->bucket_arr[bucket];
+                cache->bucket_arr[bucket] = ( u32 )cache->link_count;
+                cache->link_count++;
+            }
+        }
+    }
+}
+
+// Relink every valid record into 'bucket_count' buckets, dropping invalid
+// records.
+static void
+RelinkIrradianceCache(_mut_ IrradianceCache* restrict const cache, const size_t bucket_count)
+{
+    __UE_ASSERT__(cache);
+    __UE_ASSERT__(bucket_count && !(bucket_count & (bucket_count - 1)));
+
+    if (bucket_count != cache->bucket_count)
+    {
+        free(cache->bucket_arr);
+        cache->bucket_count = bucket_count;
+        cache->bucket_arr   = ( u32* )malloc(bucket_count * sizeof(u32));
+        __UE_ASSERT__(cache->bucket_arr);
+    }
+
+    memset(cache->bucket_arr, 0xFF, bucket_count * sizeof(u32));
+    cache->link_count = 0;
+
+    const size_t record_count = cache->record_count;
+    cache->record_count       = 0;
+    for (size_t record_index = 0; record_index < record_count; record_index++)
+    {
+        if (!cache->record_arr[record_index].valid)
+        {
+            continue;
+        }
+
+        cache->record_arr[cache->record_count] = cache->record_arr[record_index];
+        cache->record_count++;
+        LinkIrradianceRecord(cache, ( u32 )(cache->record_count - 1));
+    }
+
+    cache->invalid_count = 0;
+}
+
+static IrradianceCache*
+CreateIrradianceCache(const IrradianceCacheSettings* restrict const settings)
+{
+    __UE_ASSERT__(settings);
+    __UE_ASSERT__(settings->accuracy > 0.0f);
+    __UE_ASSERT__(settings->min_radius > 0.0f && settings->min_radius <= settings->max_radius);
+    __UE_ASSERT__(settings->record_rays && settings->population_stride);
+
+    IrradianceCache* cache = ( IrradianceCache* )calloc(1, sizeof(IrradianceCache));
+    __UE_ASSERT__(cache);
+
+    cache->settings  = *settings;
+    cache->cell_size = 2.0f * settings->accuracy * settings->max_radius;
+    RelinkIrradianceCache(cache, 1024);
+
+    return cache;
+}
+
+static void
+DestroyIrradianceCache(_mut_ IrradianceCache* restrict const cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+
+    free(cache->record_arr);
+    free(cache->link_arr);
+    free(cache->bucket_arr);
+    free(cache);
+}
+
+static void
+ClearIrradianceCache(_mut_ IrradianceCache* restrict const cache)
+{
+    __UE_ASSERT__(cache);
+
+    cache->record_count  = 0;
+    cache->link_count    = 0;
+    cache->invalid_count = 0;
+    memset(cache->bucket_arr, 0xFF, cache->bucket_count * sizeof(u32));
+}
+
+// True if nothing lies between a hit on entity_index and a record; both
+// ends are offset to their surface side. Meshes are not tested.
+static bool
+IsIrradianceRecordVisible(const Scene* restrict const            scene,
+                          const v3* restrict const               position,
+                          const v3* restrict const               normal,
+                          const u32                              entity_index,
+                          const IrradianceRecord* restrict const record)
+{
+    __UE_ASSERT__(scene && position && normal && record);
+
+    if (record->entity_index == entity_index)
+    {
+        return true;
+    }
+
+    v3 record_end = { 0 };
+    v3Set(&record_end,
+          record->position.x - (IRRADIANCE_RAY_OFFSET * record->normal.x),
+          record->position.y - (IRRADIANCE_RAY_OFFSET * record->normal.y),
+          record->position.z - (IRRADIANCE_RAY_OFFSET * record->normal.z));
+
+    Ray ray = { 0 };
+    v3Set(&ray.origin,
+          position->x - (IRRADIANCE_RAY_OFFSET * normal->x),
+          position->y - (IRRADIANCE_RAY_OFFSET * normal->y),
+          position->z - (IRRADIANCE_RAY_OFFSET * normal->z));
+    v3Sub(&record_end, &ray.origin, &ray.direction);
+
+    const r32 distance = v3Mag(&ray.direction);
+    if (distance <= ( r32 )TOLERANCE)
+    {
+        return true;
+    }
+
+    v3Norm(&ray.direction);
+    return !OccludedScene(&ray, distance, scene, NULL, 0);
+}
+
+// Interpolated irradiance at a hit on entity_index; false if no record is
+// close enough. With a scene, records it occludes are skipped (see:
+// IsIrradianceRecordVisible()); NULL skips the test.
+static bool
+LookupIrradiance(const IrradianceCache* restrict const cache,
+                 const Scene* restrict const           scene,
+                 const v3* restrict const              position,
+                 const v3* restrict const              normal,
+                 const u32                             entity_index,
+                 _mut_ Color32_RGB* restrict const     irradiance)
+{
+    __UE_ASSERT__(cache && position && normal && irradiance);
+    __UE_ASSERT__(!scene || !scene->mesh_count);
+
+    const IrradianceCell cell     = GetIrradianceCell(cache, position->x, position->y, position->z);
+    const r32            accuracy = cache->settings.accuracy;
+
+    r32 weight_sum = 0.0f;
+    r32 red_sum    = 0.0f;
+    r32 green_sum  = 0.0f;
+    r32 blue_sum   = 0.0f;
+    for (u32 link_index = cache->bucket_arr[GetIrradianceBucket(cache, &cell)]; link_index != IRRADIANCE_LINK_NONE; link_index = cache->link_arr[link_index].next)
+    {
+        // Buckets are shared by unrelated cells
+        const IrradianceCellLink* link = &cache->link_arr[link_index];
+        if (link->cell.x != cell.x || link->cell.y != cell.y || link->cell.z != cell.z)
+        {
+            continue;
+        }
+
+        const IrradianceRecord* record = &cache->record_arr[link->record_index];
+        v3                      offset = { 0 };
+        v3Sub(position, &record->position, &offset);
+
+        const r32 influence   = accuracy * record->radius;
+        const r32 distance_sq = v3Dot(&offset, &offset);
+        if (!record->valid || distance_sq >= (influence * influence))
+        {
+            continue;
+        }
+
+        const r32 normal_dot = v3Dot(normal, &record->normal);
+        const r32 error      = (( r32 )sqrt(distance_sq) / record->radius) + ( r32 )sqrt(normal_dot < 1.0f ? (1.0f - normal_dot) : 0.0f);
+        if (error >= accuracy || (scene && !IsIrradianceRecordVisible(scene, position, normal, entity_index, record)))
+        {
+            continue;
+        }
+
+        const r32 weight = 1.0f / (error > 1e-6f ? error : 1e-6f);
+        weight_sum += weight;
+        red_sum += weight * ( r32 )record->irradiance.channel.R;
+        green_sum += weight * ( r32 )record->irradiance.channel.G;
+        blue_sum += weight * ( r32 )record->irradiance.channel.B;
+    }
+
+    if (weight_sum <= 0.0f)
+    {
+        return false;
+    }
+
+    irradiance->channel.R = ( u8 )fmin(255.0f, round(red_sum / weight_sum));
+    irradiance->channel.G = ( u8 )fmin(255.0f, round(green_sum / weight_sum));
+    irradiance->channel.B = ( u8 )fmin(255.0f, round(blue_sum / weight_sum));
+    irradiance->channel.A = 0xFF;
+    return true;
+}
+
+// Note: not thread safe; see: PopulateIrradianceCache().
+static void
+InsertIrradianceRecord(_mut_ IrradianceCache* restrict const cache, const IrradianceRecord* restrict const record)
+{
+    __UE_ASSERT__(cache && record);
+    __UE_ASSERT__(record->radius > 0.0f && record->radius <= cache->settings.max_radius);
+
+    if (cache->record_count == cache->record_capacity)
+    {
+        cache->record_capacity = cache->record_capacity ? (cache->record_capacity * 2) : 1024;
+        cache->record_arr      = ( IrradianceRecord* )realloc(cache->record_arr, cache->record_capacity * sizeof(IrradianceRecord));
+        __UE_ASSERT__(cache->record_arr);
+    }
+
+    cache->record_arr[cache->record_count]       = *record;
+    cache->record_arr[cache->record_count].valid = true;
+    cache->record_count++;
+    LinkIrradianceRecord(cache, ( u32 )(cache->record_count - 1));
+
+    // Keep chains short
+    if (cache->link_count > (cache->bucket_count * 2))
+    {
+        RelinkIrradianceCache(cache, cache->bucket_count * 4);
+    }
+}
+
+// Drop the records that may see a change to entity 'entity_index' within the
+// sphere (center, radius). Returns the number dropped.
+static size_t
+InvalidateIrradianceSphere(_mut_ IrradianceCache* restrict const cache, const u32 entity_index, const v3* restrict const center, const r32 radius)
+{
+    __UE_ASSERT__(cache && center);
+
+    const u64 entity_bit    = ( u64 )1 << (entity_index & 63);
+    const r32 min_coverage  = 1.0f / ( r32 )cache->settings.record_rays;
+    size_t    dropped_count = 0;
+    for (size_t record_index = 0; record_index < cache->record_count; record_index++)
+    {
+        IrradianceRecord* record = &cache->record_arr[record_index];
+        if (!record->valid)
+        {
+            continue;
+        }
+
+        bool sees_change = (record->entity_index == entity_index) || (record->hit_mask & entity_bit);
+        if (!sees_change)
+        {
+            // Bounce rays leave against the normal; coverage approximates the
+            // share of the cosine-weighted hemisphere the bounds subtend.
+            v3 offset = { 0 };
+            v3Sub(center, &record->position, &offset);
+
+            const r32 distance = v3Mag(&offset);
+            const r32 height   = -v3Dot(&offset, &record->normal);
+            const r32 coverage = distance > radius ? ((radius * radius) / (distance * distance)) : 1.0f;
+            sees_change        = (distance - radius) < record->reach && height > -radius && coverage >= min_coverage;
+        }
+
+        if (sees_change)
+        {
+            record->valid = false;
+            dropped_count++;
+        }
+    }
+
+    cache->invalid_count += dropped_count;
+    return dropped_count;
+}
+
+// Call with the entity as it was and as it is after a change.
+static size_t
+InvalidateIrradianceEntity(_mut_ IrradianceCache* restrict const cache, const u32 entity_index, const Entity* restrict const previous, const Entity* restrict const current)
+{
+    __UE_ASSERT__(cache && previous && current);
+
+    // Meshes carry no bounds here
+    if (previous->type == ET_TRIANGLE_MESH || current->type == ET_TRIANGLE_MESH)
+    {
+        const size_t dropped_count = cache->record_count - cache->invalid_count;
+        ClearIrradianceCache(cache);
+        return dropped_count;
+    }
+
+    // Cubes by their bounding sphere, sqrt(3) / 2 of the edge
+    const r32 previous_radius = previous->type == ET_CUBE ? (0.8660254f * ( r32 )fabs(previous->length)) : ( r32 )fabs(previous->radius);
+    const r32 current_radius  = current->type == ET_CUBE ? (0.8660254f * ( r32 )fabs(current->length)) : ( r32 )fabs(current->radius);
+
+    return InvalidateIrradianceSphere(cache, entity_index, &previous->position, previous_radius) + InvalidateIrradianceSphere(cache, entity_index, &current->position, current_radius);
+}
+
+// Cosine-weighted direction about the unit vector 'axis' from two samples in
+// [ 0, 1 ).
+__UE_inline__ static void
+GetCosineHemisphereDirection(const v3* restrict const axis, const r32 sample_u, const r32 sample_v, _mut_ v3* restrict const direction)
+{
+    __UE_ASSERT__(axis && direction);
+
+    // Branchless orthonormal basis (Duff et al., 2017)
+    const r32 sign     = axis->z >= 0.0f ? 1.0f : -1.0f;
+    const r32 a        = -1.0f / (sign + axis->z);
+    const r32 b        = axis->x * axis->y * a;
+    v3        tangent  = { 0 };
+    v3        binormal = { 0 };
+    v3Set(&tangent, 1.0f + (sign * axis->x * axis->x * a), sign * b, -sign * axis->x);
+    v3Set(&binormal, b, sign + (axis->y * axis->y * a), -axis->y);
+
+    const r32 radius = ( r32 )sqrt(sample_u);
+    const r32 phi    = 2.0f * ( r32 )_PI_ * sample_v;
+    const r32 x      = radius * ( r32 )cos(phi);
+    const r32 y      = radius * ( r32 )sin(phi);
+    const r32 z      = ( r32 )sqrt(1.0f - sample_u);
+
+    v3SetAndNorm(direction,
+                 (x * tangent.x) + (y * binormal.x) + (z * axis->x),
+                 (x * tangent.y) + (y * binormal.y) + (z * axis->y),
+                 (x * tangent.z) + (y * binormal.z) + (z * axis->z));
+}
+
+#endif // __UE_IRRADIANCE_TOOLS_H___
@@ -0,0 +1,549 @@
+#ifndef __UE_KERNEL_TOOLS_H___
+#define __UE_KERNEL_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <entity_tools.h>
+#include <irradiance_tools.h>
+#include <macro_tools.h>
+#include <material_tools.h>
+#include <maths_tools.h>
+#include <sampler_tools.h>
+#include <scene_tools.h>
+#include <shading_tools.h>
+#include <stats_tools.h>
+#include <thread_tools.h>
+#include <type_tools.h>
+
+//
+// Specialized tracer kernels
+//
+// The tracing loop is a template over its feature policy:
+//
+//   kAntiAliasing  jittered sample within the pixel, or the pixel center;
+//                  the jitter is blue noise when the frame has a mask
+//   kMaxBounces    reflection depth, [ 0, KERNEL_MAX_BOUNCES ]; 0 disables
+//                  reflections
+//   kPrimitives    KP_SPHERES traces the sphere list of the frame's Scene
+//                  only; KP_ENTITIES adds its cube list
+//
+// Every combination is instantiated into a table of ParallelFor() row tasks.
+// GetTraceKernel() picks one from TraceKernelSettings once per frame, so the
+// inner loop of each variant has no feature branches and the quality can be
+// changed between frames without rebuilding.
+//
+// Bounces recurse through the template, one instantiation per depth, so the
+// recursion is bounded at compile time. A bounce is spawned while the depth
+// is below both kMaxBounces and the hit material's max_generated_rays; the
+// reflected color is blended by BlendColorByMaterial(), except at the primary
+// hit: a row defers those blends to ShadeHitRecords() (see: shading_tools.h),
+// which shades them one material class at a time.
+//
+// With an IrradianceCache in the frame, the first bounce of a diffuse hit is
+// interpolated from the cache where it has records (see:
+// PopulateIrradianceCache()) and traced where it has none.
+//
+// Entities are intersected through a type-sorted Scene, one kernel per
+// primitive type (see: scene_tools.h); the frame's scene must be up to date
+// with its entities.
+//
+// Note: shading is otherwise the flat albedo of TraceEntityArray(). Unlike
+//       TraceEntityArray(), hits within TOLERANCE of the ray origin are
+//       ignored.
+// Note: ET_TRIANGLE_MESH entities are not traced (see: mesh_tools.h), and
+//       the irradiance cache needs a scene without them.
+//
+
+#define KERNEL_MAX_BOUNCES   3   // See: kTraceKernelTable
+#define KERNEL_SHADING_BATCH 256 // Primary hits per ShadeHitRecords() call
+
+typedef enum
+{
+    KP_SPHERES, // ET_SPHERE (or ET_NONE) entities only; cubes are skipped
+    KP_ENTITIES // Spheres and cubes
+} KernelPrimitiveSet;
+
+#define KERNEL_PRIMITIVE_SET_COUNT (KP_ENTITIES + 1)
+
+typedef struct
+{
+    bool               anti_aliasing;
+    bool               reflections;
+    u32                max_bounces; // Clamped to KERNEL_MAX_BOUNCES; ignored without reflections
+    KernelPrimitiveSet primitives;
+} TraceKernelSettings;
+
+typedef struct
+{
+    Color32_RGB*  pixel_arr; // image_width * image_height, row-major
+    size_t        image_width;
+    size_t        image_height;
+    const Scene*  scene;        // See: CreateScene()
+    u32           sample_index; // See: BeginPixelSample()
+
+    const IrradianceCache* irradiance_cache; // NULL traces every bounce
+    const BlueNoiseMask*   blue_noise;       // NULL jitters with Sobol samples; see: SampleBlueNoise()
+    RenderStats*           stats;            // NULL counts nothing; see: stats_tools.h
+} TraceKernelFrame;
+
+// Defaults follow the compile-time flags the kernels replace.
+__UE_inline__ static void
+GetDefaultTraceKernelSettings(_mut_ TraceKernelSettings* restrict const settings)
+{
+    __UE_ASSERT__(settings);
+
+    settings->anti_aliasing = (( r32 )__UE_AA__noise > 0.0f);
+    settings->reflections   = (__UE_AA__reflections != 0);
+    settings->max_bounces   = KERNEL_MAX_BOUNCES;
+    settings->primitives    = KP_ENTITIES;
+}
+
+//
+// Kernel body
+//
+
+// Closest hit beyond TOLERANCE and within MAX_RAY_MAG.
+template <KernelPrimitiveSet kPrimitives>
+__UE_inline__ static bool
+IntersectKernelPrimitives(const Ray* restrict const ray, const Scene* restrict const scene, _mut_ RayIntersection* restrict const closest_intersection)
+{
+    r32 closest_magnitude = ( r32 )MAX_RAY_MAG;
+    u32 closest_index     = IntersectSceneSpheres(scene, ray, ( r32 )TOLERANCE, &closest_magnitude);
+    if constexpr (kPrimitives == KP_ENTITIES)
+    {
+        const u32 cube_index = IntersectSceneCubes(scene, ray, ( r32 )TOLERANCE, &closest_magnitude);
+        closest_index        = (cube_index != ENTITY_INDEX_NONE) ? cube_index : closest_index;
+    }
+
+    if (closest_index == ENTITY_INDEX_NONE)
+    {
+        closest_intersection->entity_index = ENTITY_INDEX_NONE;
+        return false;
+    }
+
+    ResolveSceneIntersection(scene, ray, closest_index, closest_magnitude, closest_intersection);
+    return true;
+}
+
+template <u32 kBounce, u32 kMaxBounces, KernelPrimitiveSet kPrimitives>
+static bool
+TraceKernelRay(const Ray* restrict const             ray,
+               const Scene* restrict const           scene,
+               const IrradianceCache* restrict const irradiance_cache,
+               _mut_ Color32_RGB* restrict const     return_color);
+
+// The color a hit's material is blended with: its cached irradiance or its
+// traced bounce. Returns false if the hit keeps its own color.
+template <u32 kBounce, u32 kMaxBounces, KernelPrimitiveSet kPrimitives>
+static bool
+GetKernelHitInput(const Ray* restrict const             ray,
+                  const RayIntersection* restrict const intersection,
+                  const Scene* restrict const           scene,
+                  const IrradianceCache* restrict const irradiance_cache,
+                  _mut_ Color32_RGB* restrict const     input_color)
+{
+    if constexpr (kBounce < kMaxBounces)
+    {
+        const Material* material = &scene->entity_arr[intersection->entity_index].material;
+        if (kBounce >= material->max_generated_rays || material->material_class == MATERIAL_CLASS_N__UE_ON__E)
+        {
+            return false;
+        }
+
+        if constexpr (kBounce == 0)
+        {
+            if (irradiance_cache && material->material_class == MATERIAL_CLASS_DIFFUSE && LookupIrradiance(irradiance_cache, scene, &intersection->position, &intersection->normal_vector, intersection->entity_index, input_color))
+            {
+                return true;
+            }
+        }
+
+        // Mirror direction, perturbed by the reflection noise; the sign of the
+        // normal does not matter.
+        const r32 normal_dot = v3Dot(&ray->direction, &intersection->normal_vector);
+        const r32 xrand      = NextSample1D() - 0.5f;
+        const r32 yrand      = NextSample1D() - 0.5f;
+        const r32 zrand      = NextSample1D() - 0.5f;
+
+        Ray bounce_ray    = { 0 };
+        bounce_ray.origin = intersection->position;
+        v3SetAndNorm(&bounce_ray.direction,
+                     ray->direction.x - (2.0f * normal_dot * intersection->normal_vector.x) + (xrand * ( r32 )__UE_AA__reflection_noise),
+                     ray->direction.y - (2.0f * normal_dot * intersection->normal_vector.y) + (yrand * ( r32 )__UE_AA__reflection_noise),
+                     ray->direction.z - (2.0f * normal_dot * intersection->normal_vector.z) + (zrand * ( r32 )__UE_AA__reflection_noise));
+
+        __UE_STAT__(bounces, 1);
+        return TraceKernelRay<kBounce + 1, kMaxBounces, kPrimitives>(&bounce_ray, scene, NULL, input_color);
+    }
+    else
+    {
+        (void)ray;
+        (void)intersection;
+        (void)scene;
+        (void)irradiance_cache;
+        (void)input_color;
+        return false;
+    }
+}
+
+// Color of a hit, including its bounces.
+template <u32 kBounce, u32 kMaxBounces, KernelPrimitiveSet kPrimitives>
+static void
+ShadeKernelHit(const Ray* restrict const             ray,
+               const RayIntersection* restrict const intersection,
+               const Scene* restrict const           scene,
+               const IrradianceCache* restrict const irradiance_cache,
+               _mut_ Color32_RGB* restrict const     return_color)
+{
+    const Material* material = &scene->entity_arr[intersection->entity_index].material;
+    return_color->value      = material->color.value;
+
+    Color32_RGB input_color = { 0 };
+    if (GetKernelHitInput<kBounce, kMaxBounces, kPrimitives>(ray, intersection, scene, irradiance_cache, &input_color))
+    {
+        BlendColorByMaterial(material, &input_color, return_color);
+    }
+}
+
+template <u32 kBounce, u32 kMaxBounces, KernelPrimitiveSet kPrimitives>
+static bool
+TraceKernelRay(const Ray* restrict const             ray,
+               const Scene* restrict const           scene,
+               const IrradianceCache* restrict const irradiance_cache,
+               _mut_ Color32_RGB* restrict const     return_color)
+{
+    __UE_STAT__(rays, 1);
+
+    RayIntersection intersection = { 0 };
+    if (!IntersectKernelPrimitives<kPrimitives>(ray, scene, &intersection))
+    {
+        return false;
+    }
+
+    ShadeKernelHit<kBounce, kMaxBounces, kPrimitives>(ray, &intersection, scene, irradiance_cache, return_color);
+    return true;
+}
+
+// One image row; a ParallelTaskFunction over a TraceKernelFrame.
+template <bool kAntiAliasing, u32 kMaxBounces, KernelPrimitiveSet kPrimitives>
+static void
+TraceKernelRow(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const TraceKernelFrame* frame = ( const TraceKernelFrame* )context;
+    const size_t            pix_y = task_index;
+
+    HitRecord    record_arr[KERNEL_SHADING_BATCH];
+    HitRecord    sorted_record_arr[KERNEL_SHADING_BATCH];
+    ShadingBatch batch = { 0 };
+    InitShadingBatch(&batch, record_arr, sorted_record_arr, KERNEL_SHADING_BATCH);
+
+    for (size_t pix_x = 0; pix_x < frame->image_width; pix_x++)
+    {
+        const size_t pixel_index = (pix_y * frame->image_width) + pix_x;
+        BeginPixelSample(( u32 )pixel_index, frame->sample_index);
+
+#if __UE_STATS__enabled == 1
+        BeginPixelStats();
+#endif // __UE_STATS__enabled == 1
+
+        r32 sample_x = ( r32 )pix_x + 0.5f;
+        r32 sample_y = ( r32 )pix_y + 0.5f;
+        if constexpr (kAntiAliasing)
+        {
+            // The Sobol dimensions are drawn either way, so the bounces see
+            // the same samples with and without a mask
+            r32 jitter_x = NextSample1D();
+            r32 jitter_y = NextSample1D();
+            if (frame->blue_noise)
+            {
+                jitter_x = SampleBlueNoise(frame->blue_noise, pix_x, pix_y, frame->sample_index, 0);
+                jitter_y = SampleBlueNoise(frame->blue_noise, pix_x, pix_y, frame->sample_index, 1);
+            }
+
+            sample_x += (jitter_x - 0.5f) * ( r32 )__UE_AA__noise;
+            sample_y += (jitter_y - 0.5f) * ( r32 )__UE_AA__noise;
+        }
+
+        Ray ray = { 0 };
+        SetRayDirectionByPixelSample(&ray, sample_x, sample_y, frame->image_width, frame->image_height);
+        v3Norm(&ray.direction);
+
+        // The hit's own color now; its blend is shaded with the batch
+        __UE_STAT__(rays, 1);
+        RayIntersection intersection = { 0 };
+        Color32_RGB     sample_color = { 0 };
+        Color32_RGB     input_color  = { 0 };
+        const bool      is_hit       = IntersectKernelPrimitives<kPrimitives>(&ray, frame->scene, &intersection);
+        if (is_hit)
+        {
+            sample_color.value = frame->scene->entity_arr[intersection.entity_index].material.color.value;
+        }
+        sample_color.channel.A        = 0xFF;
+        frame->pixel_arr[pixel_index] = sample_color;
+
+        if (is_hit && GetKernelHitInput<0, kMaxBounces, kPrimitives>(&ray, &intersection, frame->scene, frame->irradiance_cache, &input_color))
+        {
+            if (!PushHitRecord(&batch, &intersection, pixel_index, &input_color))
+            {
+                ShadeHitRecords(&batch, frame->scene->entity_arr, frame->scene->num_entitys, frame->pixel_arr);
+                ResetShadingBatch(&batch);
+                PushHitRecord(&batch, &intersection, pixel_index, &input_color);
+            }
+        }
+
+#if __UE_STATS__enabled == 1
+        if (frame->stats)
+        {
+            EndPixelStats(frame->stats, pix_x, pix_y);
+        }
+#endif // __UE_STATS__enabled == 1
+    }
+
+    ShadeHitRecords(&batch, frame->scene->entity_arr, frame->scene->num_entitys, frame->pixel_arr);
+}
+
+//
+// Kernel selection
+//
+#define TRACE_KERNEL_PRIMITIVES(anti_aliasing, max_bounces) \
+    { TraceKernelRow<anti_aliasing, max_bounces, KP_SPHERES>, TraceKernelRow<anti_aliasing, max_bounces, KP_ENTITIES> }
+
+// Note: one entry per depth in [ 0, KERNEL_MAX_BOUNCES ]
+#define TRACE_KERNEL_BOUNCES(anti_aliasing)                                                   \
+    {                                                                                         \
+        TRACE_KERNEL_PRIMITIVES(anti_aliasing, 0), TRACE_KERNEL_PRIMITIVES(anti_aliasing, 1), \
+        TRACE_KERNEL_PRIMITIVES(anti_aliasing, 2), TRACE_KERNEL_PRIMITIVES(anti_aliasing, 3)  \
+    }
+
+static const ParallelTaskFunction kTraceKernelTable[2][KERNEL_MAX_BOUNCES + 1][KERNEL_PRIMITIVE_SET_COUNT] = {
+    TRACE_KERNEL_BOUNCES(false),
+    TRACE_KERNEL_BOUNCES(true)
+};
+
+static_assert(KERNEL_MAX_BOUNCES == 3, "kTraceKernelTable instantiates depths 0 through 3");
+
+#undef TRACE_KERNEL_BOUNCES
+#undef TRACE_KERNEL_PRIMITIVES
+
+static ParallelTaskFunction
+GetTraceKernel(const TraceKernelSettings* restrict const settings)
+{
+    __UE_ASSERT__(settings);
+    __UE_ASSERT__(( u32 )settings->primitives < KERNEL_PRIMITIVE_SET_COUNT);
+
+    const u32 max_bounces = !settings->reflections ? 0 : (settings->max_bounces < KERNEL_MAX_BOUNCES ? settings->max_bounces : KERNEL_MAX_BOUNCES);
+    return kTraceKernelTable[settings->anti_aliasing ? 1 : 0][max_bounces][settings->primitives];
+}
+
+// Trace one sample per pixel with the kernel for 'settings', one parallel task
+// per row. If frame->stats is not NULL (and statistics are enabled) each
+// pixel's traversal counters are added to it; rows do not align with its
+// tiles, so the caller aggregates them (see: AggregateRenderStats()).
+static void
+RenderTraceKernel(const TraceKernelSettings* restrict const settings, const TraceKernelFrame* restrict const frame, ThreadPool* const pool)
+{
+    __UE_ASSERT__(settings && frame);
+    __UE_ASSERT__(frame->pixel_arr && frame->scene);
+    __UE_ASSERT__(frame->image_width && frame->image_height);
+
+    ParallelFor(pool, frame->image_height, GetTraceKernel(settings), ( void* )frame);
+}
+
+//
+// Irradiance cache population
+//
+typedef struct
+{
+    const TraceKernelFrame*  frame;
+    const IrradianceCache*   cache;
+    IrradianceRecord*        candidate_arr;       // column_count per row
+    u32*                     candidate_count_arr; // Per row
+    size_t                   column_count;
+} IrradiancePopulation;
+
+// Trace record_rays cosine-weighted bounces from a diffuse hit. Each is shaded
+// like a first bounce, and a miss counts as white: a missed bounce leaves the
+// albedo untouched, which is what blending white does.
+template <u32 kMaxBounces, KernelPrimitiveSet kPrimitives>
+static void
+ComputeIrradianceRecord(const IrradianceCacheSettings* restrict const settings,
+                        const RayIntersection* restrict const         intersection,
+                        const Scene* restrict const                   scene,
+                        _mut_ IrradianceRecord* restrict const        record)
+{
+    __UE_ASSERT__(settings && intersection && scene && record);
+
+    v3 surface_side = { 0 };
+    v3Set(&surface_side, -intersection->normal_vector.x, -intersection->normal_vector.y, -intersection->normal_vector.z);
+
+    Ray bounce_ray = { 0 };
+    v3Set(&bounce_ray.origin,
+          intersection->position.x + (IRRADIANCE_RAY_OFFSET * surface_side.x),
+          intersection->position.y + (IRRADIANCE_RAY_OFFSET * surface_side.y),
+          intersection->position.z + (IRRADIANCE_RAY_OFFSET * surface_side.z));
+
+    r32 red_sum              = 0.0f;
+    r32 green_sum            = 0.0f;
+    r32 blue_sum             = 0.0f;
+    r32 inverse_distance_sum = 0.0f;
+    r32 reach                = 0.0f;
+    u64 hit_mask             = 0;
+    for (u32 ray_index = 0; ray_index < settings->record_rays; ray_index++)
+    {
+        const r32 sample_u = NextSample1D();
+        const r32 sample_v = NextSample1D();
+        GetCosineHemisphereDirection(&surface_side, sample_u, sample_v, &bounce_ray.direction);
+
+        __UE_STAT__(bounces, 1);
+        __UE_STAT__(rays, 1);
+        RayIntersection bounce_intersection = { 0 };
+        Color32_RGB     bounce_color        = { 0 };
+        r32             distance            = ( r32 )MAX_RAY_MAG;
+        bounce_color.value                  = 0xFFFFFFFF;
+        if (IntersectKernelPrimitives<kPrimitives>(&bounce_ray, scene, &bounce_intersection))
+        {
+            ShadeKernelHit<1, kMaxBounces, kPrimitives>(&bounce_ray, &bounce_intersection, scene, NULL, &bounce_color);
+            distance = bounce_intersection.magnitude;
+            hit_mask |= ( u64 )1 << (bounce_intersection.entity_index & 63);
+        }
+
+        red_sum += ( r32 )bounce_color.channel.R;
+        green_sum += ( r32 )bounce_color.channel.G;
+        blue_sum += ( r32 )bounce_color.channel.B;
+        inverse_distance_sum += 1.0f / distance;
+        reach = distance > reach ? distance : reach;
+    }
+
+    const r32 ray_count       = ( r32 )settings->record_rays;
+    const r32 harmonic_radius = ray_count / inverse_distance_sum;
+
+    memset(record, 0, sizeof(IrradianceRecord));
+    record->position             = intersection->position;
+    record->normal               = intersection->normal_vector;
+    record->radius               = harmonic_radius < settings->min_radius ? settings->min_radius : (harmonic_radius > settings->max_radius ? settings->max_radius : harmonic_radius);
+    record->reach                = reach;
+    record->irradiance.channel.R = ( u8 )fmin(255.0f, round(red_sum / ray_count));
+    record->irradiance.channel.G = ( u8 )fmin(255.0f, round(green_sum / ray_count));
+    record->irradiance.channel.B = ( u8 )fmin(255.0f, round(blue_sum / ray_count));
+    record->irradiance.channel.A = 0xFF;
+    record->entity_index         = intersection->entity_index;
+    record->hit_mask             = hit_mask;
+}
+
+// One population row: a primary ray every population_stride pixels, and a
+// candidate record for each diffuse hit the cache does not cover yet.
+template <u32 kMaxBounces, KernelPrimitiveSet kPrimitives>
+static void
+PopulateIrradianceRow(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    const IrradiancePopulation*    population = ( const IrradiancePopulation* )context;
+    const TraceKernelFrame*        frame      = population->frame;
+    const IrradianceCacheSettings* settings   = &population->cache->settings;
+    const size_t                   pix_y      = task_index * settings->population_stride;
+    IrradianceRecord*              candidates = &population->candidate_arr[task_index * population->column_count];
+
+    u32 candidate_count = 0;
+    for (size_t pix_x = 0; pix_x < frame->image_width; pix_x += settings->population_stride)
+    {
+        const size_t pixel_index = (pix_y * frame->image_width) + pix_x;
+        BeginPixelSample(( u32 )pixel_index, frame->sample_index);
+
+        Ray ray = { 0 };
+        SetRayDirectionByPixelSample(&ray, ( r32 )pix_x + 0.5f, ( r32 )pix_y + 0.5f, frame->image_width, frame->image_height);
+        v3Norm(&ray.direction);
+
+        RayIntersection intersection = { 0 };
+        if (!IntersectKernelPrimitives<kPrimitives>(&ray, frame->scene, &intersection))
+        {
+            continue;
+        }
+
+        const Material* material   = &frame->scene->entity_arr[intersection.entity_index].material;
+        Color32_RGB     irradiance = { 0 };
+        if (material->material_class != MATERIAL_CLASS_DIFFUSE || !material->max_generated_rays
+            || LookupIrradiance(population->cache, frame->scene, &intersection.position, &intersection.normal_vector, intersection.entity_index, &irradiance))
+        {
+            continue;
+        }
+
+        ComputeIrradianceRecord<kMaxBounces, kPrimitives>(settings, &intersection, frame->scene, &candidates[candidate_count++]);
+    }
+
+    population->candidate_count_arr[task_index] = candidate_count;
+}
+
+#define IRRADIANCE_POPULATION_PRIMITIVES(max_bounces) \
+    { PopulateIrradianceRow<max_bounces, KP_SPHERES>, PopulateIrradianceRow<max_bounces, KP_ENTITIES> }
+
+static const ParallelTaskFunction kIrradiancePopulationTable[KERNEL_MAX_BOUNCES + 1][KERNEL_PRIMITIVE_SET_COUNT] = {
+    IRRADIANCE_POPULATION_PRIMITIVES(0),
+    IRRADIANCE_POPULATION_PRIMITIVES(1),
+    IRRADIANCE_POPULATION_PRIMITIVES(2),
+    IRRADIANCE_POPULATION_PRIMITIVES(3)
+};
+
+#undef IRRADIANCE_POPULATION_PRIMITIVES
+
+// Add records where the frame's diffuse hits are not yet covered; call before
+// RenderTraceKernel() with the same settings and 'frame' (whose
+// irradiance_cache is ignored here). Candidates are traced in parallel and
+// inserted in image order, skipping any an earlier insertion now covers, so
+// the cache does not depend on the thread count. Returns the number of
+// records added.
+static size_t
+PopulateIrradianceCache(const TraceKernelSettings* restrict const settings, const TraceKernelFrame* restrict const frame, _mut_ IrradianceCache* restrict const cache, ThreadPool* const pool)
+{
+    __UE_ASSERT__(settings && frame && cache);
+    __UE_ASSERT__(frame->scene && frame->image_width && frame->image_height);
+    __UE_ASSERT__(( u32 )settings->primitives < KERNEL_PRIMITIVE_SET_COUNT);
+
+    // Nothing bounces
+    const u32 max_bounces = !settings->reflections ? 0 : (settings->max_bounces < KERNEL_MAX_BOUNCES ? settings->max_bounces : KERNEL_MAX_BOUNCES);
+    if (!max_bounces)
+    {
+        return 0;
+    }
+
+    if (cache->invalid_count)
+    {
+        RelinkIrradianceCache(cache, cache->bucket_count);
+    }
+
+    const size_t stride    = cache->settings.population_stride;
+    const size_t row_count = (frame->image_height + stride - 1) / stride;
+
+    IrradiancePopulation population = { 0 };
+    population.frame                = frame;
+    population.cache                = cache;
+    population.column_count         = (frame->image_width + stride - 1) / stride;
+    population.candidate_arr        = ( IrradianceRecord* )malloc(row_count * population.column_count * sizeof(IrradianceRecord));
+    population.candidate_count_arr  = ( u32* )calloc(row_count, sizeof(u32));
+    __UE_ASSERT__(population.candidate_arr && population.candidate_count_arr);
+
+    ParallelFor(pool, row_count, kIrradiancePopulationTable[max_bounces][settings->primitives], &population);
+
+    const size_t record_count = cache->record_count;
+    for (size_t row_index = 0; row_index < row_count; row_index++)
+    {
+        const IrradianceRecord* candidates = &population.candidate_arr[row_index * population.column_count];
+        for (u32 candidate_index = 0; candidate_index < population.candidate_count_arr[row_index]; candidate_index++)
+        {
+            Color32_RGB irradiance = { 0 };
+            if (!LookupIrradiance(cache, frame->scene, &candidates[candidate_index].position, &candidates[candidate_index].normal, candidates[candidate_index].entity_index, &irradiance))
+            {
+                InsertIrradianceRecord(cache, &candidates[candidate_index]);
+            }
+        }
+    }
+
+    free(population.candidate_arr);
+    free(population.candidate_count_arr);
+
+    return cache->record_count - record_count;
+}
+
+#endif // __UE_KERNEL_TOOLS_H___
@@ -13,6 +13,8 @@ typedef enum
     MATERIAL_CLASS_METAL
 } MaterialClass;
 
+#define MATERIAL_CLASS_COUNT (MATERIAL_CLASS_METAL + 1)
+
 typedef struct
 {
     u16           max_generated_rays;
@@ -50,6 +52,45 @@ GetDefaultMaterialByClass(_mut_ Material* restrict const material, const Materia
     }
 }
 
+//
+// Shading kernels
+//
+// A surface absorbs 'absorbtion_coefficient' of the light arriving along
+// 'input_color'; the remainder leaves the surface. Diffuse surfaces re-emit
+// the absorbed share in their own color. Metals reflect the remainder tinted
+// by their color and contribute nothing of their own.
+//
+// Note: per-class kernels are exposed so that batched shading (see:
+//       shading_tools.h) can run one class over many hits without a switch.
+//
+__UE_inline__ static u8
+BlendColorChannel(const u8 own, const u8 input, const r32 own_weight, const r32 tinted_weight)
+{
+    const r32 value = (own_weight * ( r32 )own) + (tinted_weight * (( r32 )own * ( r32 )input / 255.0f));
+    return ( u8 )(value > 255.0f ? 255.0f : value);
+}
+
+__UE_inline__ static void
+BlendColorDiffuse(const Material* restrict const material, const Color32_RGB* restrict const input_color, _mut_ Color32_RGB* restrict const return_color)
+{
+    const r32 own_weight    = material->absorbtion_coefficient;
+    const r32 tinted_weight = 1.0f - material->absorbtion_coefficient;
+
+    return_color->channel.R = BlendColorChannel(material->color.channel.R, input_color->channel.R, own_weight, tinted_weight);
+    return_color->channel.G = BlendColorChannel(material->color.channel.G, input_color->channel.G, own_weight, tinted_weight);
+    return_color->channel.B = BlendColorChannel(material->color.channel.B, input_color->channel.B, own_weight, tinted_weight);
+}
+
+__UE_inline__ static void
+BlendColorMetal(const Material* restrict const material, const Color32_RGB* restrict const input_color, _mut_ Color32_RGB* restrict const return_color)
+{
+    const r32 tinted_weight = 1.0f - material->absorbtion_coefficient;
+
+    return_color->channel.R = BlendColorChannel(material->color.channel.R, input_color->channel.R, 0.0f, tinted_weight);
+    return_color->channel.G = BlendColorChannel(material->color.channel.G, input_color->channel.G, 0.0f, tinted_weight);
+    return_color->channel.B = BlendColorChannel(material->color.channel.B, input_color->channel.B, 0.0f, tinted_weight);
+}
+
 __UE_inline__ static void
 BlendColorByMaterial(const Material* restrict const material, const Color32_RGB* restrict const input_color, _mut_ Color32_RGB* restrict const return_color)
 {
@@ -60,9 +101,24 @@ BlendColorByMaterial(const Material* restrict const material, const Color32_RGB*
     __UE_ASSERT__(input_color);
     __UE_ASSERT__(return_color);
 
-    // [ cfarvin::TODO ] (return_color->channel.R)
+    switch (material->material_class)
+    {
+        case MATERIAL_CLASS_DIFFUSE:
+        {
+            BlendColorDiffuse(material, input_color, return_color);
+            break;
+        }
+        case MATERIAL_CLASS_METAL:
+        {
+            BlendColorMetal(material, input_color, return_color);
+            break;
+        }
 
-    return;
+        case MATERIAL_CLASS_N__UE_ON__E:
+        {
+            break;
+        }
+    }
 }
 
 #endif // __UE_MATERIAL_TOOLS_H__
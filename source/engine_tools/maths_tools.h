@@ -550,4 +550,81 @@ m4Mult(const m4* restrict const a, const m4* restrict const b, m4* restrict cons
     }
 }
 
+// Note: transforms treat m4 as a column-vector affine transform; the upper
+//       3x3 block is the linear part and column 3 is the translation.
+__UE_inline__ static void
+m4TransformPoint(const m4* restrict const a, const v3* restrict const point, v3* restrict const result)
+{
+    uAssert(a && point && result);
+    for (uint8_t row = 0; row < 3; row++)
+    {
+        result->arr[row] = a->arr2d[row][0] * point->x + a->arr2d[row][1] * point->y + a->arr2d[row][2] * point->z + a->arr2d[row][3];
+    }
+}
+
+__UE_inline__ static void
+m4TransformDirection(const m4* restrict const a, const v3* restrict const direction, v3* restrict const result)
+{
+    uAssert(a && direction && result);
+    for (uint8_t row = 0; row < 3; row++)
+    {
+        result->arr[row] = a->arr2d[row][0] * direction->x + a->arr2d[row][1] * direction->y + a->arr2d[row][2] * direction->z;
+    }
+}
+
+// Transforms a surface normal by the transpose of 'a'; pass the inverse of
+// the transform applied to the surface. The result is not normalized.
+__UE_inline__ static void
+m4TransformNormal(const m4* restrict const a, const v3* restrict const normal, v3* restrict const result)
+{
+    uAssert(a && normal && result);
+    for (uint8_t col = 0; col < 3; col++)
+    {
+        result->arr[col] = a->arr2d[0][col] * normal->x + a->arr2d[1][col] * normal->y + a->arr2d[2][col] * normal->z;
+    }
+}
+
+// Inverse of an affine transform; the bottom row of 'a' is assumed to be
+// [ 0, 0, 0, 1 ].
+// Returns false, leaving 'result' untouched, if 'a' is singular.
+static bool
+m4AffineInverse(const m4* restrict const a, m4* restrict const result)
+{
+    uAssert(a && result);
+
+    // Cofactors of the linear part
+    const r32 c00 = a->arr2d[1][1] * a->arr2d[2][2] - a->arr2d[1][2] * a->arr2d[2][1];
+    const r32 c01 = a->arr2d[1][2] * a->arr2d[2][0] - a->arr2d[1][0] * a->arr2d[2][2];
+    const r32 c02 = a->arr2d[1][0] * a->arr2d[2][1] - a->arr2d[1][1] * a->arr2d[2][0];
+
+    const r32 determinant = a->arr2d[0][0] * c00 + a->arr2d[0][1] * c01 + a->arr2d[0][2] * c02;
+    if (fabs(determinant) < _TOLERANCE_)
+    {
+        return false;
+    }
+
+    const r32 inverse_determinant = 1.0f / determinant;
+
+    m4 inverse          = {};
+    inverse.arr2d[0][0] = c00 * inverse_determinant;
+    inverse.arr2d[1][0] = c01 * inverse_determinant;
+    inverse.arr2d[2][0] = c02 * inverse_determinant;
+    inverse.arr2d[0][1] = (a->arr2d[0][2] * a->arr2d[2][1] - a->arr2d[0][1] * a->arr2d[2][2]) * inverse_determinant;
+    inverse.arr2d[1][1] = (a->arr2d[0][0] * a->arr2d[2][2] - a->arr2d[0][2] * a->arr2d[2][0]) * inverse_determinant;
+    inverse.arr2d[2][1] = (a->arr2d[0][1] * a->arr2d[2][0] - a->arr2d[0][0] * a->arr2d[2][1]) * inverse_determinant;
+    inverse.arr2d[0][2] = (a->arr2d[0][1] * a->arr2d[1][2] - a->arr2d[0][2] * a->arr2d[1][1]) * inverse_determinant;
+    inverse.arr2d[1][2] = (a->arr2d[0][2] * a->arr2d[1][0] - a->arr2d[0][0] * a->arr2d[1][2]) * inverse_determinant;
+    inverse.arr2d[2][2] = (a->arr2d[0][0] * a->arr2d[1][1] - a->arr2d[0][1] * a->arr2d[1][0]) * inverse_determinant;
+
+    // Inverse translation: -(L^-1 * t)
+    for (uint8_t row = 0; row < 3; row++)
+    {
+        inverse.arr2d[row][3] = -(inverse.arr2d[row][0] * a->arr2d[0][3] + inverse.arr2d[row][1] * a->arr2d[1][3] + inverse.arr2d[row][2] * a->arr2d[2][3]);
+    }
+    inverse.arr2d[3][3] = 1;
+
+    *result = inverse;
+    return true;
+}
+
 #endif // __UE_MATHS_TOOLS_H___
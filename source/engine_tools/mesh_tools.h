@@ -0,0 +1,638 @@
+#ifndef __UE_MESH_TOOLS_H___
+#define __UE_MESH_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <bvh_tools.h>
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <thread_tools.h>
+#include <type_tools.h>
+
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if __UE_SIMD__sse
+#include <emmintrin.h>
+#endif // __UE_SIMD__sse
+
+//
+// Indexed triangle meshes
+//
+// Each mesh owns a BVH over its triangles with at most four triangles per
+// leaf. After the build, every leaf's triangles are copied into one
+// TrianglePacket: vertex 0 and both edges in SoA form, ready for a 4-wide
+// Moller-Trumbore test. Unused lanes hold degenerate triangles that never
+// report a hit.
+//
+// Triangles are two-sided. Normals face away from the ray origin, matching
+// the sphere convention of IntersectEntity().
+//
+
+#define MESH_PACKET_WIDTH 4
+#define TRIANGLE_INDEX_NONE (~( u32 )0)
+
+typedef struct
+{
+    r32 v0_x[MESH_PACKET_WIDTH];
+    r32 v0_y[MESH_PACKET_WIDTH];
+    r32 v0_z[MESH_PACKET_WIDTH];
+    r32 edge1_x[MESH_PACKET_WIDTH];
+    r32 edge1_y[MESH_PACKET_WIDTH];
+    r32 edge1_z[MESH_PACKET_WIDTH];
+    r32 edge2_x[MESH_PACKET_WIDTH];
+    r32 edge2_y[MESH_PACKET_WIDTH];
+    r32 edge2_z[MESH_PACKET_WIDTH];
+    u32 triangle_index[MESH_PACKET_WIDTH]; // TRIANGLE_INDEX_NONE for unused lanes
+} TrianglePacket;
+
+typedef struct
+{
+    v3*    vertices;
+    u32*   indices; // Three per triangle
+    size_t vertex_count;
+    size_t triangle_count;
+
+    BVH*            bvh;         // Over triangles; leaves hold at most MESH_PACKET_WIDTH
+    TrianglePacket* packets;     // One per BVH leaf
+    u32*            leaf_packet; // BVH node index -> packet index; leaves only
+} TriangleMesh;
+
+__UE_inline__ static void
+GetTriangleVertices(const TriangleMesh* restrict const mesh, const u32 triangle_index, _mut_ v3* restrict const vertices)
+{
+    __UE_ASSERT__(mesh && vertices);
+    __UE_ASSERT__(triangle_index < mesh->triangle_count);
+
+    vertices[0] = mesh->vertices[mesh->indices[(3 * triangle_index) + 0]];
+    vertices[1] = mesh->vertices[mesh->indices[(3 * triangle_index) + 1]];
+    vertices[2] = mesh->vertices[mesh->indices[(3 * triangle_index) + 2]];
+}
+
+static void
+GetTriangleBounds(const void* primitives, const u32 primitive_index, _mut_ AABB* const bounds)
+{
+    const TriangleMesh* mesh = ( const TriangleMesh* )primitives;
+
+    v3 vertices[3];
+    GetTriangleVertices(mesh, primitive_index, vertices);
+
+    AABBSetEmpty(bounds);
+    AABBGrowPoint(bounds, &vertices[0]);
+    AABBGrowPoint(bounds, &vertices[1]);
+    AABBGrowPoint(bounds, &vertices[2]);
+}
+
+static void
+PackTriangleMeshLeaves(_mut_ TriangleMesh* restrict const mesh)
+{
+    __UE_ASSERT__(mesh && mesh->bvh);
+
+    const BVH* bvh = mesh->bvh;
+
+    const size_t leaf_count = CountBVHLeaves(bvh);
+
+    free(mesh->packets);
+    mesh->packets = ( TrianglePacket* )calloc(leaf_count, sizeof(TrianglePacket));
+    __UE_ASSERT__(mesh->packets);
+
+    // Walk from the root so that only reachable leaves are packed
+    u32 packet_index = 0;
+    u32 stack[BVH_STACK_SIZE];
+    u32 stack_size      = 0;
+    stack[stack_size++] = 0;
+    while (stack_size)
+    {
+        const u32      node_index = stack[--stack_size];
+        const BVHNode* node       = &bvh->nodes[node_index];
+        if (node->left_count)
+        {
+            __UE_ASSERT__((stack_size + 2) <= (sizeof(stack) / sizeof(stack[0])));
+            stack[stack_size++] = node_index + (2 * node->left_count);
+            stack[stack_size++] = node_index + 1;
+            continue;
+        }
+
+        __UE_ASSERT__(node->index_count <= MESH_PACKET_WIDTH);
+        __UE_ASSERT__(packet_index < leaf_count);
+
+        TrianglePacket* packet        = &mesh->packets[packet_index];
+        mesh->leaf_packet[node_index] = packet_index++;
+        for (u32 lane = 0; lane < MESH_PACKET_WIDTH; lane++)
+        {
+            if (lane >= node->index_count)
+            {
+                packet->triangle_index[lane] = TRIANGLE_INDEX_NONE;
+                continue;
+            }
+
+            const u32 triangle_index = bvh->indices[node->first_index + lane];
+
+            v3 vertices[3];
+            v3 edge1 = { 0 };
+            v3 edge2 = { 0 };
+            GetTriangleVertices(mesh, triangle_index, vertices);
+            v3Sub(&vertices[1], &vertices[0], &edge1);
+            v3Sub(&vertices[2], &vertices[0], &edge2);
+
+            packet->v0_x[lane]           = vertices[0].x;
+            packet->v0_y[lane]           = vertices[0].y;
+            packet->v0_z[lane]           = vertices[0].z;
+            packet->edge1_x[lane]        = edge1.x;
+            packet->edge1_y[lane]        = edge1.y;
+            packet->edge1_z[lane]        = edge1.z;
+            packet->edge2_x[lane]        = edge2.x;
+            packet->edge2_y[lane]        = edge2.y;
+            packet->edge2_z[lane]        = edge2.z;
+            packet->triangle_index[lane] = triangle_index;
+        }
+    }
+}
+
+// Copies the vertex and index data.
+static TriangleMesh*
+CreateTriangleMesh(const v3* restrict const  vertices,
+                   const size_t              vertex_count,
+                   const u32* restrict const indices,
+                   const size_t              triangle_count,
+                   ThreadPool* const         pool)
+{
+    __UE_ASSERT__(vertices && vertex_count);
+    __UE_ASSERT__(indices && triangle_count);
+
+    TriangleMesh* mesh = ( TriangleMesh* )calloc(1, sizeof(TriangleMesh));
+    __UE_ASSERT__(mesh);
+
+    mesh->vertex_count   = vertex_count;
+    mesh->triangle_count = triangle_count;
+    mesh->vertices       = ( v3* )malloc(vertex_count * sizeof(v3));
+    mesh->indices        = ( u32* )malloc(3 * triangle_count * sizeof(u32));
+    __UE_ASSERT__(mesh->vertices && mesh->indices);
+
+    memcpy(mesh->vertices, vertices, vertex_count * sizeof(v3));
+    memcpy(mesh->indices, indices, 3 * triangle_count * sizeof(u32));
+    for (size_t index = 0; index < (3 * triangle_count); index++)
+    {
+        __UE_ASSERT__(indices[index] < vertex_count);
+    }
+
+    mesh->bvh         = CreateBVH(triangle_count, MESH_PACKET_WIDTH);
+    mesh->leaf_packet = ( u32* )calloc(mesh->bvh->node_capacity, sizeof(u32));
+    __UE_ASSERT__(mesh->leaf_packet);
+
+    BuildBVH(mesh->bvh, GetTriangleBounds, mesh, pool);
+    PackTriangleMeshLeaves(mesh);
+
+    return mesh;
+}
+
+static void
+DestroyTriangleMesh(_mut_ TriangleMesh* restrict const mesh)
+{
+    if (!mesh)
+    {
+        return;
+    }
+
+    DestroyBVH(mesh->bvh);
+    free(mesh->vertices);
+    free(mesh->indices);
+    free(mesh->packets);
+    free(mesh->leaf_packet);
+    free(mesh);
+}
+
+// Call after editing vertex positions; topology must not change.
+static BVHUpdateStats
+UpdateTriangleMesh(_mut_ TriangleMesh* restrict const mesh, ThreadPool* const pool)
+{
+    __UE_ASSERT__(mesh);
+
+    const BVHUpdateStats stats = UpdateBVH(mesh->bvh, GetTriangleBounds, mesh, pool);
+    PackTriangleMeshLeaves(mesh);
+
+    return stats;
+}
+
+//
+// Packet intersection
+//
+// Returns the lane of the closest hit in [ 0, *magnitude ), or -1. On a hit,
+// *magnitude is updated.
+//
+#if __UE_SIMD__sse
+__UE_inline__ static s32
+IntersectTrianglePacket(const TrianglePacket* restrict const packet, const Ray* restrict const ray, _mut_ r32* restrict const magnitude)
+{
+    __UE_STAT__(primitive_tests, MESH_PACKET_WIDTH);
+
+    const __m128 direction_x = _mm_set1_ps(ray->direction.x);
+    const __m128 direction_y = _mm_set1_ps(ray->direction.y);
+    const __m128 direction_z = _mm_set1_ps(ray->direction.z);
+    const __m128 edge1_x     = _mm_loadu_ps(packet->edge1_x);
+    const __m128 edge1_y     = _mm_loadu_ps(packet->edge1_y);
+    const __m128 edge1_z     = _mm_loadu_ps(packet->edge1_z);
+    const __m128 edge2_x     = _mm_loadu_ps(packet->edge2_x);
+    const __m128 edge2_y     = _mm_loadu_ps(packet->edge2_y);
+    const __m128 edge2_z     = _mm_loadu_ps(packet->edge2_z);
+
+    // p = d x e2
+    const __m128 p_x = _mm_sub_ps(_mm_mul_ps(direction_y, edge2_z), _mm_mul_ps(direction_z, edge2_y));
+    const __m128 p_y = _mm_sub_ps(_mm_mul_ps(direction_z, edge2_x), _mm_mul_ps(direction_x, edge2_z));
+    const __m128 p_z = _mm_sub_ps(_mm_mul_ps(direction_x, edge2_y), _mm_mul_ps(direction_y, edge2_x));
+
+    const __m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(edge1_x, p_x), _mm_mul_ps(edge1_y, p_y)), _mm_mul_ps(edge1_z, p_z));
+    const __m128 abs_mask    = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    __m128       valid       = _mm_cmpgt_ps(_mm_and_ps(determinant, abs_mask), _mm_set1_ps(( r32 )_TOLERANCE_ * ( r32 )_TOLERANCE_));
+
+    // Degenerate lanes divide by zero; they are masked out by 'valid'
+    const __m128 inverse_determinant = _mm_div_ps(_mm_set1_ps(1.0f), determinant);
+
+    // t = o - v0
+    const __m128 t_x = _mm_sub_ps(_mm_set1_ps(ray->origin.x), _mm_loadu_ps(packet->v0_x));
+    const __m128 t_y = _mm_sub_ps(_mm_set1_ps(ray->origin.y), _mm_loadu_ps(packet->v0_y));
+    const __m128 t_z = _mm_sub_ps(_mm_set1_ps(ray->origin.z), _mm_loadu_ps(packet->v0_z));
+
+    const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(t_x, p_x), _mm_mul_ps(t_y, p_y)), _mm_mul_ps(t_z, p_z)), inverse_determinant);
+
+    // q = t x e1
+    const __m128 q_x = _mm_sub_ps(_mm_mul_ps(t_y, edge1_z), _mm_mul_ps(t_z, edge1_y));
+    const __m128 q_y = _mm_sub_ps(_mm_mul_ps(t_z, edge1_x), _mm_mul_ps(t_x, edge1_z));
+    const __m128 q_z = _mm_sub_ps(_mm_mul_ps(t_x, edge1_y), _mm_mul_ps(t_y, edge1_x));
+
+    const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(direction_x, q_x), _mm_mul_ps(direction_y, q_y)), _mm_mul_ps(direction_z, q_z)), inverse_determinant);
+    const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(edge2_x, q_x), _mm_mul_ps(edge2_y, q_y)), _mm_mul_ps(edge2_z, q_z)), inverse_determinant);
+
+    const __m128 zero = _mm_setzero_ps();
+    valid             = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+    valid             = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+    valid             = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+    valid             = _mm_and_ps(valid, _mm_cmpge_ps(t, zero));
+    valid             = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(*magnitude)));
+
+    const int valid_lanes = _mm_movemask_ps(valid);
+    if (!valid_lanes)
+    {
+        return -1;
+    }
+
+    r32 lane_t[MESH_PACKET_WIDTH];
+    _mm_storeu_ps(lane_t, t);
+
+    s32 closest_lane = -1;
+    for (s32 lane = 0; lane < MESH_PACKET_WIDTH; lane++)
+    {
+        if ((valid_lanes & (1 << lane)) && lane_t[lane] < *magnitude)
+        {
+            *magnitude   = lane_t[lane];
+            closest_lane = lane;
+        }
+    }
+
+    return closest_lane;
+}
+#else  // __UE_SIMD__sse
+__UE_inline__ static s32
+IntersectTrianglePacket(const TrianglePacket* restrict const packet, const Ray* restrict const ray, _mut_ r32* restrict const magnitude)
+{
+    __UE_STAT__(primitive_tests, MESH_PACKET_WIDTH);
+
+    s32 closest_lane = -1;
+    for (s32 lane = 0; lane < MESH_PACKET_WIDTH; lane++)
+    {
+        v3 edge1 = { 0 };
+        v3 edge2 = { 0 };
+        v3 p     = { 0 };
+        v3Set(&edge1, packet->edge1_x[lane], packet->edge1_y[lane], packet->edge1_z[lane]);
+        v3Set(&edge2, packet->edge2_x[lane], packet->edge2_y[lane], packet->edge2_z[lane]);
+        v3Cross(&ray->direction, &edge2, &p);
+
+        const r32 determinant = v3Dot(&edge1, &p);
+        if (fabs(determinant) <= (_TOLERANCE_ * _TOLERANCE_))
+        {
+            continue;
+        }
+
+        const r32 inverse_determinant = 1.0f / determinant;
+
+        v3 t = { 0 };
+        v3 q = { 0 };
+        v3Set(&t, ray->origin.x - packet->v0_x[lane], ray->origin.y - packet->v0_y[lane], ray->origin.z - packet->v0_z[lane]);
+        v3Cross(&t, &edge1, &q);
+
+        const r32 u = v3Dot(&t, &p) * inverse_determinant;
+        const r32 v = v3Dot(&ray->direction, &q) * inverse_determinant;
+        const r32 d = v3Dot(&edge2, &q) * inverse_determinant;
+        if (u >= 0.0f && v >= 0.0f && (u + v) <= 1.0f && d >= 0.0f && d < *magnitude)
+        {
+            *magnitude   = d;
+            closest_lane = lane;
+        }
+    }
+
+    return closest_lane;
+}
+#endif // __UE_SIMD__sse
+
+// Closest hit on a mesh, in mesh space, within [ 0, max_magnitude ).
+// Returns false, leaving 'closest_intersection' and 'closest_triangle_index'
+// untouched, if nothing is hit.
+static bool
+IntersectTriangleMesh(const Ray* restrict const ray,
+                      const TriangleMesh* restrict const    mesh,
+                      const r32                             max_magnitude,
+                      _mut_ RayIntersection* restrict const closest_intersection,
+                      _mut_ u32* restrict const             closest_triangle_index)
+{
+    __UE_ASSERT__(ray && mesh);
+    __UE_ASSERT__(closest_intersection && closest_triangle_index);
+
+    const BVH* bvh = mesh->bvh;
+
+    v3 inverse_direction = { 0 };
+    GetInverseDirection(&ray->direction, &inverse_direction);
+
+    r32 closest_magnitude = max_magnitude;
+    u32 triangle_index    = TRIANGLE_INDEX_NONE;
+
+    u32 stack[BVH_STACK_SIZE];
+    r32 stack_near[BVH_STACK_SIZE];
+    u32 stack_size = 0;
+
+    const r32 root_near = IntersectAABB(&ray->origin, &inverse_direction, &bvh->nodes[0].min, &bvh->nodes[0].max, closest_magnitude);
+    if (root_near != FLT_MAX)
+    {
+        stack[stack_size]      = 0;
+        stack_near[stack_size] = root_near;
+        stack_size++;
+    }
+
+    while (stack_size)
+    {
+        stack_size--;
+        if (stack_near[stack_size] >= closest_magnitude)
+        {
+            continue;
+        }
+
+        const u32      node_index = stack[stack_size];
+        const BVHNode* node       = &bvh->nodes[node_index];
+        if (!node->left_count)
+        {
+            const TrianglePacket* packet = &mesh->packets[mesh->leaf_packet[node_index]];
+
+            const s32 lane = IntersectTrianglePacket(packet, ray, &closest_magnitude);
+            if (lane >= 0)
+            {
+                triangle_index = packet->triangle_index[lane];
+            }
+
+            continue;
+        }
+
+        u32 near_index = node_index + 1;
+        u32 far_index  = node_index + (2 * node->left_count);
+        r32 near_entry = IntersectAABB(&ray->origin, &inverse_direction, &bvh->nodes[near_index].min, &bvh->nodes[near_index].max, closest_magnitude);
+        r32 far_entry  = IntersectAABB(&ray->origin, &inverse_direction, &bvh->nodes[far_index].min, &bvh->nodes[far_index].max, closest_magnitude);
+        if (far_entry < near_entry)
+        {
+            const u32 swap_index = near_index;
+            const r32 swap_entry = near_entry;
+            near_index           = far_index;
+            near_entry           = far_entry;
+            far_index            = swap_index;
+            far_entry            = swap_entry;
+        }
+
+        __UE_ASSERT__((stack_size + 2) <= (sizeof(stack) / sizeof(stack[0])));
+        if (far_entry != FLT_MAX)
+        {
+            stack[stack_size]      = far_index;
+            stack_near[stack_size] = far_entry;
+            stack_size++;
+        }
+        if (near_entry != FLT_MAX)
+        {
+            stack[stack_size]      = near_index;
+            stack_near[stack_size] = near_entry;
+            stack_size++;
+        }
+    }
+
+    if (triangle_index == TRIANGLE_INDEX_NONE)
+    {
+        return false;
+    }
+
+    v3 vertices[3];
+    v3 edge1 = { 0 };
+    v3 edge2 = { 0 };
+    GetTriangleVertices(mesh, triangle_index, vertices);
+    v3Sub(&vertices[1], &vertices[0], &edge1);
+    v3Sub(&vertices[2], &vertices[0], &edge2);
+
+    closest_intersection->does_intersect = true;
+    closest_intersection->magnitude      = closest_magnitude;
+    v3Set(&closest_intersection->position,
+          ray->origin.x + (closest_magnitude * ray->direction.x),
+          ray->origin.y + (closest_magnitude * ray->direction.y),
+          ray->origin.z + (closest_magnitude * ray->direction.z));
+
+    // Face away from the ray origin
+    v3Cross(&edge1, &edge2, &closest_intersection->normal_vector);
+    v3Norm(&closest_intersection->normal_vector);
+    if (v3Dot(&closest_intersection->normal_vector, &ray->direction) < 0.0f)
+    {
+        v3 flipped_normal = { 0 };
+        v3ScalarMul(&closest_intersection->normal_vector, -1.0f, &flipped_normal);
+        closest_intersection->normal_vector = flipped_normal;
+    }
+
+    *closest_triangle_index = triangle_index;
+    return true;
+}
+
+// IntersectTriangleMesh() for an ET_TRIANGLE_MESH entity; the ray and the
+// reported position are in world space.
+__UE_inline__ static bool
+IntersectMeshEntity(const Ray* restrict const ray,
+                    const Entity* restrict const          entity,
+                    const TriangleMesh* restrict const    mesh,
+                    const r32                             max_magnitude,
+                    _mut_ RayIntersection* restrict const intersection)
+{
+    __UE_ASSERT__(ray && entity && mesh && intersection);
+    __UE_ASSERT__(entity->type == ET_TRIANGLE_MESH);
+
+    Ray mesh_ray       = *ray;
+    u32 triangle_index = TRIANGLE_INDEX_NONE;
+    v3Sub(&ray->origin, &entity->position, &mesh_ray.origin);
+    if (!IntersectTriangleMesh(&mesh_ray, mesh, max_magnitude, intersection, &triangle_index))
+    {
+        return false;
+    }
+
+    v3 world_position = { 0 };
+    v3Add(&intersection->position, &entity->position, &world_position);
+    intersection->position = world_position;
+
+    return true;
+}
+
+// Closest-hit query over an entity array that may contain ET_TRIANGLE_MESH
+// entities; the mesh counterpart of TraceEntityArray(). Mesh entities index
+// into mesh_arr and are translated by their position.
+// Note: secondary rays are not spawned (see: ReflectRays()).
+static void
+TraceMeshEntityArray(const Ray* restrict const ray,
+                     _mut_ RayIntersection* restrict const intersection,
+                     _mut_ r32* restrict const global_magnitude_threshold,
+                     _mut_ Color32_RGB* restrict const return_color,
+                     const Entity* restrict const      entity_arr,
+                     const size_t                      num_entitys,
+                     const TriangleMesh* const* const  mesh_arr,
+                     const size_t                      mesh_count)
+{
+    __UE_ASSERT__(ray);
+    __UE_ASSERT__(intersection);
+    __UE_ASSERT__(global_magnitude_threshold);
+    __UE_ASSERT__(return_color);
+    __UE_ASSERT__(entity_arr);
+    __UE_ASSERT__(mesh_arr || !mesh_count);
+    __UE_STAT__(rays, 1);
+
+    RayIntersection closest_intersection = { 0 };
+    r32             closest_magnitude    = ( r32 )fmin(MAX_RAY_MAG, fabs(*global_magnitude_threshold));
+    u32             closest_entity_index = ENTITY_INDEX_NONE;
+
+    for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
+    {
+        const Entity*   entity    = &entity_arr[entity_index];
+        RayIntersection candidate = { 0 };
+        if (entity->type != ET_TRIANGLE_MESH)
+        {
+            IntersectEntity(ray, entity, &candidate);
+            if (!candidate.does_intersect || candidate.magnitude < 0.0f || candidate.magnitude >= closest_magnitude)
+            {
+                continue;
+            }
+        }
+        else
+        {
+            __UE_ASSERT__(entity->mesh_index < mesh_count);
+            if (!IntersectMeshEntity(ray, entity, mesh_arr[entity->mesh_index], closest_magnitude, &candidate))
+            {
+                continue;
+            }
+        }
+
+        closest_intersection = candidate;
+        closest_magnitude    = candidate.magnitude;
+        closest_entity_index = ( u32 )entity_index;
+    }
+
+    *intersection                = closest_intersection;
+    intersection->does_intersect = (closest_entity_index != ENTITY_INDEX_NONE);
+    intersection->entity_index   = closest_entity_index;
+    if (intersection->does_intersect)
+    {
+        return_color->value = entity_arr[closest_entity_index].material.color.value;
+    }
+}
+
+//
+// Occlusion
+//
+// Any-hit counterparts of IntersectTriangleMesh(), IntersectMeshEntity() and
+// TraceMeshEntityArray(); see: IsRayOccludedByEntity().
+//
+static bool
+OccludedTriangleMesh(const Ray* restrict const ray, const r32 max_magnitude, const TriangleMesh* restrict const mesh)
+{
+    __UE_ASSERT__(ray && mesh);
+
+    const BVH* bvh = mesh->bvh;
+
+    v3 inverse_direction = { 0 };
+    GetInverseDirection(&ray->direction, &inverse_direction);
+
+    u32 stack[BVH_STACK_SIZE];
+    u32 stack_size      = 0;
+    stack[stack_size++] = 0;
+    while (stack_size)
+    {
+        const u32      node_index = stack[--stack_size];
+        const BVHNode* node       = &bvh->nodes[node_index];
+        if (IntersectAABB(&ray->origin, &inverse_direction, &node->min, &node->max, max_magnitude) == FLT_MAX)
+        {
+            continue;
+        }
+
+        if (!node->left_count)
+        {
+            r32 magnitude = max_magnitude;
+            if (IntersectTrianglePacket(&mesh->packets[mesh->leaf_packet[node_index]], ray, &magnitude) >= 0)
+            {
+                return true;
+            }
+
+            continue;
+        }
+
+        __UE_ASSERT__((stack_size + 2) <= (sizeof(stack) / sizeof(stack[0])));
+        stack[stack_size++] = node_index + (2 * node->left_count);
+        stack[stack_size++] = node_index + 1;
+    }
+
+    return false;
+}
+
+__UE_inline__ static bool
+OccludedMeshEntity(const Ray* restrict const ray, const r32 max_magnitude, const Entity* restrict const entity, const TriangleMesh* restrict const mesh)
+{
+    __UE_ASSERT__(ray && entity && mesh);
+    __UE_ASSERT__(entity->type == ET_TRIANGLE_MESH);
+
+    Ray mesh_ray = *ray;
+    v3Sub(&ray->origin, &entity->position, &mesh_ray.origin);
+    return OccludedTriangleMesh(&mesh_ray, max_magnitude, mesh);
+}
+
+static bool
+OccludedMeshEntityArray(const Ray* restrict const ray,
+                        const r32                        max_magnitude,
+                        const Entity* restrict const     entity_arr,
+                        const size_t                     num_entitys,
+                        const TriangleMesh* const* const mesh_arr,
+                        const size_t                     mesh_count)
+{
+    __UE_ASSERT__(ray && entity_arr);
+    __UE_ASSERT__(mesh_arr || !mesh_count);
+    __UE_STAT__(rays, 1);
+
+    for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
+    {
+        const Entity* entity = &entity_arr[entity_index];
+        if (entity->type != ET_TRIANGLE_MESH)
+        {
+            if (IsRayOccludedByEntity(ray, entity, max_magnitude))
+            {
+                return true;
+            }
+
+            continue;
+        }
+
+        __UE_ASSERT__(entity->mesh_index < mesh_count);
+        if (OccludedMeshEntity(ray, max_magnitude, entity, mesh_arr[entity->mesh_index]))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif // __UE_MESH_TOOLS_H___
@@ -0,0 +1,239 @@
+#ifndef __UE_RAY_SORT_TOOLS_H___
+#define __UE_RAY_SORT_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <bvh_tools.h>
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <type_tools.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Ray reordering
+//
+// Secondary rays leave their surfaces in scattered directions; traced in the
+// order they were generated, neighbouring rays touch unrelated BVH nodes.
+// A RayBatch collects one bounce worth of rays and reorders them by a 30-bit
+// key before tracing:
+//
+//   [ 29 .. 27 ] direction octant (sign bits of x, y, z)
+//   [ 26 ..  0 ] Morton code of the origin, 9 bits per axis, quantized
+//                within the caller's origin bounds
+//
+// Rays with the same octant and nearby origins then run down the BVH one
+// after another and mostly hit the same cache lines. The keys are sorted
+// with an LSD radix sort over 8-bit digits; digits shared by every key (ie:
+// one octant, or a small origin spread) are skipped.
+//
+// Results are reported in push order regardless of the trace order.
+//
+// Note: library only; no renderer reorders its rays yet, and the one user is
+//       runRaySortBenchmark(). The tracers in this tree bounce depth-first
+//       (ReflectRays(), kernel_tools.h) and the kernels scan the frame's
+//       Scene linearly, so there is no bounce wavefront over a BVH to
+//       reorder. A wavefront BVH tracer would push each bounce here, sort,
+//       then trace with TraceRayBatchBVH().
+//
+
+#define RAY_SORT_MORTON_BITS  9
+#define RAY_SORT_OCTANT_SHIFT (3 * RAY_SORT_MORTON_BITS)
+#define RAY_SORT_KEY_BITS     (RAY_SORT_OCTANT_SHIFT + 3)
+#define RAY_SORT_DIGIT_BITS   8
+#define RAY_SORT_DIGIT_COUNT  (1 << RAY_SORT_DIGIT_BITS)
+
+typedef struct
+{
+    Ray* ray_arr;
+    u32* key_arr;
+    u32* order_arr; // ray_arr indices in trace order
+
+    // Radix sort scratch
+    u32* scratch_key_arr;
+    u32* scratch_order_arr;
+
+    size_t ray_count;
+    size_t ray_capacity;
+} RayBatch;
+
+static RayBatch*
+CreateRayBatch(const size_t ray_capacity)
+{
+    __UE_ASSERT__(ray_capacity);
+
+    RayBatch* batch = ( RayBatch* )calloc(1, sizeof(RayBatch));
+    __UE_ASSERT__(batch);
+
+    batch->ray_capacity      = ray_capacity;
+    batch->ray_arr           = ( Ray* )calloc(ray_capacity, sizeof(Ray));
+    batch->key_arr           = ( u32* )calloc(ray_capacity, sizeof(u32));
+    batch->order_arr         = ( u32* )calloc(ray_capacity, sizeof(u32));
+    batch->scratch_key_arr   = ( u32* )calloc(ray_capacity, sizeof(u32));
+    batch->scratch_order_arr = ( u32* )calloc(ray_capacity, sizeof(u32));
+    __UE_ASSERT__(batch->ray_arr && batch->key_arr && batch->order_arr);
+    __UE_ASSERT__(batch->scratch_key_arr && batch->scratch_order_arr);
+
+    return batch;
+}
+
+static void
+DestroyRayBatch(_mut_ RayBatch* restrict const batch)
+{
+    if (!batch)
+    {
+        return;
+    }
+
+    free(batch->ray_arr);
+    free(batch->key_arr);
+    free(batch->order_arr);
+    free(batch->scratch_key_arr);
+    free(batch->scratch_order_arr);
+    free(batch);
+}
+
+__UE_inline__ static void
+ResetRayBatch(_mut_ RayBatch* restrict const batch)
+{
+    __UE_ASSERT__(batch);
+    batch->ray_count = 0;
+}
+
+// Returns false, recording nothing, if the batch is full.
+__UE_inline__ static bool
+PushRay(_mut_ RayBatch* restrict const batch, const Ray* restrict const ray)
+{
+    __UE_ASSERT__(batch && ray);
+
+    if (batch->ray_count == batch->ray_capacity)
+    {
+        return false;
+    }
+
+    batch->order_arr[batch->ray_count] = ( u32 )batch->ray_count;
+    batch->ray_arr[batch->ray_count++] = *ray;
+    return true;
+}
+
+// Spreads the low 9 bits of 'value' so that bit n lands on bit 3n.
+__UE_inline__ static u32
+SpreadMortonBits(u32 value)
+{
+    value &= 0x1FF;
+    value = (value | (value << 16)) & 0x030000FF;
+    value = (value | (value << 8)) & 0x0300F00F;
+    value = (value | (value << 4)) & 0x030C30C3;
+    value = (value | (value << 2)) & 0x09249249;
+    return value;
+}
+
+__UE_inline__ static u32
+GetRaySortKey(const Ray* restrict const ray, const AABB* restrict const origin_bounds, const v3* restrict const origin_scale)
+{
+    const u32 octant = (ray->direction.x < 0.0f ? 1 : 0) | (ray->direction.y < 0.0f ? 2 : 0) | (ray->direction.z < 0.0f ? 4 : 0);
+
+    u32 cell[3] = { 0 };
+    for (u8 axis = 0; axis < 3; axis++)
+    {
+        const r32 scaled = (ray->origin.arr[axis] - origin_bounds->min.arr[axis]) * origin_scale->arr[axis];
+        cell[axis]       = (scaled <= 0.0f) ? 0 : (scaled >= ( r32 )(1 << RAY_SORT_MORTON_BITS) - 1.0f) ? (1 << RAY_SORT_MORTON_BITS) - 1 : ( u32 )scaled;
+    }
+
+    return (octant << RAY_SORT_OCTANT_SHIFT) | SpreadMortonBits(cell[0]) | (SpreadMortonBits(cell[1]) << 1) | (SpreadMortonBits(cell[2]) << 2);
+}
+
+// Fills order_arr with the trace order. 'origin_bounds' should contain the
+// batch's ray origins (ie: the scene bounds); origins outside it are clamped.
+static void
+SortRayBatch(_mut_ RayBatch* restrict const batch, const AABB* restrict const origin_bounds)
+{
+    __UE_ASSERT__(batch && origin_bounds);
+
+    v3 origin_scale = { 0 };
+    for (u8 axis = 0; axis < 3; axis++)
+    {
+        const r32 extent       = origin_bounds->max.arr[axis] - origin_bounds->min.arr[axis];
+        origin_scale.arr[axis] = (extent > 0.0f) ? (( r32 )(1 << RAY_SORT_MORTON_BITS) / extent) : 0.0f;
+    }
+
+    for (size_t ray_index = 0; ray_index < batch->ray_count; ray_index++)
+    {
+        batch->key_arr[ray_index]   = GetRaySortKey(&batch->ray_arr[ray_index], origin_bounds, &origin_scale);
+        batch->order_arr[ray_index] = ( u32 )ray_index;
+    }
+
+    u32* key_arr           = batch->key_arr;
+    u32* order_arr         = batch->order_arr;
+    u32* scratch_key_arr   = batch->scratch_key_arr;
+    u32* scratch_order_arr = batch->scratch_order_arr;
+    for (u32 shift = 0; shift < RAY_SORT_KEY_BITS; shift += RAY_SORT_DIGIT_BITS)
+    {
+        size_t digit_offset[RAY_SORT_DIGIT_COUNT] = { 0 };
+        for (size_t ray_index = 0; ray_index < batch->ray_count; ray_index++)
+        {
+            digit_offset[(key_arr[ray_index] >> shift) & (RAY_SORT_DIGIT_COUNT - 1)]++;
+        }
+
+        // Every key shares this digit; the pass would not move anything
+        if (batch->ray_count && digit_offset[(key_arr[0] >> shift) & (RAY_SORT_DIGIT_COUNT - 1)] == batch->ray_count)
+        {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (size_t digit = 0; digit < RAY_SORT_DIGIT_COUNT; digit++)
+        {
+            const size_t digit_count = digit_offset[digit];
+            digit_offset[digit]      = offset;
+            offset += digit_count;
+        }
+
+        for (size_t ray_index = 0; ray_index < batch->ray_count; ray_index++)
+        {
+            const size_t destination       = digit_offset[(key_arr[ray_index] >> shift) & (RAY_SORT_DIGIT_COUNT - 1)]++;
+            scratch_key_arr[destination]   = key_arr[ray_index];
+            scratch_order_arr[destination] = order_arr[ray_index];
+        }
+
+        u32* swap         = key_arr;
+        key_arr           = scratch_key_arr;
+        scratch_key_arr   = swap;
+        swap              = order_arr;
+        order_arr         = scratch_order_arr;
+        scratch_order_arr = swap;
+    }
+
+    // Results of an odd number of passes live in the scratch arrays
+    if (order_arr != batch->order_arr)
+    {
+        memcpy(batch->key_arr, key_arr, batch->ray_count * sizeof(u32));
+        memcpy(batch->order_arr, order_arr, batch->ray_count * sizeof(u32));
+    }
+}
+
+// Closest hit for every ray in the batch, traced in order_arr order;
+// intersection_arr[n] is the result for the n'th pushed ray.
+static void
+TraceRayBatchBVH(const RayBatch* restrict const batch,
+                 const BVH* restrict const      bvh,
+                 const Entity* restrict const   entity_arr,
+                 const r32                      max_magnitude,
+                 _mut_ RayIntersection* restrict const intersection_arr)
+{
+    __UE_ASSERT__(batch && bvh && entity_arr && intersection_arr);
+
+    for (size_t order_index = 0; order_index < batch->ray_count; order_index++)
+    {
+        const u32        ray_index    = batch->order_arr[order_index];
+        RayIntersection* intersection = &intersection_arr[ray_index];
+        u32              entity_index = ENTITY_INDEX_NONE;
+
+        intersection->does_intersect = IntersectEntityBVH(&batch->ray_arr[ray_index], bvh, entity_arr, max_magnitude, intersection, &entity_index);
+        intersection->entity_index   = entity_index;
+    }
+}
+
+#endif // __UE_RAY_SORT_TOOLS_H___
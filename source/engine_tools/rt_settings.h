@@ -0,0 +1,302 @@
+#ifndef __UE_RT_SETTINGS_H___
+#define __UE_RT_SETTINGS_H___
+
+#include "debug_tools.h"
+#include "macro_tools.h"
+#include "type_tools.h"
+
+//
+// Ray tracer configuration
+//
+// Each setting may be overridden in the compiler invocation, ie:
+// -D__UE_AA__noise=0.5f
+//
+
+//
+// [ begin ] Image
+#ifndef IMAGE_WIDTH
+#define IMAGE_WIDTH 800
+#endif // IMAGE_WIDTH
+
+#ifndef IMAGE_HEIGHT
+#define IMAGE_HEIGHT 400
+#endif // IMAGE_HEIGHT
+
+#define ASPECT_RATIO (( r32 )IMAGE_WIDTH / ( r32 )IMAGE_HEIGHT)
+#define TOLERANCE    _TOLERANCE_
+// [ end ] Image
+//
+
+//
+// [ begin ] Anti-aliasing
+#ifndef __UE_AA__noise
+#define __UE_AA__noise 1.0f
+#endif // __UE_AA__noise
+
+#ifndef __UE_AA__reflections
+#define __UE_AA__reflections 0
+#endif // __UE_AA__reflections
+
+#ifndef __UE_AA__reflection_noise
+#define __UE_AA__reflection_noise 0.05f
+#endif // __UE_AA__reflection_noise
+
+// Adaptive anti-aliasing, see: antialiasing_tools.h
+#ifndef __UE_AA__contrast_threshold
+#define __UE_AA__contrast_threshold 0.1f
+#endif // __UE_AA__contrast_threshold
+
+#ifndef __UE_AA__subsamples_per_axis
+#define __UE_AA__subsamples_per_axis 4
+#endif // __UE_AA__subsamples_per_axis
+
+#ifndef __UE_AA__max_refinement_samples
+#define __UE_AA__max_refinement_samples 0
+#endif // __UE_AA__max_refinement_samples
+// [ end ] Anti-aliasing
+//
+
+//
+// [ begin ] Progressive rendering
+// Note: a pixel stops receiving samples once the relative standard error of
+//       its luminance mean falls below the convergence threshold, or once it
+//       has been sampled max_samples times.
+#ifndef __UE_PR__tile_size
+#define __UE_PR__tile_size 16
+#endif // __UE_PR__tile_size
+
+#ifndef __UE_PR__min_samples
+#define __UE_PR__min_samples 8
+#endif // __UE_PR__min_samples
+
+#ifndef __UE_PR__max_samples
+#define __UE_PR__max_samples 1024
+#endif // __UE_PR__max_samples
+
+#ifndef __UE_PR__convergence_threshold
+#define __UE_PR__convergence_threshold 0.01f
+#endif // __UE_PR__convergence_threshold
+// [ end ] Progressive rendering
+//
+
+//
+// [ begin ] Checkpoints
+// Note: a snapshot of the accumulation buffer is taken at most once per
+//       interval, at a pass boundary; writing it to disk never blocks the
+//       render (see: checkpoint_tools.h).
+#ifndef __UE_CK__interval_seconds
+#define __UE_CK__interval_seconds 60
+#endif // __UE_CK__interval_seconds
+// [ end ] Checkpoints
+//
+
+//
+// [ begin ] Frame scheduling
+// Note: tiles are refreshed in priority order until the frame budget runs out;
+//       see: frame_schedule_tools.h
+#ifndef __UE_FS__budget_ms
+#define __UE_FS__budget_ms 16.0f
+#endif // __UE_FS__budget_ms
+
+#ifndef __UE_FS__tile_size
+#define __UE_FS__tile_size 32
+#endif // __UE_FS__tile_size
+
+#ifndef __UE_FS__change_weight
+#define __UE_FS__change_weight 4.0f
+#endif // __UE_FS__change_weight
+
+#ifndef __UE_FS__age_weight
+#define __UE_FS__age_weight 0.25f
+#endif // __UE_FS__age_weight
+// [ end ] Frame scheduling
+//
+
+//
+// [ begin ] Shading rate
+// Note: radii are fractions of the half diagonal, measured from the focus
+//       point; tiles beyond half_rate_radius trace one ray per 4 x 4 block,
+//       see: shading_rate_tools.h
+#ifndef __UE_SR__tile_size
+#define __UE_SR__tile_size 16
+#endif // __UE_SR__tile_size
+
+#ifndef __UE_SR__full_rate_radius
+#define __UE_SR__full_rate_radius 0.25f
+#endif // __UE_SR__full_rate_radius
+
+#ifndef __UE_SR__half_rate_radius
+#define __UE_SR__half_rate_radius 0.6f
+#endif // __UE_SR__half_rate_radius
+
+#ifndef __UE_SR__contrast_threshold
+#define __UE_SR__contrast_threshold 0.2f
+#endif // __UE_SR__contrast_threshold
+// [ end ] Shading rate
+//
+
+//
+// [ begin ] Temporal reprojection
+// Note: a pixel reused for max_age frames in a row is re-traced; see:
+//       temporal_tools.h
+#ifndef __UE_TR__max_age
+#define __UE_TR__max_age 32
+#endif // __UE_TR__max_age
+// [ end ] Temporal reprojection
+//
+
+//
+// [ begin ] Denoising
+// Note: edge-stopping sigmas of the a-trous filter; see: denoise_tools.h
+#ifndef __UE_DN__iterations
+#define __UE_DN__iterations 5
+#endif // __UE_DN__iterations
+
+#ifndef __UE_DN__sigma_normal
+#define __UE_DN__sigma_normal 128.0f
+#endif // __UE_DN__sigma_normal
+
+#ifndef __UE_DN__sigma_depth
+#define __UE_DN__sigma_depth 0.05f
+#endif // __UE_DN__sigma_depth
+
+#ifndef __UE_DN__sigma_luminance
+#define __UE_DN__sigma_luminance 0.5f
+#endif // __UE_DN__sigma_luminance
+// [ end ] Denoising
+//
+
+//
+// [ begin ] Irradiance cache
+// Note: a record is reused where Ward's error weight exceeds 1 / accuracy;
+//       radii are clamped to [ min_radius, max_radius ] and grid cells are
+//       2 * accuracy * max_radius wide (see: irradiance_tools.h).
+#ifndef __UE_IC__accuracy
+#define __UE_IC__accuracy 0.25f
+#endif // __UE_IC__accuracy
+
+#ifndef __UE_IC__min_radius
+#define __UE_IC__min_radius 0.01f
+#endif // __UE_IC__min_radius
+
+#ifndef __UE_IC__max_radius
+#define __UE_IC__max_radius 0.2f
+#endif // __UE_IC__max_radius
+
+#ifndef __UE_IC__record_rays
+#define __UE_IC__record_rays 16
+#endif // __UE_IC__record_rays
+
+#ifndef __UE_IC__population_stride
+#define __UE_IC__population_stride 4
+#endif // __UE_IC__population_stride
+// [ end ] Irradiance cache
+//
+
+//
+// [ begin ] Tiled framebuffer
+// Note: tiles are (1 << tile_log2) pixels square; 3 gives 8 x 8 tiles of
+//       256 bytes, see: framebuffer_tools.h
+#ifndef __UE_FB__tile_log2
+#define __UE_FB__tile_log2 3
+#endif // __UE_FB__tile_log2
+// [ end ] Tiled framebuffer
+//
+
+//
+// [ begin ] Scene files
+// Note: nodes are written in clusters of at most this many bytes (ie: one
+//       page); see: scene_file_tools.h
+#ifndef __UE_SF__cluster_bytes
+#define __UE_SF__cluster_bytes 4096
+#endif // __UE_SF__cluster_bytes
+// [ end ] Scene files
+//
+
+//
+// [ begin ] Statistics
+// Note: 1 counts rays, box tests, primitive tests and bounces per pixel and
+//       per tile; 0 compiles the counters out. See: stats_tools.h
+#ifndef __UE_STATS__enabled
+#define __UE_STATS__enabled 0
+#endif // __UE_STATS__enabled
+// [ end ] Statistics
+//
+
+//
+// [ begin ] Bounding volume hierarchy
+// Note: a subtree is rebuilt once its SAH cost exceeds its build-time cost by
+//       the rebuild threshold factor; see: bvh_tools.h
+#ifndef __UE_BVH__max_leaf_size
+#define __UE_BVH__max_leaf_size 4
+#endif // __UE_BVH__max_leaf_size
+
+#ifndef __UE_BVH__bin_count
+#define __UE_BVH__bin_count 16
+#endif // __UE_BVH__bin_count
+
+#ifndef __UE_BVH__traversal_cost
+#define __UE_BVH__traversal_cost 1.0f
+#endif // __UE_BVH__traversal_cost
+
+#ifndef __UE_BVH__sah_rebuild_threshold
+#define __UE_BVH__sah_rebuild_threshold 1.3f
+#endif // __UE_BVH__sah_rebuild_threshold
+
+// Subtrees of at most this many primitives are flattened into one leaf of the
+// compressed wide BVH; see: wide_bvh_tools.h
+#ifndef __UE_BVH__wide_leaf_size
+#define __UE_BVH__wide_leaf_size 8
+#endif // __UE_BVH__wide_leaf_size
+// [ end ] Bounding volume hierarchy
+//
+
+//
+// [ begin ] Spatial hash grid
+// Note: cells are at least twice the largest entity extent, and grown until
+//       the scene bounds hold about entities_per_cell entities per cell;
+//       see: hash_grid_tools.h
+#ifndef __UE_GRID__entities_per_cell
+#define __UE_GRID__entities_per_cell 2.0f
+#endif // __UE_GRID__entities_per_cell
+
+#ifndef __UE_GRID__build_chunk_size
+#define __UE_GRID__build_chunk_size 4096
+#endif // __UE_GRID__build_chunk_size
+// [ end ] Spatial hash grid
+//
+
+//
+// [ begin ] SIMD
+// Note: 4-wide SSE kernels are used wherever the target guarantees SSE2;
+//       -D__UE_SIMD__sse=0 forces the scalar fallbacks.
+#ifndef __UE_SIMD__sse
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define __UE_SIMD__sse 1
+#else
+#define __UE_SIMD__sse 0
+#endif // defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#endif // __UE_SIMD__sse
+// [ end ] SIMD
+//
+
+//
+// [ begin ] Passifiers
+#define __UE_ASSERT__(cond) uAssert(cond)
+
+// Marks a pointer parameter as an output/mutable parameter
+#define _mut_
+// [ end ] Passifiers
+//
+
+//
+// [ begin ] Color types
+typedef Color32RGB Color32_RGB;
+typedef Color32HSV Color32_HSV;
+
+// Note: little endian storage; matches 32-bit BGRA bitmap pixel order
+#define channel LSB_channel
+// [ end ] Color types
+//
+
+#endif // __UE_RT_SETTINGS_H___
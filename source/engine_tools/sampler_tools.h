@@ -0,0 +1,341 @@
+#ifndef __UE_SAMPLER_TOOLS_H___
+#define __UE_SAMPLER_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <type_tools.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Low-discrepancy sampling
+//
+// Samples are addressed by (pixel, sample, dimension) and computed on demand
+// from read-only tables, so they may be drawn from any thread without shared
+// state:
+//    1. SampleSobol(): Owen-scrambled, shuffled Sobol sequence. Each pixel
+//       gets a decorrelated scramble. Dimensions 0 and 1 form a (0, 2)
+//       sequence (any power-of-two sample count is stratified); dimensions
+//       past SOBOL_DIMENSIONS are padded with independently scrambled copies.
+//    2. SampleBlueNoise(): tiled 64x64 blue noise mask (void-and-cluster),
+//       rotated per sample by the golden ratio. Blue noise trades convergence
+//       rate for a visually pleasing error distribution at very low sample
+//       counts.
+//
+// The tracer draws dimensions in order through a per-thread sample cursor;
+// see: BeginPixelSample(), NextSample1D().
+//
+
+#define SOBOL_DIMENSIONS 8
+#define SOBOL_BITS       32
+#define BLUE_NOISE_SIZE  64
+
+// Joe & Kuo (2008), new-joe-kuo-6.21201; dimension 0 is van der Corput.
+static const u32 kSobolDirections[SOBOL_DIMENSIONS][SOBOL_BITS] = {
+    { 0x80000000, 0x40000000, 0x20000000, 0x10000000, 0x08000000, 0x04000000, 0x02000000, 0x01000000,
+      0x00800000, 0x00400000, 0x00200000, 0x00100000, 0x00080000, 0x00040000, 0x00020000, 0x00010000,
+      0x00008000, 0x00004000, 0x00002000, 0x00001000, 0x00000800, 0x00000400, 0x00000200, 0x00000100,
+      0x00000080, 0x00000040, 0x00000020, 0x00000010, 0x00000008, 0x00000004, 0x00000002, 0x00000001 },
+    { 0x80000000, 0xC0000000, 0xA0000000, 0xF0000000, 0x88000000, 0xCC000000, 0xAA000000, 0xFF000000,
+      0x80800000, 0xC0C00000, 0xA0A00000, 0xF0F00000, 0x88880000, 0xCCCC0000, 0xAAAA0000, 0xFFFF0000,
+      0x80008000, 0xC000C000, 0xA000A000, 0xF000F000, 0x88008800, 0xCC00CC00, 0xAA00AA00, 0xFF00FF00,
+      0x80808080, 0xC0C0C0C0, 0xA0A0A0A0, 0xF0F0F0F0, 0x88888888, 0xCCCCCCCC, 0xAAAAAAAA, 0xFFFFFFFF },
+    { 0x80000000, 0xC0000000, 0x60000000, 0x90000000, 0xE8000000, 0x5C000000, 0x8E000000, 0xC5000000,
+      0x68800000, 0x9CC00000, 0xEE600000, 0x55900000, 0x80680000, 0xC09C0000, 0x60EE0000, 0x90550000,
+      0xE8808000, 0x5CC0C000, 0x8E606000, 0xC5909000, 0x6868E800, 0x9C9C5C00, 0xEEEE8E00, 0x5555C500,
+      0x8000E880, 0xC0005CC0, 0x60008E60, 0x9000C590, 0xE8006868, 0x5C009C9C, 0x8E00EEEE, 0xC5005555 },
+    { 0x80000000, 0xC0000000, 0x20000000, 0x50000000, 0xF8000000, 0x74000000, 0xA2000000, 0x93000000,
+      0xD8800000, 0x25400000, 0x59E00000, 0xE6D00000, 0x78080000, 0xB40C0000, 0x82020000, 0xC3050000,
+      0x208F8000, 0x51474000, 0xFBEA2000, 0x75D93000, 0xA0858800, 0x914E5400, 0xDBE79E00, 0x25DB6D00,
+      0x58800080, 0xE54000C0, 0x79E00020, 0xB6D00050, 0x800800F8, 0xC00C0074, 0x200200A2, 0x50050093 },
+    { 0x80000000, 0x40000000, 0x20000000, 0xB0000000, 0xF8000000, 0xDC000000, 0x7A000000, 0x9D000000,
+      0x5A800000, 0x2FC00000, 0xA1600000, 0xF0B00000, 0xDA880000, 0x6FC40000, 0x81620000, 0x40BB0000,
+      0x22878000, 0xB3C9C000, 0xFB65A000, 0xDDB2D000, 0x78022800, 0x9C0B3C00, 0x5A0FB600, 0x2D0DDB00,
+      0xA2878080, 0xF3C9C040, 0xDB65A020, 0x6DB2D0B0, 0x800228F8, 0x400B3CDC, 0x200FB67A, 0xB00DDB9D },
+    { 0x80000000, 0x40000000, 0x60000000, 0x30000000, 0xC8000000, 0x24000000, 0x56000000, 0xFB000000,
+      0xE0800000, 0x70400000, 0xA8600000, 0x14300000, 0x9EC80000, 0xDF240000, 0xB6D60000, 0x8BBB0000,
+      0x48008000, 0x64004000, 0x36006000, 0xCB003000, 0x2880C800, 0x54402400, 0xFE605600, 0xEF30FB00,
+      0x7E48E080, 0xAF647040, 0x1EB6A860, 0x9F8B1430, 0xD6C81EC8, 0xBB249F24, 0x80D6D6D6, 0x40BBBBBB },
+    { 0x80000000, 0xC0000000, 0xA0000000, 0xD0000000, 0x58000000, 0x94000000, 0x3E000000, 0xE3000000,
+      0xBE800000, 0x23C00000, 0x1E200000, 0xF3100000, 0x46780000, 0x67840000, 0x78460000, 0x84670000,
+      0xC6788000, 0xA784C000, 0xD846A000, 0x5467D000, 0x9E78D800, 0x33845400, 0xE6469E00, 0xB7673300,
+      0x20F86680, 0x104477C0, 0xF8668020, 0x4477C010, 0x668020F8, 0x77C01044, 0x8020F866, 0xC0104477 },
+    { 0x80000000, 0x40000000, 0xA0000000, 0x50000000, 0x88000000, 0x24000000, 0x12000000, 0x2D000000,
+      0x76800000, 0x9E400000, 0x08200000, 0x64100000, 0xB2280000, 0x7D140000, 0xFEA20000, 0xBA490000,
+      0x1A248000, 0x491B4000, 0xC4B5A000, 0xE3739000, 0xF6800800, 0xDE400400, 0xA8200A00, 0x34100500,
+      0x3A280880, 0x59140240, 0xECA20120, 0x974902D0, 0x6CA48768, 0xD75B49E4, 0xCC95A082, 0x87639641 }
+};
+
+typedef struct
+{
+    r32 value[BLUE_NOISE_SIZE * BLUE_NOISE_SIZE]; // Ranks, normalized to [ 0, 1 )
+} BlueNoiseMask;
+
+typedef struct
+{
+    u32 pixel_index;
+    u32 sample_index;
+    u32 dimension;
+} SampleContext;
+
+static thread_local SampleContext kSampleContext = { 0, 0, 0 };
+
+__UE_inline__ static u32
+ReverseBits32(u32 x)
+{
+    x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+    x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+    return (x >> 16) | (x << 16);
+}
+
+// lowbias32, Chris Wellons
+__UE_inline__ static u32
+HashU32(u32 x)
+{
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+__UE_inline__ static u32
+HashCombine(const u32 seed, const u32 value)
+{
+    return HashU32(seed ^ (value + 0x9E3779B9u + (seed << 6) + (seed >> 2)));
+}
+
+// Owen scrambling in base 2 (Laine & Karras, 2011; Burley, 2020).
+__UE_inline__ static u32
+NestedUniformScramble(u32 x, const u32 seed)
+{
+    x = ReverseBits32(x);
+    x += seed;
+    x ^= x * 0x6C50B47Cu;
+    x ^= x * 0xB82F1E52u;
+    x ^= x * 0xC7AFE638u;
+    x ^= x * 0x8D22F6E6u;
+    return ReverseBits32(x);
+}
+
+__UE_inline__ static u32
+SobolSample32(u32 index, const u32 dimension)
+{
+    __UE_ASSERT__(dimension < SOBOL_DIMENSIONS);
+
+    u32 result = 0;
+    for (u32 bit = 0; index; index >>= 1, bit++)
+    {
+        if (index & 1)
+        {
+            result ^= kSobolDirections[dimension][bit];
+        }
+    }
+
+    return result;
+}
+
+// Returns a sample in [ 0, 1 ).
+__UE_inline__ static r32
+SampleSobol(const u32 pixel_index, const u32 sample_index, const u32 dimension, const u32 seed)
+{
+    const u32 sobol_dimension = dimension % SOBOL_DIMENSIONS;
+    const u32 pixel_seed      = HashCombine(HashCombine(seed, pixel_index), dimension / SOBOL_DIMENSIONS);
+
+    // Shuffling the index with a seed shared by a padded group keeps the
+    // dimensions of that group correlated as in the unpadded sequence.
+    const u32 shuffled_index = NestedUniformScramble(sample_index, pixel_seed);
+    const u32 sample         = NestedUniformScramble(SobolSample32(shuffled_index, sobol_dimension), HashCombine(pixel_seed, sobol_dimension));
+
+    // Keep 24 bits so that the result is exactly representable and < 1.
+    return ( r32 )(sample >> 8) / 16777216.0f;
+}
+
+// Returns a sample in [ 0, 1 ).
+__UE_inline__ static r32
+SampleBlueNoise(const BlueNoiseMask* restrict const mask, const size_t pix_x, const size_t pix_y, const u32 sample_index, const u32 dimension)
+{
+    __UE_ASSERT__(mask);
+
+    // Decorrelate dimensions with a per-dimension toroidal offset
+    const u32    offset   = HashU32(dimension + 1);
+    const size_t mask_x   = (pix_x + (offset & (BLUE_NOISE_SIZE - 1))) & (BLUE_NOISE_SIZE - 1);
+    const size_t mask_y   = (pix_y + ((offset >> 16) & (BLUE_NOISE_SIZE - 1))) & (BLUE_NOISE_SIZE - 1);
+    const r32    rotated  = mask->value[(mask_y * BLUE_NOISE_SIZE) + mask_x] + (( r32 )sample_index * 0.6180339887f);
+    const r32    fraction = rotated - ( r32 )floor(rotated);
+
+    return fraction < 1.0f ? fraction : 0.0f;
+}
+
+static void
+SplatBlueNoiseEnergy(_mut_ r32* restrict const energy, const r32* restrict const kernel, const size_t pixel_index, const r32 sign)
+{
+    __UE_ASSERT__(energy && kernel);
+
+    const size_t pix_x = pixel_index % BLUE_NOISE_SIZE;
+    const size_t pix_y = pixel_index / BLUE_NOISE_SIZE;
+    for (size_t y = 0; y < BLUE_NOISE_SIZE; y++)
+    {
+        const size_t kernel_row = ((y + BLUE_NOISE_SIZE - pix_y) & (BLUE_NOISE_SIZE - 1)) * BLUE_NOISE_SIZE;
+        for (size_t x = 0; x < BLUE_NOISE_SIZE; x++)
+        {
+            energy[(y * BLUE_NOISE_SIZE) + x] += sign * kernel[kernel_row + ((x + BLUE_NOISE_SIZE - pix_x) & (BLUE_NOISE_SIZE - 1))];
+        }
+    }
+}
+
+// Tightest cluster (is_set == true) or largest void (is_set == false).
+static size_t
+FindBlueNoiseExtremum(const r32* restrict const energy, const bool* restrict const pattern, const bool is_set)
+{
+    __UE_ASSERT__(energy && pattern);
+
+    size_t extremum_index = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+    for (size_t pixel_index = 0; pixel_index < (BLUE_NOISE_SIZE * BLUE_NOISE_SIZE); pixel_index++)
+    {
+        if (pattern[pixel_index] != is_set)
+        {
+            continue;
+        }
+
+        if (extremum_index == (BLUE_NOISE_SIZE * BLUE_NOISE_SIZE) || (is_set && energy[pixel_index] > energy[extremum_index]) ||
+            (!is_set && energy[pixel_index] < energy[extremum_index]))
+        {
+            extremum_index = pixel_index;
+        }
+    }
+
+    __UE_ASSERT__(extremum_index < (BLUE_NOISE_SIZE * BLUE_NOISE_SIZE));
+    return extremum_index;
+}
+
+// Void-and-cluster (Ulichney, 1993). Generation takes tens of milliseconds;
+// create the mask once and share it read-only.
+static BlueNoiseMask*
+CreateBlueNoiseMask(const u32 seed)
+{
+    const size_t pixel_count = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+    const r32    sigma       = 1.5f;
+
+    BlueNoiseMask* mask          = ( BlueNoiseMask* )calloc(1, sizeof(BlueNoiseMask));
+    r32*           kernel        = ( r32* )calloc(pixel_count, sizeof(r32));
+    r32*           energy        = ( r32* )calloc(pixel_count, sizeof(r32));
+    r32*           phase_energy  = ( r32* )calloc(pixel_count, sizeof(r32));
+    bool*          pattern       = ( bool* )calloc(pixel_count, sizeof(bool));
+    bool*          phase_pattern = ( bool* )calloc(pixel_count, sizeof(bool));
+    __UE_ASSERT__(mask && kernel && energy && phase_energy && pattern && phase_pattern);
+
+    // Toroidal gaussian energy kernel
+    for (size_t y = 0; y < BLUE_NOISE_SIZE; y++)
+    {
+        for (size_t x = 0; x < BLUE_NOISE_SIZE; x++)
+        {
+            const r32 dx = ( r32 )(x < (BLUE_NOISE_SIZE / 2) ? x : BLUE_NOISE_SIZE - x);
+            const r32 dy = ( r32 )(y < (BLUE_NOISE_SIZE / 2) ? y : BLUE_NOISE_SIZE - y);
+
+            kernel[(y * BLUE_NOISE_SIZE) + x] = ( r32 )exp(-((dx * dx) + (dy * dy)) / (2.0f * sigma * sigma));
+        }
+    }
+
+    // Initial binary pattern: ~10% minority pixels
+    const size_t minority_count = pixel_count / 10;
+    u32          random_state   = HashU32(seed) | 1;
+    for (size_t placed = 0; placed < minority_count;)
+    {
+        random_state ^= random_state << 13;
+        random_state ^= random_state >> 17;
+        random_state ^= random_state << 5;
+
+        const size_t pixel_index = random_state % pixel_count;
+        if (!pattern[pixel_index])
+        {
+            pattern[pixel_index] = true;
+            SplatBlueNoiseEnergy(energy, kernel, pixel_index, 1.0f);
+            placed++;
+        }
+    }
+
+    // Relax into the prototype pattern
+    while (true)
+    {
+        const size_t cluster_index = FindBlueNoiseExtremum(energy, pattern, true);
+        pattern[cluster_index]     = false;
+        SplatBlueNoiseEnergy(energy, kernel, cluster_index, -1.0f);
+
+        const size_t void_index = FindBlueNoiseExtremum(energy, pattern, false);
+        pattern[void_index]     = true;
+        SplatBlueNoiseEnergy(energy, kernel, void_index, 1.0f);
+
+        if (void_index == cluster_index)
+        {
+            break;
+        }
+    }
+
+    // Phase 1: rank the prototype's minority pixels, tightest cluster last
+    memcpy(phase_pattern, pattern, pixel_count * sizeof(bool));
+    memcpy(phase_energy, energy, pixel_count * sizeof(r32));
+    for (size_t rank = minority_count; rank > 0; rank--)
+    {
+        const size_t cluster_index   = FindBlueNoiseExtremum(phase_energy, phase_pattern, true);
+        phase_pattern[cluster_index] = false;
+        SplatBlueNoiseEnergy(phase_energy, kernel, cluster_index, -1.0f);
+
+        mask->value[cluster_index] = ( r32 )(rank - 1);
+    }
+
+    // Phases 2 and 3: fill the largest void until the pattern is full. Note:
+    // the tightest cluster of zeros (phase 3) is the largest void of ones,
+    // so one loop covers both phases.
+    for (size_t rank = minority_count; rank < pixel_count; rank++)
+    {
+        const size_t void_index = FindBlueNoiseExtremum(energy, pattern, false);
+        pattern[void_index]     = true;
+        SplatBlueNoiseEnergy(energy, kernel, void_index, 1.0f);
+
+        mask->value[void_index] = ( r32 )rank;
+    }
+
+    for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+    {
+        mask->value[pixel_index] = (mask->value[pixel_index] + 0.5f) / ( r32 )pixel_count;
+    }
+
+    free(kernel);
+    free(energy);
+    free(phase_energy);
+    free(pattern);
+    free(phase_pattern);
+
+    return mask;
+}
+
+static void
+DestroyBlueNoiseMask(_mut_ BlueNoiseMask* restrict const mask)
+{
+    free(mask);
+}
+
+// Reset this thread's sample cursor; call before tracing each sample.
+__UE_inline__ static void
+BeginPixelSample(const u32 pixel_index, const u32 sample_index)
+{
+    kSampleContext.pixel_index  = pixel_index;
+    kSampleContext.sample_index = sample_index;
+    kSampleContext.dimension    = 0;
+}
+
+// Draw the next dimension of this thread's current sample, in [ 0, 1 ).
+__UE_inline__ static r32
+NextSample1D()
+{
+    return SampleSobol(kSampleContext.pixel_index, kSampleContext.sample_index, kSampleContext.dimension++, 0);
+}
+
+#endif // __UE_SAMPLER_TOOLS_H___
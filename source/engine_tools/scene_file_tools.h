@@ -0,0 +1,548 @@
+#ifndef __UE_SCENE_FILE_TOOLS_H___
+#define __UE_SCENE_FILE_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <bvh_tools.h>
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <type_tools.h>
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+//
+// Out-of-core scenes
+//
+// A scene file holds a BVH and its entities in the layout the tracer reads
+// them in, so it can be memory mapped instead of loaded. The operating
+// system pages nodes and entities in as rays touch them and drops clean
+// pages under memory pressure; a scene larger than physical memory renders
+// at the speed of its page faults rather than failing to allocate.
+//
+// File layout, sections aligned to __UE_SF__cluster_bytes:
+//
+//   [ SceneFileHeader ]
+//   [ SceneFileNode   ] node_count
+//   [ Entity          ] entity_count, in BVH leaf order
+//
+// Nodes are grouped into clusters: a subtree is laid out breadth first until
+// the cluster is full, and the children of its frontier start new clusters,
+// emitted depth first. A cluster never straddles a page: it takes the rest of
+// the current page, or a fresh page when less than a quarter remains. A ray
+// descending the tree then faults in about one page per log2(nodes per page)
+// levels, and the entities of a leaf, being stored in leaf order, share pages
+// with those of neighbouring leaves.
+//
+// Note: files are written in native byte order and store Entity verbatim;
+//       they are tied to the build that wrote them (see: SceneFileHeader).
+// Note: the writer works from a resident scene and BVH; only rendering is
+//       out-of-core.
+// Note: OpenSceneFile() checks the header only; reading every node would
+//       fault the whole tree in. Traversal bound-checks each node it visits
+//       instead, so a corrupt tree renders wrong but never reads outside the
+//       mapping or loops forever.
+//
+
+#define SCENE_FILE_MAGIC   0x43534555 // "UESC"
+#define SCENE_FILE_VERSION 1
+
+typedef struct
+{
+    u32 magic;
+    u32 version;
+    u32 node_size;   // sizeof(SceneFileNode) of the writer
+    u32 entity_size; // sizeof(Entity) of the writer
+    u64 node_count;
+    u64 node_offset;
+    u64 entity_count;
+    u64 entity_offset;
+    u64 file_size;
+} SceneFileHeader;
+
+// Siblings are stored next to each other: the children of an inner node are
+// nodes offset and offset + 1, and always follow their parent.
+typedef struct
+{
+    v3  min;
+    u32 offset; // Inner: left child node; leaf: first entity
+    v3  max;
+    u32 count;  // Leaf: number of entities; 0 for inner nodes
+} SceneFileNode;
+
+typedef struct
+{
+    const SceneFileHeader* header;
+    const SceneFileNode*   nodes;
+    const Entity*          entity_arr; // Entity indices reported by the tracer index this array
+    size_t                 node_count;
+    size_t                 entity_count;
+
+    const u8* base;
+    size_t    file_size;
+#if _WIN32
+    HANDLE file_handle;
+    HANDLE mapping_handle;
+#else
+    int file_descriptor;
+#endif // _WIN32
+} SceneFile;
+
+//
+// Writing
+//
+typedef struct
+{
+    u32 source_index; // BVH::nodes
+    u32 file_index;   // SceneFileNode slot
+} SceneFileNodeLink;
+
+__UE_inline__ static void
+PushSceneFileNodeLink(_mut_ SceneFileNodeLink* restrict const link_arr, _mut_ size_t* restrict const link_count, const u32 source_index, const u32 file_index)
+{
+    link_arr[*link_count].source_index = source_index;
+    link_arr[*link_count].file_index   = file_index;
+    (*link_count)++;
+}
+
+__UE_inline__ static u64
+AlignSceneFileOffset(const u64 offset)
+{
+    const u64 alignment = __UE_SF__cluster_bytes;
+    return ((offset + alignment - 1) / alignment) * alignment;
+}
+
+static bool
+WriteSceneFilePadding(FILE* const file, u64 byte_count)
+{
+    static const u8 zeros[256] = { 0 };
+    while (byte_count)
+    {
+        const size_t chunk = byte_count < sizeof(zeros) ? ( size_t )byte_count : sizeof(zeros);
+        if (fwrite(zeros, 1, chunk, file) != chunk)
+        {
+            return false;
+        }
+        byte_count -= chunk;
+    }
+
+    return true;
+}
+
+// Lays out the nodes of 'bvh' in clusters; returns the number of slots
+// used, padding included.
+static size_t
+ClusterSceneFileNodes(const BVH* restrict const bvh, _mut_ SceneFileNode* restrict const file_nodes)
+{
+    const size_t page_nodes = __UE_SF__cluster_bytes / sizeof(SceneFileNode);
+    __UE_ASSERT__(page_nodes >= 8);
+
+    // Inner nodes whose children start a new cluster, and the breadth-first
+    // queue of the cluster being filled
+    SceneFileNodeLink* pending = ( SceneFileNodeLink* )calloc(bvh->node_capacity, sizeof(SceneFileNodeLink));
+    SceneFileNodeLink* queue   = ( SceneFileNodeLink* )calloc(page_nodes, sizeof(SceneFileNodeLink));
+    __UE_ASSERT__(pending && queue);
+
+    size_t node_count    = 1;
+    size_t pending_count = 0;
+    size_t queue_begin   = 0;
+    size_t queue_end     = 0;
+    size_t cluster_end   = page_nodes; // First slot past the current cluster
+    PushSceneFileNodeLink(queue, &queue_end, 0, 0);
+    for (;;)
+    {
+        while (queue_begin < queue_end)
+        {
+            const SceneFileNodeLink link   = queue[queue_begin++];
+            const BVHNode*          source = &bvh->nodes[link.source_index];
+            SceneFileNode*          node   = &file_nodes[link.file_index];
+            node->min                      = source->min;
+            node->max                      = source->max;
+            if (!source->left_count)
+            {
+                node->offset = source->first_index;
+                node->count  = source->index_count;
+                continue;
+            }
+
+            node->count = 0;
+            if ((node_count + 2) > cluster_end)
+            {
+                pending[pending_count++] = link;
+                continue;
+            }
+
+            node->offset = ( u32 )node_count;
+            PushSceneFileNodeLink(queue, &queue_end, link.source_index + 1, ( u32 )node_count);
+            PushSceneFileNodeLink(queue, &queue_end, link.source_index + (2 * source->left_count), ( u32 )node_count + 1);
+            node_count += 2;
+        }
+
+        if (!pending_count)
+        {
+            break;
+        }
+
+        // Start the next cluster; padding slots are zeroed and never referenced
+        const size_t page_remaining = page_nodes - (node_count % page_nodes);
+        if (page_remaining < (page_nodes / 4))
+        {
+            memset(&file_nodes[node_count], 0, page_remaining * sizeof(SceneFileNode));
+            node_count += page_remaining;
+        }
+        cluster_end = node_count + (page_nodes - (node_count % page_nodes));
+
+        const SceneFileNodeLink parent       = pending[--pending_count];
+        const BVHNode*          source       = &bvh->nodes[parent.source_index];
+        file_nodes[parent.file_index].offset = ( u32 )node_count;
+
+        queue_begin = 0;
+        queue_end   = 0;
+        PushSceneFileNodeLink(queue, &queue_end, parent.source_index + 1, ( u32 )node_count);
+        PushSceneFileNodeLink(queue, &queue_end, parent.source_index + (2 * source->left_count), ( u32 )node_count + 1);
+        node_count += 2;
+    }
+
+    free(queue);
+    free(pending);
+    return node_count;
+}
+
+// Writes the entities of 'bvh' (see: CreateEntityBVH()) and the tree itself
+// to 'path'. Returns false, leaving no file at 'path', if the file cannot be
+// written.
+// Note: triangle mesh entities refer to caller-owned meshes and cannot be
+//       written; a scene with any is rejected before the file is opened.
+static bool
+WriteSceneFile(const char* const path, const Entity* restrict const entity_arr, const BVH* restrict const bvh)
+{
+    __UE_ASSERT__(path && entity_arr && bvh);
+    __UE_ASSERT__(bvh->primitive_count);
+
+    for (size_t index = 0; index < bvh->primitive_count; index++)
+    {
+        if (entity_arr[bvh->indices[index]].type == ET_TRIANGLE_MESH)
+        {
+            return false;
+        }
+    }
+
+    // Padding only fills the last quarter of a page, adding at most a third
+    // to the node count
+    SceneFileNode* file_nodes = ( SceneFileNode* )calloc(2 * bvh->node_capacity, sizeof(SceneFileNode));
+    __UE_ASSERT__(file_nodes);
+
+    const size_t node_count = ClusterSceneFileNodes(bvh, file_nodes);
+
+    SceneFileHeader header = { 0 };
+    header.magic           = SCENE_FILE_MAGIC;
+    header.version         = SCENE_FILE_VERSION;
+    header.node_size       = sizeof(SceneFileNode);
+    header.entity_size     = sizeof(Entity);
+    header.node_count      = node_count;
+    header.node_offset     = AlignSceneFileOffset(sizeof(SceneFileHeader));
+    header.entity_count    = bvh->primitive_count;
+    header.entity_offset   = AlignSceneFileOffset(header.node_offset + (node_count * sizeof(SceneFileNode)));
+    header.file_size       = header.entity_offset + (header.entity_count * sizeof(Entity));
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+    {
+        free(file_nodes);
+        return false;
+    }
+
+    bool is_written = fwrite(&header, sizeof(SceneFileHeader), 1, file) == 1;
+    is_written      = is_written && WriteSceneFilePadding(file, header.node_offset - sizeof(SceneFileHeader));
+    is_written      = is_written && fwrite(file_nodes, sizeof(SceneFileNode), node_count, file) == node_count;
+    is_written      = is_written && WriteSceneFilePadding(file, header.entity_offset - (header.node_offset + (node_count * sizeof(SceneFileNode))));
+    for (size_t index = 0; is_written && index < bvh->primitive_count; index++)
+    {
+        is_written = fwrite(&entity_arr[bvh->indices[index]], sizeof(Entity), 1, file) == 1;
+    }
+
+    is_written = (fclose(file) == 0) && is_written;
+    if (!is_written)
+    {
+        remove(path);
+    }
+
+    free(file_nodes);
+    return is_written;
+}
+
+//
+// Mapping
+//
+static void
+CloseSceneFile(_mut_ SceneFile* restrict const scene)
+{
+    if (!scene)
+    {
+        return;
+    }
+
+#if _WIN32
+    if (scene->base)
+    {
+        UnmapViewOfFile(scene->base);
+    }
+    if (scene->mapping_handle)
+    {
+        CloseHandle(scene->mapping_handle);
+    }
+    if (scene->file_handle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(scene->file_handle);
+    }
+#else
+    if (scene->base)
+    {
+        munmap(( void* )scene->base, scene->file_size);
+    }
+    if (scene->file_descriptor >= 0)
+    {
+        close(scene->file_descriptor);
+    }
+#endif // _WIN32
+
+    free(scene);
+}
+
+// Maps a file written by WriteSceneFile() read-only. Nothing but the first
+// page of nodes is read up front. Returns NULL if the file cannot be mapped
+// or was not written by a compatible build.
+static SceneFile*
+OpenSceneFile(const char* const path)
+{
+    __UE_ASSERT__(path);
+
+    SceneFile* scene = ( SceneFile* )calloc(1, sizeof(SceneFile));
+    __UE_ASSERT__(scene);
+
+#if _WIN32
+    scene->file_handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    LARGE_INTEGER file_size = { 0 };
+    if (scene->file_handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(scene->file_handle, &file_size) || ( u64 )file_size.QuadPart < sizeof(SceneFileHeader))
+    {
+        CloseSceneFile(scene);
+        return NULL;
+    }
+
+    scene->file_size      = ( size_t )file_size.QuadPart;
+    scene->mapping_handle = CreateFileMappingA(scene->file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    scene->base           = scene->mapping_handle ? ( const u8* )MapViewOfFile(scene->mapping_handle, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!scene->base)
+    {
+        CloseSceneFile(scene);
+        return NULL;
+    }
+#else
+    scene->file_descriptor = open(path, O_RDONLY);
+    struct stat file_stat  = { 0 };
+    if (scene->file_descriptor < 0 || fstat(scene->file_descriptor, &file_stat) != 0 || ( u64 )file_stat.st_size < sizeof(SceneFileHeader))
+    {
+        CloseSceneFile(scene);
+        return NULL;
+    }
+
+    scene->file_size = ( size_t )file_stat.st_size;
+    void* base       = mmap(NULL, scene->file_size, PROT_READ, MAP_SHARED, scene->file_descriptor, 0);
+    if (base == MAP_FAILED)
+    {
+        CloseSceneFile(scene);
+        return NULL;
+    }
+
+    // Read-ahead would fetch clusters of unrelated subtrees
+    scene->base = ( const u8* )base;
+    madvise(base, scene->file_size, MADV_RANDOM);
+#endif // _WIN32
+
+    // Offsets are checked against the file size before anything is subtracted
+    // from it. Node and entity indices are 32 bit.
+    const SceneFileHeader* header = ( const SceneFileHeader* )scene->base;
+    if (header->magic != SCENE_FILE_MAGIC || header->version != SCENE_FILE_VERSION || header->node_size != sizeof(SceneFileNode) || header->entity_size != sizeof(Entity)
+        || header->file_size != scene->file_size || !header->node_count || !header->entity_count || header->node_count > UINT32_MAX || header->entity_count > UINT32_MAX
+        || header->node_offset < sizeof(SceneFileHeader) || header->node_offset > header->file_size || header->entity_offset > header->file_size
+        || header->node_count > ((header->file_size - header->node_offset) / sizeof(SceneFileNode)) || header->entity_offset < (header->node_offset + (header->node_count * sizeof(SceneFileNode)))
+        || header->entity_count > ((header->file_size - header->entity_offset) / sizeof(Entity)))
+    {
+        CloseSceneFile(scene);
+        return NULL;
+    }
+
+    scene->header       = header;
+    scene->nodes        = ( const SceneFileNode* )(scene->base + header->node_offset);
+    scene->entity_arr   = ( const Entity* )(scene->base + header->entity_offset);
+    scene->node_count   = ( size_t )header->node_count;
+    scene->entity_count = ( size_t )header->entity_count;
+
+#if !_WIN32
+    // Every ray starts in the root cluster
+    const size_t page_offset = ( size_t )header->node_offset & ~(( size_t )sysconf(_SC_PAGESIZE) - 1);
+    madvise(( void* )(scene->base + page_offset), __UE_SF__cluster_bytes, MADV_WILLNEED);
+#endif // !_WIN32
+
+    return scene;
+}
+
+//
+// Tracing
+//
+
+// Closest hit among the entities of a scene file within [ 0, max_magnitude );
+// the counterpart of IntersectEntityBVH(). Returns false, leaving
+// 'closest_intersection' and 'closest_entity_index' untouched, if nothing is
+// hit.
+static bool
+IntersectSceneFile(const Ray* restrict const ray,
+                   const SceneFile* restrict const       scene,
+                   const r32                             max_magnitude,
+                   _mut_ RayIntersection* restrict const closest_intersection,
+                   _mut_ u32* restrict const             closest_entity_index)
+{
+    __UE_ASSERT__(ray && scene);
+    __UE_ASSERT__(closest_intersection && closest_entity_index);
+    __UE_STAT__(rays, 1);
+
+    v3 inverse_direction = { 0 };
+    GetInverseDirection(&ray->direction, &inverse_direction);
+
+    const SceneFileNode* nodes             = scene->nodes;
+    r32                  closest_magnitude = max_magnitude;
+    bool                 does_intersect    = false;
+
+    u32 stack[BVH_STACK_SIZE];
+    r32 stack_near[BVH_STACK_SIZE];
+    u32 stack_size = 0;
+
+    const r32 root_near = IntersectAABB(&ray->origin, &inverse_direction, &nodes[0].min, &nodes[0].max, closest_magnitude);
+    if (root_near != FLT_MAX)
+    {
+        stack[stack_size]      = 0;
+        stack_near[stack_size] = root_near;
+        stack_size++;
+    }
+
+    while (stack_size)
+    {
+        stack_size--;
+        if (stack_near[stack_size] >= closest_magnitude)
+        {
+            continue;
+        }
+
+        const u32            node_index = stack[stack_size];
+        const SceneFileNode* node       = &nodes[node_index];
+        if (node->count)
+        {
+            if ((( u64 )node->offset + node->count) > scene->entity_count)
+            {
+                continue;
+            }
+
+            for (u32 entity_index = node->offset; entity_index < (node->offset + node->count); entity_index++)
+            {
+                // Mesh pointers do not survive a round trip; see WriteSceneFile()
+                const Entity* entity = &scene->entity_arr[entity_index];
+                if (entity->type == ET_TRIANGLE_MESH)
+                {
+                    continue;
+                }
+
+                RayIntersection candidate = { 0 };
+                IntersectEntity(ray, entity, &candidate);
+                if (candidate.does_intersect && candidate.magnitude >= 0.0f && candidate.magnitude < closest_magnitude)
+                {
+                    *closest_intersection = candidate;
+                    *closest_entity_index = entity_index;
+                    closest_magnitude     = candidate.magnitude;
+                    does_intersect        = true;
+                }
+            }
+
+            continue;
+        }
+
+        // Children past the node array, or not past their parent, are corrupt.
+        // So is a tree deeper than any BVH (see: BVH_MEDIAN_SPLIT_DEPTH).
+        if (node->offset <= node_index || (( u64 )node->offset + 1) >= scene->node_count || (stack_size + 2) > BVH_STACK_SIZE)
+        {
+            continue;
+        }
+
+        // Push the farther child first so that the nearer child is visited first
+        u32 near_index = node->offset;
+        u32 far_index  = node->offset + 1;
+        r32 near_entry = IntersectAABB(&ray->origin, &inverse_direction, &nodes[near_index].min, &nodes[near_index].max, closest_magnitude);
+        r32 far_entry  = IntersectAABB(&ray->origin, &inverse_direction, &nodes[far_index].min, &nodes[far_index].max, closest_magnitude);
+        if (far_entry < near_entry)
+        {
+            const u32 swap_index = near_index;
+            const r32 swap_entry = near_entry;
+            near_index           = far_index;
+            near_entry           = far_entry;
+            far_index            = swap_index;
+            far_entry            = swap_entry;
+        }
+
+        if (far_entry != FLT_MAX)
+        {
+            stack[stack_size]      = far_index;
+            stack_near[stack_size] = far_entry;
+            stack_size++;
+        }
+        if (near_entry != FLT_MAX)
+        {
+            stack[stack_size]      = near_index;
+            stack_near[stack_size] = near_entry;
+            stack_size++;
+        }
+    }
+
+    return does_intersect;
+}
+
+// Closest-hit query; the scene file counterpart of TraceEntityBVH().
+__UE_inline__ static void
+TraceSceneFile(const Ray* restrict const ray,
+               _mut_ RayIntersection* restrict const intersection,
+               _mut_ r32* restrict const global_magnitude_threshold,
+               _mut_ Color32_RGB* restrict const return_color,
+               const SceneFile* restrict const   scene)
+{
+    __UE_ASSERT__(ray);
+    __UE_ASSERT__(intersection);
+    __UE_ASSERT__(global_magnitude_threshold);
+    __UE_ASSERT__(return_color);
+    __UE_ASSERT__(scene);
+
+    const r32 max_magnitude = ( r32 )fmin(MAX_RAY_MAG, fabs(*global_magnitude_threshold));
+
+    RayIntersection closest_intersection = { 0 };
+    u32             closest_entity_index = ENTITY_INDEX_NONE;
+    const bool      does_intersect       = IntersectSceneFile(ray, scene, max_magnitude, &closest_intersection, &closest_entity_index);
+
+    *intersection                = closest_intersection;
+    intersection->does_intersect = does_intersect;
+    intersection->entity_index   = closest_entity_index;
+    if (does_intersect)
+    {
+        return_color->value = scene->entity_arr[closest_entity_index].material.color.value;
+    }
+}
+
+#endif // __UE_SCENE_FILE_TOOLS_H___
@@ -0,0 +1,700 @@
+#ifndef __UE_SCENE_TOOLS_H___
+#define __UE_SCENE_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <bvh_tools.h>
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <mesh_tools.h>
+#include <type_tools.h>
+
+#include <float.h>
+#include <stdlib.h>
+
+#if __UE_SIMD__sse
+#include <emmintrin.h>
+#endif // __UE_SIMD__sse
+
+//
+// Type-sorted scenes
+//
+// A Scene splits an entity array into one homogeneous, structure-of-arrays
+// primitive list per entity type. Each list is intersected by its own kernel
+// over contiguous data, four primitives at a time with SSE, with no
+// per-entity type dispatch. Only the closest primitive of the whole scene is
+// resolved into a full RayIntersection, once per ray.
+//
+// Columns are padded to a multiple of SCENE_LANE_WIDTH; padded lanes are
+// masked out.
+//
+// Note: the scene references, and does not own, the entity array. Rebuild
+//       the scene after adding, removing or retyping entities.
+//
+
+#define SCENE_LANE_WIDTH 4
+
+typedef struct
+{
+    // ET_SPHERE
+    r32*   sphere_x;
+    r32*   sphere_y;
+    r32*   sphere_z;
+    r32*   sphere_radius_sq;
+    u32*   sphere_entity; // Index into entity_arr
+    size_t sphere_count;
+
+    // ET_CUBE
+    r32*   cube_min_x;
+    r32*   cube_min_y;
+    r32*   cube_min_z;
+    r32*   cube_max_x;
+    r32*   cube_max_y;
+    r32*   cube_max_z;
+    u32*   cube_entity;
+    size_t cube_count;
+
+    // ET_TRIANGLE_MESH
+    u32*   mesh_entity;
+    size_t mesh_count;
+
+    const Entity* entity_arr;
+    size_t        num_entitys;
+} Scene;
+
+__UE_inline__ static void*
+AllocateSceneColumn(const size_t count, const size_t element_size)
+{
+    const size_t padded_count = ((count + SCENE_LANE_WIDTH - 1) / SCENE_LANE_WIDTH) * SCENE_LANE_WIDTH;
+
+    void* column = calloc(padded_count ? padded_count : SCENE_LANE_WIDTH, element_size);
+    __UE_ASSERT__(column);
+
+    return column;
+}
+
+// Copies entity geometry into the scene's columns. Call after moving
+// entities; types and entity count must be unchanged.
+static void
+UpdateScene(_mut_ Scene* restrict const scene)
+{
+    __UE_ASSERT__(scene && scene->entity_arr);
+
+    size_t sphere_index = 0;
+    size_t cube_index   = 0;
+    size_t mesh_index   = 0;
+    for (size_t entity_index = 0; entity_index < scene->num_entitys; entity_index++)
+    {
+        const Entity* entity = &scene->entity_arr[entity_index];
+        switch (entity->type)
+        {
+            case ET_CUBE:
+            {
+                const r32 half_length = 0.5f * entity->length;
+
+                scene->cube_min_x[cube_index]  = entity->position.x - half_length;
+                scene->cube_min_y[cube_index]  = entity->position.y - half_length;
+                scene->cube_min_z[cube_index]  = entity->position.z - half_length;
+                scene->cube_max_x[cube_index]  = entity->position.x + half_length;
+                scene->cube_max_y[cube_index]  = entity->position.y + half_length;
+                scene->cube_max_z[cube_index]  = entity->position.z + half_length;
+                scene->cube_entity[cube_index] = ( u32 )entity_index;
+                cube_index++;
+                break;
+            }
+
+            case ET_TRIANGLE_MESH:
+            {
+                scene->mesh_entity[mesh_index++] = ( u32 )entity_index;
+                break;
+            }
+
+            // Note: ET_NONE entities are traced as spheres, as in IntersectEntity()
+            case ET_NONE:
+            case ET_SPHERE:
+            {
+                scene->sphere_x[sphere_index]         = entity->position.x;
+                scene->sphere_y[sphere_index]         = entity->position.y;
+                scene->sphere_z[sphere_index]         = entity->position.z;
+                scene->sphere_radius_sq[sphere_index] = entity->radius * entity->radius;
+                scene->sphere_entity[sphere_index]    = ( u32 )entity_index;
+                sphere_index++;
+                break;
+            }
+        }
+    }
+
+    __UE_ASSERT__(sphere_index == scene->sphere_count);
+    __UE_ASSERT__(cube_index == scene->cube_count);
+    __UE_ASSERT__(mesh_index == scene->mesh_count);
+}
+
+static Scene*
+CreateScene(const Entity* restrict const entity_arr, const size_t num_entitys)
+{
+    __UE_ASSERT__(entity_arr && num_entitys);
+
+    Scene* scene = ( Scene* )calloc(1, sizeof(Scene));
+    __UE_ASSERT__(scene);
+
+    scene->entity_arr  = entity_arr;
+    scene->num_entitys = num_entitys;
+    for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
+    {
+        scene->cube_count += (entity_arr[entity_index].type == ET_CUBE);
+        scene->mesh_count += (entity_arr[entity_index].type == ET_TRIANGLE_MESH);
+    }
+    scene->sphere_count = num_entitys - scene->cube_count - scene->mesh_count;
+
+    scene->sphere_x         = ( r32* )AllocateSceneColumn(scene->sphere_count, sizeof(r32));
+    scene->sphere_y         = ( r32* )AllocateSceneColumn(scene->sphere_count, sizeof(r32));
+    scene->sphere_z         = ( r32* )AllocateSceneColumn(scene->sphere_count, sizeof(r32));
+    scene->sphere_radius_sq = ( r32* )AllocateSceneColumn(scene->sphere_count, sizeof(r32));
+    scene->sphere_entity    = ( u32* )AllocateSceneColumn(scene->sphere_count, sizeof(u32));
+    scene->cube_min_x       = ( r32* )AllocateSceneColumn(scene->cube_count, sizeof(r32));
+    scene->cube_min_y       = ( r32* )AllocateSceneColumn(scene->cube_count, sizeof(r32));
+    scene->cube_min_z       = ( r32* )AllocateSceneColumn(scene->cube_count, sizeof(r32));
+    scene->cube_max_x       = ( r32* )AllocateSceneColumn(scene->cube_count, sizeof(r32));
+    scene->cube_max_y       = ( r32* )AllocateSceneColumn(scene->cube_count, sizeof(r32));
+    scene->cube_max_z       = ( r32* )AllocateSceneColumn(scene->cube_count, sizeof(r32));
+    scene->cube_entity      = ( u32* )AllocateSceneColumn(scene->cube_count, sizeof(u32));
+    scene->mesh_entity      = ( u32* )AllocateSceneColumn(scene->mesh_count, sizeof(u32));
+
+    UpdateScene(scene);
+    return scene;
+}
+
+static void
+DestroyScene(_mut_ Scene* restrict const scene)
+{
+    if (!scene)
+    {
+        return;
+    }
+
+    free(scene->sphere_x);
+    free(scene->sphere_y);
+    free(scene->sphere_z);
+    free(scene->sphere_radius_sq);
+    free(scene->sphere_entity);
+    free(scene->cube_min_x);
+    free(scene->cube_min_y);
+    free(scene->cube_min_z);
+    free(scene->cube_max_x);
+    free(scene->cube_max_y);
+    free(scene->cube_max_z);
+    free(scene->cube_entity);
+    free(scene->mesh_entity);
+    free(scene);
+}
+
+//
+// Per-type kernels
+//
+// Each returns the entity index of the closest primitive of its type within
+// [ min_magnitude, *magnitude ), updating *magnitude, or ENTITY_INDEX_NONE.
+// A ray that starts inside a primitive hits its exit point.
+//
+#if __UE_SIMD__sse
+// Lane-wise closest hit reduction shared by the SSE kernels
+__UE_inline__ static void
+SelectClosestLanes(const __m128 hit, const __m128 t, const __m128i index, _mut_ __m128* restrict const closest_t, _mut_ __m128i* restrict const closest_index)
+{
+    *closest_t     = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, *closest_t));
+    *closest_index = _mm_or_si128(_mm_and_si128(_mm_castps_si128(hit), index), _mm_andnot_si128(_mm_castps_si128(hit), *closest_index));
+}
+
+__UE_inline__ static u32
+ReduceClosestLanes(const __m128 closest_t, const __m128i closest_index, const u32* restrict const entity_column, _mut_ r32* restrict const magnitude)
+{
+    r32 lane_t[SCENE_LANE_WIDTH];
+    s32 lane_index[SCENE_LANE_WIDTH];
+    _mm_storeu_ps(lane_t, closest_t);
+    _mm_storeu_si128(( __m128i* )lane_index, closest_index);
+
+    u32 entity_index = ENTITY_INDEX_NONE;
+    for (u32 lane = 0; lane < SCENE_LANE_WIDTH; lane++)
+    {
+        if (lane_index[lane] >= 0 && lane_t[lane] < *magnitude)
+        {
+            *magnitude   = lane_t[lane];
+            entity_index = entity_column[lane_index[lane]];
+        }
+    }
+
+    return entity_index;
+}
+
+static u32
+IntersectSceneSpheres(const Scene* restrict const scene, const Ray* restrict const ray, const r32 min_magnitude, _mut_ r32* restrict const magnitude)
+{
+    const __m128  origin_x    = _mm_set1_ps(ray->origin.x);
+    const __m128  origin_y    = _mm_set1_ps(ray->origin.y);
+    const __m128  origin_z    = _mm_set1_ps(ray->origin.z);
+    const __m128  direction_x = _mm_set1_ps(ray->direction.x);
+    const __m128  direction_y = _mm_set1_ps(ray->direction.y);
+    const __m128  direction_z = _mm_set1_ps(ray->direction.z);
+    const __m128  t_min       = _mm_set1_ps(min_magnitude);
+    const __m128  zero        = _mm_setzero_ps();
+    const __m128i count       = _mm_set1_epi32(( s32 )scene->sphere_count);
+    __m128i       index       = _mm_setr_epi32(0, 1, 2, 3);
+    __m128        closest_t   = _mm_set1_ps(*magnitude);
+    __m128i       closest     = _mm_set1_epi32(-1);
+    __UE_STAT__(primitive_tests, scene->sphere_count);
+
+    for (size_t sphere_index = 0; sphere_index < scene->sphere_count; sphere_index += SCENE_LANE_WIDTH)
+    {
+        // Normalized direction: t = -b -/+ sqrt(b^2 - c)
+        const __m128 offset_x     = _mm_sub_ps(origin_x, _mm_loadu_ps(&scene->sphere_x[sphere_index]));
+        const __m128 offset_y     = _mm_sub_ps(origin_y, _mm_loadu_ps(&scene->sphere_y[sphere_index]));
+        const __m128 offset_z     = _mm_sub_ps(origin_z, _mm_loadu_ps(&scene->sphere_z[sphere_index]));
+        const __m128 b            = _mm_add_ps(_mm_add_ps(_mm_mul_ps(offset_x, direction_x), _mm_mul_ps(offset_y, direction_y)), _mm_mul_ps(offset_z, direction_z));
+        const __m128 offset_sq    = _mm_add_ps(_mm_add_ps(_mm_mul_ps(offset_x, offset_x), _mm_mul_ps(offset_y, offset_y)), _mm_mul_ps(offset_z, offset_z));
+        const __m128 c            = _mm_sub_ps(offset_sq, _mm_loadu_ps(&scene->sphere_radius_sq[sphere_index]));
+        const __m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), c);
+        const __m128 root         = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+        const __m128 t_near       = _mm_sub_ps(_mm_sub_ps(zero, b), root);
+        const __m128 t_far        = _mm_sub_ps(root, b);
+
+        // Rays that start inside report the exit point
+        const __m128 is_inside = _mm_cmplt_ps(t_near, zero);
+        const __m128 t         = _mm_or_ps(_mm_and_ps(is_inside, t_far), _mm_andnot_ps(is_inside, t_near));
+
+        __m128 hit = _mm_castsi128_ps(_mm_cmplt_epi32(index, count));
+        hit        = _mm_and_ps(hit, _mm_cmpge_ps(discriminant, zero));
+        hit        = _mm_and_ps(hit, _mm_cmpge_ps(t, t_min));
+        hit        = _mm_and_ps(hit, _mm_cmplt_ps(t, closest_t));
+
+        SelectClosestLanes(hit, t, index, &closest_t, &closest);
+        index = _mm_add_epi32(index, _mm_set1_epi32(SCENE_LANE_WIDTH));
+    }
+
+    return ReduceClosestLanes(closest_t, closest, scene->sphere_entity, magnitude);
+}
+
+static u32
+IntersectSceneCubes(const Scene* restrict const scene, const Ray* restrict const ray, const r32 min_magnitude, _mut_ r32* restrict const magnitude)
+{
+    v3 inverse_direction = { 0 };
+    GetInverseDirection(&ray->direction, &inverse_direction);
+
+    const __m128  origin_x  = _mm_set1_ps(ray->origin.x);
+    const __m128  origin_y  = _mm_set1_ps(ray->origin.y);
+    const __m128  origin_z  = _mm_set1_ps(ray->origin.z);
+    const __m128  inverse_x = _mm_set1_ps(inverse_direction.x);
+    const __m128  inverse_y = _mm_set1_ps(inverse_direction.y);
+    const __m128  inverse_z = _mm_set1_ps(inverse_direction.z);
+    const __m128  t_min     = _mm_set1_ps(min_magnitude);
+    const __m128  zero      = _mm_setzero_ps();
+    const __m128i count     = _mm_set1_epi32(( s32 )scene->cube_count);
+    __m128i       index     = _mm_setr_epi32(0, 1, 2, 3);
+    __m128        closest_t = _mm_set1_ps(*magnitude);
+    __m128i       closest   = _mm_set1_epi32(-1);
+    __UE_STAT__(primitive_tests, scene->cube_count);
+
+    for (size_t cube_index = 0; cube_index < scene->cube_count; cube_index += SCENE_LANE_WIDTH)
+    {
+        // Slab test
+        const __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&scene->cube_min_x[cube_index]), origin_x), inverse_x);
+        const __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&scene->cube_max_x[cube_index]), origin_x), inverse_x);
+        const __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&scene->cube_min_y[cube_index]), origin_y), inverse_y);
+        const __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&scene->cube_max_y[cube_index]), origin_y), inverse_y);
+        const __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&scene->cube_min_z[cube_index]), origin_z), inverse_z);
+        const __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&scene->cube_max_z[cube_index]), origin_z), inverse_z);
+
+        const __m128 t_near = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)), _mm_min_ps(z0, z1));
+        const __m128 t_far  = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)), _mm_max_ps(z0, z1));
+
+        // Rays that start inside report the exit face
+        const __m128 is_inside = _mm_cmplt_ps(t_near, zero);
+        const __m128 t         = _mm_or_ps(_mm_and_ps(is_inside, t_far), _mm_andnot_ps(is_inside, t_near));
+
+        __m128 hit = _mm_castsi128_ps(_mm_cmplt_epi32(index, count));
+        hit        = _mm_and_ps(hit, _mm_cmple_ps(t_near, t_far));
+        hit        = _mm_and_ps(hit, _mm_cmpge_ps(t, t_min));
+        hit        = _mm_and_ps(hit, _mm_cmplt_ps(t, closest_t));
+
+        SelectClosestLanes(hit, t, index, &closest_t, &closest);
+        index = _mm_add_epi32(index, _mm_set1_epi32(SCENE_LANE_WIDTH));
+    }
+
+    return ReduceClosestLanes(closest_t, closest, scene->cube_entity, magnitude);
+}
+#else  // __UE_SIMD__sse
+static u32
+IntersectSceneSpheres(const Scene* restrict const scene, const Ray* restrict const ray, const r32 min_magnitude, _mut_ r32* restrict const magnitude)
+{
+    __UE_STAT__(primitive_tests, scene->sphere_count);
+
+    u32 entity_index = ENTITY_INDEX_NONE;
+    for (size_t sphere_index = 0; sphere_index < scene->sphere_count; sphere_index++)
+    {
+        v3 offset = { 0 };
+        v3Set(&offset, ray->origin.x - scene->sphere_x[sphere_index], ray->origin.y - scene->sphere_y[sphere_index], ray->origin.z - scene->sphere_z[sphere_index]);
+
+        const r32 b            = v3Dot(&offset, &ray->direction);
+        const r32 discriminant = (b * b) - (v3Dot(&offset, &offset) - scene->sphere_radius_sq[sphere_index]);
+        if (discriminant < 0.0f)
+        {
+            continue;
+        }
+
+        // Rays that start inside report the exit point
+        const r32 root   = ( r32 )sqrt(discriminant);
+        const r32 t_near = -b - root;
+        const r32 t      = (t_near < 0.0f) ? (-b + root) : t_near;
+        if (t >= min_magnitude && t < *magnitude)
+        {
+            *magnitude   = t;
+            entity_index = scene->sphere_entity[sphere_index];
+        }
+    }
+
+    return entity_index;
+}
+
+static u32
+IntersectSceneCubes(const Scene* restrict const scene, const Ray* restrict const ray, const r32 min_magnitude, _mut_ r32* restrict const magnitude)
+{
+    v3 inverse_direction = { 0 };
+    GetInverseDirection(&ray->direction, &inverse_direction);
+
+    __UE_STAT__(primitive_tests, scene->cube_count);
+
+    u32 entity_index = ENTITY_INDEX_NONE;
+    for (size_t cube_index = 0; cube_index < scene->cube_count; cube_index++)
+    {
+        const r32 cube_min[3] = { scene->cube_min_x[cube_index], scene->cube_min_y[cube_index], scene->cube_min_z[cube_index] };
+        const r32 cube_max[3] = { scene->cube_max_x[cube_index], scene->cube_max_y[cube_index], scene->cube_max_z[cube_index] };
+
+        // Slab test
+        r32 t_near = -FLT_MAX;
+        r32 t_far  = FLT_MAX;
+        for (u8 axis = 0; axis < 3; axis++)
+        {
+            const r32 t0 = (cube_min[axis] - ray->origin.arr[axis]) * inverse_direction.arr[axis];
+            const r32 t1 = (cube_max[axis] - ray->origin.arr[axis]) * inverse_direction.arr[axis];
+            const r32 lo = t0 < t1 ? t0 : t1;
+            const r32 hi = t0 < t1 ? t1 : t0;
+            t_near       = lo > t_near ? lo : t_near;
+            t_far        = hi < t_far ? hi : t_far;
+        }
+
+        if (t_near > t_far || t_far < 0.0f)
+        {
+            continue;
+        }
+
+        // Rays that start inside report the exit face
+        const r32 t = (t_near < 0.0f) ? t_far : t_near;
+        if (t >= min_magnitude && t < *magnitude)
+        {
+            *magnitude   = t;
+            entity_index = scene->cube_entity[cube_index];
+        }
+    }
+
+    return entity_index;
+}
+#endif // __UE_SIMD__sse
+
+// Full intersection record of a sphere or cube the per-type kernels hit at
+// 'magnitude'.
+__UE_inline__ static void
+ResolveSceneIntersection(const Scene* restrict const           scene,
+                         const Ray* restrict const             ray,
+                         const u32                             entity_index,
+                         const r32                             magnitude,
+                         _mut_ RayIntersection* restrict const intersection)
+{
+    __UE_ASSERT__(scene && ray && intersection);
+    __UE_ASSERT__(entity_index < scene->num_entitys);
+
+    const Entity* entity = &scene->entity_arr[entity_index];
+    __UE_ASSERT__(entity->type != ET_TRIANGLE_MESH);
+
+    IntersectEntity(ray, entity, intersection);
+    intersection->entity_index = entity_index;
+
+    // IntersectSphere() reports the entry point, behind a ray that starts
+    // inside; the kernels hit the exit point
+    if (entity->type != ET_CUBE && intersection->magnitude < 0.0f)
+    {
+        intersection->does_intersect = true;
+        intersection->magnitude      = magnitude;
+        v3Set(&intersection->position,
+              ray->origin.x + (magnitude * ray->direction.x),
+              ray->origin.y + (magnitude * ray->direction.y),
+              ray->origin.z + (magnitude * ray->direction.z));
+        v3Sub(&entity->position, &intersection->position, &intersection->normal_vector);
+        v3Norm(&intersection->normal_vector);
+    }
+}
+
+// Closest-hit query over every primitive type; the type-sorted counterpart
+// of TraceEntityArray(). mesh_arr may be NULL for scenes without meshes.
+// Note: secondary rays are not spawned (see: ReflectRays()).
+static void
+TraceScene(const Ray* restrict const ray,
+           _mut_ RayIntersection* restrict const intersection,
+           _mut_ r32* restrict const global_magnitude_threshold,
+           _mut_ Color32_RGB* restrict const return_color,
+           const Scene* restrict const       scene,
+           const TriangleMesh* const* const  mesh_arr,
+           const size_t                      mesh_count)
+{
+    __UE_ASSERT__(ray);
+    __UE_ASSERT__(intersection);
+    __UE_ASSERT__(global_magnitude_threshold);
+    __UE_ASSERT__(return_color);
+    __UE_ASSERT__(scene);
+    __UE_ASSERT__(mesh_arr || !scene->mesh_count);
+
+    r32 closest_magnitude    = ( r32 )fmin(MAX_RAY_MAG, fabs(*global_magnitude_threshold));
+    u32 closest_entity_index = ENTITY_INDEX_NONE;
+
+    u32 entity_index = IntersectSceneSpheres(scene, ray, 0.0f, &closest_magnitude);
+    if (entity_index != ENTITY_INDEX_NONE)
+    {
+        closest_entity_index = entity_index;
+    }
+
+    entity_index = IntersectSceneCubes(scene, ray, 0.0f, &closest_magnitude);
+    if (entity_index != ENTITY_INDEX_NONE)
+    {
+        closest_entity_index = entity_index;
+    }
+
+    // Meshes resolve their own intersection record
+    RayIntersection mesh_intersection = { 0 };
+    for (size_t mesh_index = 0; mesh_index < scene->mesh_count; mesh_index++)
+    {
+        const Entity* entity = &scene->entity_arr[scene->mesh_entity[mesh_index]];
+        __UE_ASSERT__(entity->mesh_index < mesh_count);
+
+        if (IntersectMeshEntity(ray, entity, mesh_arr[entity->mesh_index], closest_magnitude, &mesh_intersection))
+        {
+            closest_magnitude    = mesh_intersection.magnitude;
+            closest_entity_index = scene->mesh_entity[mesh_index];
+        }
+    }
+
+    RayIntersection closest_intersection = { 0 };
+    if (closest_entity_index != ENTITY_INDEX_NONE)
+    {
+        if (scene->entity_arr[closest_entity_index].type == ET_TRIANGLE_MESH)
+        {
+            closest_intersection = mesh_intersection;
+        }
+        else
+        {
+            ResolveSceneIntersection(scene, ray, closest_entity_index, closest_magnitude, &closest_intersection);
+        }
+    }
+
+    *intersection                = closest_intersection;
+    intersection->does_intersect = (closest_entity_index != ENTITY_INDEX_NONE);
+    intersection->entity_index   = closest_entity_index;
+    if (intersection->does_intersect)
+    {
+        intersection->magnitude = closest_magnitude;
+        return_color->value     = scene->entity_arr[closest_entity_index].material.color.value;
+    }
+}
+
+//
+// Occlusion
+//
+// Any-hit counterparts of the per-type kernels and TraceScene(); each kernel
+// returns as soon as one group of lanes reports an occluder.
+// See: IsRayOccludedByEntity().
+//
+#if __UE_SIMD__sse
+static bool
+OccludedSceneSpheres(const Scene* restrict const scene, const Ray* restrict const ray, const r32 max_magnitude)
+{
+    const __m128  origin_x    = _mm_set1_ps(ray->origin.x);
+    const __m128  origin_y    = _mm_set1_ps(ray->origin.y);
+    const __m128  origin_z    = _mm_set1_ps(ray->origin.z);
+    const __m128  direction_x = _mm_set1_ps(ray->direction.x);
+    const __m128  direction_y = _mm_set1_ps(ray->direction.y);
+    const __m128  direction_z = _mm_set1_ps(ray->direction.z);
+    const __m128  t_max       = _mm_set1_ps(max_magnitude);
+    const __m128  zero        = _mm_setzero_ps();
+    const __m128i count       = _mm_set1_epi32(( s32 )scene->sphere_count);
+    __m128i       index       = _mm_setr_epi32(0, 1, 2, 3);
+
+    for (size_t sphere_index = 0; sphere_index < scene->sphere_count; sphere_index += SCENE_LANE_WIDTH)
+    {
+        const __m128 offset_x     = _mm_sub_ps(origin_x, _mm_loadu_ps(&scene->sphere_x[sphere_index]));
+        const __m128 offset_y     = _mm_sub_ps(origin_y, _mm_loadu_ps(&scene->sphere_y[sphere_index]));
+        const __m128 offset_z     = _mm_sub_ps(origin_z, _mm_loadu_ps(&scene->sphere_z[sphere_index]));
+        const __m128 b            = _mm_add_ps(_mm_add_ps(_mm_mul_ps(offset_x, direction_x), _mm_mul_ps(offset_y, direction_y)), _mm_mul_ps(offset_z, direction_z));
+        const __m128 offset_sq    = _mm_add_ps(_mm_add_ps(_mm_mul_ps(offset_x, offset_x), _mm_mul_ps(offset_y, offset_y)), _mm_mul_ps(offset_z, offset_z));
+        const __m128 c            = _mm_sub_ps(offset_sq, _mm_loadu_ps(&scene->sphere_radius_sq[sphere_index]));
+        const __m128 discriminant = _mm_sub_ps(_mm_mul_ps(b, b), c);
+        const __m128 root         = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+        const __m128 t_near       = _mm_sub_ps(_mm_sub_ps(zero, b), root);
+        const __m128 t_far        = _mm_sub_ps(root, b);
+
+        const __m128 near_in_range = _mm_and_ps(_mm_cmpge_ps(t_near, zero), _mm_cmplt_ps(t_near, t_max));
+        const __m128 far_in_range  = _mm_and_ps(_mm_cmpge_ps(t_far, zero), _mm_cmplt_ps(t_far, t_max));
+
+        __m128 hit = _mm_castsi128_ps(_mm_cmplt_epi32(index, count));
+        hit        = _mm_and_ps(hit, _mm_cmpge_ps(discriminant, zero));
+        hit        = _mm_and_ps(hit, _mm_or_ps(near_in_range, far_in_range));
+        if (_mm_movemask_ps(hit))
+        {
+            return true;
+        }
+
+        index = _mm_add_epi32(index, _mm_set1_epi32(SCENE_LANE_WIDTH));
+    }
+
+    return false;
+}
+
+static bool
+OccludedSceneCubes(const Scene* restrict const scene, const Ray* restrict const ray, const r32 max_magnitude)
+{
+    v3 inverse_direction = { 0 };
+    GetInverseDirection(&ray->direction, &inverse_direction);
+
+    const __m128  origin_x  = _mm_set1_ps(ray->origin.x);
+    const __m128  origin_y  = _mm_set1_ps(ray->origin.y);
+    const __m128  origin_z  = _mm_set1_ps(ray->origin.z);
+    const __m128  inverse_x = _mm_set1_ps(inverse_direction.x);
+    const __m128  inverse_y = _mm_set1_ps(inverse_direction.y);
+    const __m128  inverse_z = _mm_set1_ps(inverse_direction.z);
+    const __m128  t_max     = _mm_set1_ps(max_magnitude);
+    const __m128  zero      = _mm_setzero_ps();
+    const __m128i count     = _mm_set1_epi32(( s32 )scene->cube_count);
+    __m128i       index     = _mm_setr_epi32(0, 1, 2, 3);
+
+    for (size_t cube_index = 0; cube_index < scene->cube_count; cube_index += SCENE_LANE_WIDTH)
+    {
+        const __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&scene->cube_min_x[cube_index]), origin_x), inverse_x);
+        const __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&scene->cube_max_x[cube_index]), origin_x), inverse_x);
+        const __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&scene->cube_min_y[cube_index]), origin_y), inverse_y);
+        const __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&scene->cube_max_y[cube_index]), origin_y), inverse_y);
+        const __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&scene->cube_min_z[cube_index]), origin_z), inverse_z);
+        const __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&scene->cube_max_z[cube_index]), origin_z), inverse_z);
+
+        const __m128 t_near = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)), _mm_min_ps(z0, z1));
+        const __m128 t_far  = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)), _mm_max_ps(z0, z1));
+
+        const __m128 near_in_range = _mm_and_ps(_mm_cmpge_ps(t_near, zero), _mm_cmplt_ps(t_near, t_max));
+        const __m128 far_in_range  = _mm_and_ps(_mm_cmpge_ps(t_far, zero), _mm_cmplt_ps(t_far, t_max));
+
+        __m128 hit = _mm_castsi128_ps(_mm_cmplt_epi32(index, count));
+        hit        = _mm_and_ps(hit, _mm_cmple_ps(t_near, t_far));
+        hit        = _mm_and_ps(hit, _mm_or_ps(near_in_range, far_in_range));
+        if (_mm_movemask_ps(hit))
+        {
+            return true;
+        }
+
+        index = _mm_add_epi32(index, _mm_set1_epi32(SCENE_LANE_WIDTH));
+    }
+
+    return false;
+}
+#else  // __UE_SIMD__sse
+static bool
+OccludedSceneSpheres(const Scene* restrict const scene, const Ray* restrict const ray, const r32 max_magnitude)
+{
+    for (size_t sphere_index = 0; sphere_index < scene->sphere_count; sphere_index++)
+    {
+        v3 offset = { 0 };
+        v3Set(&offset, ray->origin.x - scene->sphere_x[sphere_index], ray->origin.y - scene->sphere_y[sphere_index], ray->origin.z - scene->sphere_z[sphere_index]);
+
+        const r32 b            = v3Dot(&offset, &ray->direction);
+        const r32 discriminant = (b * b) - (v3Dot(&offset, &offset) - scene->sphere_radius_sq[sphere_index]);
+        if (discriminant < 0.0f)
+        {
+            continue;
+        }
+
+        const r32 root   = ( r32 )sqrt(discriminant);
+        const r32 t_near = -b - root;
+        const r32 t_far  = -b + root;
+        if ((t_near >= 0.0f && t_near < max_magnitude) || (t_far >= 0.0f && t_far < max_magnitude))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool
+OccludedSceneCubes(const Scene* restrict const scene, const Ray* restrict const ray, const r32 max_magnitude)
+{
+    v3 inverse_direction = { 0 };
+    GetInverseDirection(&ray->direction, &inverse_direction);
+
+    for (size_t cube_index = 0; cube_index < scene->cube_count; cube_index++)
+    {
+        const r32 cube_min[3] = { scene->cube_min_x[cube_index], scene->cube_min_y[cube_index], scene->cube_min_z[cube_index] };
+        const r32 cube_max[3] = { scene->cube_max_x[cube_index], scene->cube_max_y[cube_index], scene->cube_max_z[cube_index] };
+
+        // Slab test
+        r32 t_near = -FLT_MAX;
+        r32 t_far  = FLT_MAX;
+        for (u8 axis = 0; axis < 3; axis++)
+        {
+            const r32 t0 = (cube_min[axis] - ray->origin.arr[axis]) * inverse_direction.arr[axis];
+            const r32 t1 = (cube_max[axis] - ray->origin.arr[axis]) * inverse_direction.arr[axis];
+            const r32 lo = t0 < t1 ? t0 : t1;
+            const r32 hi = t0 < t1 ? t1 : t0;
+            t_near       = lo > t_near ? lo : t_near;
+            t_far        = hi < t_far ? hi : t_far;
+        }
+
+        if (t_near > t_far || t_far < 0.0f)
+        {
+            continue;
+        }
+
+        const r32 t = (t_near < 0.0f) ? t_far : t_near;
+        if (t < max_magnitude)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+#endif // __UE_SIMD__sse
+
+static bool
+OccludedScene(const Ray* restrict const ray,
+              const r32                        max_magnitude,
+              const Scene* restrict const      scene,
+              const TriangleMesh* const* const mesh_arr,
+              const size_t                     mesh_count)
+{
+    __UE_ASSERT__(ray && scene);
+    __UE_ASSERT__(mesh_arr || !scene->mesh_count);
+
+    if (OccludedSceneSpheres(scene, ray, max_magnitude) || OccludedSceneCubes(scene, ray, max_magnitude))
+    {
+        return true;
+    }
+
+    for (size_t mesh_index = 0; mesh_index < scene->mesh_count; mesh_index++)
+    {
+        const Entity* entity = &scene->entity_arr[scene->mesh_entity[mesh_index]];
+        __UE_ASSERT__(entity->mesh_index < mesh_count);
+
+        if (OccludedMeshEntity(ray, max_magnitude, entity, mesh_arr[entity->mesh_index]))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif // __UE_SCENE_TOOLS_H___
@@ -0,0 +1,418 @@
+#ifndef __UE_SHADING_RATE_TOOLS_H___
+#define __UE_SHADING_RATE_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <antialiasing_tools.h>
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <sampler_tools.h>
+#include <thread_tools.h>
+#include <type_tools.h>
+
+#include <atomic>
+#include <stdlib.h>
+
+//
+// Variable-rate tracing
+//
+// Each tile carries a shading rate: one primary ray per pixel, per 2 x 2 or
+// per 4 x 4 block. A tile at a coarse rate traces the top-left pixel of each
+// block (its lattice) and the rest of the block is bilinearly interpolated
+// from the four surrounding lattice pixels. Across a tile edge a corner may
+// land off a coarser neighbour's lattice; such corners are dropped and the
+// remaining weights renormalized. Past the image's last lattice row or
+// column the nearest one is held.
+//
+// The rate map is set by:
+//   - SetShadingRateByFocus(): full rate around a focus point (ie: where the
+//     viewer is looking), coarser with distance
+//   - RefineShadingRateByContrast(): finer rates for tiles whose previous
+//     frame shows a large luminance range
+//   - MarkShadingRateRegion(): a caller chosen rate over a pixel rectangle,
+//     ie: full rate over a moved entity's screen footprint, whose previous
+//     frame contrast is stale
+//
+// Rendering is two parallel passes, trace then reconstruct; the second only
+// reads lattice pixels, which the first wrote, and only writes the others, so
+// the result depends neither on the thread count nor on what the buffer
+// held before. Lattice pixels are traced exactly as a full
+// rate render would trace them.
+//
+// Note: tile_size must be a multiple of 4.
+//
+
+typedef enum
+{
+    SHADING_RATE_1X1 = 0, // Values are log2 of the block size
+    SHADING_RATE_2X2 = 1,
+    SHADING_RATE_4X4 = 2,
+    SHADING_RATE_COUNT
+} ShadingRate;
+
+typedef struct
+{
+    size_t tile_size;
+    r32    full_rate_radius;   // Fraction of the half diagonal from the focus
+    r32    half_rate_radius;   // Fraction of the half diagonal from the focus
+    r32    contrast_threshold; // Tile luminance range in [ 0, 1 ] for full rate; half of it for 2 x 2
+} ShadingRateSettings;
+
+typedef struct
+{
+    size_t pixels_traced;
+    size_t pixel_count;
+    r32    traced_fraction;
+    size_t tiles_at_rate[SHADING_RATE_COUNT];
+} ShadingRateStats;
+
+typedef struct
+{
+    u8* tile_rate; // ShadingRate of each tile
+
+    size_t image_width;
+    size_t image_height;
+    size_t tile_size;
+    size_t tiles_x;
+    size_t tiles_y;
+} ShadingRateMap;
+
+__UE_inline__ static void
+GetDefaultShadingRateSettings(_mut_ ShadingRateSettings* restrict const settings)
+{
+    __UE_ASSERT__(settings);
+
+    settings->tile_size          = __UE_SR__tile_size;
+    settings->full_rate_radius   = ( r32 )__UE_SR__full_rate_radius;
+    settings->half_rate_radius   = ( r32 )__UE_SR__half_rate_radius;
+    settings->contrast_threshold = ( r32 )__UE_SR__contrast_threshold;
+}
+
+// Every tile starts at full rate.
+static ShadingRateMap*
+CreateShadingRateMap(const size_t image_width, const size_t image_height, const size_t tile_size)
+{
+    __UE_ASSERT__(image_width && image_height);
+    __UE_ASSERT__(tile_size && !(tile_size % 4));
+
+    ShadingRateMap* map = ( ShadingRateMap* )calloc(1, sizeof(ShadingRateMap));
+    __UE_ASSERT__(map);
+
+    map->image_width  = image_width;
+    map->image_height = image_height;
+    map->tile_size    = tile_size;
+    map->tiles_x      = (image_width + tile_size - 1) / tile_size;
+    map->tiles_y      = (image_height + tile_size - 1) / tile_size;
+    map->tile_rate    = ( u8* )calloc(map->tiles_x * map->tiles_y, sizeof(u8));
+    __UE_ASSERT__(map->tile_rate);
+
+    return map;
+}
+
+static void
+DestroyShadingRateMap(_mut_ ShadingRateMap* restrict const map)
+{
+    if (!map)
+    {
+        return;
+    }
+
+    free(map->tile_rate);
+    free(map);
+}
+
+//
+// Rate selection
+//
+
+// The distance from the focus to the nearest point of each tile picks its
+// rate, so the tile under the focus is always at full rate.
+static void
+SetShadingRateByFocus(_mut_ ShadingRateMap* restrict const map, const ShadingRateSettings* restrict const settings, const r32 focus_x, const r32 focus_y)
+{
+    __UE_ASSERT__(map && settings);
+    __UE_ASSERT__(settings->full_rate_radius <= settings->half_rate_radius);
+
+    const r32 half_diagonal = 0.5f * ( r32 )sqrt(( r64 )((map->image_width * map->image_width) + (map->image_height * map->image_height)));
+    const r32 full_distance = settings->full_rate_radius * half_diagonal;
+    const r32 half_distance = settings->half_rate_radius * half_diagonal;
+
+    for (size_t tile_y = 0; tile_y < map->tiles_y; tile_y++)
+    {
+        const r32 y_min    = ( r32 )(tile_y * map->tile_size);
+        const r32 y_max    = y_min + ( r32 )map->tile_size;
+        const r32 offset_y = focus_y < y_min ? (y_min - focus_y) : (focus_y > y_max ? (focus_y - y_max) : 0.0f);
+
+        for (size_t tile_x = 0; tile_x < map->tiles_x; tile_x++)
+        {
+            const r32 x_min    = ( r32 )(tile_x * map->tile_size);
+            const r32 x_max    = x_min + ( r32 )map->tile_size;
+            const r32 offset_x = focus_x < x_min ? (x_min - focus_x) : (focus_x > x_max ? (focus_x - x_max) : 0.0f);
+            const r32 distance = ( r32 )sqrt((offset_x * offset_x) + (offset_y * offset_y));
+
+            ShadingRate rate = SHADING_RATE_4X4;
+            if (distance <= full_distance)
+            {
+                rate = SHADING_RATE_1X1;
+            }
+            else if (distance <= half_distance)
+            {
+                rate = SHADING_RATE_2X2;
+            }
+
+            map->tile_rate[(tile_y * map->tiles_x) + tile_x] = ( u8 )rate;
+        }
+    }
+}
+
+// Only ever makes tiles finer. 'pixel_array' is the previous frame, linear
+// and row-major.
+// Returns the number of tiles made finer.
+static size_t
+RefineShadingRateByContrast(_mut_ ShadingRateMap* restrict const      map,
+                            const ShadingRateSettings* restrict const settings,
+                            const Color32_RGB* restrict const         pixel_array)
+{
+    __UE_ASSERT__(map && settings && pixel_array);
+
+    size_t refined_count = 0;
+    for (size_t tile_index = 0; tile_index < (map->tiles_x * map->tiles_y); tile_index++)
+    {
+        const size_t x_min = (tile_index % map->tiles_x) * map->tile_size;
+        const size_t y_min = (tile_index / map->tiles_x) * map->tile_size;
+        const size_t x_max = (x_min + map->tile_size) < map->image_width ? (x_min + map->tile_size) : map->image_width;
+        const size_t y_max = (y_min + map->tile_size) < map->image_height ? (y_min + map->tile_size) : map->image_height;
+
+        r32 luminance_min = 1.0f;
+        r32 luminance_max = 0.0f;
+        for (size_t pix_y = y_min; pix_y < y_max; pix_y++)
+        {
+            for (size_t pix_x = x_min; pix_x < x_max; pix_x++)
+            {
+                const r32 luminance = GetColorLuminance(&pixel_array[(pix_y * map->image_width) + pix_x]);
+                luminance_min       = luminance < luminance_min ? luminance : luminance_min;
+                luminance_max       = luminance > luminance_max ? luminance : luminance_max;
+            }
+        }
+
+        const r32   contrast = luminance_max - luminance_min;
+        ShadingRate rate     = ( ShadingRate )map->tile_rate[tile_index];
+        if (contrast >= settings->contrast_threshold)
+        {
+            rate = SHADING_RATE_1X1;
+        }
+        else if (contrast >= (0.5f * settings->contrast_threshold) && rate > SHADING_RATE_2X2)
+        {
+            rate = SHADING_RATE_2X2;
+        }
+
+        if (rate != ( ShadingRate )map->tile_rate[tile_index])
+        {
+            map->tile_rate[tile_index] = ( u8 )rate;
+            refined_count++;
+        }
+    }
+
+    return refined_count;
+}
+
+// Set every tile overlapping the pixel rectangle
+// [ x_min, x_max ) x [ y_min, y_max ) to 'rate'.
+static void
+MarkShadingRateRegion(_mut_ ShadingRateMap* restrict const map, const size_t x_min, const size_t y_min, const size_t x_max, const size_t y_max, const ShadingRate rate)
+{
+    __UE_ASSERT__(map);
+    __UE_ASSERT__(rate < SHADING_RATE_COUNT);
+
+    if (x_min >= x_max || y_min >= y_max || x_min >= map->image_width || y_min >= map->image_height)
+    {
+        return;
+    }
+
+    const size_t tile_x_max = ((x_max < map->image_width ? x_max : map->image_width) - 1) / map->tile_size;
+    const size_t tile_y_max = ((y_max < map->image_height ? y_max : map->image_height) - 1) / map->tile_size;
+    for (size_t tile_y = y_min / map->tile_size; tile_y <= tile_y_max; tile_y++)
+    {
+        for (size_t tile_x = x_min / map->tile_size; tile_x <= tile_x_max; tile_x++)
+        {
+            map->tile_rate[(tile_y * map->tiles_x) + tile_x] = ( u8 )rate;
+        }
+    }
+}
+
+//
+// Rendering
+//
+typedef struct
+{
+    const ShadingRateMap* map;
+    Color32_RGB*          pixel_array;
+    const Entity*         entity_arr;
+    size_t                num_entitys;
+    u32                   frame_index;
+
+    std::atomic< size_t > pixels_traced;
+} ShadingRateContext;
+
+// True if the trace pass writes this pixel, ie: it is on the lattice of the
+// tile that contains it.
+__UE_inline__ static bool
+IsShadingRateLatticePixel(const ShadingRateMap* restrict const map, const size_t pix_x, const size_t pix_y)
+{
+    const size_t tile_index = ((pix_y / map->tile_size) * map->tiles_x) + (pix_x / map->tile_size);
+    const size_t block_mask = (( size_t )1 << map->tile_rate[tile_index]) - 1;
+    return !((pix_x | pix_y) & block_mask);
+}
+
+// Traces the lattice pixels of one tile.
+static void
+TraceShadingRateTile(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    ShadingRateContext*   frame      = ( ShadingRateContext* )context;
+    const ShadingRateMap* map        = frame->map;
+    const size_t          block_size = ( size_t )1 << map->tile_rate[task_index];
+    const size_t          x_min      = (task_index % map->tiles_x) * map->tile_size;
+    const size_t          y_min      = (task_index / map->tiles_x) * map->tile_size;
+    const size_t          x_max      = (x_min + map->tile_size) < map->image_width ? (x_min + map->tile_size) : map->image_width;
+    const size_t          y_max      = (y_min + map->tile_size) < map->image_height ? (y_min + map->tile_size) : map->image_height;
+
+    size_t pixels_traced = 0;
+    for (size_t pix_y = y_min; pix_y < y_max; pix_y += block_size)
+    {
+        for (size_t pix_x = x_min; pix_x < x_max; pix_x += block_size)
+        {
+            const size_t pixel_index = (pix_y * map->image_width) + pix_x;
+
+            BeginPixelSample(( u32 )pixel_index, frame->frame_index);
+            RayIntersection intersection = { 0 };
+            Color32_RGB     sample_color = { 0 };
+            TracePrimarySample(( r32 )pix_x + 0.5f, ( r32 )pix_y + 0.5f, map->image_width, map->image_height, &intersection, &sample_color, frame->entity_arr, frame->num_entitys);
+            sample_color.channel.A = 0xFF;
+
+            frame->pixel_array[pixel_index] = sample_color;
+            pixels_traced++;
+        }
+    }
+
+    frame->pixels_traced.fetch_add(pixels_traced, std::memory_order_relaxed);
+}
+
+// Adds a corner's weighted channels to 'sum'. A corner without weight is not
+// read: it may be a pixel another tile is reconstructing.
+__UE_inline__ static void
+AddShadingRateCorner(const Color32_RGB* restrict const pixel_array, const size_t image_width, const size_t x, const size_t y, const u32 weight, _mut_ u32* restrict const sum)
+{
+    if (!weight)
+    {
+        return;
+    }
+
+    const Color32_RGB* corner = &pixel_array[(y * image_width) + x];
+    sum[0] += weight * corner->channel.R;
+    sum[1] += weight * corner->channel.G;
+    sum[2] += weight * corner->channel.B;
+}
+
+// Interpolates the pixels of one tile that were not traced.
+static void
+ReconstructShadingRateTile(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+
+    ShadingRateContext*   frame = ( ShadingRateContext* )context;
+    const ShadingRateMap* map   = frame->map;
+    const u32             rate  = map->tile_rate[task_index];
+    if (rate == SHADING_RATE_1X1)
+    {
+        return;
+    }
+
+    const size_t block_size = ( size_t )1 << rate;
+    const size_t x_min      = (task_index % map->tiles_x) * map->tile_size;
+    const size_t y_min      = (task_index / map->tiles_x) * map->tile_size;
+    const size_t x_max      = (x_min + map->tile_size) < map->image_width ? (x_min + map->tile_size) : map->image_width;
+    const size_t y_max      = (y_min + map->tile_size) < map->image_height ? (y_min + map->tile_size) : map->image_height;
+
+    const Color32_RGB* pixel_array = frame->pixel_array;
+    for (size_t pix_y = y_min; pix_y < y_max; pix_y++)
+    {
+        const size_t y0       = pix_y & ~(block_size - 1);
+        const size_t y1       = (y0 + block_size) < map->image_height ? (y0 + block_size) : y0;
+        const u32    weight_y = ( u32 )(pix_y - y0);
+
+        for (size_t pix_x = x_min; pix_x < x_max; pix_x++)
+        {
+            const size_t x0       = pix_x & ~(block_size - 1);
+            const size_t x1       = (x0 + block_size) < map->image_width ? (x0 + block_size) : x0;
+            const u32    weight_x = ( u32 )(pix_x - x0);
+            if (!weight_x && !weight_y)
+            {
+                continue;
+            }
+
+            // Corners in a coarser neighbour may be off its lattice, and are
+            // only filled by its own reconstruction; they get no weight and
+            // are never read. c00 is on this tile's lattice and always has
+            // weight.
+            const u32 w00 = (( u32 )block_size - weight_x) * (( u32 )block_size - weight_y);
+            const u32 w10 = IsShadingRateLatticePixel(map, x1, y0) ? (weight_x * (( u32 )block_size - weight_y)) : 0;
+            const u32 w01 = IsShadingRateLatticePixel(map, x0, y1) ? ((( u32 )block_size - weight_x) * weight_y) : 0;
+            const u32 w11 = IsShadingRateLatticePixel(map, x1, y1) ? (weight_x * weight_y) : 0;
+
+            const u32 weight_total = w00 + w10 + w01 + w11;
+            u32       sum[3]       = { weight_total / 2, weight_total / 2, weight_total / 2 };
+            AddShadingRateCorner(pixel_array, map->image_width, x0, y0, w00, sum);
+            AddShadingRateCorner(pixel_array, map->image_width, x1, y0, w10, sum);
+            AddShadingRateCorner(pixel_array, map->image_width, x0, y1, w01, sum);
+            AddShadingRateCorner(pixel_array, map->image_width, x1, y1, w11, sum);
+
+            Color32_RGB* pixel = &frame->pixel_array[(pix_y * map->image_width) + pix_x];
+            pixel->channel.R   = ( u8 )(sum[0] / weight_total);
+            pixel->channel.G   = ( u8 )(sum[1] / weight_total);
+            pixel->channel.B   = ( u8 )(sum[2] / weight_total);
+            pixel->channel.A   = 0xFF;
+        }
+    }
+}
+
+// Render every pixel of 'pixel_array' (linear, row-major) at its tile's
+// rate. Tiles are spread over the pool's threads.
+static ShadingRateStats
+RenderShadingRateFrame(const ShadingRateMap* restrict const map,
+                       _mut_ Color32_RGB* restrict const    pixel_array,
+                       const Entity* restrict const         entity_arr,
+                       const size_t                         num_entitys,
+                       const u32                            frame_index,
+                       ThreadPool* const                    pool)
+{
+    __UE_ASSERT__(map && pixel_array && entity_arr);
+
+    const size_t tile_count = map->tiles_x * map->tiles_y;
+
+    ShadingRateContext frame = {};
+    frame.map                = map;
+    frame.pixel_array        = pixel_array;
+    frame.entity_arr         = entity_arr;
+    frame.num_entitys        = num_entitys;
+    frame.frame_index        = frame_index;
+    frame.pixels_traced.store(0);
+
+    ParallelFor(pool, tile_count, TraceShadingRateTile, &frame);
+    ParallelFor(pool, tile_count, ReconstructShadingRateTile, &frame);
+
+    ShadingRateStats stats = { 0 };
+    stats.pixels_traced    = frame.pixels_traced.load();
+    stats.pixel_count      = map->image_width * map->image_height;
+    stats.traced_fraction  = ( r32 )stats.pixels_traced / ( r32 )stats.pixel_count;
+    for (size_t tile_index = 0; tile_index < tile_count; tile_index++)
+    {
+        stats.tiles_at_rate[map->tile_rate[tile_index]]++;
+    }
+
+    return stats;
+}
+
+#endif // __UE_SHADING_RATE_TOOLS_H___
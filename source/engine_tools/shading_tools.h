@@ -0,0 +1,215 @@
+#ifndef __UE_SHADING_TOOLS_H___
+#define __UE_SHADING_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <color_tools.h>
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <material_tools.h>
+#include <type_tools.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Batched shading
+//
+// Tracing records one HitRecord per hit instead of shading in place. The
+// shading pass bins the records by MaterialClass with a counting sort, then
+// runs each class's kernel over its contiguous range, so every kernel sees
+// one material class and no per-hit switch.
+//
+// Materials are referred to by index: a record holds the index of the hit
+// entity, whose material is entity_arr[entity_index].material.
+//
+// Usage:
+//   ResetShadingBatch(batch);
+//   for each sample: trace, then PushHitRecord(batch, ...) on a hit
+//   ShadeHitRecords(batch, entity_arr, num_entitys, pixel_array);
+//
+// The tracer kernels shade their primary hits this way, one batch per chunk
+// of a row on caller-owned storage (see: TraceKernelRow()).
+//
+
+typedef struct
+{
+    u32         entity_index;
+    u32         pixel_index;
+    Color32_RGB input_color;
+} HitRecord;
+
+typedef struct
+{
+    HitRecord* record_arr;
+    HitRecord* sorted_record_arr;
+    size_t     record_count;
+    size_t     record_capacity;
+
+    // Records of class c are sorted_record_arr[ class_offset[c], class_offset[c + 1] )
+    size_t class_offset[MATERIAL_CLASS_COUNT + 1];
+} ShadingBatch;
+
+static ShadingBatch*
+CreateShadingBatch(const size_t record_capacity)
+{
+    __UE_ASSERT__(record_capacity);
+
+    ShadingBatch* batch = ( ShadingBatch* )calloc(1, sizeof(ShadingBatch));
+    __UE_ASSERT__(batch);
+
+    batch->record_capacity   = record_capacity;
+    batch->record_arr        = ( HitRecord* )calloc(record_capacity, sizeof(HitRecord));
+    batch->sorted_record_arr = ( HitRecord* )calloc(record_capacity, sizeof(HitRecord));
+    __UE_ASSERT__(batch->record_arr && batch->sorted_record_arr);
+
+    return batch;
+}
+
+// A batch over caller-owned storage, e.g. on the stack; never destroyed.
+__UE_inline__ static void
+InitShadingBatch(_mut_ ShadingBatch* restrict const batch, _mut_ HitRecord* const record_arr, _mut_ HitRecord* const sorted_record_arr, const size_t record_capacity)
+{
+    __UE_ASSERT__(batch && record_arr && sorted_record_arr && record_capacity);
+
+    memset(batch, 0, sizeof(ShadingBatch));
+    batch->record_arr        = record_arr;
+    batch->sorted_record_arr = sorted_record_arr;
+    batch->record_capacity   = record_capacity;
+}
+
+static void
+DestroyShadingBatch(_mut_ ShadingBatch* restrict const batch)
+{
+    if (!batch)
+    {
+        return;
+    }
+
+    free(batch->record_arr);
+    free(batch->sorted_record_arr);
+    free(batch);
+}
+
+__UE_inline__ static void
+ResetShadingBatch(_mut_ ShadingBatch* restrict const batch)
+{
+    __UE_ASSERT__(batch);
+    batch->record_count = 0;
+}
+
+// Returns false, recording nothing, if the batch is full; shade and reset
+// the batch before pushing again.
+__UE_inline__ static bool
+PushHitRecord(_mut_ ShadingBatch* restrict const batch,
+              const RayIntersection* restrict const intersection,
+              const size_t                          pixel_index,
+              const Color32_RGB* restrict const     input_color)
+{
+    __UE_ASSERT__(batch && intersection && input_color);
+    __UE_ASSERT__(intersection->does_intersect);
+    __UE_ASSERT__(intersection->entity_index != ENTITY_INDEX_NONE);
+
+    if (batch->record_count == batch->record_capacity)
+    {
+        return false;
+    }
+
+    HitRecord* record    = &batch->record_arr[batch->record_count++];
+    record->entity_index = intersection->entity_index;
+    record->pixel_index  = ( u32 )pixel_index;
+    record->input_color  = *input_color;
+
+    return true;
+}
+
+// Stable counting sort of record_arr into sorted_record_arr by material class.
+static void
+SortHitRecordsByMaterial(_mut_ ShadingBatch* restrict const batch, const Entity* restrict const entity_arr, const size_t num_entitys)
+{
+    __UE_ASSERT__(batch && entity_arr);
+    (void)num_entitys;
+
+    size_t class_count[MATERIAL_CLASS_COUNT] = { 0 };
+    for (size_t record_index = 0; record_index < batch->record_count; record_index++)
+    {
+        const u32 entity_index = batch->record_arr[record_index].entity_index;
+        __UE_ASSERT__(entity_index < num_entitys);
+        class_count[entity_arr[entity_index].material.material_class]++;
+    }
+
+    batch->class_offset[0] = 0;
+    for (size_t class_index = 0; class_index < MATERIAL_CLASS_COUNT; class_index++)
+    {
+        batch->class_offset[class_index + 1] = batch->class_offset[class_index] + class_count[class_index];
+    }
+
+    size_t class_cursor[MATERIAL_CLASS_COUNT] = { 0 };
+    for (size_t class_index = 0; class_index < MATERIAL_CLASS_COUNT; class_index++)
+    {
+        class_cursor[class_index] = batch->class_offset[class_index];
+    }
+
+    for (size_t record_index = 0; record_index < batch->record_count; record_index++)
+    {
+        const HitRecord*    record         = &batch->record_arr[record_index];
+        const MaterialClass material_class = entity_arr[record->entity_index].material.material_class;
+        batch->sorted_record_arr[class_cursor[material_class]++] = *record;
+    }
+}
+
+//
+// Per-class kernels
+//
+static void
+ShadeDiffuseRecords(const HitRecord* restrict const record_arr,
+                    const size_t                    record_count,
+                    const Entity* restrict const    entity_arr,
+                    _mut_ Color32_RGB* restrict const pixel_array)
+{
+    for (size_t record_index = 0; record_index < record_count; record_index++)
+    {
+        const HitRecord* record = &record_arr[record_index];
+        BlendColorDiffuse(&entity_arr[record->entity_index].material, &record->input_color, &pixel_array[record->pixel_index]);
+    }
+}
+
+static void
+ShadeMetalRecords(const HitRecord* restrict const record_arr,
+                  const size_t                    record_count,
+                  const Entity* restrict const    entity_arr,
+                  _mut_ Color32_RGB* restrict const pixel_array)
+{
+    for (size_t record_index = 0; record_index < record_count; record_index++)
+    {
+        const HitRecord* record = &record_arr[record_index];
+        BlendColorMetal(&entity_arr[record->entity_index].material, &record->input_color, &pixel_array[record->pixel_index]);
+    }
+}
+
+// Writes the shaded color of every recorded hit to pixel_array[pixel_index].
+// Records of MATERIAL_CLASS_N__UE_ON__E leave their pixel untouched.
+// Note: pixels hit by more than one record receive the last record shaded;
+//       accumulate per-sample batches when sampling a pixel more than once.
+static void
+ShadeHitRecords(_mut_ ShadingBatch* restrict const batch,
+                const Entity* restrict const       entity_arr,
+                const size_t                       num_entitys,
+                _mut_ Color32_RGB* restrict const pixel_array)
+{
+    __UE_ASSERT__(batch && entity_arr && pixel_array);
+
+    SortHitRecordsByMaterial(batch, entity_arr, num_entitys);
+
+    const size_t* offset = batch->class_offset;
+    ShadeDiffuseRecords(&batch->sorted_record_arr[offset[MATERIAL_CLASS_DIFFUSE]],
+                        offset[MATERIAL_CLASS_DIFFUSE + 1] - offset[MATERIAL_CLASS_DIFFUSE],
+                        entity_arr,
+                        pixel_array);
+    ShadeMetalRecords(&batch->sorted_record_arr[offset[MATERIAL_CLASS_METAL]],
+                      offset[MATERIAL_CLASS_METAL + 1] - offset[MATERIAL_CLASS_METAL],
+                      entity_arr,
+                      pixel_array);
+}
+
+#endif // __UE_SHADING_TOOLS_H___
@@ -0,0 +1,301 @@
+#ifndef __UE_STATS_TOOLS_H___
+#define __UE_STATS_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <color_tools.h>
+#include <image_tools.h>
+#include <macro_tools.h>
+#include <thread_tools.h>
+#include <type_tools.h>
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+//
+// Ray tracer statistics
+//
+// With -D__UE_STATS__enabled=1 the traversal kernels count their work into a
+// thread_local RayStats:
+//
+//   rays             one per closest-hit or any-hit query
+//   box_tests        one per ray/AABB slab test (eight per wide BVH node)
+//   primitive_tests  one per entity or triangle tested
+//   bounces          one per secondary ray spawned by ReflectRays()
+//
+// A renderer brackets each pixel with BeginPixelStats() / EndPixelStats(),
+// which moves the thread's counters into that pixel's slot of a RenderStats.
+// A pixel is only ever traced by one thread at a time, and a tile's totals are
+// summed by the task that owns the tile, so nothing on the hot path is atomic
+// or shared between threads.
+//
+// With __UE_STATS__enabled == 0 (the default) __UE_STAT__() expands to
+// nothing, its arguments are not evaluated, and the pixel hooks are empty.
+//
+
+typedef struct
+{
+    u32 rays;
+    u32 box_tests;
+    u32 primitive_tests;
+    u32 bounces;
+} RayStats;
+
+typedef enum
+{
+    RS_RAYS,
+    RS_BOX_TESTS,
+    RS_PRIMITIVE_TESTS,
+    RS_BOUNCES
+} RayStatsCounter;
+
+#if __UE_STATS__enabled == 1
+static thread_local RayStats kRayStats = { 0, 0, 0, 0 };
+
+#define __UE_STAT__(counter, count) (kRayStats.counter += ( u32 )(count))
+#else
+#define __UE_STAT__(counter, count) (( void )0)
+#endif // __UE_STATS__enabled == 1
+
+typedef struct
+{
+    RayStats* pixel_arr; // image_width * image_height, row-major
+    RayStats* tile_arr;  // tiles_x * tiles_y, row-major
+
+    size_t image_width;
+    size_t image_height;
+    size_t tile_size;
+    size_t tiles_x;
+    size_t tiles_y;
+    size_t tile_count;
+} RenderStats;
+
+__UE_inline__ static u32
+GetRayStatsCounter(const RayStats* restrict const stats, const RayStatsCounter counter)
+{
+    __UE_ASSERT__(stats);
+
+    switch (counter)
+    {
+        case RS_RAYS:
+            return stats->rays;
+        case RS_BOX_TESTS:
+            return stats->box_tests;
+        case RS_PRIMITIVE_TESTS:
+            return stats->primitive_tests;
+        case RS_BOUNCES:
+            return stats->bounces;
+    }
+
+    __UE_ASSERT__(false);
+    return 0;
+}
+
+__UE_inline__ static void
+AddRayStats(_mut_ RayStats* restrict const total, const RayStats* restrict const stats)
+{
+    __UE_ASSERT__(total && stats);
+
+    total->rays += stats->rays;
+    total->box_tests += stats->box_tests;
+    total->primitive_tests += stats->primitive_tests;
+    total->bounces += stats->bounces;
+}
+
+static RenderStats*
+CreateRenderStats(const size_t image_width, const size_t image_height, const size_t tile_size)
+{
+    __UE_ASSERT__(image_width && image_height && tile_size);
+
+    RenderStats* stats = ( RenderStats* )calloc(1, sizeof(RenderStats));
+    __UE_ASSERT__(stats);
+
+    stats->image_width  = image_width;
+    stats->image_height = image_height;
+    stats->tile_size    = tile_size;
+    stats->tiles_x      = (image_width + tile_size - 1) / tile_size;
+    stats->tiles_y      = (image_height + tile_size - 1) / tile_size;
+    stats->tile_count   = stats->tiles_x * stats->tiles_y;
+    stats->pixel_arr    = ( RayStats* )calloc(image_width * image_height, sizeof(RayStats));
+    stats->tile_arr     = ( RayStats* )calloc(stats->tile_count, sizeof(RayStats));
+    __UE_ASSERT__(stats->pixel_arr && stats->tile_arr);
+
+    return stats;
+}
+
+static void
+DestroyRenderStats(_mut_ RenderStats* restrict const stats)
+{
+    if (!stats)
+    {
+        return;
+    }
+
+    free(stats->pixel_arr);
+    free(stats->tile_arr);
+    free(stats);
+}
+
+static void
+ClearRenderStats(_mut_ RenderStats* restrict const stats)
+{
+    __UE_ASSERT__(stats);
+
+    memset(stats->pixel_arr, 0, stats->image_width * stats->image_height * sizeof(RayStats));
+    memset(stats->tile_arr, 0, stats->tile_count * sizeof(RayStats));
+}
+
+//
+// Pixel hooks
+//
+
+// Discard whatever the calling thread counted outside of a pixel.
+__UE_inline__ static void
+BeginPixelStats(void)
+{
+#if __UE_STATS__enabled == 1
+    const RayStats zero_stats = { 0 };
+    kRayStats                 = zero_stats;
+#endif // __UE_STATS__enabled == 1
+}
+
+// Add what the calling thread counted since BeginPixelStats() to the pixel;
+// samples of the same pixel accumulate.
+__UE_inline__ static void
+EndPixelStats(_mut_ RenderStats* restrict const stats, const size_t pix_x, const size_t pix_y)
+{
+#if __UE_STATS__enabled == 1
+    __UE_ASSERT__(stats);
+    __UE_ASSERT__(pix_x < stats->image_width && pix_y < stats->image_height);
+
+    AddRayStats(&stats->pixel_arr[(pix_y * stats->image_width) + pix_x], &kRayStats);
+#else
+    (void)stats;
+    (void)pix_x;
+    (void)pix_y;
+#endif // __UE_STATS__enabled == 1
+}
+
+//
+// Aggregation
+//
+
+// Sum the pixels of one tile into its slot. Renderers that already work tile
+// by tile call this from the tile's task.
+static void
+AggregateRenderStatsTile(_mut_ RenderStats* restrict const stats, const size_t tile_index)
+{
+    __UE_ASSERT__(stats);
+    __UE_ASSERT__(tile_index < stats->tile_count);
+
+    const size_t column_begin = (tile_index % stats->tiles_x) * stats->tile_size;
+    const size_t row_begin    = (tile_index / stats->tiles_x) * stats->tile_size;
+    const size_t column_end   = (column_begin + stats->tile_size) < stats->image_width ? (column_begin + stats->tile_size) : stats->image_width;
+    const size_t row_end      = (row_begin + stats->tile_size) < stats->image_height ? (row_begin + stats->tile_size) : stats->image_height;
+
+    RayStats tile_stats = { 0 };
+    for (size_t pix_y = row_begin; pix_y < row_end; pix_y++)
+    {
+        for (size_t pix_x = column_begin; pix_x < column_end; pix_x++)
+        {
+            AddRayStats(&tile_stats, &stats->pixel_arr[(pix_y * stats->image_width) + pix_x]);
+        }
+    }
+
+    stats->tile_arr[tile_index] = tile_stats;
+}
+
+static void
+AggregateRenderStatsTask(void* context, const size_t task_index, const size_t thread_index)
+{
+    (void)thread_index;
+    AggregateRenderStatsTile(( RenderStats* )context, task_index);
+}
+
+// Recompute every tile from the pixels, one parallel task per tile.
+static void
+AggregateRenderStats(_mut_ RenderStats* restrict const stats, ThreadPool* const pool)
+{
+    __UE_ASSERT__(stats);
+    ParallelFor(pool, stats->tile_count, AggregateRenderStatsTask, stats);
+}
+
+// Totals over the tiles; see: AggregateRenderStats().
+static RayStats
+GetRenderStatsTotal(const RenderStats* restrict const stats)
+{
+    __UE_ASSERT__(stats);
+
+    RayStats total = { 0 };
+    for (size_t tile_index = 0; tile_index < stats->tile_count; tile_index++)
+    {
+        AddRayStats(&total, &stats->tile_arr[tile_index]);
+    }
+
+    return total;
+}
+
+//
+// Heatmaps
+//
+
+// Cold (blue) to hot (red) on a log scale, so that a few very expensive
+// pixels do not wash out the rest of the image.
+__UE_inline__ static Color32_RGB
+GetHeatmapColor(const u32 value, const u32 max_value)
+{
+    Color32_HSV heat = { 0 };
+    heat.H           = 240.0f;
+    heat.S           = 1.0f;
+    heat.V           = 1.0f;
+    if (max_value)
+    {
+        const r32 heat_t = ( r32 )(log1p(( r64 )value) / log1p(( r64 )max_value));
+        heat.H           = 240.0f * (1.0f - (heat_t < 1.0f ? heat_t : 1.0f));
+    }
+
+    Color32_RGB color = { 0 };
+    HSV32ToRGB32(&heat, &color);
+    color.channel.A = 0xFF;
+    return color;
+}
+
+// Write one counter as a heatmap through WriteBitmap32(). With per_tile set,
+// each pixel shows the total of its tile (see: AggregateRenderStats()).
+// Returns false if the image could not be written.
+static bool
+WriteRenderStatsHeatmap(const RenderStats* restrict const stats, const RayStatsCounter counter, const bool per_tile, const char* restrict const image_name)
+{
+    __UE_ASSERT__(stats && image_name);
+
+    const RayStats* source_arr   = per_tile ? stats->tile_arr : stats->pixel_arr;
+    const size_t    source_count = per_tile ? stats->tile_count : (stats->image_width * stats->image_height);
+
+    u32 max_value = 0;
+    for (size_t source_index = 0; source_index < source_count; source_index++)
+    {
+        const u32 value = GetRayStatsCounter(&source_arr[source_index], counter);
+        max_value       = value > max_value ? value : max_value;
+    }
+
+    Color32_RGB* pixel_arr = ( Color32_RGB* )calloc(stats->image_width * stats->image_height, sizeof(Color32_RGB));
+    __UE_ASSERT__(pixel_arr);
+
+    for (size_t pix_y = 0; pix_y < stats->image_height; pix_y++)
+    {
+        for (size_t pix_x = 0; pix_x < stats->image_width; pix_x++)
+        {
+            const size_t source_index = per_tile ? (((pix_y / stats->tile_size) * stats->tiles_x) + (pix_x / stats->tile_size)) : ((pix_y * stats->image_width) + pix_x);
+
+            pixel_arr[(pix_y * stats->image_width) + pix_x] = GetHeatmapColor(GetRayStatsCounter(&source_arr[source_index], counter), max_value);
+        }
+    }
+
+    const bool success = WriteBitmap32(pixel_arr, ( u32 )stats->image_width, ( u32 )stats->image_height, image_name);
+    free(pixel_arr);
+
+    return success;
+}
+
+#endif // __UE_STATS_TOOLS_H___
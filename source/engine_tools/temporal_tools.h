@@ -0,0 +1,376 @@
+#ifndef __UE_TEMPORAL_TOOLS_H___
+#define __UE_TEMPORAL_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <type_tools.h>
+
+#include <float.h>
+#include <stdlib.h>
+
+//
+// Temporal reprojection
+//
+// Each pixel keeps the world space point its primary ray hit, or for misses
+// the point MAX_RAY_MAG along the ray. On the next frame those points are
+// projected through the new camera and splatted into the pixels they land
+// in, nearest point first. Pixels that receive a point reuse its color;
+// pixels that receive none (disocclusions, newly visible screen edges) are
+// traced. A reused point is also rejected when 3 or more of its 4
+// neighbours hold a clearly nearer point, ie: background showing through a
+// gap in a surface that grew closer to the camera.
+//
+// Two points splatted into one pixel leave a hole next to it. A hole between
+// two reused points of the same entity at similar depths, left and right or
+// above and below, is filled with their color and mean position instead of
+// being traced.
+//
+// Reuse is bounded: a pixel reused for __UE_TR__max_age frames in a row is
+// re-traced. Ages of a full trace start staggered so that expiry is spread
+// across frames.
+//
+// Note: shading is view independent (see: TraceEntityArray()), so a point's
+//       color stays valid as long as the scene does not change. Scene changes
+//       must be reported with InvalidateTemporalCache() or
+//       InvalidateTemporalRegion().
+//
+
+#define TEMPORAL_DEPTH_REJECT_FACTOR 0.9f
+
+static_assert(__UE_TR__max_age >= 1 && __UE_TR__max_age <= 0xFFFF, "TemporalCache::max_age is a u16 of at least 1");
+
+typedef enum
+{
+    TEMPORAL_SAMPLE_NONE   = 0,
+    TEMPORAL_SAMPLE_VALID  = 1 << 0,
+    TEMPORAL_SAMPLE_HIT    = 1 << 1,
+    TEMPORAL_SAMPLE_FILLED = 1 << 2 // Interpolated from neighbours this frame
+} TemporalSampleFlags;
+
+typedef struct
+{
+    v3          position;     // World space hit point, or the far point on a miss
+    r32         depth;        // Distance along the view axis of the camera it was splatted with
+    u32         entity_index; // ENTITY_INDEX_NONE on miss
+    Color32_RGB color;
+    u16         age;          // Frames reused since it was traced
+    u8          flags;        // TemporalSampleFlags
+} TemporalSample;
+
+typedef struct
+{
+    size_t rays_traced;
+    size_t reused_pixels;
+    size_t expired_samples;  // Previous samples dropped for reaching max_age
+    size_t rejected_samples; // Splatted samples dropped by the depth test of neighbours
+    size_t filled_pixels;    // Holes interpolated from neighbours, counted in reused_pixels
+} TemporalStats;
+
+typedef struct
+{
+    TemporalSample* sample_arr;      // Previous frame, indexed by pixel
+    TemporalSample* next_sample_arr; // Frame being built
+    bool*           force_trace;     // Pixels invalidated since the previous frame
+
+    Camera camera; // Camera of sample_arr
+    bool   has_history;
+
+    size_t image_width;
+    size_t image_height;
+    u16    max_age; // 0 and 1 both disable reuse
+} TemporalCache;
+
+static TemporalCache*
+CreateTemporalCache(const size_t image_width, const size_t image_height)
+{
+    __UE_ASSERT__(image_width && image_height);
+
+    TemporalCache* cache = ( TemporalCache* )calloc(1, sizeof(TemporalCache));
+    __UE_ASSERT__(cache);
+
+    const size_t pixel_count = image_width * image_height;
+    cache->image_width       = image_width;
+    cache->image_height      = image_height;
+    cache->max_age           = __UE_TR__max_age;
+    cache->sample_arr        = ( TemporalSample* )calloc(pixel_count, sizeof(TemporalSample));
+    cache->next_sample_arr   = ( TemporalSample* )calloc(pixel_count, sizeof(TemporalSample));
+    cache->force_trace       = ( bool* )calloc(pixel_count, sizeof(bool));
+    __UE_ASSERT__(cache->sample_arr && cache->next_sample_arr && cache->force_trace);
+
+    return cache;
+}
+
+static void
+DestroyTemporalCache(_mut_ TemporalCache* restrict const cache)
+{
+    if (!cache)
+    {
+        return;
+    }
+
+    free(cache->sample_arr);
+    free(cache->next_sample_arr);
+    free(cache->force_trace);
+    free(cache);
+}
+
+// The next frame is traced in full.
+__UE_inline__ static void
+InvalidateTemporalCache(_mut_ TemporalCache* restrict const cache)
+{
+    __UE_ASSERT__(cache);
+    cache->has_history = false;
+}
+
+// Pixels in [ x_min, x_max ) x [ y_min, y_max ) are neither reused from nor
+// reused into on the next frame, ie: the screen footprint of a moved entity.
+static void
+InvalidateTemporalRegion(_mut_ TemporalCache* restrict const cache, const size_t x_min, const size_t y_min, const size_t x_max, const size_t y_max)
+{
+    __UE_ASSERT__(cache);
+
+    const size_t x_end = x_max < cache->image_width ? x_max : cache->image_width;
+    const size_t y_end = y_max < cache->image_height ? y_max : cache->image_height;
+    for (size_t pix_y = y_min; pix_y < y_end; pix_y++)
+    {
+        for (size_t pix_x = x_min; pix_x < x_end; pix_x++)
+        {
+            cache->force_trace[(pix_y * cache->image_width) + pix_x] = true;
+        }
+    }
+}
+
+// Continuous image coordinates and view depth of a world space point.
+// Returns false if the point is behind the camera.
+__UE_inline__ static bool
+ProjectPointToCamera(const v3* restrict const point,
+                     const v3* restrict const origin,
+                     const v3* restrict const right,
+                     const v3* restrict const up,
+                     const v3* restrict const forward,
+                     const size_t             image_width,
+                     const size_t             image_height,
+                     _mut_ r32* restrict const sample_x,
+                     _mut_ r32* restrict const sample_y,
+                     _mut_ r32* restrict const depth)
+{
+    v3 to_point = { 0 };
+    v3Sub(point, origin, &to_point);
+
+    *depth = v3Dot(&to_point, forward);
+    if (*depth <= ( r32 )TOLERANCE)
+    {
+        return false;
+    }
+
+    const r32 aspect_ratio = ( r32 )image_width / ( r32 )image_height;
+    *sample_x              = (((v3Dot(&to_point, right) / *depth) / aspect_ratio) + 0.5f) * ( r32 )image_width;
+    *sample_y              = ((v3Dot(&to_point, up) / *depth) + 0.5f) * ( r32 )image_height;
+    return true;
+}
+
+// True for a sample splatted this frame and not invalidated.
+__UE_inline__ static bool
+IsTemporalSampleSplatted(const TemporalCache* restrict const cache, const TemporalSample* restrict const sample, const size_t pixel_index)
+{
+    return ((sample->flags & (TEMPORAL_SAMPLE_VALID | TEMPORAL_SAMPLE_FILLED)) == TEMPORAL_SAMPLE_VALID) && !cache->force_trace[pixel_index];
+}
+
+// Reprojects the previous frame into 'camera', traces the pixels that could
+// not be reused and writes the frame to pixel_array.
+static TemporalStats
+RenderTemporalFrame(_mut_ TemporalCache* restrict const cache,
+                    const Camera* restrict const        camera,
+                    _mut_ Color32_RGB* restrict const   pixel_array,
+                    const Entity* restrict const        entity_arr,
+                    const size_t                        num_entitys)
+{
+    __UE_ASSERT__(cache && camera && pixel_array && entity_arr);
+
+    TemporalStats stats       = { 0 };
+    const size_t  width       = cache->image_width;
+    const size_t  height      = cache->image_height;
+    const size_t  pixel_count = width * height;
+
+    v3 right   = { 0 };
+    v3 up      = { 0 };
+    v3 forward = { 0 };
+    GetCameraBasis(camera, &right, &up, &forward);
+
+    TemporalSample* previous = cache->sample_arr;
+    TemporalSample* next     = cache->next_sample_arr;
+    for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+    {
+        next[pixel_index].flags = TEMPORAL_SAMPLE_NONE;
+        next[pixel_index].depth = FLT_MAX;
+    }
+
+    // Splat
+    for (size_t pixel_index = 0; cache->has_history && pixel_index < pixel_count; pixel_index++)
+    {
+        const TemporalSample* sample = &previous[pixel_index];
+        if (!(sample->flags & TEMPORAL_SAMPLE_VALID) || cache->force_trace[pixel_index])
+        {
+            continue;
+        }
+
+        if ((sample->age + 1) >= cache->max_age)
+        {
+            stats.expired_samples++;
+            continue;
+        }
+
+        r32 sample_x = 0;
+        r32 sample_y = 0;
+        r32 depth    = 0;
+        if (!ProjectPointToCamera(&sample->position, &camera->origin, &right, &up, &forward, width, height, &sample_x, &sample_y, &depth))
+        {
+            continue;
+        }
+
+        if (sample_x < 0.0f || sample_y < 0.0f || sample_x >= ( r32 )width || sample_y >= ( r32 )height)
+        {
+            continue;
+        }
+
+        TemporalSample* target = &next[(( size_t )sample_y * width) + ( size_t )sample_x];
+        if (depth < target->depth)
+        {
+            *target       = *sample;
+            target->depth = depth;
+            target->age   = ( u16 )(sample->age + 1);
+        }
+    }
+
+    // Reject background seen through gaps in a nearer surface. Decisions read
+    // the splatted depths only; rejected pixels are marked in force_trace.
+    for (size_t pix_y = 1; cache->has_history && (pix_y + 1) < height; pix_y++)
+    {
+        for (size_t pix_x = 1; (pix_x + 1) < width; pix_x++)
+        {
+            const size_t pixel_index = (pix_y * width) + pix_x;
+            if (!(next[pixel_index].flags & TEMPORAL_SAMPLE_VALID))
+            {
+                continue;
+            }
+
+            const r32    threshold        = next[pixel_index].depth * TEMPORAL_DEPTH_REJECT_FACTOR;
+            const size_t neighbour_arr[4] = { pixel_index - 1, pixel_index + 1, pixel_index - width, pixel_index + width };
+            u8           nearer_count     = 0;
+            for (u8 neighbour = 0; neighbour < 4; neighbour++)
+            {
+                nearer_count += (next[neighbour_arr[neighbour]].depth < threshold);
+            }
+
+            if (nearer_count >= 3)
+            {
+                cache->force_trace[pixel_index] = true;
+                stats.rejected_samples++;
+            }
+        }
+    }
+
+    // Fill holes left by splat collisions. Decisions read splatted samples
+    // only, never samples filled earlier in this loop.
+    for (size_t pix_y = 1; cache->has_history && (pix_y + 1) < height; pix_y++)
+    {
+        for (size_t pix_x = 1; (pix_x + 1) < width; pix_x++)
+        {
+            const size_t pixel_index = (pix_y * width) + pix_x;
+            if ((next[pixel_index].flags & TEMPORAL_SAMPLE_VALID) || cache->force_trace[pixel_index])
+            {
+                continue;
+            }
+
+            // Horizontal pair first, then vertical
+            const size_t pair_arr[2][2] = { { pixel_index - 1, pixel_index + 1 }, { pixel_index - width, pixel_index + width } };
+            for (u8 pair = 0; pair < 2; pair++)
+            {
+                const TemporalSample* a = &next[pair_arr[pair][0]];
+                const TemporalSample* b = &next[pair_arr[pair][1]];
+                if (!IsTemporalSampleSplatted(cache, a, pair_arr[pair][0]) || !IsTemporalSampleSplatted(cache, b, pair_arr[pair][1]))
+                {
+                    continue;
+                }
+
+                const r32 min_depth = a->depth < b->depth ? a->depth : b->depth;
+                const r32 max_depth = a->depth < b->depth ? b->depth : a->depth;
+                if (a->entity_index != b->entity_index || min_depth < (max_depth * TEMPORAL_DEPTH_REJECT_FACTOR))
+                {
+                    continue;
+                }
+
+                TemporalSample* hole = &next[pixel_index];
+                *hole                = *a;
+                hole->flags |= TEMPORAL_SAMPLE_FILLED;
+                hole->depth = 0.5f * (a->depth + b->depth);
+                hole->age   = a->age > b->age ? a->age : b->age;
+                v3Set(&hole->position, 0.5f * (a->position.x + b->position.x), 0.5f * (a->position.y + b->position.y), 0.5f * (a->position.z + b->position.z));
+                stats.filled_pixels++;
+                break;
+            }
+        }
+    }
+
+    // Trace what could not be reused
+    for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+    {
+        TemporalSample* sample = &next[pixel_index];
+        if ((sample->flags & TEMPORAL_SAMPLE_VALID) && !cache->force_trace[pixel_index])
+        {
+            pixel_array[pixel_index] = sample->color;
+            stats.reused_pixels++;
+            continue;
+        }
+
+        const size_t pix_x = pixel_index % width;
+        const size_t pix_y = pixel_index / width;
+
+        Ray ray = { 0 };
+        SetRayByCameraSample(&ray, camera, ( r32 )pix_x + 0.5f, ( r32 )pix_y + 0.5f, width, height);
+
+        RayIntersection intersection        = { 0 };
+        Color32_RGB     color               = { 0 };
+        r32             magnitude_threshold = ( r32 )MAX_RAY_MAG;
+        TraceEntityArray(&ray, &intersection, &magnitude_threshold, &color, entity_arr, num_entitys);
+        color.channel.A = 0xFF;
+        stats.rays_traced++;
+
+        sample->color        = color;
+        sample->entity_index = intersection.entity_index;
+        sample->flags        = TEMPORAL_SAMPLE_VALID | (intersection.does_intersect ? TEMPORAL_SAMPLE_HIT : 0);
+        if (intersection.does_intersect)
+        {
+            sample->position = intersection.position;
+        }
+        else
+        {
+            v3 far_offset = { 0 };
+            v3ScalarMul(&ray.direction, ( r32 )MAX_RAY_MAG, &far_offset);
+            v3Add(&ray.origin, &far_offset, &sample->position);
+        }
+
+        // Ages of a full trace are staggered so that its pixels do not all
+        // expire on the same frame
+        const bool is_staggered  = !cache->has_history && cache->max_age;
+        sample->age              = is_staggered ? ( u16 )(((( u32 )pixel_index * 0x9E3779B1u) >> 16) % cache->max_age) : 0;
+        pixel_array[pixel_index] = color;
+    }
+
+    for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+    {
+        cache->force_trace[pixel_index] = false;
+    }
+
+    cache->sample_arr      = next;
+    cache->next_sample_arr = previous;
+    cache->camera          = *camera;
+    cache->has_history     = true;
+
+    return stats;
+}
+
+#endif // __UE_TEMPORAL_TOOLS_H___
@@ -0,0 +1,194 @@
+#ifndef __UE_THREAD_TOOLS_H___
+#define __UE_THREAD_TOOLS_H___
+
+#include "debug_tools.h"
+#include "macro_tools.h"
+#include "type_tools.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+//
+// Thread pool
+//
+// A fixed set of worker threads that execute ParallelFor() batches. The
+// calling thread participates in every batch, so a pool of N workers runs
+// batches N + 1 wide. Tasks are claimed dynamically from a shared counter;
+// thread_index is 0 for the calling thread and [ 1, N ] for workers, and may
+// be used to address per-thread scratch memory without synchronization.
+//
+// Note: a NULL pool is valid everywhere and runs batches serially on the
+//       calling thread.
+//
+
+typedef void (*ParallelTaskFunction)(void* context, size_t task_index, size_t thread_index);
+
+typedef struct
+{
+    std::thread*            threads;
+    size_t                  worker_count;
+    std::mutex              mutex;
+    std::condition_variable wake_workers;
+    std::condition_variable batch_complete;
+
+    ParallelTaskFunction  task_function;
+    void*                 task_context;
+    size_t                task_count;
+    std::atomic< size_t > next_task;
+
+    size_t busy_workers; // Guarded by mutex
+    u64    generation;   // Guarded by mutex
+    bool   shutdown;     // Guarded by mutex
+} ThreadPool;
+
+__UE_inline__ static size_t
+GetHardwareThreadCount()
+{
+    const size_t hardware_threads = ( size_t )std::thread::hardware_concurrency();
+    return hardware_threads ? hardware_threads : 1;
+}
+
+__UE_inline__ static size_t
+GetThreadPoolWidth(const ThreadPool* const pool)
+{
+    return pool ? (pool->worker_count + 1) : 1;
+}
+
+static void
+RunThreadPoolTasks(ThreadPool* const pool, const size_t thread_index)
+{
+    while (true)
+    {
+        const size_t task_index = pool->next_task.fetch_add(1, std::memory_order_relaxed);
+        if (task_index >= pool->task_count)
+        {
+            return;
+        }
+
+        pool->task_function(pool->task_context, task_index, thread_index);
+    }
+}
+
+static void
+ThreadPoolWorker(ThreadPool* const pool, const size_t thread_index)
+{
+    u64 seen_generation = 0;
+    while (true)
+    {
+        {
+            std::unique_lock< std::mutex > lock(pool->mutex);
+            while (!pool->shutdown && pool->generation == seen_generation)
+            {
+                pool->wake_workers.wait(lock);
+            }
+
+            if (pool->shutdown)
+            {
+                return;
+            }
+
+            seen_generation = pool->generation;
+        }
+
+        RunThreadPoolTasks(pool, thread_index);
+
+        {
+            std::unique_lock< std::mutex > lock(pool->mutex);
+            if (--pool->busy_workers == 0)
+            {
+                pool->batch_complete.notify_one();
+            }
+        }
+    }
+}
+
+// worker_count == 0 creates one worker per hardware thread, less the caller.
+static ThreadPool*
+CreateThreadPool(size_t worker_count)
+{
+    if (!worker_count)
+    {
+        worker_count = GetHardwareThreadCount() - 1;
+    }
+
+    ThreadPool* pool   = new ThreadPool();
+    pool->worker_count = worker_count;
+    pool->threads      = new std::thread[worker_count ? worker_count : 1];
+    pool->next_task.store(0);
+
+    for (size_t worker_index = 0; worker_index < worker_count; worker_index++)
+    {
+        pool->threads[worker_index] = std::thread(ThreadPoolWorker, pool, worker_index + 1);
+    }
+
+    return pool;
+}
+
+static void
+DestroyThreadPool(ThreadPool* const pool)
+{
+    if (!pool)
+    {
+        return;
+    }
+
+    {
+        std::unique_lock< std::mutex > lock(pool->mutex);
+        pool->shutdown = true;
+    }
+    pool->wake_workers.notify_all();
+
+    for (size_t worker_index = 0; worker_index < pool->worker_count; worker_index++)
+    {
+        pool->threads[worker_index].join();
+    }
+
+    delete[] pool->threads;
+    delete pool;
+}
+
+// Run task_function(context, [ 0, task_count ), thread_index) and block until
+// every task has completed.
+static void
+ParallelFor(ThreadPool* const pool, const size_t task_count, const ParallelTaskFunction task_function, void* const context)
+{
+    uAssertMsg_v(task_function, "[ thread ] Task function must be non null.\n");
+
+    if (!task_count)
+    {
+        return;
+    }
+
+    if (!pool || !pool->worker_count || task_count == 1)
+    {
+        for (size_t task_index = 0; task_index < task_count; task_index++)
+        {
+            task_function(context, task_index, 0);
+        }
+
+        return;
+    }
+
+    {
+        std::unique_lock< std::mutex > lock(pool->mutex);
+        pool->task_function = task_function;
+        pool->task_context  = context;
+        pool->task_count    = task_count;
+        pool->busy_workers  = pool->worker_count;
+        pool->next_task.store(0, std::memory_order_relaxed);
+        pool->generation++;
+    }
+    pool->wake_workers.notify_all();
+
+    RunThreadPoolTasks(pool, 0);
+
+    std::unique_lock< std::mutex > lock(pool->mutex);
+    while (pool->busy_workers)
+    {
+        pool->batch_complete.wait(lock);
+    }
+}
+
+#endif // __UE_THREAD_TOOLS_H___
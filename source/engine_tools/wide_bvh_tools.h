@@ -0,0 +1,467 @@
+#ifndef __UE_WIDE_BVH_TOOLS_H___
+#define __UE_WIDE_BVH_TOOLS_H___
+
+#include <rt_settings.h>
+
+#include <bvh_tools.h>
+#include <entity_tools.h>
+#include <macro_tools.h>
+#include <maths_tools.h>
+#include <type_tools.h>
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if __UE_SIMD__sse
+#include <emmintrin.h>
+#endif // __UE_SIMD__sse
+
+//
+// Compressed wide BVH
+//
+// A read-only, 8-wide BVH with 80 byte nodes. A node stores its own bounds
+// as an origin and a power-of-two step per axis; the bounds of its eight
+// children are stored as 8-bit multiples of that step, rounded outward so
+// they stay conservative:
+//
+//   child_min = origin + quantized_min * 2^exponent
+//   child_max = origin + quantized_max * 2^exponent
+//
+// All children of a node are tested against a ray together; with
+// __UE_SIMD__sse as two 4-lane slab tests. Inner children of a node are
+// contiguous, as are the primitive indices of its leaf children, so a node
+// needs only two base indices and a byte per child.
+//
+// The tree is collapsed from a binary BVH (see: CreateEntityBVH()): each
+// wide node repeatedly opens its largest child until it has eight, and
+// subtrees of at most __UE_BVH__wide_leaf_size primitives become a single
+// leaf. Without the latter, dense scenes end up with many wide nodes holding
+// two binary leaves each.
+//
+// Note: the tree is not refit; rebuild it from the binary BVH after
+//       UpdateBVH().
+//
+
+#define WIDE_BVH_WIDTH 8
+
+// Each wide level consumes at least one binary level, so no wide leaf is
+// deeper than a binary one (see: BVH_STACK_SIZE). A visited node pops one
+// entry and pushes at most WIDE_BVH_WIDTH, leaving at most
+// WIDE_BVH_WIDTH - 1 entries per level on the traversal stack.
+#define WIDE_BVH_STACK_SIZE (BVH_STACK_SIZE * (WIDE_BVH_WIDTH - 1))
+
+// Inner children are stored in child order from child_base, and leaf
+// primitives in child order from primitive_base; a child's node or first
+// primitive is found by counting the children before it.
+typedef struct
+{
+    v3  origin;                           // Minimum corner of the node's bounds
+    s8  exponent[3];                      // Quantization step per axis is 2^exponent
+    u8  child_count;                      // Valid children, in [ 1, WIDE_BVH_WIDTH ]
+    u32 child_base;                       // First inner child node; inner children are contiguous
+    u32 primitive_base;                   // First WideBVH::indices entry of the leaf children
+    u8  leaf_count[WIDE_BVH_WIDTH];       // Primitives of a leaf child; 0 for inner children
+    u8  quantized_min[3][WIDE_BVH_WIDTH]; // [ axis ][ child ]
+    u8  quantized_max[3][WIDE_BVH_WIDTH]; // [ axis ][ child ]
+} WideBVHNode;
+
+typedef struct
+{
+    WideBVHNode* nodes;
+    u32*         indices;
+    size_t       node_count;
+    size_t       primitive_count;
+} WideBVH;
+
+//
+// Build
+//
+__UE_inline__ static r32
+GetWideBVHStep(const s8 exponent)
+{
+    return ldexpf(1.0f, exponent);
+}
+
+// Smallest exponent whose 255 steps cover [ origin, max ].
+__UE_inline__ static s8
+GetWideBVHExponent(const r32 origin, const r32 max)
+{
+    const r32 extent = max - origin;
+    if (extent <= 0.0f)
+    {
+        return -126;
+    }
+
+    s32 exponent = ( s32 )ceilf(log2f(extent / 255.0f));
+    exponent     = exponent < -126 ? -126 : exponent;
+    while (exponent < 127 && (origin + (255.0f * GetWideBVHStep(( s8 )exponent))) < max)
+    {
+        exponent++;
+    }
+
+    return ( s8 )exponent;
+}
+
+static void
+QuantizeWideBVHChild(_mut_ WideBVHNode* restrict const node, const u8 child_index, const AABB* restrict const child_bounds)
+{
+    for (u8 axis = 0; axis < 3; axis++)
+    {
+        const r32 origin = node->origin.arr[axis];
+        const r32 step   = GetWideBVHStep(node->exponent[axis]);
+
+        r32 low  = floorf((child_bounds->min.arr[axis] - origin) / step);
+        r32 high = ceilf((child_bounds->max.arr[axis] - origin) / step);
+        low      = low < 0.0f ? 0.0f : (low > 255.0f ? 255.0f : low);
+        high     = high < 0.0f ? 0.0f : (high > 255.0f ? 255.0f : high);
+
+        // Division and rounding may land a step inside the true bounds
+        while (low > 0.0f && (origin + (low * step)) > child_bounds->min.arr[axis])
+        {
+            low -= 1.0f;
+        }
+        while (high < 255.0f && (origin + (high * step)) < child_bounds->max.arr[axis])
+        {
+            high += 1.0f;
+        }
+
+        node->quantized_min[axis][child_index] = ( u8 )low;
+        node->quantized_max[axis][child_index] = ( u8 )high;
+    }
+}
+
+// Collapses 'bvh' into a new wide BVH. 'bvh' is not referenced afterwards.
+static WideBVH*
+CreateWideBVH(const BVH* restrict const bvh)
+{
+    __UE_ASSERT__(bvh && bvh->primitive_count);
+    __UE_ASSERT__(bvh->max_leaf_size <= __UE_BVH__wide_leaf_size && __UE_BVH__wide_leaf_size <= 255);
+
+    WideBVH* wide = ( WideBVH* )calloc(1, sizeof(WideBVH));
+    __UE_ASSERT__(wide);
+
+    // Every wide node but a leaf root replaces at least one binary inner node
+    const size_t node_capacity = bvh->primitive_count;
+    wide->nodes                = ( WideBVHNode* )calloc(node_capacity, sizeof(WideBVHNode));
+    wide->indices              = ( u32* )calloc(bvh->primitive_count, sizeof(u32));
+    wide->primitive_count      = bvh->primitive_count;
+    __UE_ASSERT__(wide->nodes && wide->indices);
+
+    // The binary node each wide node was made from; wide nodes are created,
+    // and so processed, breadth first
+    u32* source_arr = ( u32* )calloc(node_capacity, sizeof(u32));
+    __UE_ASSERT__(source_arr);
+
+    size_t index_count = 0;
+    wide->node_count   = 1;
+    source_arr[0]      = 0;
+    for (size_t node_index = 0; node_index < wide->node_count; node_index++)
+    {
+        WideBVHNode* node = &wide->nodes[node_index];
+
+        // Open the largest inner child until the node is full
+        u32 child_arr[WIDE_BVH_WIDTH] = { 0 };
+        u8  child_count               = 0;
+        const BVHNode* source         = &bvh->nodes[source_arr[node_index]];
+        if (source->left_count)
+        {
+            child_arr[child_count++] = source_arr[node_index] + 1;
+            child_arr[child_count++] = source_arr[node_index] + (2 * source->left_count);
+        }
+        else
+        {
+            child_arr[child_count++] = source_arr[node_index];
+        }
+
+        while (child_count < WIDE_BVH_WIDTH)
+        {
+            s32 open_index = -1;
+            r32 open_area  = -1.0f;
+            for (u8 child_index = 0; child_index < child_count; child_index++)
+            {
+                const BVHNode* child = &bvh->nodes[child_arr[child_index]];
+                AABB           child_bounds;
+                GetBVHNodeBounds(child, &child_bounds);
+                if (child->index_count > __UE_BVH__wide_leaf_size && AABBSurfaceArea(&child_bounds) > open_area)
+                {
+                    open_index = child_index;
+                    open_area  = AABBSurfaceArea(&child_bounds);
+                }
+            }
+
+            if (open_index < 0)
+            {
+                break;
+            }
+
+            const u32 opened         = child_arr[open_index];
+            child_arr[open_index]    = opened + 1;
+            child_arr[child_count++] = opened + (2 * bvh->nodes[opened].left_count);
+        }
+
+        AABB node_bounds;
+        GetBVHNodeBounds(source, &node_bounds);
+        node->origin      = node_bounds.min;
+        node->child_count = child_count;
+        for (u8 axis = 0; axis < 3; axis++)
+        {
+            node->exponent[axis] = GetWideBVHExponent(node_bounds.min.arr[axis], node_bounds.max.arr[axis]);
+        }
+
+        node->child_base     = ( u32 )wide->node_count;
+        node->primitive_base = ( u32 )index_count;
+        for (u8 child_index = 0; child_index < child_count; child_index++)
+        {
+            const BVHNode* child = &bvh->nodes[child_arr[child_index]];
+            AABB           child_bounds;
+            GetBVHNodeBounds(child, &child_bounds);
+            QuantizeWideBVHChild(node, child_index, &child_bounds);
+
+            // Subtrees small enough are flattened into one leaf; a subtree's
+            // primitives are contiguous in bvh->indices
+            if (child->index_count > __UE_BVH__wide_leaf_size)
+            {
+                __UE_ASSERT__(wide->node_count < node_capacity);
+                node->leaf_count[child_index]  = 0;
+                source_arr[wide->node_count++] = child_arr[child_index];
+                continue;
+            }
+
+            node->leaf_count[child_index] = ( u8 )child->index_count;
+            memcpy(&wide->indices[index_count], &bvh->indices[child->first_index], child->index_count * sizeof(u32));
+            index_count += child->index_count;
+        }
+    }
+
+    __UE_ASSERT__(index_count == bvh->primitive_count);
+    free(source_arr);
+    return wide;
+}
+
+static void
+DestroyWideBVH(_mut_ WideBVH* restrict const wide)
+{
+    if (!wide)
+    {
+        return;
+    }
+
+    free(wide->nodes);
+    free(wide->indices);
+    free(wide);
+}
+
+static WideBVH*
+CreateEntityWideBVH(const Entity* restrict const entity_arr, const size_t num_entitys, ThreadPool* const pool)
+{
+    BVH*     bvh  = CreateEntityBVH(entity_arr, num_entitys, pool);
+    WideBVH* wide = CreateWideBVH(bvh);
+    DestroyBVH(bvh);
+    return wide;
+}
+
+//
+// Traversal
+//
+
+// Entry magnitudes of the ray into the children of 'node', FLT_MAX for
+// children missed within [ 0, max_magnitude ]. Entries past child_count are
+// unspecified.
+__UE_inline__ static void
+IntersectWideBVHChildren(const WideBVHNode* restrict const node,
+                         const v3* restrict const          origin,
+                         const v3* restrict const          inverse_direction,
+                         const r32                         max_magnitude,
+                         _mut_ r32* restrict const         entry_arr)
+{
+    __UE_STAT__(box_tests, node->child_count);
+
+#if __UE_SIMD__sse
+    // t = (node_origin + q * step - origin) / direction = q * scale + offset
+    const __m128i zero = _mm_setzero_si128();
+    __m128        scale[3];
+    __m128        offset[3];
+    for (u8 axis = 0; axis < 3; axis++)
+    {
+        const r32 inverse = inverse_direction->arr[axis];
+        scale[axis]       = _mm_set1_ps(GetWideBVHStep(node->exponent[axis]) * inverse);
+        offset[axis]      = _mm_set1_ps((node->origin.arr[axis] - origin->arr[axis]) * inverse);
+    }
+
+    for (u8 lane_base = 0; lane_base < node->child_count; lane_base += 4)
+    {
+        __m128 t_near = _mm_setzero_ps();
+        __m128 t_far  = _mm_set1_ps(max_magnitude);
+        for (u8 axis = 0; axis < 3; axis++)
+        {
+            s32 packed_min = 0;
+            s32 packed_max = 0;
+            memcpy(&packed_min, &node->quantized_min[axis][lane_base], sizeof(s32));
+            memcpy(&packed_max, &node->quantized_max[axis][lane_base], sizeof(s32));
+            const __m128 low  = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed_min), zero), zero));
+            const __m128 high = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed_max), zero), zero));
+
+            const __m128 t0 = _mm_add_ps(_mm_mul_ps(low, scale[axis]), offset[axis]);
+            const __m128 t1 = _mm_add_ps(_mm_mul_ps(high, scale[axis]), offset[axis]);
+            t_near          = _mm_max_ps(t_near, _mm_min_ps(t0, t1));
+            t_far           = _mm_min_ps(t_far, _mm_max_ps(t0, t1));
+        }
+
+        const __m128 is_valid = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_set_epi32(lane_base + 3, lane_base + 2, lane_base + 1, lane_base), _mm_set1_epi32(node->child_count)));
+        const __m128 is_hit   = _mm_and_ps(_mm_cmple_ps(t_near, t_far), is_valid);
+        _mm_storeu_ps(&entry_arr[lane_base], _mm_or_ps(_mm_and_ps(is_hit, t_near), _mm_andnot_ps(is_hit, _mm_set1_ps(FLT_MAX))));
+    }
+#else
+    for (u8 child_index = 0; child_index < node->child_count; child_index++)
+    {
+        r32 t_near = 0.0f;
+        r32 t_far  = max_magnitude;
+        for (u8 axis = 0; axis < 3; axis++)
+        {
+            const r32 inverse = inverse_direction->arr[axis];
+            const r32 scale   = GetWideBVHStep(node->exponent[axis]) * inverse;
+            const r32 offset  = (node->origin.arr[axis] - origin->arr[axis]) * inverse;
+            const r32 t0      = (( r32 )node->quantized_min[axis][child_index] * scale) + offset;
+            const r32 t1      = (( r32 )node->quantized_max[axis][child_index] * scale) + offset;
+            t_near            = t0 < t1 ? (t0 > t_near ? t0 : t_near) : (t1 > t_near ? t1 : t_near);
+            t_far             = t0 < t1 ? (t1 < t_far ? t1 : t_far) : (t0 < t_far ? t0 : t_far);
+        }
+
+        entry_arr[child_index] = t_near <= t_far ? t_near : FLT_MAX;
+    }
+#endif // __UE_SIMD__sse
+}
+
+// Closest hit among the entities of a wide BVH within [ 0, max_magnitude );
+// the counterpart of IntersectEntityBVH(). Returns false, leaving
+// 'closest_intersection' and 'closest_entity_index' untouched, if nothing is
+// hit.
+static bool
+IntersectEntityWideBVH(const Ray* restrict const ray,
+                       const WideBVH* restrict const         wide,
+                       const Entity* restrict const          entity_arr,
+                       const r32                             max_magnitude,
+                       _mut_ RayIntersection* restrict const closest_intersection,
+                       _mut_ u32* restrict const             closest_entity_index)
+{
+    __UE_ASSERT__(ray && wide && entity_arr);
+    __UE_ASSERT__(closest_intersection && closest_entity_index);
+    __UE_STAT__(rays, 1);
+
+    v3 inverse_direction = { 0 };
+    GetInverseDirection(&ray->direction, &inverse_direction);
+
+    r32  closest_magnitude = max_magnitude;
+    bool does_intersect    = false;
+
+    u32 stack[WIDE_BVH_STACK_SIZE];
+    r32 stack_near[WIDE_BVH_STACK_SIZE];
+    u32 stack_size         = 0;
+    stack[stack_size]      = 0;
+    stack_near[stack_size] = 0.0f;
+    stack_size++;
+
+    while (stack_size)
+    {
+        stack_size--;
+        if (stack_near[stack_size] >= closest_magnitude)
+        {
+            continue;
+        }
+
+        const WideBVHNode* node = &wide->nodes[stack[stack_size]];
+        r32                entry_arr[WIDE_BVH_WIDTH];
+        IntersectWideBVHChildren(node, &ray->origin, &inverse_direction, closest_magnitude, entry_arr);
+
+        // Leaves are tested on the spot; inner children are pushed far to
+        // near so that the nearest is visited next
+        u32 push_arr[WIDE_BVH_WIDTH];
+        r32 push_near[WIDE_BVH_WIDTH];
+        u8  push_count  = 0;
+        u32 inner_index = node->child_base;
+        u32 first_index = node->primitive_base;
+        for (u8 child_index = 0; child_index < node->child_count; child_index++)
+        {
+            const u32 leaf_count = node->leaf_count[child_index];
+            if (entry_arr[child_index] >= closest_magnitude)
+            {
+                inner_index += (leaf_count == 0);
+                first_index += leaf_count;
+                continue;
+            }
+
+            if (!leaf_count)
+            {
+                u8 insert_index = push_count++;
+                for (; insert_index && push_near[insert_index - 1] < entry_arr[child_index]; insert_index--)
+                {
+                    push_arr[insert_index]  = push_arr[insert_index - 1];
+                    push_near[insert_index] = push_near[insert_index - 1];
+                }
+                push_arr[insert_index]  = inner_index++;
+                push_near[insert_index] = entry_arr[child_index];
+                continue;
+            }
+
+            for (u32 index = first_index; index < (first_index + leaf_count); index++)
+            {
+                const u32 entity_index = wide->indices[index];
+
+                RayIntersection candidate = { 0 };
+                IntersectEntity(ray, &entity_arr[entity_index], &candidate);
+                if (candidate.does_intersect && candidate.magnitude >= 0.0f && candidate.magnitude < closest_magnitude)
+                {
+                    *closest_intersection = candidate;
+                    *closest_entity_index = entity_index;
+                    closest_magnitude     = candidate.magnitude;
+                    does_intersect        = true;
+                }
+            }
+            first_index += leaf_count;
+        }
+
+        __UE_ASSERT__((stack_size + push_count) <= (sizeof(stack) / sizeof(stack[0])));
+        for (u8 push_index = 0; push_index < push_count; push_index++)
+        {
+            stack[stack_size]      = push_arr[push_index];
+            stack_near[stack_size] = push_near[push_index];
+            stack_size++;
+        }
+    }
+
+    return does_intersect;
+}
+
+// Closest-hit query; the wide BVH counterpart of TraceEntityBVH().
+__UE_inline__ static void
+TraceEntityWideBVH(const Ray* restrict const ray,
+                   _mut_ RayIntersection* restrict const intersection,
+                   _mut_ r32* restrict const global_magnitude_threshold,
+                   _mut_ Color32_RGB* restrict const return_color,
+                   const WideBVH* restrict const     wide,
+                   const Entity* restrict const      entity_arr)
+{
+    __UE_ASSERT__(ray);
+    __UE_ASSERT__(intersection);
+    __UE_ASSERT__(global_magnitude_threshold);
+    __UE_ASSERT__(return_color);
+    __UE_ASSERT__(wide && entity_arr);
+
+    const r32 max_magnitude = ( r32 )fmin(MAX_RAY_MAG, fabs(*global_magnitude_threshold));
+
+    RayIntersection closest_intersection = { 0 };
+    u32             closest_entity_index = ENTITY_INDEX_NONE;
+    const bool      does_intersect       = IntersectEntityWideBVH(ray, wide, entity_arr, max_magnitude, &closest_intersection, &closest_entity_index);
+
+    *intersection                = closest_intersection;
+    intersection->does_intersect = does_intersect;
+    intersection->entity_index   = closest_entity_index;
+    if (does_intersect)
+    {
+        return_color->value = entity_arr[closest_entity_index].material.color.value;
+    }
+}
+
+#endif // __UE_WIDE_BVH_TOOLS_H___
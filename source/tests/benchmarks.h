@@ -0,0 +1,411 @@
+#ifndef __UE_BENCHMARKS_H__
+#define __UE_BENCHMARKS_H__
+
+// Benchmarks are opt-in; build with __UE_benchmarks__ == 1 to run them on
+// startup, after the tests.
+#if __UE_benchmarks__ == 1
+#define __uBENCHMARKS_ENABLED__ 1
+#endif // __UE_benchmarks__ == 1
+
+#if __uBENCHMARKS_ENABLED__
+#include <rt_settings.h>
+
+#include <bvh_tools.h>
+#include <clock_tools.h>
+#include <entity_tools.h>
+#include <hash_grid_tools.h>
+#include <maths_tools.h>
+#include <ray_sort_tools.h>
+#include <thread_tools.h>
+#include <type_tools.h>
+#include <wide_bvh_tools.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef __UE_BENCH__entity_count
+#define __UE_BENCH__entity_count 100000
+#endif // __UE_BENCH__entity_count
+
+#ifndef __UE_BENCH__ray_count
+#define __UE_BENCH__ray_count (1 << 18)
+#endif // __UE_BENCH__ray_count
+
+#ifndef __UE_BENCH__repetitions
+#define __UE_BENCH__repetitions 3
+#endif // __UE_BENCH__repetitions
+
+// Field of small spheres in [ -1, 1 ] x [ -1, 1 ] x [ -3, -1 ]; the caller
+// seeds XorShift32State.
+static Entity*
+CreateBenchmarkSpheres(const size_t num_entitys)
+{
+    Entity* entity_arr = CreateEntities(num_entitys);
+    for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
+    {
+        Entity* entity = &entity_arr[entity_index];
+        entity->type   = ET_SPHERE;
+        entity->radius = 0.002f + (0.008f * NormalBoundedXorShift32());
+        v3Set(&entity->position, (2.0f * NormalBoundedXorShift32()) - 1.0f, (2.0f * NormalBoundedXorShift32()) - 1.0f, -1.0f - (2.0f * NormalBoundedXorShift32()));
+    }
+
+    return entity_arr;
+}
+
+// Random unit vector in the hemisphere around 'normal'
+static void
+GetBenchmarkBounceDirection(const v3* restrict const normal, _mut_ v3* restrict const direction)
+{
+    do
+    {
+        v3Set(direction, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f);
+    } while (v3Dot(direction, direction) < 0.01f);
+
+    v3Norm(direction);
+    if (v3Dot(direction, normal) < 0.0f)
+    {
+        v3Set(direction, -direction->x, -direction->y, -direction->z);
+    }
+}
+
+// Secondary-ray throughput with and without SortRayBatch(). Primary rays from
+// the origin are fanned over a field of small spheres; every hit spawns one
+// bounce ray in a random direction. The sorted figure includes the sort.
+void
+runRaySortBenchmark()
+{
+    puts("\tRunning ray sort benchmark...");
+
+    const u32 PrevXorState = XorShift32State;
+    XorShift32State        = 0x5EED;
+
+    const size_t num_entitys = __UE_BENCH__entity_count;
+    Entity*      entity_arr  = CreateBenchmarkSpheres(num_entitys);
+
+    BVH* bvh = CreateEntityBVH(entity_arr, num_entitys, NULL);
+
+    AABB origin_bounds = { 0 };
+    origin_bounds.min  = bvh->nodes[0].min;
+    origin_bounds.max  = bvh->nodes[0].max;
+
+    // One bounce worth of rays, pushed in primary (pixel) order
+    RayBatch*        batch            = CreateRayBatch(__UE_BENCH__ray_count);
+    RayIntersection* intersection_arr = ( RayIntersection* )calloc(__UE_BENCH__ray_count, sizeof(RayIntersection));
+    RayIntersection* reference_arr    = ( RayIntersection* )calloc(__UE_BENCH__ray_count, sizeof(RayIntersection));
+    __UE_ASSERT__(intersection_arr && reference_arr);
+
+    const size_t grid_width = 1024;
+    for (size_t primary_index = 0; batch->ray_count < batch->ray_capacity; primary_index++)
+    {
+        const size_t pix_x   = primary_index % grid_width;
+        const size_t pix_y   = (primary_index / grid_width) % grid_width;
+        Ray          primary = { 0 };
+        v3SetAndNorm(&primary.direction, (( r32 )pix_x / ( r32 )grid_width) - 0.5f, (( r32 )pix_y / ( r32 )grid_width) - 0.5f, -1.0f);
+
+        RayIntersection primary_intersection = { 0 };
+        u32             entity_index         = ENTITY_INDEX_NONE;
+        if (!IntersectEntityBVH(&primary, bvh, entity_arr, ( r32 )MAX_RAY_MAG, &primary_intersection, &entity_index))
+        {
+            continue;
+        }
+
+        // Sphere normals point inward, see: IntersectEntity()
+        v3  outward_normal = { 0 };
+        v3  offset         = { 0 };
+        Ray bounce         = { 0 };
+        v3ScalarMul(&primary_intersection.normal_vector, -1.0f, &outward_normal);
+        v3ScalarMul(&outward_normal, ( r32 )TOLERANCE, &offset);
+        v3Add(&primary_intersection.position, &offset, &bounce.origin);
+        GetBenchmarkBounceDirection(&outward_normal, &bounce.direction);
+        PushRay(batch, &bounce);
+    }
+
+    r64 unsorted_seconds = 0;
+    r64 sorted_seconds   = 0;
+    r64 sort_seconds     = 0;
+    for (u32 repetition = 0; repetition < __UE_BENCH__repetitions; repetition++)
+    {
+        for (size_t ray_index = 0; ray_index < batch->ray_count; ray_index++)
+        {
+            batch->order_arr[ray_index] = ( u32 )ray_index;
+        }
+
+        r64 start = GetClockSeconds();
+        TraceRayBatchBVH(batch, bvh, entity_arr, ( r32 )MAX_RAY_MAG, reference_arr);
+        unsorted_seconds += GetClockSeconds() - start;
+
+        start = GetClockSeconds();
+        SortRayBatch(batch, &origin_bounds);
+        const r64 sorted = GetClockSeconds();
+        TraceRayBatchBVH(batch, bvh, entity_arr, ( r32 )MAX_RAY_MAG, intersection_arr);
+        sort_seconds += sorted - start;
+        sorted_seconds += GetClockSeconds() - start;
+    }
+
+    // Same rays, same results; only the order of traversal differs
+    for (size_t ray_index = 0; ray_index < batch->ray_count; ray_index++)
+    {
+        __UE_ASSERT__(intersection_arr[ray_index].does_intersect == reference_arr[ray_index].does_intersect);
+        __UE_ASSERT__(intersection_arr[ray_index].entity_index == reference_arr[ray_index].entity_index);
+    }
+
+    const r64 ray_total = ( r64 )batch->ray_count * __UE_BENCH__repetitions;
+    printf("\t\t%zu entities, %zu bounce rays\n", num_entitys, batch->ray_count);
+    printf("\t\tunsorted: %.2f Mrays/s\n", ray_total / unsorted_seconds * 1e-6);
+    printf("\t\tsorted:   %.2f Mrays/s (sort %.1f%% of sorted time)\n", ray_total / sorted_seconds * 1e-6, 100.0 * sort_seconds / sorted_seconds);
+    fflush(stdout);
+
+    free(reference_arr);
+    free(intersection_arr);
+    DestroyRayBatch(batch);
+    DestroyBVH(bvh);
+    free(entity_arr);
+
+    // Reset XorShift32State
+    XorShift32State = PrevXorState;
+}
+
+// Per-frame UpdateEntityBVH() cost for small motion: every entity moves by up
+// to 0.001 per axis per frame, a tenth of the largest radius. Timed serially
+// and on a pool as wide as the machine.
+void
+runBVHUpdateBenchmark()
+{
+    puts("\tRunning BVH update benchmark...");
+
+    const u32 PrevXorState = XorShift32State;
+    XorShift32State        = 0x5EED;
+
+    const size_t num_entitys = __UE_BENCH__entity_count;
+    const u32    frame_count = 16 * __UE_BENCH__repetitions;
+    Entity*      entity_arr  = CreateBenchmarkSpheres(num_entitys);
+    ThreadPool*  pool        = CreateThreadPool(GetHardwareThreadCount() - 1);
+
+    for (u32 pass = 0; pass < 2; pass++)
+    {
+        ThreadPool* pass_pool = pass ? pool : NULL;
+
+        r64 start = GetClockSeconds();
+        BVH* bvh  = CreateEntityBVH(entity_arr, num_entitys, pass_pool);
+        const r64 build_seconds = GetClockSeconds() - start;
+
+        r64    update_seconds   = 0;
+        size_t rebuilt_subtrees = 0;
+        size_t full_rebuilds    = 0;
+        for (u32 frame_index = 0; frame_index < frame_count; frame_index++)
+        {
+            for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
+            {
+                v3* position = &entity_arr[entity_index].position;
+                v3Set(position,
+                      position->x + (0.002f * (NormalBoundedXorShift32() - 0.5f)),
+                      position->y + (0.002f * (NormalBoundedXorShift32() - 0.5f)),
+                      position->z + (0.002f * (NormalBoundedXorShift32() - 0.5f)));
+            }
+
+            start                      = GetClockSeconds();
+            const BVHUpdateStats stats = UpdateEntityBVH(bvh, entity_arr, pass_pool);
+            update_seconds += GetClockSeconds() - start;
+            rebuilt_subtrees += stats.rebuilt_subtrees;
+            full_rebuilds += stats.full_rebuild;
+        }
+
+        printf("\t\t%zu entities, %zu thread(s), %zu subtrees\n", num_entitys, GetThreadPoolWidth(pass_pool), bvh->subtree_count);
+        printf("\t\tbuild:  %.2f ms\n", build_seconds * 1e3);
+        printf("\t\tupdate: %.2f ms/frame, %zu subtree rebuilds and %zu full rebuilds over %u frames\n",
+               (update_seconds / ( r64 )frame_count) * 1e3,
+               rebuilt_subtrees,
+               full_rebuilds,
+               frame_count);
+        fflush(stdout);
+
+        DestroyBVH(bvh);
+    }
+
+    DestroyThreadPool(pool);
+    free(entity_arr);
+
+    // Reset XorShift32State
+    XorShift32State = PrevXorState;
+}
+
+// Closest-hit throughput and node memory of the binary BVH and the
+// compressed wide BVH built from it, over the same rays.
+void
+runWideBVHBenchmark()
+{
+    puts("\tRunning wide BVH benchmark...");
+
+    const u32 PrevXorState = XorShift32State;
+    XorShift32State        = 0x5EED;
+
+    const size_t num_entitys = __UE_BENCH__entity_count;
+    Entity*      entity_arr  = CreateBenchmarkSpheres(num_entitys);
+
+    BVH*     bvh  = CreateEntityBVH(entity_arr, num_entitys, NULL);
+    WideBVH* wide = CreateWideBVH(bvh);
+
+    Ray* ray_arr = ( Ray* )calloc(__UE_BENCH__ray_count, sizeof(Ray));
+    u32* hit_arr = ( u32* )calloc(__UE_BENCH__ray_count, sizeof(u32));
+    __UE_ASSERT__(ray_arr && hit_arr);
+    for (size_t ray_index = 0; ray_index < __UE_BENCH__ray_count; ray_index++)
+    {
+        v3SetAndNorm(&ray_arr[ray_index].direction, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f, -1.0f);
+    }
+
+    r64    binary_seconds = 0;
+    r64    wide_seconds   = 0;
+    size_t mismatch_count = 0;
+    for (u32 repetition = 0; repetition < __UE_BENCH__repetitions; repetition++)
+    {
+        r64 start = GetClockSeconds();
+        for (size_t ray_index = 0; ray_index < __UE_BENCH__ray_count; ray_index++)
+        {
+            RayIntersection intersection = { 0 };
+            hit_arr[ray_index]           = ENTITY_INDEX_NONE;
+            IntersectEntityBVH(&ray_arr[ray_index], bvh, entity_arr, ( r32 )MAX_RAY_MAG, &intersection, &hit_arr[ray_index]);
+        }
+        binary_seconds += GetClockSeconds() - start;
+
+        start = GetClockSeconds();
+        for (size_t ray_index = 0; ray_index < __UE_BENCH__ray_count; ray_index++)
+        {
+            RayIntersection intersection = { 0 };
+            u32             entity_index = ENTITY_INDEX_NONE;
+            IntersectEntityWideBVH(&ray_arr[ray_index], wide, entity_arr, ( r32 )MAX_RAY_MAG, &intersection, &entity_index);
+            mismatch_count += (entity_index != hit_arr[ray_index]);
+        }
+        wide_seconds += GetClockSeconds() - start;
+    }
+
+    // A binary tree with n leaves has 2n - 1 nodes
+    const size_t binary_node_count = (2 * CountBVHLeaves(bvh)) - 1;
+    const r64    ray_total         = ( r64 )__UE_BENCH__ray_count * __UE_BENCH__repetitions;
+    printf("\t\t%zu entities, %d rays, %zu closest-hit mismatches\n", num_entitys, __UE_BENCH__ray_count, mismatch_count);
+    printf("\t\tbinary: %.2f Mrays/s, %zu nodes, %.2f MB\n", ray_total / binary_seconds * 1e-6, binary_node_count, ( r64 )(binary_node_count * sizeof(BVHNode)) / (1024.0 * 1024.0));
+    printf("\t\twide:   %.2f Mrays/s, %zu nodes, %.2f MB\n", ray_total / wide_seconds * 1e-6, wide->node_count, ( r64 )(wide->node_count * sizeof(WideBVHNode)) / (1024.0 * 1024.0));
+    fflush(stdout);
+
+    free(hit_arr);
+    free(ray_arr);
+    DestroyWideBVH(wide);
+    DestroyBVH(bvh);
+    free(entity_arr);
+
+    // Reset XorShift32State
+    XorShift32State = PrevXorState;
+}
+
+// Spatial hash grid against the linear TraceEntityArray() scan on
+// CreateRandomEntities() scenes of 1k to 1M spheres. Radii are scaled by
+// cbrt(64 / n) so every scene fills the volume like the default 64 sphere
+// scene. The linear scan traces (1 << 24) / n rays so it stays affordable at
+// 1M entities; mismatches are counted over those rays. The grid is built
+// serially and on a pool as wide as the machine, and traced as built by the
+// pool.
+void
+runHashGridBenchmark()
+{
+    puts("\tRunning hash grid benchmark...");
+
+    const u32 PrevXorState = XorShift32State;
+    XorShift32State        = 0x5EED;
+
+    EntityHashGrid* grid = CreateEntityHashGrid();
+    ThreadPool*     pool = CreateThreadPool(GetHardwareThreadCount() - 1);
+    for (size_t num_entitys = 1000; num_entitys <= 1000000; num_entitys *= 10)
+    {
+        Entity*   entity_arr   = CreateRandomEntities(num_entitys);
+        const r32 radius_scale = ( r32 )cbrt(64.0 / ( r64 )num_entitys);
+        for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
+        {
+            entity_arr[entity_index].radius *= radius_scale;
+        }
+
+        const size_t grid_ray_count   = __UE_BENCH__ray_count;
+        const size_t linear_ray_count = ((( size_t )1 << 24) / num_entitys) < grid_ray_count ? ((( size_t )1 << 24) / num_entitys) : grid_ray_count;
+
+        Ray* ray_arr = ( Ray* )calloc(grid_ray_count, sizeof(Ray));
+        u32* hit_arr = ( u32* )calloc(linear_ray_count, sizeof(u32));
+        __UE_ASSERT__(ray_arr && hit_arr);
+        for (size_t ray_index = 0; ray_index < grid_ray_count; ray_index++)
+        {
+            v3SetAndNorm(&ray_arr[ray_index].direction, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f, -1.0f);
+        }
+
+        r64    serial_build_seconds = 0;
+        r64    pool_build_seconds   = 0;
+        r64    grid_seconds         = 0;
+        r64    linear_seconds       = 0;
+        size_t mismatch_count       = 0;
+        for (u32 repetition = 0; repetition < __UE_BENCH__repetitions; repetition++)
+        {
+            r64 start = GetClockSeconds();
+            BuildEntityHashGrid(grid, entity_arr, num_entitys, NULL);
+            serial_build_seconds += GetClockSeconds() - start;
+
+            start = GetClockSeconds();
+            BuildEntityHashGrid(grid, entity_arr, num_entitys, pool);
+            pool_build_seconds += GetClockSeconds() - start;
+
+            start = GetClockSeconds();
+            for (size_t ray_index = 0; ray_index < linear_ray_count; ray_index++)
+            {
+                RayIntersection intersection = { 0 };
+                Color32_RGB     color        = { 0 };
+                r32             threshold    = ( r32 )MAX_RAY_MAG;
+                TraceEntityArray(&ray_arr[ray_index], &intersection, &threshold, &color, entity_arr, num_entitys);
+                hit_arr[ray_index] = intersection.entity_index;
+            }
+            linear_seconds += GetClockSeconds() - start;
+
+            start = GetClockSeconds();
+            for (size_t ray_index = 0; ray_index < grid_ray_count; ray_index++)
+            {
+                RayIntersection intersection = { 0 };
+                Color32_RGB     color        = { 0 };
+                r32             threshold    = ( r32 )MAX_RAY_MAG;
+                TraceEntityHashGrid(&ray_arr[ray_index], &intersection, &threshold, &color, grid, entity_arr);
+                mismatch_count += (ray_index < linear_ray_count) && (intersection.entity_index != hit_arr[ray_index]);
+            }
+            grid_seconds += GetClockSeconds() - start;
+        }
+
+        const r64 repetitions = ( r64 )__UE_BENCH__repetitions;
+        printf("\t\t%zu entities, %zu closest-hit mismatches\n", num_entitys, mismatch_count);
+        printf("\t\tlinear: %.2f Krays/s\n", (( r64 )linear_ray_count * repetitions) / linear_seconds * 1e-3);
+        printf("\t\tgrid:   %.2f Krays/s, %zu entries, %zu buckets\n", (( r64 )grid_ray_count * repetitions) / grid_seconds * 1e-3, grid->entry_count, grid->bucket_count);
+        printf("\t\tbuild:  %.2f ms serial, %.2f ms on %zu thread(s)\n",
+               (serial_build_seconds / repetitions) * 1e3,
+               (pool_build_seconds / repetitions) * 1e3,
+               GetThreadPoolWidth(pool));
+        fflush(stdout);
+
+        free(hit_arr);
+        free(ray_arr);
+        free(entity_arr);
+    }
+
+    DestroyThreadPool(pool);
+    DestroyEntityHashGrid(grid);
+
+    // Reset XorShift32State
+    XorShift32State = PrevXorState;
+}
+
+void
+runAllBenchmarks()
+{
+    puts("[ benchmarks ] Running All Benchmarks...");
+
+    runRaySortBenchmark();
+    runBVHUpdateBenchmark();
+    runWideBVHBenchmark();
+    runHashGridBenchmark();
+
+    puts("[ benchmarks ] Done");
+    fflush(stdout);
+}
+#endif // __uBENCHMARKS_ENABLED__
+
+#endif // __UE_BENCHMARKS_H__
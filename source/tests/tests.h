@@ -1,11 +1,29 @@
 #ifndef __UE_TESTS_H__
 #define __UE_TESTS_H__
 
+#include "antialiasing_tools.h"
+#include "batch_render_tools.h"
+#include "bvh_tools.h"
+#include "checkpoint_tools.h"
+#include "cull_tools.h"
 #include "data_structures.h"
 #include "debug_tools.h"
+#include "denoise_tools.h"
+#include "farm_tools.h"
+#include "hash_grid_tools.h"
+#include "instance_tools.h"
+#include "irradiance_tools.h"
+#include "kernel_tools.h"
 #include "maths_tools.h"
 #include "memory_tools.h"
+#include "mesh_tools.h"
+#include "scene_file_tools.h"
+#include "scene_tools.h"
+#include "shading_rate_tools.h"
+#include "temporal_tools.h"
+#include "thread_tools.h"
 #include "type_tools.h"
+#include "wide_bvh_tools.h"
 
 #include <assert.h>
 #include <inttypes.h>
@@ -17,6 +35,30 @@
 #define __uTESTS_ENABLED__ 1
 #endif // __UE_debug__ == 1
 
+// Spheres of radius [ 0.05, 0.2 ] with random colors in [ -1, 1 ] x [ -1, 1 ]
+// x [ -2, -1 ], drawn from XorShift32 seeded with 'seed'. XorShift32State is
+// left as it was.
+static Entity*
+CreateTestEntities(const size_t num_entitys, const u32 seed)
+{
+    const u32 PrevXorState = XorShift32State;
+    XorShift32State        = seed;
+
+    Entity* entity_arr = CreateEntities(num_entitys);
+    for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
+    {
+        Entity* entity               = &entity_arr[entity_index];
+        entity->type                 = ET_SPHERE;
+        entity->radius               = 0.05f + (0.15f * NormalBoundedXorShift32());
+        entity->material.color.value = XorShift32();
+        v3Set(&entity->position, (2.0f * NormalBoundedXorShift32()) - 1.0f, (2.0f * NormalBoundedXorShift32()) - 1.0f, -1.0f - NormalBoundedXorShift32());
+    }
+
+    // Reset XorShift32State
+    XorShift32State = PrevXorState;
+    return entity_arr;
+}
+
 #define arrayTestFailMessage "Failed dynamic array tests\n"
 void static runDynamicArrayTests()
 {
@@ -510,6 +552,46 @@ runMathsTests()
     v4Set(&v4Result, 1860, 2250, 2640, 2980);
     uTesetAssert(v4IsEqual(&m4Result.n, &v4Result), "Failed m4Mult() tests");
 
+    // m4TransformPoint(), m4TransformDirection()
+    m4A.i = (v4) { { 0, -2, 0, 1 } };
+    m4A.j = (v4) { { 2, 0, 0, 2 } };
+    m4A.k = (v4) { { 0, 0, 2, 3 } };
+    m4A.n = (v4) { { 0, 0, 0, 1 } };
+    v3Set(&v3A, 1, 1, 1);
+    m4TransformPoint(&m4A, &v3A, &v3Result);
+    v3Set(&v3B, -1, 4, 5);
+    uTesetAssert(v3IsEqual(&v3Result, &v3B), "Failed m4TransformPoint() tests");
+    m4TransformDirection(&m4A, &v3A, &v3Result);
+    v3Set(&v3B, -2, 2, 2);
+    uTesetAssert(v3IsEqual(&v3Result, &v3B), "Failed m4TransformDirection() tests");
+
+    // m4AffineInverse()
+    uTesetAssert(m4AffineInverse(&m4A, &m4B), "Failed m4AffineInverse() tests");
+    m4Mult(&m4A, &m4B, &m4Result);
+    m4 m4Ident4 = {};
+    m4Ident(&m4Ident4);
+    for (uint8_t idx = 0; idx < 16; idx++)
+    {
+        uTesetAssert(IsWithinTolerance(m4Result.arr[idx], m4Ident4.arr[idx]), "Failed m4AffineInverse() tests");
+    }
+    m4TransformPoint(&m4B, &v3B, &v3Result);
+    m4TransformPoint(&m4A, &v3Result, &v3A);
+    uTesetAssert(v3IsEqual(&v3A, &v3B), "Failed m4AffineInverse() tests");
+    m4Set(&m4A, 0);
+    uTesetAssert(!m4AffineInverse(&m4A, &m4B), "Failed m4AffineInverse() tests");
+
+    // m4TransformNormal(): normals remain perpendicular to transformed tangents
+    m4A.i = (v4) { { 1, 0, 0, 0 } };
+    m4A.j = (v4) { { 0, 4, 0, 0 } };
+    m4A.k = (v4) { { 0, 0, 1, 0 } };
+    m4A.n = (v4) { { 0, 0, 0, 1 } };
+    m4AffineInverse(&m4A, &m4B);
+    v3Set(&v3A, 1, 1, 0);
+    v3Set(&v3B, 1, -1, 0);
+    m4TransformNormal(&m4B, &v3A, &v3Result);
+    m4TransformDirection(&m4A, &v3B, &v3A);
+    uTesetAssert(IsWithinTolerance(v3Dot(&v3Result, &v3A), 0), "Failed m4TransformNormal() tests");
+
     //
     // XorShift32 Tests
     //
@@ -540,6 +622,1960 @@ runStringTests()
     uStringDestroy(str);
 }
 
+#define shadingRateTestFailMessage "Failed shading rate tests\n"
+static void
+runShadingRateTests()
+{
+    puts("\tRunning shading rate tests...");
+
+    const size_t num_entitys = 64;
+    Entity*      entity_arr  = CreateTestEntities(num_entitys, 0x5EED);
+
+    // Partial tiles on both axes; 2 x 2 and 4 x 4 tiles alternate so that
+    // every coarse tile borders a tile of the other rate
+    const size_t    image_width  = 70;
+    const size_t    image_height = 38;
+    const size_t    pixel_count  = image_width * image_height;
+    ShadingRateMap* map          = CreateShadingRateMap(image_width, image_height, 16);
+    for (size_t tile_index = 0; tile_index < (map->tiles_x * map->tiles_y); tile_index++)
+    {
+        map->tile_rate[tile_index] = ( u8 )((tile_index & 1) ? SHADING_RATE_4X4 : SHADING_RATE_2X2);
+    }
+    map->tile_rate[0] = SHADING_RATE_1X1;
+
+    // The output must not depend on what the buffer held, nor on threading
+    Color32_RGB* zero_arr = ( Color32_RGB* )calloc(pixel_count, sizeof(Color32_RGB));
+    Color32_RGB* full_arr = ( Color32_RGB* )malloc(pixel_count * sizeof(Color32_RGB));
+    Color32_RGB* pool_arr = ( Color32_RGB* )malloc(pixel_count * sizeof(Color32_RGB));
+    uTesetAssert(zero_arr && full_arr && pool_arr, shadingRateTestFailMessage);
+    memset(full_arr, 0xFF, pixel_count * sizeof(Color32_RGB));
+    memset(pool_arr, 0x5A, pixel_count * sizeof(Color32_RGB));
+
+    ThreadPool* pool = CreateThreadPool(3);
+    RenderShadingRateFrame(map, zero_arr, entity_arr, num_entitys, 0, NULL);
+    RenderShadingRateFrame(map, full_arr, entity_arr, num_entitys, 0, NULL);
+    RenderShadingRateFrame(map, pool_arr, entity_arr, num_entitys, 0, pool);
+    uTesetAssert(!memcmp(zero_arr, full_arr, pixel_count * sizeof(Color32_RGB)), "Failed shading rate tests: output depends on prior buffer contents.\n");
+    uTesetAssert(!memcmp(zero_arr, pool_arr, pixel_count * sizeof(Color32_RGB)), "Failed shading rate tests: output depends on the thread count.\n");
+
+    // Lattice pixels match a full rate render; only the others are
+    // interpolated
+    ShadingRateMap* full_map = CreateShadingRateMap(image_width, image_height, 16);
+    RenderShadingRateFrame(full_map, full_arr, entity_arr, num_entitys, 0, pool);
+    size_t lattice_count = 0;
+    for (size_t pix_y = 0; pix_y < image_height; pix_y++)
+    {
+        for (size_t pix_x = 0; pix_x < image_width; pix_x++)
+        {
+            const size_t pixel_index = (pix_y * image_width) + pix_x;
+            if (IsShadingRateLatticePixel(map, pix_x, pix_y))
+            {
+                uTesetAssert(!memcmp(&zero_arr[pixel_index], &full_arr[pixel_index], sizeof(Color32_RGB)), "Failed shading rate tests: a lattice pixel differs from a full rate render.\n");
+                lattice_count++;
+            }
+            uTesetAssert(zero_arr[pixel_index].channel.A == 0xFF, "Failed shading rate tests: a pixel was not reconstructed.\n");
+        }
+    }
+    uTesetAssert(lattice_count < pixel_count, shadingRateTestFailMessage);
+
+    // Focus picks full rate at the focus and the coarsest rate far from it
+    ShadingRateSettings settings = { 0 };
+    GetDefaultShadingRateSettings(&settings);
+    const size_t tile_count = map->tiles_x * map->tiles_y;
+    SetShadingRateByFocus(map, &settings, 0.0f, 0.0f);
+    uTesetAssert(map->tile_rate[0] == SHADING_RATE_1X1 && map->tile_rate[tile_count - 1] == SHADING_RATE_4X4, "Failed shading rate tests: focus did not pick the rates.\n");
+
+    // Contrast only ever makes tiles finer
+    u8 focus_rate[32] = { 0 };
+    uTesetAssert(tile_count <= sizeof(focus_rate), shadingRateTestFailMessage);
+    memcpy(focus_rate, map->tile_rate, tile_count);
+    const size_t refined_count = RefineShadingRateByContrast(map, &settings, full_arr);
+    size_t       finer_count   = 0;
+    for (size_t tile_index = 0; tile_index < tile_count; tile_index++)
+    {
+        uTesetAssert(map->tile_rate[tile_index] <= focus_rate[tile_index], "Failed shading rate tests: contrast made a tile coarser.\n");
+        finer_count += map->tile_rate[tile_index] != focus_rate[tile_index];
+    }
+    uTesetAssert(refined_count == finer_count, "Failed shading rate tests: refined tiles were miscounted.\n");
+
+    // A region marks every tile it overlaps, and only those
+    MarkShadingRateRegion(map, 0, 0, image_width, image_height, SHADING_RATE_4X4);
+    MarkShadingRateRegion(map, 20, 0, 40, 10, SHADING_RATE_2X2);
+    for (size_t tile_index = 0; tile_index < tile_count; tile_index++)
+    {
+        const bool marked = tile_index == 1 || tile_index == 2;
+        uTesetAssert(map->tile_rate[tile_index] == (marked ? SHADING_RATE_2X2 : SHADING_RATE_4X4), "Failed shading rate tests: region marked the wrong tiles.\n");
+    }
+
+    DestroyShadingRateMap(full_map);
+    DestroyThreadPool(pool);
+    free(pool_arr);
+    free(full_arr);
+    free(zero_arr);
+    DestroyShadingRateMap(map);
+    free(entity_arr);
+}
+
+#define sceneFileTestFailMessage "Failed scene file tests\n"
+static void
+runSceneFileTests()
+{
+    puts("\tRunning scene file tests...");
+
+    const size_t num_entitys = 256;
+    Entity*      entity_arr  = CreateTestEntities(num_entitys, 0x5EED);
+
+    const size_t ray_count = 1024;
+    Ray*         ray_arr   = ( Ray* )calloc(ray_count, sizeof(Ray));
+    uTesetAssert(ray_arr, sceneFileTestFailMessage);
+    for (size_t ray_index = 0; ray_index < ray_count; ray_index++)
+    {
+        v3SetAndNorm(&ray_arr[ray_index].direction, (( r32 )(ray_index % 32) / 32.0f) - 0.5f, (( r32 )(ray_index / 32) / 32.0f) - 0.5f, -1.0f);
+    }
+
+    // Round trip: same hits as the resident BVH; file entities are in leaf
+    // order, so file index i is entity bvh->indices[i]
+    const char* const path = "ue_scene_file_test.uesc";
+    BVH*              bvh  = CreateEntityBVH(entity_arr, num_entitys, NULL);
+    uTesetAssert(WriteSceneFile(path, entity_arr, bvh), sceneFileTestFailMessage);
+
+    SceneFile* scene = OpenSceneFile(path);
+    uTesetAssert(scene && scene->entity_count == num_entitys, sceneFileTestFailMessage);
+    for (size_t ray_index = 0; ray_index < ray_count; ray_index++)
+    {
+        RayIntersection resident_intersection = { 0 };
+        RayIntersection file_intersection     = { 0 };
+        u32             resident_index        = ENTITY_INDEX_NONE;
+        u32             file_index            = ENTITY_INDEX_NONE;
+        const bool      resident_hit          = IntersectEntityBVH(&ray_arr[ray_index], bvh, entity_arr, ( r32 )MAX_RAY_MAG, &resident_intersection, &resident_index);
+        const bool      file_hit              = IntersectSceneFile(&ray_arr[ray_index], scene, ( r32 )MAX_RAY_MAG, &file_intersection, &file_index);
+        uTesetAssert(resident_hit == file_hit, "Failed scene file tests: round trip changed a hit.\n");
+        uTesetAssert(!file_hit || bvh->indices[file_index] == resident_index, "Failed scene file tests: round trip changed a hit.\n");
+    }
+    const SceneFileHeader header = *scene->header;
+    CloseSceneFile(scene);
+
+    // Corrupt headers are rejected
+    FILE* file = fopen(path, "r+b");
+    uTesetAssert(file, sceneFileTestFailMessage);
+
+    SceneFileHeader corrupt_header = header;
+    corrupt_header.entity_offset   = ~( u64 )0;
+    fseek(file, 0, SEEK_SET);
+    fwrite(&corrupt_header, sizeof(SceneFileHeader), 1, file);
+    fflush(file);
+    uTesetAssert(!OpenSceneFile(path), "Failed scene file tests: accepted an entity offset past the end of the file.\n");
+
+    corrupt_header       = header;
+    corrupt_header.magic = 0;
+    fseek(file, 0, SEEK_SET);
+    fwrite(&corrupt_header, sizeof(SceneFileHeader), 1, file);
+    fflush(file);
+    uTesetAssert(!OpenSceneFile(path), "Failed scene file tests: accepted a bad magic number.\n");
+
+    // Corrupt nodes are opened, but never followed out of bounds or in cycles
+    const size_t   node_count = ( size_t )header.node_count;
+    SceneFileNode* node_arr   = ( SceneFileNode* )calloc(node_count, sizeof(SceneFileNode));
+    uTesetAssert(node_arr, sceneFileTestFailMessage);
+    fseek(file, ( long )header.node_offset, SEEK_SET);
+    uTesetAssert(fread(node_arr, sizeof(SceneFileNode), node_count, file) == node_count, sceneFileTestFailMessage);
+    for (size_t node_index = 1; node_index < node_count; node_index++)
+    {
+        SceneFileNode* node = &node_arr[node_index];
+        if (node->count && (node_index & 1))
+        {
+            node->count = ~( u32 )0;
+        }
+        else if (!node->count && (node_index % 3) == 1)
+        {
+            node->offset = ( u32 )node_count;
+        }
+        else if (!node->count && (node_index % 3) == 2)
+        {
+            node->offset = ( u32 )node_index;
+        }
+    }
+    fseek(file, 0, SEEK_SET);
+    fwrite(&header, sizeof(SceneFileHeader), 1, file);
+    fseek(file, ( long )header.node_offset, SEEK_SET);
+    fwrite(node_arr, sizeof(SceneFileNode), node_count, file);
+    fclose(file);
+
+    scene = OpenSceneFile(path);
+    uTesetAssert(scene, sceneFileTestFailMessage);
+    for (size_t ray_index = 0; ray_index < ray_count; ray_index++)
+    {
+        RayIntersection intersection = { 0 };
+        u32             entity_index = ENTITY_INDEX_NONE;
+        if (IntersectSceneFile(&ray_arr[ray_index], scene, ( r32 )MAX_RAY_MAG, &intersection, &entity_index))
+        {
+            uTesetAssert(entity_index < num_entitys, "Failed scene file tests: followed a corrupt node.\n");
+        }
+    }
+    CloseSceneFile(scene);
+    remove(path);
+
+    // A scene with a mesh entity is rejected without creating a file
+    entity_arr[num_entitys / 2].type = ET_TRIANGLE_MESH;
+    uTesetAssert(!WriteSceneFile(path, entity_arr, bvh), "Failed scene file tests: wrote a triangle mesh entity.\n");
+    file = fopen(path, "rb");
+    uTesetAssert(!file, "Failed scene file tests: a rejected scene left a file behind.\n");
+
+    free(node_arr);
+    DestroyBVH(bvh);
+    free(ray_arr);
+    free(entity_arr);
+}
+
+#define checkpointTestFailMessage "Failed checkpoint tests\n"
+static void
+runCheckpointTests()
+{
+    puts("\tRunning checkpoint tests...");
+
+    const size_t num_entitys = 32;
+    Entity*      entity_arr  = CreateTestEntities(num_entitys, 0x5EED);
+
+    ProgressiveSettings settings   = { 0 };
+    settings.min_samples           = 2;
+    settings.max_samples           = 16;
+    settings.convergence_threshold = 0.05f;
+
+    const char* const path         = "ue_checkpoint_test.ckpt";
+    const size_t      image_width  = 48;
+    const size_t      image_height = 32;
+    const size_t      pixel_count  = image_width * image_height;
+    const u64         scene_hash   = GetCheckpointSceneHash(entity_arr, num_entitys);
+
+    // Uninterrupted reference
+    AccumulationBuffer* reference = CreateAccumulationBuffer(image_width, image_height, 8);
+    while (RenderProgressivePass(reference, &settings, entity_arr, num_entitys, NULL))
+    {
+    }
+
+    // Interrupted render: snapshots after passes 5 and 6, then two more
+    // passes that are lost with the process
+    AccumulationBuffer* interrupted = CreateAccumulationBuffer(image_width, image_height, 8);
+    remove(path);
+    Checkpoint* checkpoint = CreateCheckpoint(path, interrupted, &settings, scene_hash);
+    uTesetAssert(checkpoint, checkpointTestFailMessage);
+    uTesetAssert(!ResumeFromCheckpoint(checkpoint, interrupted), "Failed checkpoint tests: resumed from an empty file.\n");
+    for (u32 pass_index = 0; pass_index < 8; pass_index++)
+    {
+        RenderProgressivePass(interrupted, &settings, entity_arr, num_entitys, NULL);
+        if (interrupted->pass_count == 5 || interrupted->pass_count == 6)
+        {
+            uTesetAssert(RequestCheckpoint(checkpoint, interrupted, true), checkpointTestFailMessage);
+            WaitForCheckpoint(checkpoint);
+        }
+    }
+    const CheckpointHeader header = *checkpoint->header;
+    DestroyCheckpoint(checkpoint);
+
+    // Tear the newest slot (sequence 2, slot 0); resume falls back to pass 5
+    FILE* file = fopen(path, "r+b");
+    uTesetAssert(file && header.slot_arr[0].sequence == 2 && header.slot_arr[0].pass_count == 6, checkpointTestFailMessage);
+    fseek(file, ( long )header.slot_offset, SEEK_SET);
+    const int torn_byte = fgetc(file);
+    fseek(file, ( long )header.slot_offset, SEEK_SET);
+    fputc(torn_byte ^ 0xFF, file);
+    fclose(file);
+
+    AccumulationBuffer* resumed = CreateAccumulationBuffer(image_width, image_height, 8);
+    checkpoint                  = CreateCheckpoint(path, resumed, &settings, scene_hash);
+    uTesetAssert(checkpoint && ResumeFromCheckpoint(checkpoint, resumed), "Failed checkpoint tests: could not resume.\n");
+    uTesetAssert(resumed->pass_count == 5, "Failed checkpoint tests: did not fall back to the older slot.\n");
+    DestroyCheckpoint(checkpoint);
+
+    while (RenderProgressivePass(resumed, &settings, entity_arr, num_entitys, NULL))
+    {
+    }
+
+    Color32_RGB* reference_arr = ( Color32_RGB* )calloc(pixel_count, sizeof(Color32_RGB));
+    Color32_RGB* resumed_arr   = ( Color32_RGB* )calloc(pixel_count, sizeof(Color32_RGB));
+    uTesetAssert(reference_arr && resumed_arr, checkpointTestFailMessage);
+    ResolveAccumulationBuffer(reference, reference_arr);
+    ResolveAccumulationBuffer(resumed, resumed_arr);
+    uTesetAssert(resumed->pass_count == reference->pass_count, "Failed checkpoint tests: resumed render took a different number of passes.\n");
+    uTesetAssert(!memcmp(reference->sample_count, resumed->sample_count, pixel_count * sizeof(u32)), "Failed checkpoint tests: resumed sample counts differ.\n");
+    uTesetAssert(!memcmp(reference_arr, resumed_arr, pixel_count * sizeof(Color32_RGB)), "Failed checkpoint tests: resumed image differs.\n");
+
+    // A file written for another scene is reset rather than resumed
+    AccumulationBuffer* other_scene = CreateAccumulationBuffer(image_width, image_height, 8);
+    checkpoint                      = CreateCheckpoint(path, other_scene, &settings, scene_hash + 1);
+    uTesetAssert(checkpoint && !ResumeFromCheckpoint(checkpoint, other_scene), "Failed checkpoint tests: resumed a checkpoint of another scene.\n");
+    DestroyCheckpoint(checkpoint);
+    remove(path);
+
+    DestroyAccumulationBuffer(other_scene);
+    free(resumed_arr);
+    free(reference_arr);
+    DestroyAccumulationBuffer(resumed);
+    DestroyAccumulationBuffer(interrupted);
+    DestroyAccumulationBuffer(reference);
+    free(entity_arr);
+}
+
+#define progressiveTestFailMessage "Failed progressive rendering tests\n"
+static void
+runProgressiveTests()
+{
+    puts("\tRunning progressive rendering tests...");
+
+    // Welford's running luminance moments match a two-pass reference
+    AccumulationBuffer* moments      = CreateAccumulationBuffer(1, 1, 1);
+    const u32           PrevXorState = XorShift32State;
+    XorShift32State                  = 0x5EED;
+
+    const size_t sample_count = 256;
+    r32          luminance_arr[256];
+    r64          luminance_sum = 0.0;
+    for (size_t sample_index = 0; sample_index < sample_count; sample_index++)
+    {
+        Color32_RGB sample_color = { 0 };
+        sample_color.value       = XorShift32();
+        AccumulateSample(moments, 0, &sample_color);
+
+        v3 linear_color = { 0 };
+        v3Set(&linear_color, sample_color.channel.R / 255.0f, sample_color.channel.G / 255.0f, sample_color.channel.B / 255.0f);
+        luminance_arr[sample_index] = GetLuminance(&linear_color);
+        luminance_sum += luminance_arr[sample_index];
+    }
+    XorShift32State = PrevXorState;
+
+    const r64 mean = luminance_sum / ( r64 )sample_count;
+    r64       m2   = 0.0;
+    for (size_t sample_index = 0; sample_index < sample_count; sample_index++)
+    {
+        m2 += (luminance_arr[sample_index] - mean) * (luminance_arr[sample_index] - mean);
+    }
+    uTesetAssert(moments->sample_count[0] == sample_count, progressiveTestFailMessage);
+    uTesetAssert(fabs(moments->luminance_mean[0] - mean) < 1e-5, "Failed progressive rendering tests: running mean differs from the two-pass mean.\n");
+    uTesetAssert(fabs(moments->luminance_m2[0] - m2) < (1e-4 * m2), "Failed progressive rendering tests: running variance differs from the two-pass variance.\n");
+    DestroyAccumulationBuffer(moments);
+
+    // Converged tiles are skipped, and passes do not depend on the pool
+    const size_t num_entitys = 32;
+    Entity*      entity_arr  = CreateTestEntities(num_entitys, 0x5EED);
+
+    ProgressiveSettings settings   = { 0 };
+    settings.min_samples           = 2;
+    settings.max_samples           = 16;
+    settings.convergence_threshold = 0.05f;
+
+    const size_t        image_width  = 48;
+    const size_t        image_height = 32;
+    const size_t        pixel_count  = image_width * image_height;
+    ThreadPool*         pool         = CreateThreadPool(3);
+    AccumulationBuffer* serial       = CreateAccumulationBuffer(image_width, image_height, 8);
+    AccumulationBuffer* parallel     = CreateAccumulationBuffer(image_width, image_height, 8);
+    u32*                prev_count   = ( u32* )calloc(pixel_count, sizeof(u32));
+    bool*               prev_tile    = ( bool* )calloc(serial->tiles_x * serial->tiles_y, sizeof(bool));
+    uTesetAssert(prev_count && prev_tile, progressiveTestFailMessage);
+
+    while (true)
+    {
+        memcpy(prev_count, serial->sample_count, pixel_count * sizeof(u32));
+        memcpy(prev_tile, serial->tile_converged, serial->tiles_x * serial->tiles_y * sizeof(bool));
+
+        const size_t serial_samples   = RenderProgressivePass(serial, &settings, entity_arr, num_entitys, NULL);
+        const size_t parallel_samples = RenderProgressivePass(parallel, &settings, entity_arr, num_entitys, pool);
+        uTesetAssert(serial_samples == parallel_samples, "Failed progressive rendering tests: parallel pass took a different number of samples.\n");
+
+        for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+        {
+            const size_t tile_index = ((pixel_index / image_width / serial->tile_size) * serial->tiles_x) + ((pixel_index % image_width) / serial->tile_size);
+            if (prev_tile[tile_index])
+            {
+                uTesetAssert(serial->sample_count[pixel_index] == prev_count[pixel_index], "Failed progressive rendering tests: a converged tile was sampled.\n");
+            }
+        }
+
+        if (!serial_samples)
+        {
+            break;
+        }
+    }
+    uTesetAssert(serial->converged_tile_count == (serial->tiles_x * serial->tiles_y), "Failed progressive rendering tests: the image did not converge.\n");
+    uTesetAssert(!memcmp(serial->sample_count, parallel->sample_count, pixel_count * sizeof(u32)), "Failed progressive rendering tests: parallel sample counts differ.\n");
+    uTesetAssert(!memcmp(serial->color_sum, parallel->color_sum, pixel_count * sizeof(v3)), "Failed progressive rendering tests: parallel image differs.\n");
+
+    // A reset buffer renders the same image again
+    const u32 pass_count = serial->pass_count;
+    ResetAccumulationBuffer(parallel);
+    uTesetAssert(!parallel->pass_count && !parallel->converged_tile_count && !parallel->sample_count[0], "Failed progressive rendering tests: the buffer was not reset.\n");
+    while (RenderProgressivePass(parallel, &settings, entity_arr, num_entitys, pool))
+    {
+    }
+    uTesetAssert(parallel->pass_count == pass_count, "Failed progressive rendering tests: reset render took a different number of passes.\n");
+    uTesetAssert(!memcmp(serial->color_sum, parallel->color_sum, pixel_count * sizeof(v3)), "Failed progressive rendering tests: reset render differs.\n");
+
+    free(prev_tile);
+    free(prev_count);
+    DestroyAccumulationBuffer(parallel);
+    DestroyAccumulationBuffer(serial);
+    DestroyThreadPool(pool);
+    free(entity_arr);
+}
+
+#define samplerTestFailMessage "Failed sampler tests\n"
+static void
+runSamplerTests()
+{
+    puts("\tRunning sampler tests...");
+
+    // Every rank appears once, and neighbours are further apart than the
+    // 1 / 3 of white noise
+    BlueNoiseMask* mask        = CreateBlueNoiseMask(1);
+    const size_t   pixel_count = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+    bool*          rank_seen   = ( bool* )calloc(pixel_count, sizeof(bool));
+    uTesetAssert(mask && rank_seen, samplerTestFailMessage);
+
+    r64 neighbour_delta = 0.0;
+    for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+    {
+        const size_t rank = ( size_t )(mask->value[pixel_index] * ( r32 )pixel_count);
+        uTesetAssert(rank < pixel_count && !rank_seen[rank], "Failed sampler tests: blue noise ranks are not a permutation.\n");
+        rank_seen[rank] = true;
+
+        const size_t pix_x = pixel_index % BLUE_NOISE_SIZE;
+        const size_t pix_y = pixel_index / BLUE_NOISE_SIZE;
+        neighbour_delta += fabs(mask->value[pixel_index] - mask->value[(pix_y * BLUE_NOISE_SIZE) + ((pix_x + 1) & (BLUE_NOISE_SIZE - 1))]);
+    }
+    uTesetAssert((neighbour_delta / ( r64 )pixel_count) > 0.37, "Failed sampler tests: blue noise mask is not high-pass.\n");
+
+    // Blue noise jitter in the kernel does not depend on the pool
+    const size_t num_entitys  = 32;
+    const size_t image_width  = 48;
+    const size_t image_height = 32;
+    Entity*      entity_arr   = CreateTestEntities(num_entitys, 0x5EED);
+    Scene*       scene        = CreateScene(entity_arr, num_entitys);
+    ThreadPool*  pool         = CreateThreadPool(3);
+    Color32_RGB* sobol_arr    = ( Color32_RGB* )calloc(image_width * image_height, sizeof(Color32_RGB));
+    Color32_RGB* serial_arr   = ( Color32_RGB* )calloc(image_width * image_height, sizeof(Color32_RGB));
+    Color32_RGB* pool_arr     = ( Color32_RGB* )calloc(image_width * image_height, sizeof(Color32_RGB));
+    uTesetAssert(sobol_arr && serial_arr && pool_arr, samplerTestFailMessage);
+
+    TraceKernelSettings settings = { 0 };
+    GetDefaultTraceKernelSettings(&settings);
+    settings.anti_aliasing = true;
+
+    TraceKernelFrame frame = { 0 };
+    frame.image_width      = image_width;
+    frame.image_height     = image_height;
+    frame.scene            = scene;
+    frame.sample_index     = 3;
+
+    frame.pixel_arr = sobol_arr;
+    RenderTraceKernel(&settings, &frame, NULL);
+
+    frame.blue_noise = mask;
+    frame.pixel_arr  = serial_arr;
+    RenderTraceKernel(&settings, &frame, NULL);
+    frame.pixel_arr = pool_arr;
+    RenderTraceKernel(&settings, &frame, pool);
+    uTesetAssert(!memcmp(serial_arr, pool_arr, image_width * image_height * sizeof(Color32_RGB)), "Failed sampler tests: blue noise frame depends on the pool.\n");
+    uTesetAssert(memcmp(serial_arr, sobol_arr, image_width * image_height * sizeof(Color32_RGB)), "Failed sampler tests: blue noise mask was not sampled.\n");
+
+    free(pool_arr);
+    free(serial_arr);
+    free(sobol_arr);
+    DestroyThreadPool(pool);
+    DestroyScene(scene);
+    free(entity_arr);
+    free(rank_seen);
+    DestroyBlueNoiseMask(mask);
+}
+
+__UE_inline__ static bool
+IsTestAABBInside(const AABB* restrict const inner, const AABB* restrict const outer)
+{
+    return inner->min.x >= outer->min.x && inner->min.y >= outer->min.y && inner->min.z >= outer->min.z && inner->max.x <= outer->max.x
+           && inner->max.y <= outer->max.y && inner->max.z <= outer->max.z;
+}
+
+// Walk the tree: every node holds its children, every leaf holds the current
+// bounds of its entities, and every entity is in exactly one leaf.
+static bool
+IsEntityBVHConsistent(const BVH* restrict const bvh, const Entity* restrict const entity_arr, _mut_ u32* restrict const seen_count)
+{
+    memset(seen_count, 0, bvh->primitive_count * sizeof(u32));
+
+    u32 stack[BVH_STACK_SIZE];
+    u32 stack_size      = 0;
+    stack[stack_size++] = 0;
+    while (stack_size)
+    {
+        const u32      node_index = stack[--stack_size];
+        const BVHNode* node       = &bvh->nodes[node_index];
+        AABB           bounds     = { 0 };
+        GetBVHNodeBounds(node, &bounds);
+
+        if (!node->left_count)
+        {
+            for (u32 index = node->first_index; index < (node->first_index + node->index_count); index++)
+            {
+                AABB entity_bounds = { 0 };
+                GetEntityBounds(entity_arr, bvh->indices[index], &entity_bounds);
+                if (!IsTestAABBInside(&entity_bounds, &bounds))
+                {
+                    return false;
+                }
+                seen_count[bvh->indices[index]]++;
+            }
+            continue;
+        }
+
+        const u32 child_index[2] = { node_index + 1, node_index + (2 * node->left_count) };
+        for (u32 child = 0; child < 2; child++)
+        {
+            AABB child_bounds = { 0 };
+            GetBVHNodeBounds(&bvh->nodes[child_index[child]], &child_bounds);
+            if (!IsTestAABBInside(&child_bounds, &bounds))
+            {
+                return false;
+            }
+            stack[stack_size++] = child_index[child];
+        }
+    }
+
+    for (size_t primitive_index = 0; primitive_index < bvh->primitive_count; primitive_index++)
+    {
+        if (seen_count[primitive_index] != 1)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+#define bvhTestFailMessage "Failed bvh tests\n"
+static void
+runBVHTests()
+{
+    puts("\tRunning bvh tests...");
+
+    const size_t num_entitys = 300;
+    Entity*      entity_arr  = CreateTestEntities(num_entitys, 0x5EED);
+    u32*         seen_count  = ( u32* )calloc(num_entitys, sizeof(u32));
+    ThreadPool*  pool        = CreateThreadPool(3);
+    BVH*         bvh         = CreateEntityBVH(entity_arr, num_entitys, pool);
+    uTesetAssert(seen_count && bvh, bvhTestFailMessage);
+    uTesetAssert(IsEntityBVHConsistent(bvh, entity_arr, seen_count), "Failed bvh tests: built bounds do not contain every entity.\n");
+
+    // A small drift is refit in place; scattering the entities degrades the
+    // tree past the rebuild threshold. Either way the bounds must hold.
+    const u32 PrevXorState = XorShift32State;
+    XorShift32State        = 0xC0FFEE;
+    const r32 drift[3]     = { 0.02f, 0.05f, 2.0f };
+    for (u32 update_index = 0; update_index < 3; update_index++)
+    {
+        for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
+        {
+            v3* position = &entity_arr[entity_index].position;
+            position->x += drift[update_index] * (NormalBoundedXorShift32() - 0.5f);
+            position->y += drift[update_index] * (NormalBoundedXorShift32() - 0.5f);
+            position->z += drift[update_index] * (NormalBoundedXorShift32() - 0.5f);
+        }
+
+        const BVHUpdateStats stats = UpdateEntityBVH(bvh, entity_arr, pool);
+        uTesetAssert(IsEntityBVHConsistent(bvh, entity_arr, seen_count), "Failed bvh tests: refit bounds do not contain every entity.\n");
+        uTesetAssert(update_index < 2 || stats.full_rebuild || stats.rebuilt_subtrees, "Failed bvh tests: a scattered scene was not rebuilt.\n");
+
+        for (u32 ray_index = 0; ray_index < 1024; ray_index++)
+        {
+            Ray ray = { 0 };
+            v3Set(&ray.origin, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f, 0.0f);
+            v3SetAndNorm(&ray.direction, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f, -1.0f);
+
+            RayIntersection array_intersection = { 0 };
+            RayIntersection bvh_intersection   = { 0 };
+            Color32_RGB     array_color        = { 0 };
+            Color32_RGB     bvh_color          = { 0 };
+            r32             array_threshold    = ( r32 )MAX_RAY_MAG;
+            r32             bvh_threshold      = ( r32 )MAX_RAY_MAG;
+            TraceEntityArray(&ray, &array_intersection, &array_threshold, &array_color, entity_arr, num_entitys);
+            TraceEntityBVH(&ray, &bvh_intersection, &bvh_threshold, &bvh_color, bvh, entity_arr);
+            uTesetAssert(array_intersection.entity_index == bvh_intersection.entity_index, "Failed bvh tests: closest entity differs from TraceEntityArray().\n");
+        }
+    }
+    XorShift32State = PrevXorState;
+
+    DestroyBVH(bvh);
+    DestroyThreadPool(pool);
+    free(seen_count);
+    free(entity_arr);
+}
+
+// A sparse scene, and a dense one whose tree is many wide levels deep; both
+// must agree with TraceEntityArray() on the closest entity.
+#define wideBVHTestFailMessage "Failed wide bvh tests\n"
+static void
+runWideBVHTests()
+{
+    puts("\tRunning wide bvh tests...");
+
+    const size_t scene_sizes[2] = { 61, 4096 };
+    ThreadPool*  pool           = CreateThreadPool(3);
+    const u32    PrevXorState   = XorShift32State;
+    XorShift32State             = 0xC0FFEE;
+    for (u32 scene_index = 0; scene_index < 2; scene_index++)
+    {
+        const size_t num_entitys = scene_sizes[scene_index];
+        Entity*      entity_arr  = CreateTestEntities(num_entitys, 0x5EED + scene_index);
+        for (size_t entity_index = 0; entity_index < num_entitys; entity_index += 3)
+        {
+            entity_arr[entity_index].type   = ET_CUBE;
+            entity_arr[entity_index].length = 2.0f * entity_arr[entity_index].radius;
+        }
+        for (size_t entity_index = 0; scene_index && entity_index < num_entitys; entity_index++)
+        {
+            entity_arr[entity_index].radius *= 0.25f;
+            entity_arr[entity_index].length *= 0.25f;
+        }
+
+        WideBVH* wide = CreateEntityWideBVH(entity_arr, num_entitys, pool);
+        uTesetAssert(wide && wide->primitive_count == num_entitys, wideBVHTestFailMessage);
+
+        size_t hit_count = 0;
+        for (u32 ray_index = 0; ray_index < 4096; ray_index++)
+        {
+            Ray ray = { 0 };
+            v3Set(&ray.origin, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f, 0.0f);
+            v3SetAndNorm(&ray.direction, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f, -1.0f);
+
+            RayIntersection array_intersection = { 0 };
+            RayIntersection wide_intersection  = { 0 };
+            Color32_RGB     array_color        = { 0 };
+            Color32_RGB     wide_color         = { 0 };
+            r32             array_threshold    = ( r32 )MAX_RAY_MAG;
+            r32             wide_threshold     = ( r32 )MAX_RAY_MAG;
+            TraceEntityArray(&ray, &array_intersection, &array_threshold, &array_color, entity_arr, num_entitys);
+            TraceEntityWideBVH(&ray, &wide_intersection, &wide_threshold, &wide_color, wide, entity_arr);
+
+            uTesetAssert(array_intersection.entity_index == wide_intersection.entity_index, "Failed wide bvh tests: closest entity differs from TraceEntityArray().\n");
+            if (wide_intersection.does_intersect)
+            {
+                hit_count++;
+                uTesetAssert(fabs(array_intersection.magnitude - wide_intersection.magnitude) < 1e-4f, "Failed wide bvh tests: hit distance differs from TraceEntityArray().\n");
+                uTesetAssert(array_color.value == wide_color.value, "Failed wide bvh tests: hit color differs from TraceEntityArray().\n");
+            }
+        }
+        uTesetAssert(hit_count > 256 && hit_count < 4096, "Failed wide bvh tests: rays should both hit and miss.\n");
+
+        DestroyWideBVH(wide);
+        free(entity_arr);
+    }
+    XorShift32State = PrevXorState;
+    DestroyThreadPool(pool);
+}
+
+#define hashGridTestFailMessage "Failed hash grid tests\n"
+static void
+runHashGridTests()
+{
+    puts("\tRunning hash grid tests...");
+
+    const size_t    scene_sizes[2] = { 61, 4096 };
+    ThreadPool*     pool           = CreateThreadPool(3);
+    EntityHashGrid* serial_grid    = CreateEntityHashGrid();
+    EntityHashGrid* pool_grid      = CreateEntityHashGrid();
+    const u32       PrevXorState   = XorShift32State;
+    XorShift32State                = 0xC0FFEE;
+    for (u32 scene_index = 0; scene_index < 2; scene_index++)
+    {
+        const size_t num_entitys = scene_sizes[scene_index];
+        Entity*      entity_arr  = CreateTestEntities(num_entitys, 0x5EED + scene_index);
+        for (size_t entity_index = 0; entity_index < num_entitys; entity_index += 3)
+        {
+            entity_arr[entity_index].type   = ET_CUBE;
+            entity_arr[entity_index].length = 2.0f * entity_arr[entity_index].radius;
+        }
+        for (size_t entity_index = 0; scene_index && entity_index < num_entitys; entity_index++)
+        {
+            entity_arr[entity_index].radius *= 0.25f;
+            entity_arr[entity_index].length *= 0.25f;
+        }
+
+        // The grid is rebuilt from scratch each frame; the second frame moves
+        // every entity
+        for (u32 frame_index = 0; frame_index < 2; frame_index++)
+        {
+            for (size_t entity_index = 0; frame_index && entity_index < num_entitys; entity_index++)
+            {
+                v3* position = &entity_arr[entity_index].position;
+                v3Set(position, position->x + (0.1f * (NormalBoundedXorShift32() - 0.5f)), position->y + (0.1f * (NormalBoundedXorShift32() - 0.5f)), position->z);
+            }
+
+            // The sort is stable, so the pool builds the same grid
+            BuildEntityHashGrid(serial_grid, entity_arr, num_entitys, NULL);
+            BuildEntityHashGrid(pool_grid, entity_arr, num_entitys, pool);
+            uTesetAssert(serial_grid->entry_count == pool_grid->entry_count && serial_grid->bucket_count == pool_grid->bucket_count, "Failed hash grid tests: build depends on the thread count.\n");
+            uTesetAssert(!memcmp(serial_grid->entry_arr, pool_grid->entry_arr, pool_grid->entry_count * sizeof(u32)), "Failed hash grid tests: build depends on the thread count.\n");
+            uTesetAssert(!memcmp(serial_grid->bucket_start, pool_grid->bucket_start, (pool_grid->bucket_count + 1) * sizeof(u32)), "Failed hash grid tests: build depends on the thread count.\n");
+
+            size_t hit_count = 0;
+            for (u32 ray_index = 0; ray_index < 4096; ray_index++)
+            {
+                Ray ray = { 0 };
+                v3Set(&ray.origin, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f, 0.0f);
+                v3SetAndNorm(&ray.direction, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f, -1.0f);
+
+                RayIntersection array_intersection = { 0 };
+                RayIntersection grid_intersection  = { 0 };
+                Color32_RGB     array_color        = { 0 };
+                Color32_RGB     grid_color         = { 0 };
+                r32             array_threshold    = ( r32 )MAX_RAY_MAG;
+                r32             grid_threshold     = ( r32 )MAX_RAY_MAG;
+                TraceEntityArray(&ray, &array_intersection, &array_threshold, &array_color, entity_arr, num_entitys);
+                TraceEntityHashGrid(&ray, &grid_intersection, &grid_threshold, &grid_color, pool_grid, entity_arr);
+
+                uTesetAssert(array_intersection.entity_index == grid_intersection.entity_index, "Failed hash grid tests: closest entity differs from TraceEntityArray().\n");
+                if (grid_intersection.does_intersect)
+                {
+                    hit_count++;
+                    uTesetAssert(fabs(array_intersection.magnitude - grid_intersection.magnitude) < 1e-4f, "Failed hash grid tests: hit distance differs from TraceEntityArray().\n");
+                    uTesetAssert(array_color.value == grid_color.value, "Failed hash grid tests: hit color differs from TraceEntityArray().\n");
+                }
+            }
+            uTesetAssert(hit_count > 256 && hit_count < 4096, "Failed hash grid tests: rays should both hit and miss.\n");
+        }
+
+        free(entity_arr);
+    }
+    XorShift32State = PrevXorState;
+    DestroyEntityHashGrid(pool_grid);
+    DestroyEntityHashGrid(serial_grid);
+    DestroyThreadPool(pool);
+}
+
+// Scalar, double precision Moller-Trumbore; returns false on a miss or a hit
+// behind the origin.
+static bool
+IntersectTestTriangle(const Ray* restrict const ray, const v3* restrict const vertices, _mut_ r64* restrict const magnitude)
+{
+    const r64 edge1[3] = { vertices[1].x - vertices[0].x, vertices[1].y - vertices[0].y, vertices[1].z - vertices[0].z };
+    const r64 edge2[3] = { vertices[2].x - vertices[0].x, vertices[2].y - vertices[0].y, vertices[2].z - vertices[0].z };
+    const r64 dir[3]   = { ray->direction.x, ray->direction.y, ray->direction.z };
+    const r64 t[3]     = { ray->origin.x - vertices[0].x, ray->origin.y - vertices[0].y, ray->origin.z - vertices[0].z };
+    const r64 p[3]     = { (dir[1] * edge2[2]) - (dir[2] * edge2[1]), (dir[2] * edge2[0]) - (dir[0] * edge2[2]), (dir[0] * edge2[1]) - (dir[1] * edge2[0]) };
+    const r64 q[3]     = { (t[1] * edge1[2]) - (t[2] * edge1[1]), (t[2] * edge1[0]) - (t[0] * edge1[2]), (t[0] * edge1[1]) - (t[1] * edge1[0]) };
+
+    const r64 determinant = (edge1[0] * p[0]) + (edge1[1] * p[1]) + (edge1[2] * p[2]);
+    if (fabs(determinant) < 1e-12)
+    {
+        return false;
+    }
+
+    const r64 u = ((t[0] * p[0]) + (t[1] * p[1]) + (t[2] * p[2])) / determinant;
+    const r64 v = ((dir[0] * q[0]) + (dir[1] * q[1]) + (dir[2] * q[2])) / determinant;
+    const r64 d = ((edge2[0] * q[0]) + (edge2[1] * q[1]) + (edge2[2] * q[2])) / determinant;
+
+    *magnitude = d;
+    return u >= 0.0 && v >= 0.0 && (u + v) <= 1.0 && d >= 0.0;
+}
+
+// Rays whose two nearest brute-force hits lie within rounding of each other
+// are not compared.
+#define meshTestFailMessage "Failed mesh tests\n"
+static void
+runMeshTests()
+{
+    puts("\tRunning mesh tests...");
+
+    // A soup of small triangles in [ -1, 1 ] x [ -1, 1 ] x [ -2, -1 ]
+    const size_t triangle_count = 400;
+    const size_t vertex_count   = 3 * triangle_count;
+    v3*          vertex_arr     = ( v3* )calloc(vertex_count, sizeof(v3));
+    u32*         index_arr      = ( u32* )calloc(3 * triangle_count, sizeof(u32));
+    uTesetAssert(vertex_arr && index_arr, meshTestFailMessage);
+
+    const u32 PrevXorState = XorShift32State;
+    XorShift32State        = 0x5EED;
+    for (size_t triangle_index = 0; triangle_index < triangle_count; triangle_index++)
+    {
+        v3 center = { 0 };
+        v3Set(&center, (2.0f * NormalBoundedXorShift32()) - 1.0f, (2.0f * NormalBoundedXorShift32()) - 1.0f, -1.0f - NormalBoundedXorShift32());
+        for (size_t corner = 0; corner < 3; corner++)
+        {
+            const size_t vertex_index = (3 * triangle_index) + corner;
+            v3Set(&vertex_arr[vertex_index],
+                  center.x + (0.3f * (NormalBoundedXorShift32() - 0.5f)),
+                  center.y + (0.3f * (NormalBoundedXorShift32() - 0.5f)),
+                  center.z + (0.3f * (NormalBoundedXorShift32() - 0.5f)));
+            index_arr[vertex_index] = ( u32 )vertex_index;
+        }
+    }
+
+    ThreadPool*   pool = CreateThreadPool(3);
+    TriangleMesh* mesh = CreateTriangleMesh(vertex_arr, vertex_count, index_arr, triangle_count, pool);
+
+    // Before and after moving every vertex
+    size_t hit_count = 0;
+    for (u32 update_index = 0; update_index < 2; update_index++)
+    {
+        if (update_index)
+        {
+            for (size_t vertex_index = 0; vertex_index < vertex_count; vertex_index++)
+            {
+                mesh->vertices[vertex_index].x += 0.1f * (NormalBoundedXorShift32() - 0.5f);
+                mesh->vertices[vertex_index].z += 0.1f * (NormalBoundedXorShift32() - 0.5f);
+            }
+            UpdateTriangleMesh(mesh, pool);
+        }
+
+        for (u32 ray_index = 0; ray_index < 2048; ray_index++)
+        {
+            Ray ray = { 0 };
+            v3Set(&ray.origin, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f, 0.0f);
+            v3SetAndNorm(&ray.direction, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f, -1.0f);
+
+            r64 closest_magnitude = ( r64 )MAX_RAY_MAG;
+            r64 second_magnitude  = ( r64 )MAX_RAY_MAG;
+            u32 closest_triangle  = TRIANGLE_INDEX_NONE;
+            for (u32 triangle_index = 0; triangle_index < triangle_count; triangle_index++)
+            {
+                v3  vertices[3];
+                r64 magnitude = 0.0;
+                GetTriangleVertices(mesh, triangle_index, vertices);
+                if (!IntersectTestTriangle(&ray, vertices, &magnitude))
+                {
+                    continue;
+                }
+
+                if (magnitude < closest_magnitude)
+                {
+                    second_magnitude  = closest_magnitude;
+                    closest_magnitude = magnitude;
+                    closest_triangle  = triangle_index;
+                }
+                else if (magnitude < second_magnitude)
+                {
+                    second_magnitude = magnitude;
+                }
+            }
+
+            RayIntersection intersection   = { 0 };
+            u32             triangle_index = TRIANGLE_INDEX_NONE;
+            const bool      is_hit         = IntersectTriangleMesh(&ray, mesh, ( r32 )MAX_RAY_MAG, &intersection, &triangle_index);
+            if ((second_magnitude - closest_magnitude) < 1e-4)
+            {
+                continue;
+            }
+
+            uTesetAssert(is_hit == (closest_triangle != TRIANGLE_INDEX_NONE), "Failed mesh tests: hit differs from brute-force Moller-Trumbore.\n");
+            if (is_hit)
+            {
+                hit_count++;
+                uTesetAssert(triangle_index == closest_triangle, "Failed mesh tests: closest triangle differs from brute-force Moller-Trumbore.\n");
+                uTesetAssert(fabs(intersection.magnitude - closest_magnitude) < 1e-4, "Failed mesh tests: hit distance differs from brute-force Moller-Trumbore.\n");
+            }
+
+            const r32 max_magnitude = 0.5f + (2.0f * NormalBoundedXorShift32());
+            if (fabs(closest_magnitude - max_magnitude) > 1e-4)
+            {
+                uTesetAssert(OccludedTriangleMesh(&ray, max_magnitude, mesh) == (closest_magnitude < max_magnitude), "Failed mesh tests: any-hit differs from brute-force Moller-Trumbore.\n");
+            }
+        }
+    }
+    XorShift32State = PrevXorState;
+    uTesetAssert(hit_count > 256, "Failed mesh tests: rays should hit the mesh.\n");
+
+    DestroyTriangleMesh(mesh);
+    DestroyThreadPool(pool);
+    free(index_arr);
+    free(vertex_arr);
+}
+
+#define shadingTestFailMessage "Failed shading tests\n"
+static void
+runShadingTests()
+{
+    puts("\tRunning shading tests...");
+
+    // Entities of every material class, one record per pixel, pushed through
+    // a batch too small for the image so that it is shaded several times
+    const size_t num_entitys  = 24;
+    const size_t record_count = 1000;
+    const size_t capacity     = 96;
+    Entity*      entity_arr   = CreateTestEntities(num_entitys, 0x5EED);
+    for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
+    {
+        GetDefaultMaterialByClass(&entity_arr[entity_index].material, ( MaterialClass )(entity_index % MATERIAL_CLASS_COUNT));
+        entity_arr[entity_index].material.material_class = ( MaterialClass )(entity_index % MATERIAL_CLASS_COUNT);
+    }
+
+    Color32_RGB*  batched_arr   = ( Color32_RGB* )calloc(record_count, sizeof(Color32_RGB));
+    Color32_RGB*  reference_arr = ( Color32_RGB* )calloc(record_count, sizeof(Color32_RGB));
+    ShadingBatch* batch         = CreateShadingBatch(capacity);
+    uTesetAssert(batched_arr && reference_arr && batch, shadingTestFailMessage);
+
+    const u32 PrevXorState = XorShift32State;
+    XorShift32State        = 0xC0FFEE;
+    for (size_t pixel_index = 0; pixel_index < record_count; pixel_index++)
+    {
+        RayIntersection intersection = { 0 };
+        Color32_RGB     input_color  = { 0 };
+        intersection.does_intersect  = true;
+        intersection.entity_index    = XorShift32() % num_entitys;
+        input_color.value            = XorShift32();
+
+        const Material* material   = &entity_arr[intersection.entity_index].material;
+        batched_arr[pixel_index]   = material->color;
+        reference_arr[pixel_index] = material->color;
+        if (material->material_class != MATERIAL_CLASS_N__UE_ON__E)
+        {
+            BlendColorByMaterial(material, &input_color, &reference_arr[pixel_index]);
+        }
+
+        if (!PushHitRecord(batch, &intersection, pixel_index, &input_color))
+        {
+            ShadeHitRecords(batch, entity_arr, num_entitys, batched_arr);
+
+            // Each class is one contiguous run, in push order
+            for (size_t class_index = 0; class_index < MATERIAL_CLASS_COUNT; class_index++)
+            {
+                for (size_t record_index = batch->class_offset[class_index]; record_index < batch->class_offset[class_index + 1]; record_index++)
+                {
+                    const HitRecord* record = &batch->sorted_record_arr[record_index];
+                    uTesetAssert(entity_arr[record->entity_index].material.material_class == ( MaterialClass )class_index, "Failed shading tests: a record was sorted into the wrong class.\n");
+                    uTesetAssert(record_index == batch->class_offset[class_index] || record[-1].pixel_index < record->pixel_index, "Failed shading tests: the sort is not stable.\n");
+                }
+            }
+            uTesetAssert(batch->class_offset[MATERIAL_CLASS_COUNT] == capacity, shadingTestFailMessage);
+
+            ResetShadingBatch(batch);
+            PushHitRecord(batch, &intersection, pixel_index, &input_color);
+        }
+    }
+    ShadeHitRecords(batch, entity_arr, num_entitys, batched_arr);
+    XorShift32State = PrevXorState;
+
+    // Batched shading is the per-hit switch, one class at a time
+    uTesetAssert(!memcmp(batched_arr, reference_arr, record_count * sizeof(Color32_RGB)), "Failed shading tests: batched shading differs from BlendColorByMaterial().\n");
+
+    DestroyShadingBatch(batch);
+    free(reference_arr);
+    free(batched_arr);
+    free(entity_arr);
+}
+
+// Pixels of 'pixel_array' that differ from a full trace through 'camera'.
+static size_t
+CountTemporalMismatches(const Camera* restrict const      camera,
+                        const Color32_RGB* restrict const pixel_array,
+                        const size_t                      image_width,
+                        const size_t                      image_height,
+                        const Entity* restrict const      entity_arr,
+                        const size_t                      num_entitys)
+{
+    size_t mismatch_count = 0;
+    for (size_t pixel_index = 0; pixel_index < (image_width * image_height); pixel_index++)
+    {
+        Ray ray = { 0 };
+        SetRayByCameraSample(&ray, camera, ( r32 )(pixel_index % image_width) + 0.5f, ( r32 )(pixel_index / image_width) + 0.5f, image_width, image_height);
+
+        RayIntersection intersection        = { 0 };
+        Color32_RGB     color               = { 0 };
+        r32             magnitude_threshold = ( r32 )MAX_RAY_MAG;
+        TraceEntityArray(&ray, &intersection, &magnitude_threshold, &color, entity_arr, num_entitys);
+        color.channel.A = 0xFF;
+
+        mismatch_count += (color.value != pixel_array[pixel_index].value);
+    }
+
+    return mismatch_count;
+}
+
+#define temporalTestFailMessage "Failed temporal reprojection tests\n"
+static void
+runTemporalTests()
+{
+    puts("\tRunning temporal reprojection tests...");
+
+    const size_t   num_entitys  = 48;
+    const size_t   image_width  = 96;
+    const size_t   image_height = 64;
+    const size_t   pixel_count  = image_width * image_height;
+    Entity*        entity_arr   = CreateTestEntities(num_entitys, 0x5EED);
+    TemporalCache* cache        = CreateTemporalCache(image_width, image_height);
+    Color32_RGB*   pixel_arr    = ( Color32_RGB* )calloc(pixel_count, sizeof(Color32_RGB));
+    uTesetAssert(pixel_arr, temporalTestFailMessage);
+
+    Camera camera = { 0 };
+    v3Set(&camera.direction, 0.0f, 0.0f, -1.0f);
+
+    // The first frame is a full trace; a still camera then traces only where
+    // samples expired or were rejected, and the image does not change
+    TemporalStats stats = RenderTemporalFrame(cache, &camera, pixel_arr, entity_arr, num_entitys);
+    uTesetAssert(stats.rays_traced == pixel_count && !stats.reused_pixels, "Failed temporal reprojection tests: the first frame was not traced in full.\n");
+    uTesetAssert(!CountTemporalMismatches(&camera, pixel_arr, image_width, image_height, entity_arr, num_entitys), temporalTestFailMessage);
+
+    stats = RenderTemporalFrame(cache, &camera, pixel_arr, entity_arr, num_entitys);
+    uTesetAssert(stats.rays_traced <= (stats.expired_samples + stats.rejected_samples) && (stats.reused_pixels + stats.rays_traced) == pixel_count,
+                 "Failed temporal reprojection tests: a still camera traced a reusable pixel.\n");
+    uTesetAssert(stats.expired_samples < (pixel_count / 8), "Failed temporal reprojection tests: expiry is not staggered.\n");
+    uTesetAssert(!CountTemporalMismatches(&camera, pixel_arr, image_width, image_height, entity_arr, num_entitys), "Failed temporal reprojection tests: a still camera changed the image.\n");
+
+    // A slowly moving camera traces a fraction of the image and stays within
+    // 5% of a full trace; silhouettes may land one pixel off
+    size_t rays_traced    = 0;
+    size_t mismatch_count = 0;
+    for (u32 frame_index = 1; frame_index <= 16; frame_index++)
+    {
+        v3Set(&camera.origin, 0.002f * ( r32 )frame_index, 0.001f * ( r32 )frame_index, 0.0f);
+        v3SetAndNorm(&camera.direction, 0.001f * ( r32 )frame_index, 0.0f, -1.0f);
+
+        stats = RenderTemporalFrame(cache, &camera, pixel_arr, entity_arr, num_entitys);
+        rays_traced += stats.rays_traced;
+        mismatch_count += CountTemporalMismatches(&camera, pixel_arr, image_width, image_height, entity_arr, num_entitys);
+    }
+    uTesetAssert(rays_traced < (16 * pixel_count / 2), "Failed temporal reprojection tests: a moving camera reused too little.\n");
+    uTesetAssert(mismatch_count < (16 * pixel_count / 20), "Failed temporal reprojection tests: reprojected frames drifted from a full trace.\n");
+
+    // Invalidated regions are traced, and an invalidated cache traces it all
+    InvalidateTemporalRegion(cache, 8, 8, 40, 24);
+    stats = RenderTemporalFrame(cache, &camera, pixel_arr, entity_arr, num_entitys);
+    uTesetAssert(stats.rays_traced >= (32 * 16), "Failed temporal reprojection tests: an invalidated region was reused.\n");
+
+    InvalidateTemporalCache(cache);
+    stats = RenderTemporalFrame(cache, &camera, pixel_arr, entity_arr, num_entitys);
+    uTesetAssert(stats.rays_traced == pixel_count, "Failed temporal reprojection tests: an invalidated cache was reused.\n");
+    uTesetAssert(!CountTemporalMismatches(&camera, pixel_arr, image_width, image_height, entity_arr, num_entitys), temporalTestFailMessage);
+
+    // max_age 1 disables reuse
+    cache->max_age = 1;
+    stats          = RenderTemporalFrame(cache, &camera, pixel_arr, entity_arr, num_entitys);
+    uTesetAssert(stats.rays_traced == pixel_count && stats.expired_samples == pixel_count, "Failed temporal reprojection tests: max_age 1 reused a pixel.\n");
+
+    free(pixel_arr);
+    DestroyTemporalCache(cache);
+    free(entity_arr);
+}
+
+// Guides of a plane facing the camera at depth 2, split at split_x: the
+// right part faces +x instead. Color is 'base' plus 'noise' times white noise.
+static void
+SetDenoiseTestInput(_mut_ DenoiseBuffers* restrict const buffers, const size_t split_x, const r32 left_base, const r32 right_base, const r32 noise)
+{
+    for (size_t pixel_index = 0; pixel_index < (buffers->image_width * buffers->image_height); pixel_index++)
+    {
+        const bool is_right = (pixel_index % buffers->image_width) >= split_x;
+        for (u8 channel_index = 0; channel_index < 3; channel_index++)
+        {
+            buffers->color[channel_index][pixel_index]  = (is_right ? right_base : left_base) + (noise * (NormalBoundedXorShift32() - 0.5f));
+            buffers->albedo[channel_index][pixel_index] = 0.8f;
+            buffers->normal[channel_index][pixel_index] = (channel_index == (is_right ? 0 : 2)) ? 1.0f : 0.0f;
+        }
+        buffers->depth[pixel_index] = 2.0f;
+    }
+}
+
+#define denoiseTestFailMessage "Failed denoise tests\n"
+static void
+runDenoiseTests()
+{
+    puts("\tRunning denoise tests...");
+
+    // Odd sizes exercise the scalar edge pixels of the SSE rows
+    const size_t    image_width  = 67;
+    const size_t    image_height = 45;
+    const size_t    pixel_count  = image_width * image_height;
+    DenoiseBuffers* buffers      = CreateDenoiseBuffers(image_width, image_height);
+    DenoiseBuffers* pool_buffers = CreateDenoiseBuffers(image_width, image_height);
+    ThreadPool*     pool         = CreateThreadPool(3);
+
+    DenoiseSettings settings = { 0 };
+    GetDefaultDenoiseSettings(&settings);
+
+    const u32 PrevXorState = XorShift32State;
+    XorShift32State        = 0x5EED;
+
+    // A flat image stays flat
+    SetDenoiseTestInput(buffers, image_width, 0.4f, 0.4f, 0.0f);
+    Denoise(buffers, &settings, pool);
+    for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+    {
+        uTesetAssert(fabs(buffers->color[1][pixel_index] - 0.4f) < 1e-4f, "Failed denoise tests: a flat image did not stay flat.\n");
+    }
+
+    // Noise on a flat surface is smoothed around the same mean, and the pool
+    // does not change the result
+    SetDenoiseTestInput(buffers, image_width, 0.5f, 0.5f, 0.4f);
+    for (u8 channel_index = 0; channel_index < 3; channel_index++)
+    {
+        memcpy(pool_buffers->color[channel_index], buffers->color[channel_index], pixel_count * sizeof(r32));
+        memcpy(pool_buffers->albedo[channel_index], buffers->albedo[channel_index], pixel_count * sizeof(r32));
+        memcpy(pool_buffers->normal[channel_index], buffers->normal[channel_index], pixel_count * sizeof(r32));
+    }
+    memcpy(pool_buffers->depth, buffers->depth, pixel_count * sizeof(r32));
+
+    r64 noisy_mean     = 0.0;
+    r64 noisy_variance = 0.0;
+    for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+    {
+        noisy_mean += buffers->color[0][pixel_index];
+        noisy_variance += (buffers->color[0][pixel_index] - 0.5) * (buffers->color[0][pixel_index] - 0.5);
+    }
+
+    Denoise(buffers, &settings, NULL);
+    Denoise(pool_buffers, &settings, pool);
+    r64 mean     = 0.0;
+    r64 variance = 0.0;
+    for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+    {
+        mean += buffers->color[0][pixel_index];
+        variance += (buffers->color[0][pixel_index] - 0.5) * (buffers->color[0][pixel_index] - 0.5);
+        uTesetAssert(buffers->color[0][pixel_index] == pool_buffers->color[0][pixel_index], "Failed denoise tests: the result depends on the pool.\n");
+    }
+    uTesetAssert(variance < (0.05 * noisy_variance), "Failed denoise tests: noise was not smoothed.\n");
+    uTesetAssert(fabs(mean - noisy_mean) < (0.01 * ( r64 )pixel_count), "Failed denoise tests: smoothing moved the mean.\n");
+
+    // A normal edge is not blurred
+    SetDenoiseTestInput(buffers, image_width / 2, 0.2f, 0.8f, 0.0f);
+    Denoise(buffers, &settings, pool);
+    for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+    {
+        const r32 expected = ((pixel_index % image_width) >= (image_width / 2)) ? 0.8f : 0.2f;
+        uTesetAssert(fabs(buffers->color[2][pixel_index] - expected) < 1e-3f, "Failed denoise tests: an edge was blurred.\n");
+    }
+    XorShift32State = PrevXorState;
+
+    DestroyThreadPool(pool);
+    DestroyDenoiseBuffers(pool_buffers);
+    DestroyDenoiseBuffers(buffers);
+}
+
+#define sceneTestFailMessage "Failed scene tests\n"
+static void
+runSceneTests()
+{
+    puts("\tRunning scene tests...");
+
+    // Every third entity a cube
+    const size_t num_entitys = 61;
+    Entity*      entity_arr  = CreateTestEntities(num_entitys, 0x5EED);
+    for (size_t entity_index = 0; entity_index < num_entitys; entity_index += 3)
+    {
+        entity_arr[entity_index].type   = ET_CUBE;
+        entity_arr[entity_index].length = 2.0f * entity_arr[entity_index].radius;
+    }
+    Scene* scene = CreateScene(entity_arr, num_entitys);
+    uTesetAssert(scene->sphere_count + scene->cube_count == num_entitys, sceneTestFailMessage);
+
+    // Rays from in front of the scene: the type-sorted kernels agree with the
+    // per-entity dispatch of TraceEntityArray()
+    const u32 PrevXorState = XorShift32State;
+    XorShift32State        = 0xC0FFEE;
+    size_t hit_count       = 0;
+    for (u32 ray_index = 0; ray_index < 4096; ray_index++)
+    {
+        Ray ray = { 0 };
+        v3Set(&ray.origin, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f, 0.0f);
+        v3SetAndNorm(&ray.direction, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f, -1.0f);
+
+        RayIntersection array_intersection = { 0 };
+        RayIntersection scene_intersection = { 0 };
+        Color32_RGB     array_color        = { 0 };
+        Color32_RGB     scene_color        = { 0 };
+        r32             array_threshold    = ( r32 )MAX_RAY_MAG;
+        r32             scene_threshold    = ( r32 )MAX_RAY_MAG;
+        TraceEntityArray(&ray, &array_intersection, &array_threshold, &array_color, entity_arr, num_entitys);
+        TraceScene(&ray, &scene_intersection, &scene_threshold, &scene_color, scene, NULL, 0);
+
+        uTesetAssert(array_intersection.entity_index == scene_intersection.entity_index, "Failed scene tests: closest entity differs from TraceEntityArray().\n");
+        if (scene_intersection.does_intersect)
+        {
+            hit_count++;
+            uTesetAssert(fabs(array_intersection.magnitude - scene_intersection.magnitude) < 1e-4f, "Failed scene tests: hit distance differs from TraceEntityArray().\n");
+            uTesetAssert(array_color.value == scene_color.value, "Failed scene tests: hit color differs from TraceEntityArray().\n");
+        }
+    }
+    XorShift32State = PrevXorState;
+    uTesetAssert(hit_count > 256 && hit_count < 4096, "Failed scene tests: rays should both hit and miss.\n");
+
+    DestroyScene(scene);
+    free(entity_arr);
+}
+
+// Brute-force counterpart of TraceKernelRay(): the closest entity beyond
+// TOLERANCE, its bounce drawn from the same sample dimensions, blended by
+// BlendColorByMaterial().
+static bool
+TraceKernelTestRay(const Ray* restrict const         ray,
+                   const Entity* restrict const      entity_arr,
+                   const size_t                      num_entitys,
+                   const KernelPrimitiveSet          primitives,
+                   const u32                         bounce,
+                   const u32                         max_bounces,
+                   _mut_ Color32_RGB* restrict const return_color)
+{
+    RayIntersection intersection = { 0 };
+    r32             closest      = ( r32 )MAX_RAY_MAG;
+    for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
+    {
+        const Entity* entity = &entity_arr[entity_index];
+        if (entity->type == ET_TRIANGLE_MESH || (primitives == KP_SPHERES && entity->type == ET_CUBE))
+        {
+            continue;
+        }
+
+        RayIntersection candidate = { 0 };
+        IntersectEntity(ray, entity, &candidate);
+        if (candidate.does_intersect && candidate.magnitude >= ( r32 )TOLERANCE && candidate.magnitude < closest)
+        {
+            intersection              = candidate;
+            intersection.entity_index = ( u32 )entity_index;
+            closest                   = candidate.magnitude;
+        }
+    }
+
+    if (closest >= ( r32 )MAX_RAY_MAG)
+    {
+        return false;
+    }
+
+    const Material* material = &entity_arr[intersection.entity_index].material;
+    return_color->value      = material->color.value;
+    if (bounce >= max_bounces || bounce >= material->max_generated_rays || material->material_class == MATERIAL_CLASS_N__UE_ON__E)
+    {
+        return true;
+    }
+
+    const r32 normal_dot = v3Dot(&ray->direction, &intersection.normal_vector);
+    const r32 xrand      = NextSample1D() - 0.5f;
+    const r32 yrand      = NextSample1D() - 0.5f;
+    const r32 zrand      = NextSample1D() - 0.5f;
+
+    Ray bounce_ray    = { 0 };
+    bounce_ray.origin = intersection.position;
+    v3SetAndNorm(&bounce_ray.direction,
+                 ray->direction.x - (2.0f * normal_dot * intersection.normal_vector.x) + (xrand * ( r32 )__UE_AA__reflection_noise),
+                 ray->direction.y - (2.0f * normal_dot * intersection.normal_vector.y) + (yrand * ( r32 )__UE_AA__reflection_noise),
+                 ray->direction.z - (2.0f * normal_dot * intersection.normal_vector.z) + (zrand * ( r32 )__UE_AA__reflection_noise));
+
+    Color32_RGB input_color = { 0 };
+    if (TraceKernelTestRay(&bounce_ray, entity_arr, num_entitys, primitives, bounce + 1, max_bounces, &input_color))
+    {
+        BlendColorByMaterial(material, &input_color, return_color);
+    }
+    return true;
+}
+
+// Every kTraceKernelTable entry against TraceKernelTestRay(). The two find
+// their hits differently, so a bounce that grazes an entity may go either
+// way; a few pixels in a thousand may differ.
+#define kernelTestFailMessage "Failed kernel tests\n"
+static void
+runKernelTests()
+{
+    puts("\tRunning kernel tests...");
+
+    const size_t num_entitys  = 61;
+    const size_t image_width  = 64;
+    const size_t image_height = 32;
+    const size_t pixel_count  = image_width * image_height;
+    Entity*      entity_arr   = CreateTestEntities(num_entitys, 0x5EED);
+    const u32    PrevXorState = XorShift32State;
+    XorShift32State           = 0xC0FFEE;
+    for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
+    {
+        const MaterialClass material_class = ( MaterialClass )(entity_index % MATERIAL_CLASS_COUNT);
+        GetDefaultMaterialByClass(&entity_arr[entity_index].material, material_class);
+        entity_arr[entity_index].material.material_class = material_class;
+        entity_arr[entity_index].material.color.value    = XorShift32();
+        if (entity_index % 3 == 0)
+        {
+            entity_arr[entity_index].type   = ET_CUBE;
+            entity_arr[entity_index].length = 2.0f * entity_arr[entity_index].radius;
+        }
+    }
+    XorShift32State = PrevXorState;
+
+    Scene*       scene     = CreateScene(entity_arr, num_entitys);
+    ThreadPool*  pool      = CreateThreadPool(3);
+    Color32_RGB* pixel_arr = ( Color32_RGB* )calloc(pixel_count, sizeof(Color32_RGB));
+    uTesetAssert(scene && pool && pixel_arr, kernelTestFailMessage);
+
+    TraceKernelFrame frame = { 0 };
+    frame.pixel_arr        = pixel_arr;
+    frame.image_width      = image_width;
+    frame.image_height     = image_height;
+    frame.scene            = scene;
+    frame.sample_index     = 3;
+
+    for (u32 anti_aliasing = 0; anti_aliasing < 2; anti_aliasing++)
+    {
+        for (u32 max_bounces = 0; max_bounces <= KERNEL_MAX_BOUNCES; max_bounces++)
+        {
+            for (u32 primitives = 0; primitives < KERNEL_PRIMITIVE_SET_COUNT; primitives++)
+            {
+                ParallelFor(pool, image_height, kTraceKernelTable[anti_aliasing][max_bounces][primitives], &frame);
+
+                size_t hit_count      = 0;
+                size_t mismatch_count = 0;
+                for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+                {
+                    const size_t pix_x = pixel_index % image_width;
+                    const size_t pix_y = pixel_index / image_width;
+                    BeginPixelSample(( u32 )pixel_index, frame.sample_index);
+
+                    r32 sample_x = ( r32 )pix_x + 0.5f;
+                    r32 sample_y = ( r32 )pix_y + 0.5f;
+                    if (anti_aliasing)
+                    {
+                        sample_x += (NextSample1D() - 0.5f) * ( r32 )__UE_AA__noise;
+                        sample_y += (NextSample1D() - 0.5f) * ( r32 )__UE_AA__noise;
+                    }
+
+                    Ray ray = { 0 };
+                    SetRayDirectionByPixelSample(&ray, sample_x, sample_y, image_width, image_height);
+                    v3Norm(&ray.direction);
+
+                    Color32_RGB reference = { 0 };
+                    hit_count += TraceKernelTestRay(&ray, entity_arr, num_entitys, ( KernelPrimitiveSet )primitives, 0, max_bounces, &reference);
+                    reference.channel.A = 0xFF;
+                    mismatch_count += (reference.value != pixel_arr[pixel_index].value);
+                }
+
+                uTesetAssert(hit_count > (pixel_count / 8) && hit_count < pixel_count, "Failed kernel tests: rays should both hit and miss.\n");
+                uTesetAssert((mismatch_count * 200) <= pixel_count, "Failed kernel tests: a kernel differs from the reference tracer.\n");
+            }
+        }
+    }
+
+    free(pixel_arr);
+    DestroyThreadPool(pool);
+    DestroyScene(scene);
+    free(entity_arr);
+}
+
+// Entities scattered around the camera, in front of and behind it, so that
+// both the image frustum and the tile frusta cull some. Each pixel's primary
+// ray, at its center and jittered, must find the same closest hit in its
+// tile's list as in the whole array.
+#define cullTestFailMessage "Failed cull tests\n"
+static void
+runCullTests()
+{
+    puts("\tRunning cull tests...");
+
+    const size_t num_entitys  = 200;
+    const size_t image_width  = 60;
+    const size_t image_height = 44;
+    const size_t tile_size    = 8;
+    Entity*      entity_arr   = CreateTestEntities(num_entitys, 0x5EED);
+    const u32    PrevXorState = XorShift32State;
+    XorShift32State           = 0xC0FFEE;
+    for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
+    {
+        v3Set(&entity_arr[entity_index].position, 8.0f * (NormalBoundedXorShift32() - 0.5f), 8.0f * (NormalBoundedXorShift32() - 0.5f), 6.0f * (NormalBoundedXorShift32() - 0.5f));
+        if (entity_index % 3 == 0)
+        {
+            entity_arr[entity_index].type   = ET_CUBE;
+            entity_arr[entity_index].length = 2.0f * entity_arr[entity_index].radius;
+        }
+    }
+
+    ThreadPool*     pool = CreateThreadPool(3);
+    EntityCullGrid* grid = CreateEntityCullGrid(image_width, image_height, tile_size);
+    BuildEntityCullGrid(grid, entity_arr, num_entitys, pool);
+    uTesetAssert(grid->visible_count > 0 && grid->visible_count < num_entitys, "Failed cull tests: the image frustum should cull some entities.\n");
+
+    size_t hit_count = 0;
+    for (size_t pixel_index = 0; pixel_index < (image_width * image_height); pixel_index++)
+    {
+        const size_t pix_x      = pixel_index % image_width;
+        const size_t pix_y      = pixel_index / image_width;
+        const size_t tile_index = ((pix_y / tile_size) * grid->tiles_x) + (pix_x / tile_size);
+
+        size_t        tile_entity_count = 0;
+        const Entity* tile_entity_arr   = GetEntityCullTile(grid, tile_index, &tile_entity_count);
+        uTesetAssert(tile_entity_count <= grid->visible_count, cullTestFailMessage);
+
+        for (u32 sample_index = 0; sample_index < 2; sample_index++)
+        {
+            const r32 jitter_x = sample_index ? NormalBoundedXorShift32() : 0.5f;
+            const r32 jitter_y = sample_index ? NormalBoundedXorShift32() : 0.5f;
+
+            Ray ray = { 0 };
+            SetRayDirectionByPixelSample(&ray, ( r32 )pix_x + jitter_x, ( r32 )pix_y + jitter_y, image_width, image_height);
+            v3Norm(&ray.direction);
+
+            RayIntersection array_intersection = { 0 };
+            RayIntersection cull_intersection  = { 0 };
+            Color32_RGB     array_color        = { 0 };
+            Color32_RGB     cull_color         = { 0 };
+            r32             array_threshold    = ( r32 )MAX_RAY_MAG;
+            r32             cull_threshold     = ( r32 )MAX_RAY_MAG;
+            TraceEntityArray(&ray, &array_intersection, &array_threshold, &array_color, entity_arr, num_entitys);
+            hit_count += array_intersection.does_intersect;
+
+            // A tile left with one entity traces the whole array; see:
+            // RenderTiledFramebufferTile()
+            if (tile_entity_count < 2)
+            {
+                uTesetAssert(tile_entity_count || !array_intersection.does_intersect, "Failed cull tests: a ray hit in a tile culled empty.\n");
+                continue;
+            }
+
+            TraceEntityArray(&ray, &cull_intersection, &cull_threshold, &cull_color, tile_entity_arr, tile_entity_count);
+
+            uTesetAssert(array_intersection.does_intersect == cull_intersection.does_intersect, "Failed cull tests: a culled trace missed or found a hit.\n");
+            if (array_intersection.does_intersect)
+            {
+                uTesetAssert(GetEntityCullSourceIndex(grid, tile_index, cull_intersection.entity_index) == array_intersection.entity_index, "Failed cull tests: closest entity differs from the unculled trace.\n");
+                uTesetAssert(array_intersection.magnitude == cull_intersection.magnitude && array_color.value == cull_color.value, "Failed cull tests: hit differs from the unculled trace.\n");
+            }
+        }
+    }
+    XorShift32State = PrevXorState;
+    uTesetAssert(hit_count > 0 && hit_count < (2 * image_width * image_height), "Failed cull tests: rays should both hit and miss.\n");
+
+    DestroyEntityCullGrid(grid);
+    DestroyThreadPool(pool);
+    free(entity_arr);
+}
+
+// Moving one entity must drop the records that saw it and keep the others;
+// the next population pass re-fills only the holes.
+#define irradianceTestFailMessage "Failed irradiance cache tests\n"
+static void
+runIrradianceTests()
+{
+    puts("\tRunning irradiance cache tests...");
+
+    const size_t num_entitys = 48;
+    Entity*      entity_arr  = CreateTestEntities(num_entitys, 0x5EED);
+    for (size_t entity_index = 0; entity_index < num_entitys; entity_index++)
+    {
+        GetDefaultMaterialByClass(&entity_arr[entity_index].material, MATERIAL_CLASS_DIFFUSE);
+        entity_arr[entity_index].material.material_class = MATERIAL_CLASS_DIFFUSE;
+    }
+
+    TraceKernelSettings kernel = { 0 };
+    GetDefaultTraceKernelSettings(&kernel);
+    kernel.reflections = true;
+    kernel.max_bounces = 1;
+
+    Scene*           scene = CreateScene(entity_arr, num_entitys);
+    TraceKernelFrame frame = { 0 };
+    frame.image_width      = 96;
+    frame.image_height     = 48;
+    frame.scene            = scene;
+
+    IrradianceCacheSettings cache_settings = { 0 };
+    GetDefaultIrradianceCacheSettings(&cache_settings);
+    IrradianceCache* cache = CreateIrradianceCache(&cache_settings);
+    const size_t     full_count = PopulateIrradianceCache(&kernel, &frame, cache, NULL);
+    uTesetAssert(full_count > 16 && full_count == cache->record_count, irradianceTestFailMessage);
+
+    // Move the entity under the first record
+    const u32    moved_index = cache->record_arr[0].entity_index;
+    const Entity previous    = entity_arr[moved_index];
+    entity_arr[moved_index].position.x += 0.25f;
+    UpdateScene(scene);
+
+    const size_t dropped_count = InvalidateIrradianceEntity(cache, moved_index, &previous, &entity_arr[moved_index]);
+    uTesetAssert(dropped_count > 0 && dropped_count < full_count && dropped_count == cache->invalid_count, "Failed irradiance cache tests: a move should drop some records, not all.\n");
+
+    IrradianceRecord* kept_arr   = ( IrradianceRecord* )malloc(full_count * sizeof(IrradianceRecord));
+    size_t            kept_count = 0;
+    uTesetAssert(kept_arr, irradianceTestFailMessage);
+    for (size_t record_index = 0; record_index < cache->record_count; record_index++)
+    {
+        const IrradianceRecord* record = &cache->record_arr[record_index];
+        if (record->valid)
+        {
+            uTesetAssert(record->entity_index != moved_index && !(record->hit_mask & (( u64 )1 << (moved_index & 63))), "Failed irradiance cache tests: a record that saw the move was kept.\n");
+            kept_arr[kept_count++] = *record;
+        }
+    }
+
+    // Kept records come first, unchanged, and fewer records are traced than
+    // for a cold cache
+    const size_t refill_count = PopulateIrradianceCache(&kernel, &frame, cache, NULL);
+    uTesetAssert(refill_count > 0 && refill_count < full_count, "Failed irradiance cache tests: holes were not re-filled alone.\n");
+    uTesetAssert(cache->record_count == kept_count + refill_count && !memcmp(cache->record_arr, kept_arr, kept_count * sizeof(IrradianceRecord)), "Failed irradiance cache tests: kept records changed.\n");
+
+    // Meshes carry no bounds: everything goes
+    Entity       mesh         = entity_arr[moved_index];
+    const size_t record_count = cache->record_count;
+    mesh.type                 = ET_TRIANGLE_MESH;
+    uTesetAssert(InvalidateIrradianceEntity(cache, moved_index, &entity_arr[moved_index], &mesh) == record_count, irradianceTestFailMessage);
+    uTesetAssert(!cache->record_count && !cache->invalid_count, "Failed irradiance cache tests: a mesh change did not clear the cache.\n");
+
+    free(kept_arr);
+    DestroyIrradianceCache(cache);
+    DestroyScene(scene);
+    free(entity_arr);
+}
+
+// Random rays from the z = 0 plane into the test entities, with a random
+// query distance; see: runOcclusionTests()
+static void
+GetRandomOcclusionRay(_mut_ Ray* restrict const ray, _mut_ r32* restrict const max_magnitude)
+{
+    v3Set(&ray->origin, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f, 0.0f);
+    v3SetAndNorm(&ray->direction, NormalBoundedXorShift32() - 0.5f, NormalBoundedXorShift32() - 0.5f, -1.0f);
+    *max_magnitude = 0.5f + (3.5f * NormalBoundedXorShift32());
+}
+
+// An any-hit answer must be the closest hit compared against the query
+// distance; rays whose hit lies within rounding of it are not compared.
+#define occlusionTestFailMessage "Failed occlusion tests\n"
+static void
+runOcclusionTests()
+{
+    puts("\tRunning occlusion tests...");
+
+    const size_t num_entitys = 61;
+    Entity*      entity_arr  = CreateTestEntities(num_entitys, 0x5EED);
+    for (size_t entity_index = 0; entity_index < num_entitys; entity_index += 3)
+    {
+        entity_arr[entity_index].type   = ET_CUBE;
+        entity_arr[entity_index].length = 2.0f * entity_arr[entity_index].radius;
+    }
+
+    Scene* scene = CreateScene(entity_arr, num_entitys);
+    BLAS*  blas  = CreateBLAS(entity_arr, num_entitys, NULL);
+
+    // The BLAS as is, shrunk behind it, and shifted to the right
+    Instance instance_arr[3] = { 0 };
+    m4       transform       = { 0 };
+    m4Ident(&transform);
+    uTesetAssert(SetInstanceTransform(&instance_arr[0], &transform), occlusionTestFailMessage);
+    transform.arr2d[0][0] = 0.5f;
+    transform.arr2d[1][1] = 0.5f;
+    transform.arr2d[2][2] = 0.5f;
+    transform.arr2d[2][3] = -2.0f;
+    uTesetAssert(SetInstanceTransform(&instance_arr[1], &transform), occlusionTestFailMessage);
+    m4Ident(&transform);
+    transform.arr2d[0][3] = 1.5f;
+    uTesetAssert(SetInstanceTransform(&instance_arr[2], &transform), occlusionTestFailMessage);
+    InstancedScene* instanced_scene = CreateInstancedScene(blas, 1, instance_arr, 3, NULL);
+
+    const u32 PrevXorState   = XorShift32State;
+    XorShift32State          = 0xC0FFEE;
+    size_t occluded_count[3] = { 0 };
+    size_t visible_count[3]  = { 0 };
+    for (u32 ray_index = 0; ray_index < 4096; ray_index++)
+    {
+        Ray ray           = { 0 };
+        r32 max_magnitude = 0.0f;
+        GetRandomOcclusionRay(&ray, &max_magnitude);
+
+        RayIntersection intersection[3] = { 0 };
+        Color32_RGB     color           = { 0 };
+        u32             instance_index  = 0;
+        r32             threshold[3]    = { ( r32 )MAX_RAY_MAG, ( r32 )MAX_RAY_MAG, ( r32 )MAX_RAY_MAG };
+        TraceScene(&ray, &intersection[0], &threshold[0], &color, scene, NULL, 0);
+        TraceEntityBVH(&ray, &intersection[1], &threshold[1], &color, blas->bvh, entity_arr);
+        TraceInstancedScene(&ray, &intersection[2], &threshold[2], &color, &instance_index, instanced_scene);
+
+        const bool is_occluded[3] = { OccludedScene(&ray, max_magnitude, scene, NULL, 0),
+                                      OccludedEntityBVH(&ray, max_magnitude, blas->bvh, entity_arr),
+                                      OccludedInstancedScene(&ray, max_magnitude, instanced_scene) };
+        for (u32 query = 0; query < 3; query++)
+        {
+            if (intersection[query].does_intersect && fabs(intersection[query].magnitude - max_magnitude) < 1e-3f)
+            {
+                continue;
+            }
+
+            const bool is_closer = intersection[query].does_intersect && intersection[query].magnitude < max_magnitude;
+            uTesetAssert(is_occluded[query] == is_closer, "Failed occlusion tests: any-hit and closest-hit queries disagree.\n");
+            occluded_count[query] += is_occluded[query];
+            visible_count[query] += !is_occluded[query];
+        }
+    }
+    XorShift32State = PrevXorState;
+    for (u32 query = 0; query < 3; query++)
+    {
+        uTesetAssert(occluded_count[query] > 256 && visible_count[query] > 256, "Failed occlusion tests: rays should be both occluded and visible.\n");
+    }
+
+    // An irradiance record behind a thin cube leaks through it unless the
+    // lookup tests its visibility
+    Entity wall_arr[3] = { 0 };
+    for (u32 entity_index = 0; entity_index < 2; entity_index++)
+    {
+        wall_arr[entity_index].type   = ET_SPHERE;
+        wall_arr[entity_index].radius = 0.1f;
+        v3Set(&wall_arr[entity_index].position, 5.0f + ( r32 )entity_index, 5.0f, -5.0f);
+    }
+    wall_arr[2].type   = ET_CUBE;
+    wall_arr[2].length = 0.005f;
+    v3Set(&wall_arr[2].position, 0.01f, 0.0f, -0.999f);
+    Scene* wall_scene = CreateScene(wall_arr, 3);
+
+    IrradianceCacheSettings cache_settings = { 0 };
+    GetDefaultIrradianceCacheSettings(&cache_settings);
+    IrradianceCache* cache = CreateIrradianceCache(&cache_settings);
+
+    IrradianceRecord record = { 0 };
+    v3Set(&record.position, 0.02f, 0.0f, -1.0f);
+    v3Set(&record.normal, 0.0f, 0.0f, -1.0f);
+    record.radius           = cache_settings.max_radius;
+    record.irradiance.value = 0xFFFFFFFF;
+    record.entity_index     = 1;
+    InsertIrradianceRecord(cache, &record);
+
+    v3 position = { 0 };
+    v3 normal   = { 0 };
+    v3Set(&position, 0.0f, 0.0f, -1.0f);
+    v3Set(&normal, 0.0f, 0.0f, -1.0f);
+    Color32_RGB irradiance = { 0 };
+    uTesetAssert(LookupIrradiance(cache, NULL, &position, &normal, 0, &irradiance), "Failed occlusion tests: the record should be in range.\n");
+    uTesetAssert(!LookupIrradiance(cache, wall_scene, &position, &normal, 0, &irradiance), "Failed occlusion tests: an occluded irradiance record was used.\n");
+    uTesetAssert(LookupIrradiance(cache, wall_scene, &position, &normal, 1, &irradiance), "Failed occlusion tests: a record on the same entity was skipped.\n");
+
+    DestroyIrradianceCache(cache);
+    DestroyScene(wall_scene);
+    DestroyInstancedScene(instanced_scene);
+    DestroyBLAS(blas);
+    DestroyScene(scene);
+    free(entity_arr);
+}
+
+#define farmTestFailMessage "Failed farm tests\n"
+static void
+runFarmTests()
+{
+    puts("\tRunning farm tests...");
+
+    const size_t num_entitys = 32;
+    Entity*      entity_arr  = CreateTestEntities(num_entitys, 0x5EED);
+    Scene*       scene       = CreateScene(entity_arr, num_entitys);
+
+    // The last tile is a partial band
+    const u32    image_width  = 48;
+    const u32    image_height = 30;
+    const size_t pixel_count  = ( size_t )image_width * image_height;
+
+    TraceKernelSettings kernel = { 0 };
+    GetDefaultTraceKernelSettings(&kernel);
+
+    TraceKernelFrame frame = { 0 };
+    frame.pixel_arr        = ( Color32_RGB* )calloc(pixel_count, sizeof(Color32_RGB));
+    frame.image_width      = image_width;
+    frame.image_height     = image_height;
+    frame.scene            = scene;
+    frame.sample_index     = 3;
+    uTesetAssert(frame.pixel_arr, farmTestFailMessage);
+    RenderTraceKernel(&kernel, &frame, NULL);
+
+    // Workers that exit at once without claiming a tile, as a crash on start
+    // would: every tile must be recovered by the coordinator
+    FarmSettings settings = { 0 };
+    GetDefaultFarmSettings(&settings);
+    settings.worker_count      = 2;
+    settings.worker_executable = "/bin/false";
+
+    Farm* farm = CreateFarm(&settings, entity_arr, num_entitys, image_width, image_height);
+    uTesetAssert(farm, "Failed farm tests: could not create the farm.\n");
+
+    const u32    tile_count = (image_height + settings.rows_per_tile - 1) / settings.rows_per_tile;
+    Color32_RGB* farm_arr   = ( Color32_RGB* )calloc(pixel_count, sizeof(Color32_RGB));
+    uTesetAssert(farm_arr, farmTestFailMessage);
+    for (u32 frame_index = 0; frame_index < 2; frame_index++)
+    {
+        FarmFrameReport report = { 0 };
+        memset(farm_arr, 0, pixel_count * sizeof(Color32_RGB));
+        RenderFarmFrame(farm, &kernel, frame.sample_index, farm_arr, &report);
+        uTesetAssert(report.failed_workers == settings.worker_count, "Failed farm tests: failed workers were not reported.\n");
+        uTesetAssert(report.tiles_recovered == tile_count && !report.tiles_by_workers, "Failed farm tests: tiles were not recovered.\n");
+        uTesetAssert(!memcmp(frame.pixel_arr, farm_arr, pixel_count * sizeof(Color32_RGB)), "Failed farm tests: recovered image differs.\n");
+    }
+
+    // A worker must refuse a work header whose arrays lie past the segment
+    FarmWorkHeader* work = ( FarmWorkHeader* )farm->work_segment.base;
+    uTesetAssert(IsFarmWorkHeaderValid(work, farm->work_segment.size), "Failed farm tests: a valid work header was refused.\n");
+    const u64 tile_state_offset = work->tile_state_offset;
+    const u64 pixel_offset      = work->pixel_offset;
+    const u64 bad_offsets[3][2] = {
+        { tile_state_offset, work->segment_size - sizeof(u32) },
+        { ~( u64 )0 - 3, pixel_offset },
+        { tile_state_offset, ~( u64 )0 - 3 },
+    };
+    for (u32 case_index = 0; case_index < 3; case_index++)
+    {
+        work->tile_state_offset = bad_offsets[case_index][0];
+        work->pixel_offset      = bad_offsets[case_index][1];
+        uTesetAssert(!RunFarmWorker(farm->name), "Failed farm tests: a worker accepted arrays past its segment.\n");
+    }
+    work->tile_state_offset = tile_state_offset;
+    work->pixel_offset      = pixel_offset;
+    work->tile_count        = tile_count + 1;
+    uTesetAssert(!RunFarmWorker(farm->name), "Failed farm tests: a worker accepted a mismatched tile count.\n");
+    work->tile_count = tile_count;
+    uTesetAssert(work->next_tile.load() == 0, "Failed farm tests: a refused worker claimed a tile.\n");
+
+#if !_WIN32
+    // Workers that never exit are killed at the deadline and their tiles
+    // recovered
+    const char* const stuck_worker = "./ue_farm_test_worker.sh";
+    FILE*             script       = fopen(stuck_worker, "w");
+    uTesetAssert(script, farmTestFailMessage);
+    fputs("#!/bin/sh\nexec sleep 30\n", script);
+    fclose(script);
+    chmod(stuck_worker, 0700);
+
+    farm->settings.worker_executable      = stuck_worker;
+    farm->settings.worker_timeout_seconds = 0.25;
+
+    FarmFrameReport report      = { 0 };
+    const r64       frame_begin = GetClockSeconds();
+    memset(farm_arr, 0, pixel_count * sizeof(Color32_RGB));
+    RenderFarmFrame(farm, &kernel, frame.sample_index, farm_arr, &report);
+    uTesetAssert((GetClockSeconds() - frame_begin) < 10.0, "Failed farm tests: stuck workers were waited for.\n");
+    uTesetAssert(report.timed_out_workers == settings.worker_count && report.failed_workers == settings.worker_count, "Failed farm tests: stuck workers were not reported.\n");
+    uTesetAssert(report.tiles_recovered == tile_count, "Failed farm tests: tiles of stuck workers were not recovered.\n");
+    uTesetAssert(!memcmp(frame.pixel_arr, farm_arr, pixel_count * sizeof(Color32_RGB)), "Failed farm tests: recovered image differs.\n");
+    remove(stuck_worker);
+#endif // !_WIN32
+
+    DestroyFarm(farm);
+    free(farm_arr);
+    free(frame.pixel_arr);
+    DestroyScene(scene);
+    free(entity_arr);
+}
+
+#define adaptiveAATestFailMessage "Failed adaptive anti-aliasing tests\n"
+static void
+runAdaptiveAATests()
+{
+    puts("\tRunning adaptive anti-aliasing tests...");
+
+    const size_t num_entitys  = 64;
+    Entity*      entity_arr   = CreateTestEntities(num_entitys, 0x5EED);
+    const size_t image_width  = 96;
+    const size_t image_height = 48;
+    const size_t pixel_count  = image_width * image_height;
+
+    AdaptiveAASettings settings = { 0 };
+    GetDefaultAdaptiveAASettings(&settings);
+    settings.subsamples_per_axis    = 4;
+    settings.max_refinement_samples = 0;
+
+    AdaptiveAAState* state      = CreateAdaptiveAAState(image_width, image_height);
+    Color32_RGB*     serial_arr = ( Color32_RGB* )calloc(pixel_count, sizeof(Color32_RGB));
+    Color32_RGB*     pool_arr   = ( Color32_RGB* )calloc(pixel_count, sizeof(Color32_RGB));
+    size_t*          sample_arr = ( size_t* )calloc(pixel_count, sizeof(size_t));
+    uTesetAssert(serial_arr && pool_arr && sample_arr, adaptiveAATestFailMessage);
+
+    ThreadPool*           pool         = CreateThreadPool(3);
+    const AdaptiveAAStats pool_stats   = RenderAdaptiveAA(state, &settings, pool_arr, entity_arr, num_entitys, pool);
+    const AdaptiveAAStats serial_stats = RenderAdaptiveAA(state, &settings, serial_arr, entity_arr, num_entitys, NULL);
+    uTesetAssert(!memcmp(serial_arr, pool_arr, pixel_count * sizeof(Color32_RGB)), "Failed adaptive anti-aliasing tests: output depends on the thread count.\n");
+    uTesetAssert(serial_stats.refined_pixels == pool_stats.refined_pixels, "Failed adaptive anti-aliasing tests: refinement depends on the thread count.\n");
+    uTesetAssert(serial_stats.refined_pixels == serial_stats.candidate_pixels, "Failed adaptive anti-aliasing tests: an unbounded pass skipped a pixel.\n");
+
+    // Samples per pixel: the base sample, plus the grid for refined pixels
+    for (size_t pixel_index = 0; pixel_index < pixel_count; pixel_index++)
+    {
+        sample_arr[pixel_index] = 1;
+    }
+    for (size_t queue_index = 0; queue_index < serial_stats.refined_pixels; queue_index++)
+    {
+        sample_arr[state->refinement_queue[queue_index]] += settings.subsamples_per_axis * settings.subsamples_per_axis;
+    }
+
+    // Every 8 x 8 tile with an edge gets more samples than every flat tile
+    const size_t tile_size      = 8;
+    size_t       flat_tiles     = 0;
+    size_t       edge_tiles     = 0;
+    size_t       max_flat_count = 0;
+    size_t       min_edge_count = ( size_t )-1;
+    for (size_t tile_y = 0; tile_y < image_height; tile_y += tile_size)
+    {
+        for (size_t tile_x = 0; tile_x < image_width; tile_x += tile_size)
+        {
+            r32    max_priority = 0.0f;
+            size_t tile_samples = 0;
+            for (size_t pix_y = tile_y; pix_y < (tile_y + tile_size); pix_y++)
+            {
+                for (size_t pix_x = tile_x; pix_x < (tile_x + tile_size); pix_x++)
+                {
+                    const size_t pixel_index = (pix_y * image_width) + pix_x;
+                    const r32    priority    = GetPixelRefinementPriority(state, pix_x, pix_y);
+                    max_priority             = priority > max_priority ? priority : max_priority;
+                    tile_samples += sample_arr[pixel_index];
+
+                    uTesetAssert((priority > settings.contrast_threshold) == (sample_arr[pixel_index] > 1), "Failed adaptive anti-aliasing tests: a pixel was refined against its contrast.\n");
+                }
+            }
+
+            if (max_priority > settings.contrast_threshold)
+            {
+                edge_tiles++;
+                min_edge_count = tile_samples < min_edge_count ? tile_samples : min_edge_count;
+            }
+            else
+            {
+                flat_tiles++;
+                max_flat_count = tile_samples > max_flat_count ? tile_samples : max_flat_count;
+            }
+        }
+    }
+    uTesetAssert(flat_tiles && edge_tiles, "Failed adaptive anti-aliasing tests: the scene needs flat and edge tiles.\n");
+    uTesetAssert(max_flat_count == (tile_size * tile_size) && min_edge_count > max_flat_count, "Failed adaptive anti-aliasing tests: an edge tile was not refined.\n");
+
+    // A budget refines the highest priority pixels only
+    settings.max_refinement_samples   = 16 * 10;
+    const AdaptiveAAStats budget_stats = RenderAdaptiveAA(state, &settings, serial_arr, entity_arr, num_entitys, pool);
+    uTesetAssert(budget_stats.refined_pixels == 10 && budget_stats.refinement_samples == settings.max_refinement_samples, "Failed adaptive anti-aliasing tests: the budget was not kept.\n");
+    for (size_t queue_index = 1; queue_index < budget_stats.refined_pixels; queue_index++)
+    {
+        uTesetAssert(state->priority[state->refinement_queue[queue_index - 1]] >= state->priority[state->refinement_queue[queue_index]], "Failed adaptive anti-aliasing tests: the budget skipped a higher priority pixel.\n");
+    }
+
+    DestroyThreadPool(pool);
+    free(sample_arr);
+    free(pool_arr);
+    free(serial_arr);
+    DestroyAdaptiveAAState(state);
+    free(entity_arr);
+}
+
+#define batchRenderTestFailMessage "Failed batch render tests\n"
+static void
+runBatchRenderTests()
+{
+    puts("\tRunning batch render tests...");
+
+    BatchRenderSettings settings = { 0 };
+
+    char* windowed_argv[] = { ( char* )"Understone", ( char* )"--width", ( char* )"64" };
+    uTesetAssert(!ParseBatchRenderArguments(3, windowed_argv, &settings), "Failed batch render tests: started headless without --headless.\n");
+
+    char* valid_argv[] = { ( char* )"Understone", ( char* )"--headless", ( char* )"--width", ( char* )"64", ( char* )"--height", ( char* )"32", ( char* )"--frames", ( char* )"3",
+                           ( char* )"--bounces", ( char* )"2", ( char* )"--irradiance", ( char* )"1" };
+    uTesetAssert(ParseBatchRenderArguments(12, valid_argv, &settings), batchRenderTestFailMessage);
+    uTesetAssert(settings.image_width == 64 && settings.image_height == 32 && settings.frame_count == 3, "Failed batch render tests: options were not parsed.\n");
+    uTesetAssert(settings.kernel.reflections && settings.kernel.max_bounces == 2 && settings.irradiance_cache, "Failed batch render tests: options were not parsed.\n");
+
+    // Malformed command lines are headless but render nothing
+    char* zero_width_argv[] = { ( char* )"Understone", ( char* )"--headless", ( char* )"--width", ( char* )"0" };
+    char* missing_argv[]    = { ( char* )"Understone", ( char* )"--headless", ( char* )"--frames" };
+    char* farm_first_argv[] = { ( char* )"Understone", ( char* )"--headless", ( char* )"--farm", ( char* )"2", ( char* )"--irradiance", ( char* )"1" };
+    char* farm_last_argv[]  = { ( char* )"Understone", ( char* )"--headless", ( char* )"--irradiance", ( char* )"1", ( char* )"--farm", ( char* )"2" };
+    char* farm_stats_argv[] = { ( char* )"Understone", ( char* )"--headless", ( char* )"--farm", ( char* )"2", ( char* )"--stats", ( char* )"ue_batch_test" };
+    uTesetAssert(ParseBatchRenderArguments(4, zero_width_argv, &settings) && !settings.frame_count, "Failed batch render tests: accepted a zero width.\n");
+    uTesetAssert(ParseBatchRenderArguments(3, missing_argv, &settings) && !settings.frame_count, "Failed batch render tests: accepted an option without a value.\n");
+    uTesetAssert(ParseBatchRenderArguments(6, farm_first_argv, &settings) && !settings.frame_count, "Failed batch render tests: accepted --irradiance with --farm.\n");
+    uTesetAssert(ParseBatchRenderArguments(6, farm_last_argv, &settings) && !settings.frame_count, "Failed batch render tests: accepted --farm with --irradiance.\n");
+    uTesetAssert(ParseBatchRenderArguments(6, farm_stats_argv, &settings) && !settings.frame_count, "Failed batch render tests: accepted --stats with --farm.\n");
+
+    // Only the kernel renders on the farm
+    char* renderer_argv[] = { ( char* )"Understone", ( char* )"--headless", ( char* )"--renderer", ( char* )"adaptive-aa", ( char* )"--farm", ( char* )"2" };
+    char* unknown_argv[]  = { ( char* )"Understone", ( char* )"--headless", ( char* )"--renderer", ( char* )"wavefront" };
+    uTesetAssert(ParseBatchRenderArguments(4, renderer_argv, &settings) && settings.frame_count && settings.renderer == BR_ADAPTIVE_AA, "Failed batch render tests: --renderer was not parsed.\n");
+    uTesetAssert(ParseBatchRenderArguments(6, renderer_argv, &settings) && !settings.frame_count, "Failed batch render tests: accepted --farm with --renderer adaptive-aa.\n");
+    uTesetAssert(ParseBatchRenderArguments(4, unknown_argv, &settings) && !settings.frame_count, "Failed batch render tests: accepted an unknown renderer.\n");
+
+    // Blue noise is sampled by the local kernel only
+    char* sampler_argv[]   = { ( char* )"Understone", ( char* )"--headless", ( char* )"--sampler", ( char* )"blue-noise", ( char* )"--renderer", ( char* )"progressive" };
+    char* farm_blue_argv[] = { ( char* )"Understone", ( char* )"--headless", ( char* )"--sampler", ( char* )"blue-noise", ( char* )"--farm", ( char* )"2" };
+    uTesetAssert(ParseBatchRenderArguments(4, sampler_argv, &settings) && settings.frame_count && settings.blue_noise, "Failed batch render tests: --sampler was not parsed.\n");
+    uTesetAssert(ParseBatchRenderArguments(6, sampler_argv, &settings) && !settings.frame_count, "Failed batch render tests: accepted --renderer progressive with --sampler blue-noise.\n");
+    uTesetAssert(ParseBatchRenderArguments(6, farm_blue_argv, &settings) && !settings.frame_count, "Failed batch render tests: accepted --farm with --sampler blue-noise.\n");
+
+    // A progressive frame converges to the same image on any pool
+    char* progressive_argv[] = { ( char* )"Understone", ( char* )"--headless", ( char* )"--width", ( char* )"40", ( char* )"--height", ( char* )"24",
+                                 ( char* )"--renderer", ( char* )"progressive", ( char* )"--threads", ( char* )"1", ( char* )"--output", ( char* )"ue_batch_test" };
+    uTesetAssert(ParseBatchRenderArguments(12, progressive_argv, &settings) && settings.frame_count && settings.renderer == BR_PROGRESSIVE, "Failed batch render tests: --renderer was not parsed.\n");
+
+    BatchRenderReport progressive_report = { 0 };
+    uTesetAssert(RunBatchRender(&settings, &progressive_report), batchRenderTestFailMessage);
+    uTesetAssert(progressive_report.progressive_passes && progressive_report.progressive_samples >= progressive_report.primary_rays, "Failed batch render tests: progressive frame was not accumulated.\n");
+
+    progressive_argv[9] = ( char* )"4";
+    ParseBatchRenderArguments(12, progressive_argv, &settings);
+    settings.output_prefix = "ue_batch_test_pool";
+    uTesetAssert(RunBatchRender(&settings, &progressive_report), batchRenderTestFailMessage);
+
+    FILE* serial_image = fopen("ue_batch_test_0000.bmp", "rb");
+    FILE* pool_image   = fopen("ue_batch_test_pool_0000.bmp", "rb");
+    uTesetAssert(serial_image && pool_image, "Failed batch render tests: a progressive frame is missing.\n");
+    int serial_byte = 0;
+    int pool_byte   = 0;
+    do
+    {
+        serial_byte = fgetc(serial_image);
+        pool_byte   = fgetc(pool_image);
+    } while (serial_byte == pool_byte && serial_byte != EOF);
+    uTesetAssert(serial_byte == pool_byte, "Failed batch render tests: progressive frame depends on the thread count.\n");
+    fclose(pool_image);
+    fclose(serial_image);
+    remove("ue_batch_test_pool_0000.bmp");
+    remove("ue_batch_test_0000.bmp");
+
+    // Shading rate frames past the first trace fewer pixels, and every frame
+    // is the same on any pool
+    char* rate_argv[] = { ( char* )"Understone", ( char* )"--headless", ( char* )"--width", ( char* )"96", ( char* )"--height", ( char* )"64", ( char* )"--frames", ( char* )"3",
+                          ( char* )"--renderer", ( char* )"shading-rate", ( char* )"--threads", ( char* )"1", ( char* )"--output", ( char* )"ue_batch_test" };
+    uTesetAssert(ParseBatchRenderArguments(14, rate_argv, &settings) && settings.frame_count && settings.renderer == BR_SHADING_RATE, "Failed batch render tests: --renderer was not parsed.\n");
+
+    BatchRenderReport rate_report = { 0 };
+    uTesetAssert(RunBatchRender(&settings, &rate_report), batchRenderTestFailMessage);
+    uTesetAssert(rate_report.shading_rate_traced > (rate_report.primary_rays / 3) && rate_report.shading_rate_traced < rate_report.primary_rays,
+                 "Failed batch render tests: shading rate frames were not traced at a reduced rate.\n");
+
+    rate_argv[11] = ( char* )"4";
+    ParseBatchRenderArguments(14, rate_argv, &settings);
+    settings.output_prefix = "ue_batch_test_pool";
+    uTesetAssert(RunBatchRender(&settings, &rate_report), batchRenderTestFailMessage);
+
+    for (u32 frame_index = 0; frame_index < 3; frame_index++)
+    {
+        char serial_name[64];
+        char pool_name[64];
+        snprintf(serial_name, sizeof(serial_name), "ue_batch_test_%04u.bmp", frame_index);
+        snprintf(pool_name, sizeof(pool_name), "ue_batch_test_pool_%04u.bmp", frame_index);
+
+        serial_image = fopen(serial_name, "rb");
+        pool_image   = fopen(pool_name, "rb");
+        uTesetAssert(serial_image && pool_image, "Failed batch render tests: a shading rate frame is missing.\n");
+        do
+        {
+            serial_byte = fgetc(serial_image);
+            pool_byte   = fgetc(pool_image);
+        } while (serial_byte == pool_byte && serial_byte != EOF);
+        uTesetAssert(serial_byte == pool_byte, "Failed batch render tests: shading rate frame depends on the thread count.\n");
+        fclose(pool_image);
+        fclose(serial_image);
+        remove(pool_name);
+        remove(serial_name);
+    }
+
+#if __UE_STATS__enabled == 1
+    // Every pixel is counted: its primary ray plus one ray per bounce
+    char* stats_argv[] = { ( char* )"Understone", ( char* )"--headless", ( char* )"--width",  ( char* )"40", ( char* )"--height", ( char* )"24",
+                           ( char* )"--frames",   ( char* )"2",          ( char* )"--bounces", ( char* )"2",  ( char* )"--stats",  ( char* )"ue_batch_test" };
+    uTesetAssert(ParseBatchRenderArguments(12, stats_argv, &settings) && settings.frame_count, batchRenderTestFailMessage);
+
+    BatchRenderReport report = { 0 };
+    uTesetAssert(RunBatchRender(&settings, &report), "Failed batch render tests: could not write the heatmaps.\n");
+    uTesetAssert(report.stats_total[RS_RAYS] == report.primary_rays + report.stats_total[RS_BOUNCES], "Failed batch render tests: pixels were not counted.\n");
+    uTesetAssert(report.stats_total[RS_BOUNCES] && report.stats_total[RS_PRIMITIVE_TESTS], "Failed batch render tests: pixels were not counted.\n");
+
+    const char* const heatmap_names[] = { "ue_batch_test_rays.bmp", "ue_batch_test_box_tests.bmp", "ue_batch_test_primitive_tests.bmp", "ue_batch_test_bounces.bmp" };
+    for (u32 counter = RS_RAYS; counter <= RS_BOUNCES; counter++)
+    {
+        FILE* heatmap = fopen(heatmap_names[counter], "rb");
+        uTesetAssert(heatmap, "Failed batch render tests: a heatmap is missing.\n");
+        fclose(heatmap);
+        remove(heatmap_names[counter]);
+    }
+#else
+    char* stats_argv[] = { ( char* )"Understone", ( char* )"--headless", ( char* )"--stats", ( char* )"ue_batch_test" };
+    uTesetAssert(ParseBatchRenderArguments(4, stats_argv, &settings) && !settings.frame_count, "Failed batch render tests: accepted --stats without a statistics build.\n");
+#endif // __UE_STATS__enabled == 1
+}
+
 void
 runAllTests()
 {
@@ -549,6 +2585,26 @@ runAllTests()
     runMemoryArenaTests();
     runMathsTests();
     runStringTests();
+    runShadingRateTests();
+    runSceneFileTests();
+    runCheckpointTests();
+    runProgressiveTests();
+    runSamplerTests();
+    runBVHTests();
+    runWideBVHTests();
+    runHashGridTests();
+    runMeshTests();
+    runShadingTests();
+    runTemporalTests();
+    runDenoiseTests();
+    runSceneTests();
+    runKernelTests();
+    runCullTests();
+    runIrradianceTests();
+    runOcclusionTests();
+    runFarmTests();
+    runBatchRenderTests();
+    runAdaptiveAATests();
 
     puts("[ tests ] All pass");
     fflush(stdout);